@@ -2,13 +2,36 @@
 #include <vector>
 #include <tuple>
 #include <string>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <thread>
+
+#include <signal.h>
+#include <unistd.h>
 
 #include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <cxxopts.hpp>
 #include <cpr/cpr.h>
 
 #include "aptrepo/version.hpp"
 #include "aptrepo/aptrepo.hpp"
+#include "aptrepo/internal/decompress.hpp"
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/unix_socket.hpp"
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/metrics.hpp"
+#include "aptrepo/mirror.hpp"
+#include "aptrepo/mirror_set.hpp"
+#include "aptrepo/ndjson.hpp"
+#include "aptrepo/proxy.hpp"
+#include "aptrepo/query_server.hpp"
+#include "aptrepo/watcher.hpp"
 
 void setup_logging(bool debug)
 {
@@ -23,22 +46,462 @@ void setup_logging(bool debug)
     }
 }
 
+std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty())
+        {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+aptrepo::Release parse_release(const std::string &in_release_url, const cxxopts::ParseResult &result)
+{
+    auto keyring = result["keyring"].as<std::string>();
+    if (keyring.empty())
+    {
+        return aptrepo::parse_release(in_release_url);
+    }
+    return aptrepo::parse_release(in_release_url, *aptrepo::Keyring::load(keyring));
+}
+
+std::filesystem::path query_socket(const cxxopts::ParseResult &result)
+{
+    auto socket = result["socket"].as<std::string>();
+    return socket.empty() ? aptrepo::QueryServer::default_socket() : std::filesystem::path(socket);
+}
+
+std::unique_ptr<aptrepo::QueryClient> connect_daemon(const cxxopts::ParseResult &result)
+{
+    // Releases verified with a local keyring are never taken from the daemon
+    if (!result["keyring"].as<std::string>().empty())
+    {
+        return nullptr;
+    }
+    std::filesystem::path socket;
+    try
+    {
+        socket = query_socket(result);
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::warn("Not using the daemon: {}", e.what());
+        return nullptr;
+    }
+    auto client = aptrepo::QueryClient::connect(socket);
+    if (client)
+    {
+        spdlog::debug("Forwarding to the daemon at {}", socket.string());
+    }
+    return client;
+}
+
+int mirror(const cxxopts::ParseResult &result)
+{
+    auto options = aptrepo::MirrorSync::Options();
+    options.architectures = {result["arch"].as<std::string>()};
+    options.components = split(result["components"].as<std::string>());
+    options.jobs = result["jobs"].as<std::size_t>();
+    options.rate_limit = result["rate-limit"].as<std::size_t>() * 1024;
+    options.keyring = result["keyring"].as<std::string>();
+
+    auto sync = aptrepo::MirrorSync(result["repo"].as<std::string>(), result["distro"].as<std::string>(), result["target"].as<std::string>(), options);
+    auto statistics = sync.sync();
+
+    std::cout << "Downloaded: " << statistics.downloaded << " (" << statistics.bytes << " bytes)" << std::endl;
+    std::cout << "Linked: " << statistics.linked << std::endl;
+    std::cout << "Unchanged: " << statistics.unchanged << std::endl;
+    std::cout << "Failed: " << statistics.failed << std::endl;
+
+    return statistics.failed == 0 ? 0 : 1;
+}
+
+int serve(const cxxopts::ParseResult &result)
+{
+    auto options = aptrepo::CachingProxy::Options();
+    options.address = result["listen"].as<std::string>();
+    options.port = result["port"].as<std::uint16_t>();
+    options.ttl = std::chrono::seconds(result["ttl"].as<std::size_t>());
+
+    // Block the termination signals before any server thread is started,
+    // they are handled by sigwait below.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    auto proxy = aptrepo::CachingProxy(result["repo"].as<std::string>(), result["cache"].as<std::string>(), options);
+    proxy.start();
+
+    int signal = 0;
+    sigwait(&signals, &signal);
+    spdlog::info("Stopping proxy.");
+    proxy.stop();
+
+    auto statistics = proxy.get_statistics();
+    std::cout << "Requests: " << statistics.requests << std::endl;
+    std::cout << "Hits: " << statistics.hits << std::endl;
+    std::cout << "Misses: " << statistics.misses << " (" << statistics.upstream_bytes << " bytes)" << std::endl;
+    std::cout << "Coalesced: " << statistics.coalesced << std::endl;
+    std::cout << "Rejected: " << statistics.rejected << std::endl;
+
+    return 0;
+}
+
+int export_ndjson(const cxxopts::ParseResult &result)
+{
+    auto in_release_url = result["repo"].as<std::string>() + "/dists/" + result["distro"].as<std::string>() + "/InRelease";
+    auto release = parse_release(in_release_url, result);
+
+    auto output = result["output"].as<std::string>();
+    auto writer = output == "-" ? std::make_unique<aptrepo::NdjsonWriter>(STDOUT_FILENO)
+                                : std::make_unique<aptrepo::NdjsonWriter>(std::filesystem::path(output));
+
+    auto components = split(result["components"].as<std::string>());
+    if (components.empty())
+    {
+        components = release.get_components();
+    }
+    auto arch = result["arch"].as<std::string>();
+
+    writer->write(release);
+    for (const auto &reference : release.get_references())
+    {
+        writer->write(reference, release.get_url());
+    }
+
+    if (!result["release-only"].as<bool>())
+    {
+        for (const auto &component : components)
+        {
+            // Pick the smallest variant of the Packages index
+            std::map<int, aptrepo::Reference> indexes;
+            for (const auto &reference : release.get_references(arch, component))
+            {
+                auto path = reference.get_path();
+                auto name = path.substr(path.rfind('/') + 1);
+                if (name == "Packages.xz")
+                {
+                    indexes.emplace(0, reference);
+                }
+                else if (name == "Packages.gz")
+                {
+                    indexes.emplace(1, reference);
+                }
+                else if (name == "Packages")
+                {
+                    indexes.emplace(2, reference);
+                }
+            }
+            if (indexes.empty())
+            {
+                spdlog::warn("No Packages index for {} {}", component, arch);
+                continue;
+            }
+
+            const auto &reference = indexes.begin()->second;
+            auto download = aptrepo::internal::download(reference.get_url());
+            if (aptrepo::internal::is_supported_compression(reference.get_path()))
+            {
+                const auto &content = download.get_content();
+                download = aptrepo::internal::Download(reference.get_url(), download.get_etag(),
+                                                       aptrepo::internal::decompress(content, reference.get_path()));
+            }
+            auto packages = aptrepo::Packages(std::move(download));
+            for (const auto &package : packages.get_packages())
+            {
+                writer->write(package, reference.get_url());
+            }
+        }
+    }
+
+    writer->flush();
+    spdlog::info("Exported {} records ({} bytes)", writer->get_records(), writer->get_bytes());
+
+    return 0;
+}
+
+int watch(const cxxopts::ParseResult &result)
+{
+    std::vector<std::string> urls;
+    auto list = result["urls"].as<std::string>();
+    if (list.empty())
+    {
+        urls.push_back(result["repo"].as<std::string>() + "/dists/" + result["distro"].as<std::string>() + "/InRelease");
+    }
+    else
+    {
+        std::ifstream file(list);
+        if (!file)
+        {
+            spdlog::error("Failed to read URL list {}", list);
+            return 1;
+        }
+        std::string line;
+        while (std::getline(file, line))
+        {
+            line = aptrepo::internal::trim(line);
+            if (!line.empty() && !line.starts_with('#'))
+            {
+                urls.push_back(line);
+            }
+        }
+    }
+
+    auto options = aptrepo::Watcher::Options();
+    options.interval = std::chrono::seconds(result["interval"].as<std::size_t>());
+    options.connections = result["connections"].as<std::size_t>();
+    options.state = result["state"].as<std::string>();
+    options.keyring = result["keyring"].as<std::string>();
+
+    // Block the termination signals before any thread is started,
+    // they are handled by sigwait below.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    // Change events are NDJSON diff records, sent to stdout or to all clients of the socket
+    std::unique_ptr<aptrepo::internal::UnixBroadcaster> broadcaster;
+    std::unique_ptr<aptrepo::NdjsonWriter> writer;
+    auto socket = result["socket"].as<std::string>();
+    if (socket.empty())
+    {
+        writer = std::make_unique<aptrepo::NdjsonWriter>(STDOUT_FILENO);
+    }
+    else
+    {
+        broadcaster = std::make_unique<aptrepo::internal::UnixBroadcaster>(socket);
+        writer = std::make_unique<aptrepo::NdjsonWriter>([&](std::string_view data)
+                                                         { broadcaster->send(data); });
+    }
+
+    aptrepo::Watcher watcher([&](const aptrepo::Watcher::Event &event)
+                             {
+                                 writer->write(event.diff, *event.release);
+                                 writer->flush(); },
+                             options);
+    for (const auto &url : urls)
+    {
+        watcher.add(url);
+    }
+
+    std::thread polling([&]()
+                        { watcher.run(); });
+
+    int signal = 0;
+    sigwait(&signals, &signal);
+    spdlog::info("Stopping watcher.");
+    watcher.stop();
+    polling.join();
+
+    auto statistics = watcher.get_statistics();
+    spdlog::info("Polls: {}, unchanged: {}, changed: {}, failed: {}", statistics.polls, statistics.unchanged, statistics.changed, statistics.failed);
+
+    return 0;
+}
+
+int daemon(const cxxopts::ParseResult &result)
+{
+    auto options = aptrepo::QueryServer::Options();
+    options.socket = query_socket(result);
+    options.interval = std::chrono::seconds(result["interval"].as<std::size_t>());
+    options.keyring = result["keyring"].as<std::string>();
+
+    // Block the termination signals before any server thread is started,
+    // they are handled by sigwait below.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    aptrepo::QueryServer server(options);
+    server.start();
+
+    int signal = 0;
+    sigwait(&signals, &signal);
+    spdlog::info("Stopping daemon.");
+    server.stop();
+
+    auto statistics = server.get_statistics();
+    spdlog::info("Queries: {}, failed: {}, loads: {}, polls: {}, changed: {}", statistics.queries, statistics.failed,
+                 statistics.loads, statistics.polls, statistics.changed);
+
+    return 0;
+}
+
+int query(const cxxopts::ParseResult &result)
+{
+    if (!result.count("args"))
+    {
+        spdlog::error("Missing query, e.g. aptclient query digest main/binary-amd64/Packages");
+        return 1;
+    }
+
+    // The InRelease of repo and distro is the first argument of all queries about a suite
+    auto args = result["args"].as<std::vector<std::string>>();
+    auto request = args[0];
+    if (args[0] != "ping" && args[0] != "stats")
+    {
+        request += " " + result["repo"].as<std::string>() + "/dists/" + result["distro"].as<std::string>() + "/InRelease";
+    }
+    for (std::size_t i = 1; i < args.size(); ++i)
+    {
+        request += " " + args[i];
+    }
+
+    try
+    {
+        std::vector<std::string> lines;
+        if (auto client = connect_daemon(result))
+        {
+            lines = client->query(request);
+        }
+        else
+        {
+            auto options = aptrepo::QueryServer::Options();
+            options.keyring = result["keyring"].as<std::string>();
+            lines = aptrepo::QueryServer(options).query(request);
+        }
+        for (const auto &line : lines)
+        {
+            std::cout << line << '\n';
+        }
+        std::cout.flush();
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::error("Query failed: {}", e.what());
+        return 1;
+    }
+
+    return 0;
+}
+
+int run(const std::string &command, const cxxopts::ParseResult &result)
+{
+    if (command == "mirror")
+    {
+        return mirror(result);
+    }
+
+    if (command == "serve")
+    {
+        return serve(result);
+    }
+
+    if (command == "export")
+    {
+        return export_ndjson(result);
+    }
+
+    if (command == "watch")
+    {
+        return watch(result);
+    }
+
+    if (command == "daemon")
+    {
+        return daemon(result);
+    }
+
+    if (command == "query")
+    {
+        return query(result);
+    }
+
+    auto mirrors = split(result["mirrors"].as<std::string>());
+    if (!mirrors.empty())
+    {
+        // Latency-aware download with hedged requests
+        mirrors.insert(mirrors.begin(), result["repo"].as<std::string>());
+        auto mirror_set = aptrepo::MirrorSet(mirrors);
+        mirror_set.probe();
+        auto keyring = result["keyring"].as<std::string>();
+        auto release = keyring.empty() ? mirror_set.parse_release(result["distro"].as<std::string>())
+                                       : mirror_set.parse_release(result["distro"].as<std::string>(), *aptrepo::Keyring::load(keyring));
+        spdlog::info("Parsed release: {}", static_cast<std::string>(release));
+        if (release.is_verified())
+        {
+            spdlog::info("Signed by: {}", release.get_signer());
+        }
+        return 0;
+    }
+
+    auto in_release_url = result["repo"].as<std::string>() + "/dists/" + result["distro"].as<std::string>() + "/InRelease";
+    if (auto client = connect_daemon(result))
+    {
+        std::string summary;
+        for (const auto &line : client->query("release " + in_release_url))
+        {
+            summary += line + "\n";
+        }
+        spdlog::info("Parsed release: {}", summary);
+        return 0;
+    }
+
+    auto release = parse_release(in_release_url, result);
+
+    spdlog::info("Parsed release: {}", static_cast<std::string>(release));
+    if (release.is_verified())
+    {
+        spdlog::info("Signed by: {}", release.get_signer());
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     cxxopts::Options options(argv[0], "Parse Debian APT repositories independent of the local systems package sources.");
     options.add_options()("debug", "Enable debugging")("h,help", "Print usage")("v,version", "Print version");
 
 #if __aarch64__
-    auto default_arch = "aarch64";
+    auto default_arch = "arm64";
 #else
-    auto default_arch = "x86_64";
+    auto default_arch = "amd64";
 #endif
 
     options.add_options()("r,repo", "Repository base URL", cxxopts::value<std::string>()->default_value("https://archive.ubuntu.com/ubuntu"));
     options.add_options()("d,distro", "Distro name", cxxopts::value<std::string>()->default_value("noble"));
+    options.add_options()("m,mirrors", "Comma separated alternative mirrors of the repository", cxxopts::value<std::string>()->default_value(""));
     options.add_options()("a,arch", "CPU architecture", cxxopts::value<std::string>()->default_value(default_arch));
+    options.add_options()("k,keyring", "Keyring file or directory to verify the InRelease file with, e.g. /etc/apt/trusted.gpg.d", cxxopts::value<std::string>()->default_value(""));
+    options.add_options()("metrics", "Write metrics in Prometheus text format to this file on exit", cxxopts::value<std::string>()->default_value(""));
+    options.add_options()("command", "Command: show, mirror, serve, export, watch, daemon, query", cxxopts::value<std::string>()->default_value("show"));
+    options.add_options()("args", "Arguments of the query command, e.g. architectures or digest main/binary-amd64/Packages", cxxopts::value<std::vector<std::string>>());
+    options.add_options()("socket", "Unix socket; watch sends the change events to it instead of stdout, daemon answers queries on it, "
+                                    "and show and query forward to a daemon listening on it unless a keyring is given; default for the daemon is $XDG_RUNTIME_DIR/aptclient.sock, or $TMPDIR/aptclient-<uid>/aptclient.sock without XDG_RUNTIME_DIR",
+                          cxxopts::value<std::string>()->default_value(""));
 
-    options.parse_positional({"url"});
+    options.add_options("mirror")("t,target", "Target directory of the local mirror", cxxopts::value<std::string>()->default_value("mirror"));
+    options.add_options("mirror")("c,components", "Comma separated components to mirror, empty for all", cxxopts::value<std::string>()->default_value(""));
+    options.add_options("mirror")("j,jobs", "Number of parallel downloads", cxxopts::value<std::size_t>()->default_value("8"));
+    options.add_options("mirror")("rate-limit", "Bandwidth limit of all downloads in KiB/s, 0 for no limit", cxxopts::value<std::size_t>()->default_value("0"));
+
+    options.add_options("serve")("l,listen", "IPv4 address to listen on", cxxopts::value<std::string>()->default_value("127.0.0.1"));
+    options.add_options("serve")("p,port", "Port to listen on", cxxopts::value<std::uint16_t>()->default_value("3142"));
+    options.add_options("serve")("cache", "Cache directory of the proxy", cxxopts::value<std::string>()->default_value("cache"));
+    options.add_options("serve")("ttl", "Seconds until InRelease files are revalidated", cxxopts::value<std::size_t>()->default_value("300"));
+
+    options.add_options("export")("o,output", "Output file of the NDJSON export, - for stdout", cxxopts::value<std::string>()->default_value("-"));
+    options.add_options("export")("release-only", "Export only the Release and its references");
+
+    options.add_options("watch")("urls", "File with the InRelease URLs to watch, one per line; default is the InRelease of repo and distro", cxxopts::value<std::string>()->default_value(""));
+    options.add_options("watch")("interval", "Seconds between two polls of a URL, also used by the daemon", cxxopts::value<std::size_t>()->default_value("300"));
+    options.add_options("watch")("connections", "Number of connections used for polling", cxxopts::value<std::size_t>()->default_value("4"));
+    options.add_options("watch")("state", "File to keep the ETags in across restarts", cxxopts::value<std::string>()->default_value(""));
+
+    options.parse_positional({"command", "args"});
 
     auto result = options.parse(argc, argv);
 
@@ -56,14 +519,39 @@ int main(int argc, char *argv[])
 
     bool debug = result["debug"].as<bool>();
 
+    auto command = result["command"].as<std::string>();
+
+    if ((command == "export" && result["output"].as<std::string>() == "-") || (command == "watch" && result["socket"].as<std::string>().empty()) || command == "query")
+    {
+        // Keep stdout clean for the exported records
+        spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+    }
+
     setup_logging(debug);
 
     spdlog::info("AptRepo Version: {}", PROJECT_VERSION);
 
-    auto in_release_url = result["repo"].as<std::string>() + "/dists/" + result["distro"].as<std::string>() + "/InRelease";
-    auto release = aptrepo::parse_release(in_release_url);
+    if (command != "show" && command != "mirror" && command != "serve" && command != "export" && command != "watch" &&
+        command != "daemon" && command != "query")
+    {
+        spdlog::error("Unknown command: {}", command);
+        std::cout << options.help() << std::endl;
+        return 1;
+    }
 
-    spdlog::info("Parsed release: {}", static_cast<std::string>(release));
+    auto metrics_file = result["metrics"].as<std::string>();
+    auto exporter = std::make_shared<aptrepo::PrometheusExporter>();
+    if (!metrics_file.empty())
+    {
+        aptrepo::set_metrics_sink(exporter);
+    }
 
-    return 0;
+    auto rc = run(command, result);
+
+    if (!metrics_file.empty())
+    {
+        std::ofstream(metrics_file) << exporter->render();
+    }
+
+    return rc;
 }
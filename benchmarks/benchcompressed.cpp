@@ -0,0 +1,158 @@
+/******************************************************************************
+ * Memory versus lookup latency benchmark for aptrepo::CompressedPackages.
+ *
+ * A synthetic Packages index with realistic field values is stored with
+ * several block sizes, with and without the preset dictionary. For each
+ * configuration the resident size and the latency of random lookups are
+ * reported, for uniformly distributed lookups and for a hot set where 90%
+ * of the lookups hit 1% of the packages. The parsed aptrepo::Packages is
+ * the baseline. The blocks are compressed with zstd if aptrepo is built with
+ * libzstd, otherwise with deflate; the build time of the storage is
+ * reported as well.
+ *
+ * Usage: benchcompressed [packages]
+ ******************************************************************************/
+
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/compressed_packages.hpp"
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/packages.hpp"
+
+namespace
+{
+    constexpr std::size_t lookups = 200000;
+
+    std::string random_hex(std::mt19937_64 &random, std::size_t length)
+    {
+        std::string result;
+        while (result.size() < length)
+        {
+            result += std::format("{:016x}", random());
+        }
+        result.resize(length);
+        return result;
+    }
+
+    aptrepo::Packages make_packages(std::size_t count)
+    {
+        std::mt19937_64 random(42);
+        const std::vector<std::string> sections = {"libs", "utils", "net", "devel", "python", "admin", "doc", "x11"};
+        const std::vector<std::string> maintainers = {"Ubuntu Developers <ubuntu-devel-discuss@lists.ubuntu.com>",
+                                                      "Ubuntu Core Developers <ubuntu-devel-discuss@lists.ubuntu.com>",
+                                                      "Ubuntu MOTU Developers <ubuntu-motu@lists.ubuntu.com>"};
+        const std::vector<std::string> depends = {"libc6 (>= 2.34)", "libgcc-s1 (>= 3.0)", "libstdc++6 (>= 13.1)", "zlib1g (>= 1:1.2.0)",
+                                                  "python3:any", "libssl3t64 (>= 3.0.0)", "debconf (>= 0.5) | debconf-2.0", "perl:any"};
+
+        std::string content;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto name = std::format("package-{}-{}", random_hex(random, 4), i);
+            auto section = sections[random() % sections.size()];
+            content += std::format("Package: {}\nArchitecture: amd64\nVersion: 1.{}.{}-{}ubuntu1\nPriority: optional\nSection: {}\n"
+                                   "Origin: Ubuntu\nMaintainer: {}\nOriginal-Maintainer: Debian Maintainer <maint-{}@debian.org>\n"
+                                   "Bugs: https://bugs.launchpad.net/ubuntu/+filebug\nInstalled-Size: {}\nDepends: {}, {}\n"
+                                   "Filename: pool/main/{}/{}/{}_1.{}-1_amd64.deb\nSize: {}\nMD5sum: {}\nSHA1: {}\nSHA256: {}\nSHA512: {}\n"
+                                   "Homepage: https://example.org/{}\nDescription: {} library for the {} subsystem\n"
+                                   " This package provides the runtime files of {}. It is part of the\n example suite and is used by several other packages.\n"
+                                   "Task: ubuntu-desktop\nDescription-md5: {}\n\n",
+                                   name, random() % 20, random() % 10, random() % 5, section,
+                                   maintainers[random() % maintainers.size()], random() % 500,
+                                   random() % 100000, depends[random() % depends.size()], depends[random() % depends.size()],
+                                   name.substr(0, 1), name, name, random() % 10, random() % 10000000,
+                                   random_hex(random, 32), random_hex(random, 40), random_hex(random, 64), random_hex(random, 128),
+                                   name, section, name, name, random_hex(random, 32));
+        }
+        return aptrepo::Packages(aptrepo::internal::Download("http://example.org/Packages", "", content));
+    }
+
+    std::vector<std::size_t> make_lookups(std::size_t count, bool hot)
+    {
+        std::mt19937_64 random(7);
+        std::vector<std::size_t> result;
+        auto hot_set = std::max<std::size_t>(count / 100, 1);
+        for (std::size_t i = 0; i < lookups; ++i)
+        {
+            result.push_back(hot && random() % 10 != 0 ? random() % hot_set : random() % count);
+        }
+        return result;
+    }
+
+    template <typename Get>
+    double measure(const std::vector<std::size_t> &indexes, Get &&get)
+    {
+        std::size_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (auto index : indexes)
+        {
+            checksum += get(index).get_name().size();
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (checksum == 0)
+        {
+            std::cout << "unexpected checksum" << std::endl;
+        }
+        return elapsed / static_cast<double>(indexes.size());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_level(spdlog::level::err);
+
+    std::size_t count = argc > 1 ? std::stoul(argv[1]) : 50000;
+    auto packages = make_packages(count);
+    auto uniform = make_lookups(count, false);
+    auto hot = make_lookups(count, true);
+
+    std::size_t text_bytes = 0;
+    for (const auto &package : packages.get_packages())
+    {
+        text_bytes += static_cast<std::string>(package).size();
+    }
+
+    std::cout << "config                 resident [KiB]  ratio  uniform [us]  hot set [us]  hit rate  build [ms]" << std::endl;
+    auto baseline = [&](std::size_t index)
+    { return packages.get_packages()[index]; };
+    std::cout << std::format("{:<22} {:>14}  {:>5}  {:>12.3f}  {:>12.3f}  {:>8}  {:>10}", "Packages (text size)", text_bytes / 1024, "1.00",
+                             measure(uniform, baseline), measure(hot, baseline), "-", "-")
+              << std::endl;
+
+    for (std::size_t block_size : {4 * 1024, 16 * 1024, 64 * 1024})
+    {
+        for (std::size_t dictionary_size : {0, 32 * 1024})
+        {
+            aptrepo::CompressedPackages::Options options;
+            options.block_size = block_size;
+            options.dictionary_size = dictionary_size;
+            options.cache_blocks = 32;
+            auto start = std::chrono::steady_clock::now();
+            aptrepo::CompressedPackages compressed(packages, options);
+            auto build = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            auto get = [&](std::size_t index)
+            { return compressed.get(index); };
+            auto uniform_latency = measure(uniform, get);
+            auto before = compressed.get_statistics();
+            auto hot_latency = measure(hot, get);
+            auto after = compressed.get_statistics();
+            auto hits = static_cast<double>(after.cache_hits - before.cache_hits);
+            auto total = hits + static_cast<double>(after.cache_misses - before.cache_misses);
+
+            auto name = std::format("{} {} KiB{}", after.compression, block_size / 1024, dictionary_size ? " + dict" : "");
+            std::cout << std::format("{:<22} {:>14}  {:>5.2f}  {:>12.3f}  {:>12.3f}  {:>7.1f}%  {:>10.0f}", name, compressed.get_memory_usage() / 1024,
+                                     static_cast<double>(compressed.get_memory_usage()) / static_cast<double>(text_bytes),
+                                     uniform_latency, hot_latency, 100 * hits / total, build)
+                      << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+ * Throughput benchmark for the decompression of index files.
+ *
+ * Each file is decompressed with one thread and with an increasing number
+ * of threads; the throughput of the decompressed data is reported. Only
+ * files with several blocks (xz -T0, zstd -T0 --format with several
+ * frames, BGZF) are decoded in parallel.
+ *
+ * Usage: benchdecompress <file>... [--rounds N] [--threads MAX]
+ ******************************************************************************/
+
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/decompress.hpp"
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> files;
+    std::size_t rounds = 3;
+    std::size_t max_threads = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+        {
+            rounds = std::stoul(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            max_threads = std::stoul(argv[++i]);
+        }
+        else
+        {
+            files.emplace_back(argv[i]);
+        }
+    }
+    if (files.empty())
+    {
+        std::cerr << "Usage: benchdecompress <file>... [--rounds N] [--threads MAX]" << std::endl;
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::err);
+
+    std::vector<std::size_t> thread_counts = {1};
+    for (std::size_t threads = 2; threads < max_threads; threads *= 2)
+    {
+        thread_counts.push_back(threads);
+    }
+    if (max_threads > 1)
+    {
+        thread_counts.push_back(max_threads);
+    }
+
+    for (const auto &path : files)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream content;
+        content << file.rdbuf();
+        auto data = content.str();
+
+        for (auto threads : thread_counts)
+        {
+            std::size_t size = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < rounds; ++i)
+            {
+                size = aptrepo::internal::decompress(data, path, threads).size();
+            }
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(rounds);
+            std::cout << std::format("{:<32} {:>3} threads {:>10.1f} MB/s ({} bytes)", path.substr(path.find_last_of('/') + 1), threads,
+                                     static_cast<double>(size) / elapsed / 1e6, size)
+                      << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/******************************************************************************
+ * Download path benchmark against the loopback repository server.
+ *
+ * A synthetic distribution is served on 127.0.0.1 with a configurable
+ * latency and bandwidth. internal::download of the InRelease and of the
+ * Packages index, internal::needs_update with a matching ETag and
+ * parse_release are called repeatedly; for each the throughput and the
+ * latency percentiles are reported. As no network is involved, the results
+ * are reproducible and show the overhead of the client code.
+ *
+ * Usage: benchdownload [requests] [latency ms] [bandwidth KiB/s]
+ ******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/aptrepo.hpp"
+#include "aptrepo/internal/downloads.hpp"
+
+#include "repository_server.hpp"
+
+namespace
+{
+    /******************************************************************************
+     * Call a function repeatedly and print throughput and latency percentiles.
+     *
+     * @param name     Name of the benchmark.
+     * @param requests Number of calls.
+     * @param call     Function returning the number of body bytes transferred, 0 if not measured.
+     ******************************************************************************/
+    void measure(const std::string &name, std::size_t requests, const std::function<std::size_t()> &call)
+    {
+        std::vector<double> latencies;
+        std::size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < requests; ++i)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            bytes += call();
+            latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p)
+        { return latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(p * static_cast<double>(latencies.size())))]; };
+        std::cout << std::format("{:<22} {:>9.1f} {:>10.1f} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f}", name, static_cast<double>(requests) / elapsed,
+                                 static_cast<double>(bytes) / elapsed / 1e6, percentile(0.5), percentile(0.9), percentile(0.99), latencies.back())
+                  << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_level(spdlog::level::err);
+
+    std::size_t requests = argc > 1 ? std::stoul(argv[1]) : 200;
+    auto options = aptrepo::test::RepositoryServer::Options();
+    options.latency = std::chrono::milliseconds(argc > 2 ? std::stoul(argv[2]) : 0);
+    options.bandwidth = (argc > 3 ? std::stoul(argv[3]) : 0) * 1024;
+
+    auto server = aptrepo::test::RepositoryServer(options);
+    auto packages = server.add_distribution("bench", 20000);
+    auto in_release_url = server.get_url() + "/dists/bench/InRelease";
+    auto packages_url = server.get_url() + "/dists/bench/main/binary-amd64/Packages";
+    auto etag = aptrepo::internal::download(in_release_url).get_etag();
+
+    std::cout << std::format("Packages index: {} bytes, latency {} ms, bandwidth {}", packages.size(), options.latency.count(),
+                             options.bandwidth ? std::format("{} KiB/s", options.bandwidth / 1024) : "unlimited")
+              << std::endl;
+    std::cout << "benchmark                  req/s       MB/s  p50 [ms]  p90 [ms]  p99 [ms]  max [ms]" << std::endl;
+
+    measure("download InRelease", requests, [&]()
+            { return aptrepo::internal::download(in_release_url).get_content().size(); });
+    measure("download Packages", std::max<std::size_t>(requests / 10, 1), [&]()
+            { return aptrepo::internal::download(packages_url).get_content().size(); });
+    measure("needs_update", requests, [&]()
+            {
+                aptrepo::internal::needs_update(in_release_url, etag);
+                return std::size_t(0); });
+    measure("parse_release", requests, [&]()
+            {
+                aptrepo::parse_release(in_release_url);
+                return std::size_t(0); });
+
+    auto statistics = server.get_statistics();
+    std::cout << std::format("Server: {} requests, {} not modified", statistics.requests, statistics.not_modified) << std::endl;
+    return 0;
+}
@@ -0,0 +1,109 @@
+/******************************************************************************
+ * Throughput benchmark for aptrepo::NdjsonWriter.
+ *
+ * A synthetic Packages index is exported repeatedly to a file, once with
+ * the NdjsonWriter and once with the previous approach of formatting each
+ * stanza with std::format into an std::ofstream. The throughput of the
+ * generated output is reported in MB/s.
+ *
+ * Usage: benchexport [packages] [output]
+ ******************************************************************************/
+
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/ndjson.hpp"
+#include "aptrepo/packages.hpp"
+
+namespace
+{
+    constexpr std::size_t rounds = 5;
+
+    aptrepo::Packages make_packages(std::size_t count)
+    {
+        std::string content;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            content += std::format("Package: package-{}\nArchitecture: amd64\nVersion: 1.{}-1ubuntu1\nPriority: optional\nSection: libs\n"
+                                   "Maintainer: Ubuntu Developers <ubuntu-devel-discuss@lists.ubuntu.com>\nInstalled-Size: {}\n"
+                                   "Depends: libc6 (>= 2.34), libstdc++6 (>= 13.1)\nFilename: pool/main/p/package-{}/package-{}_1.{}-1_amd64.deb\n"
+                                   "Size: {}\nSHA256: {:064x}\nDescription: \"package\" number {}\n This is a long\n .\n description.\n\n",
+                                   i, i % 10, i * 3, i, i, i % 10, i * 7, i, i);
+        }
+        return aptrepo::Packages(aptrepo::internal::Download("http://example.org/Packages", "", content));
+    }
+
+    std::string escape(std::string_view value)
+    {
+        std::string result;
+        for (auto c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+                result += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                result += std::format("\\u{:04x}", static_cast<int>(c));
+            }
+            else
+            {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    template <typename Export>
+    void measure(const std::string &name, const std::filesystem::path &path, Export &&run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < rounds; ++i)
+        {
+            run();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto bytes = static_cast<double>(std::filesystem::file_size(path)) * rounds;
+        std::cout << std::format("{:<22} {:>10.1f} MB/s", name, bytes / elapsed / 1e6) << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_level(spdlog::level::err);
+
+    std::size_t count = argc > 1 ? std::stoul(argv[1]) : 200000;
+    std::filesystem::path path = argc > 2 ? argv[2] : std::filesystem::temp_directory_path() / "benchexport.ndjson";
+    auto packages = make_packages(count);
+
+    measure("std::format/ofstream", path, [&]()
+            {
+                std::ofstream output(path);
+                for (const auto &package : packages.get_packages())
+                {
+                    std::string fields;
+                    package.get_fields().for_each([&](std::string_view key, const std::string &value)
+                                                  { fields += std::format("{}\"{}\":\"{}\"", fields.empty() ? "" : ",", key, escape(value)); });
+                    output << std::format("{{\"type\":\"package\",\"index\":\"{}\",\"fields\":{{{}}}}}\n", escape(packages.get_url()), fields);
+                } });
+
+    measure("NdjsonWriter", path, [&]()
+            {
+                aptrepo::NdjsonWriter writer(path);
+                auto url = packages.get_url();
+                for (const auto &package : packages.get_packages())
+                {
+                    writer.write(package, url);
+                } });
+
+    std::filesystem::remove(path);
+    return 0;
+}
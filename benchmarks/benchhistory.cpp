@@ -0,0 +1,133 @@
+/******************************************************************************
+ * Deduplication benchmark for aptrepo::History.
+ *
+ * A suite with an amd64 and an i386 Packages index is snapshotted once per
+ * simulated day; each day a small share of the stanzas gets a new version,
+ * and on some days the i386 index doesn't change at all. The stored stanzas
+ * are compared to the stanzas a naive copy per day would keep, and the time
+ * to look up the state at a random date is measured.
+ *
+ * Usage: benchhistory [days] [packages] [changes per day]
+ ******************************************************************************/
+
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/history.hpp"
+#include "aptrepo/release.hpp"
+
+namespace
+{
+    constexpr auto url = "http://archive.ubuntu.com/ubuntu/dists/noble-updates/InRelease";
+    constexpr auto base_url = "http://archive.ubuntu.com/ubuntu/dists/noble-updates";
+
+    std::string make_index(const std::vector<int> &versions, const std::string &arch)
+    {
+        std::string index;
+        for (std::size_t i = 0; i < versions.size(); ++i)
+        {
+            index += std::format("Package: package-{}\nVersion: 1.{}-1\nArchitecture: {}\nFilename: pool/main/p/package-{}/package-{}_1.{}-1_{}.deb\n"
+                                 "Size: {}\nDescription: synthetic package {}\n\n",
+                                 i, versions[i], arch, i, i, versions[i], arch, 1000 + i, i);
+        }
+        return index;
+    }
+
+    std::string format_date(std::chrono::sys_days day)
+    {
+        constexpr const char *weekdays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+        constexpr const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+        std::chrono::year_month_day date(day);
+        return std::format("{}, {:02} {} {} 00:00:00 UTC", weekdays[std::chrono::weekday(day).c_encoding()],
+                           static_cast<unsigned>(date.day()), months[static_cast<unsigned>(date.month()) - 1],
+                           static_cast<int>(date.year()));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_level(spdlog::level::err);
+
+    std::size_t days = argc > 1 ? std::stoul(argv[1]) : 100;
+    std::size_t packages = argc > 2 ? std::stoul(argv[2]) : 10000;
+    std::size_t changes = argc > 3 ? std::stoul(argv[3]) : 50;
+
+    // Content of the indexes by URL, served by the loader
+    std::map<std::string, std::string> indexes;
+    aptrepo::History history([&indexes](const aptrepo::Release &, const aptrepo::Reference &reference)
+                             { return aptrepo::Packages(aptrepo::internal::Download(reference.get_url(), "", indexes.at(reference.get_url()))); });
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<std::size_t> pick(0, packages - 1);
+    std::vector<int> amd64(packages, 0);
+    std::vector<int> i386(packages, 0);
+    std::size_t naive_stanzas = 0;
+    std::size_t naive_bytes = 0;
+    auto start_date = std::chrono::sys_days(std::chrono::year(2024) / 4 / 25);
+
+    auto add_start = std::chrono::steady_clock::now();
+    for (std::size_t day = 0; day < days; ++day)
+    {
+        for (std::size_t i = 0; i < changes; ++i)
+        {
+            amd64[pick(random)]++;
+            if (day % 3 == 0)
+            {
+                i386[pick(random)]++;
+            }
+        }
+
+        std::string content = std::format("Origin: Ubuntu\nSuite: noble-updates\nDate: {}\nSHA256:\n",
+                                          format_date(start_date + std::chrono::days(day)));
+        for (const auto &[arch, versions] : {std::pair{"amd64", &amd64}, std::pair{"i386", &i386}})
+        {
+            auto path = std::format("main/binary-{}/Packages", arch);
+            auto index = make_index(*versions, arch);
+            content += std::format(" {} {} {}\n", aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(index)), index.size(), path);
+            naive_stanzas += packages;
+            naive_bytes += index.size();
+            indexes[std::format("{}/{}", base_url, path)] = std::move(index);
+        }
+        history.add(std::make_shared<const aptrepo::Release>(aptrepo::internal::Download(url, std::to_string(day), content)));
+    }
+    auto add_elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - add_start).count();
+
+    auto statistics = history.get_statistics();
+    std::cout << std::format("{} snapshots, {} indexes loaded of {}, {} stanzas stored of {} ({:.1f}x), naive text {:.1f} MB",
+                             statistics.snapshots, statistics.loads, statistics.index_references, statistics.stanzas,
+                             naive_stanzas, static_cast<double>(naive_stanzas) / static_cast<double>(statistics.stanzas),
+                             static_cast<double>(naive_bytes) / 1e6)
+              << std::endl;
+    std::cout << std::format("{:.2f} ms per added snapshot", add_elapsed / static_cast<double>(days)) << std::endl;
+
+    // Point in time lookups, reading one stanza of the view
+    constexpr std::size_t lookups = 100000;
+    std::uniform_int_distribution<long> pick_seconds(0, static_cast<long>(days) * 86400);
+    auto start = aptrepo::History::Date(std::chrono::seconds(std::chrono::sys_seconds(start_date).time_since_epoch()));
+    std::size_t found = 0;
+    auto lookup_start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < lookups; ++i)
+    {
+        auto snapshot = history.at(url, start + std::chrono::seconds(pick_seconds(random)));
+        if (snapshot)
+        {
+            found += snapshot->find_index("main/binary-amd64/Packages")->packages[0]->get_name().size();
+        }
+    }
+    auto lookup_elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - lookup_start).count();
+    std::cout << std::format("{:.3f} us per point in time lookup ({})", lookup_elapsed / lookups, found > 0) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/******************************************************************************
+ * Load test for aptrepo::CachingProxy.
+ *
+ * A local upstream stand-in serves a small repository with a configurable
+ * latency. Concurrent clients, like CI runners updating their package
+ * lists, fetch InRelease, the Packages index and some pool files through the
+ * proxy, first with a cold and then with a warm cache.
+ *
+ * Usage: benchproxy [clients] [latency ms]
+ ******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cpr/cpr.h>
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/http_server.hpp"
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/proxy.hpp"
+
+namespace
+{
+    constexpr std::size_t pool_files = 16;
+    constexpr std::size_t pool_file_size = 1024 * 1024;
+
+    std::map<std::string, std::string> make_repository()
+    {
+        std::map<std::string, std::string> files;
+        std::string packages;
+        for (std::size_t i = 0; i < pool_files; ++i)
+        {
+            auto path = std::format("pool/main/p/pkg{}/pkg{}_1.0_amd64.deb", i, i);
+            files["/" + path] = std::string(pool_file_size, static_cast<char>('a' + i));
+            packages += std::format("Package: pkg{}\nVersion: 1.0\nFilename: {}\nSize: {}\n\n", i, path, pool_file_size);
+        }
+        // Pad the index to a realistic size
+        for (std::size_t i = 0; packages.size() < 4 * 1024 * 1024; ++i)
+        {
+            packages += std::format("Package: filler{}\nVersion: 1.0\nDescription: filler package {}\n\n", i, i);
+        }
+        files["/dists/bench/main/binary-amd64/Packages"] = packages;
+        files["/dists/bench/InRelease"] = std::format("Origin: Bench\nSuite: bench\nSHA256:\n {} {} main/binary-amd64/Packages\n",
+                                                      aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(packages)), packages.size());
+        return files;
+    }
+
+    void run(const std::string &label, const std::string &url, const std::vector<std::string> &paths, std::size_t clients, aptrepo::CachingProxy &proxy)
+    {
+        auto before = proxy.get_statistics();
+        std::atomic<std::size_t> failed = 0;
+        std::atomic<std::size_t> bytes = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (std::size_t c = 0; c < clients; ++c)
+        {
+            threads.emplace_back([&, c]()
+                                 {
+                                     // Every client requests the files in a different order
+                                     for (std::size_t i = 0; i < paths.size(); ++i)
+                                     {
+                                         auto r = cpr::Get(cpr::Url{url + paths[(i + c) % paths.size()]});
+                                         if (r.status_code != 200)
+                                         {
+                                             ++failed;
+                                         }
+                                         bytes += r.text.size();
+                                     } });
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        auto after = proxy.get_statistics();
+        std::cout << std::format("{:<6} {:>8.3f} s {:>9.1f} req/s {:>9.1f} MiB/s  hits {:>5}  misses {:>4}  coalesced {:>4}  upstream {:>6.1f} MiB  failed {}",
+                                 label, seconds, static_cast<double>(clients * paths.size()) / seconds,
+                                 static_cast<double>(bytes) / (1024 * 1024) / seconds,
+                                 after.hits - before.hits, after.misses - before.misses, after.coalesced - before.coalesced,
+                                 static_cast<double>(after.upstream_bytes - before.upstream_bytes) / (1024 * 1024), failed.load())
+                  << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    spdlog::set_level(spdlog::level::warn);
+
+    std::size_t clients = argc > 1 ? std::stoul(argv[1]) : 32;
+    auto latency = std::chrono::milliseconds(argc > 2 ? std::stoul(argv[2]) : 50);
+
+    auto files = make_repository();
+    std::vector<std::string> paths;
+    for (const auto &file : files)
+    {
+        paths.push_back(file.first);
+    }
+
+    auto upstream = aptrepo::internal::HttpServer([&](const aptrepo::internal::HttpRequest &request)
+                                                  {
+                                                      std::this_thread::sleep_for(latency);
+                                                      aptrepo::internal::HttpResponse response;
+                                                      auto file = files.find(request.target);
+                                                      if (file == files.end())
+                                                      {
+                                                          response.status = 404;
+                                                      }
+                                                      else
+                                                      {
+                                                          response.body = file->second;
+                                                      }
+                                                      return response; });
+
+    auto cache = std::filesystem::temp_directory_path() / "aptrepo-bench-proxy";
+    std::filesystem::remove_all(cache);
+
+    auto options = aptrepo::CachingProxy::Options();
+    options.port = 0;
+    auto proxy = aptrepo::CachingProxy(upstream.get_url(), cache, options);
+    proxy.start();
+
+    std::cout << std::format("{} clients, {} files, {} ms upstream latency", clients, paths.size(), latency.count()) << std::endl;
+    run("cold", proxy.get_url(), paths, clients, proxy);
+    run("warm", proxy.get_url(), paths, clients, proxy);
+
+    proxy.stop();
+    upstream.stop();
+    std::filesystem::remove_all(cache);
+    return 0;
+}
@@ -0,0 +1,110 @@
+/******************************************************************************
+ * Query latency benchmark for aptrepo::QueryServer.
+ *
+ * A synthetic suite with many references and a Packages index is served by
+ * the loopback repository server. Answering one question by downloading and
+ * parsing the InRelease, as every aptclient run did before, is compared to
+ * asking a QueryServer over its Unix socket, with a new connection per
+ * question like a thin client process and over one kept-open connection.
+ *
+ * Usage: benchquery [queries] [references] [packages]
+ ******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/aptrepo.hpp"
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/query_server.hpp"
+
+#include "repository_server.hpp"
+
+namespace
+{
+    void measure(const std::string &name, std::size_t queries, const std::function<void()> &call)
+    {
+        std::vector<double> latencies;
+        for (std::size_t i = 0; i < queries; ++i)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            call();
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p)
+        { return latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(p * static_cast<double>(latencies.size())))]; };
+        std::cout << std::format("{:<28} {:>10.1f} {:>10.1f} {:>10.1f}", name, percentile(0.5), percentile(0.9), percentile(0.99)) << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_level(spdlog::level::err);
+
+    std::size_t queries = argc > 1 ? std::stoul(argv[1]) : 1000;
+    std::size_t references = argc > 2 ? std::stoul(argv[2]) : 2000;
+    std::size_t packages = argc > 3 ? std::stoul(argv[3]) : 20000;
+
+    std::string index;
+    for (std::size_t i = 0; i < packages; ++i)
+    {
+        index += std::format("Package: package-{}\nVersion: 1.{}-1\nArchitecture: amd64\nFilename: pool/main/p/package-{}/package-{}_1.{}-1_amd64.deb\n"
+                             "Size: {}\nDescription: synthetic package {}\n\n",
+                             i, i % 10, i, i, i % 10, 1000 + i, i);
+    }
+    auto in_release = std::format("Origin: Test\nSuite: noble\nArchitectures: amd64 arm64\nComponents: main\n"
+                                  "Date: Thu, 25 Apr 2024 15:10:33 UTC\nSHA256:\n {} {} main/binary-amd64/Packages\n",
+                                  aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(index)), index.size());
+    for (std::size_t i = 0; i < references; ++i)
+    {
+        in_release += std::format(" {} {} main/i18n/Translation-{}\n", aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(std::to_string(i))), i, i);
+    }
+
+    auto server = aptrepo::test::RepositoryServer();
+    server.add_file("/dists/noble/InRelease", in_release);
+    server.add_file("/dists/noble/main/binary-amd64/Packages", index);
+    auto url = server.get_url() + "/dists/noble/InRelease";
+
+    auto options = aptrepo::QueryServer::Options();
+    options.socket = std::filesystem::temp_directory_path() / "aptrepo-benchquery.sock";
+    auto daemon = aptrepo::QueryServer(options);
+    daemon.start();
+
+    std::cout << std::format("{} queries, {} references, {} packages", queries, references, packages) << std::endl;
+    std::cout << std::format("{:<28} {:>10} {:>10} {:>10}", "latency in us", "p50", "p90", "p99") << std::endl;
+
+    std::size_t answers = 0;
+    measure("download and parse", std::max<std::size_t>(queries / 10, 1), [&]()
+            { answers += aptrepo::parse_release(url).get_architectures().size(); });
+
+    auto request = "architectures " + url;
+    measure("daemon, connection per query", queries, [&]()
+            { answers += aptrepo::QueryClient::connect(options.socket)->query(request).size(); });
+
+    auto client = aptrepo::QueryClient::connect(options.socket);
+    measure("daemon, open connection", queries, [&]()
+            { answers += client->query(request).size(); });
+
+    auto digest = "digest " + url + " main/binary-amd64/Packages";
+    measure("daemon, index digest", queries, [&]()
+            { answers += client->query(digest).size(); });
+
+    auto package = "package " + url + " main/binary-amd64/Packages package-" + std::to_string(packages - 1);
+    client->query(package);
+    measure("daemon, package lookup", queries, [&]()
+            { answers += client->query(package).size(); });
+
+    daemon.stop();
+    std::cout << std::format("{} answer lines", answers) << std::endl;
+    return 0;
+}
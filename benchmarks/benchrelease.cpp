@@ -0,0 +1,139 @@
+/******************************************************************************
+ * Allocation benchmark for the construction of aptrepo::Release.
+ *
+ * A synthetic InRelease file shaped like the one of an Ubuntu suite, with
+ * MD5Sum, SHA1 and SHA256 lists, is parsed and dropped repeatedly. The
+ * global operator new is replaced to count the heap allocations of the
+ * construction and the teardown of one Release, with the references in the
+ * arena of the Release, in a caller's arena reused across releases, and
+ * allocated one by one from the heap.
+ *
+ * Usage: benchrelease [references] [rounds]
+ ******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/release.hpp"
+
+namespace
+{
+    std::atomic<std::size_t> allocations = 0;
+    std::atomic<std::size_t> allocated_bytes = 0;
+
+    std::string make_in_release(std::size_t references)
+    {
+        std::string content = "Origin: Ubuntu\nLabel: Ubuntu\nSuite: noble\nVersion: 24.04\nCodename: noble\n"
+                              "Date: Thu, 25 Apr 2024 15:10:33 UTC\nArchitectures: amd64 arm64 armhf i386 ppc64el riscv64 s390x\n"
+                              "Components: main restricted universe multiverse\nDescription: Ubuntu Noble 24.04\n";
+        for (const auto &[algorithm, digits] : {std::pair{"MD5Sum", 32}, std::pair{"SHA1", 40}, std::pair{"SHA256", 64}})
+        {
+            content += std::format("{}:\n", algorithm);
+            for (std::size_t i = 0; i < references; ++i)
+            {
+                auto digest = std::format("{:0>{}x}", i * 2654435761u, digits);
+                content += std::format(" {} {:>16} main/binary-amd64/Packages{}.xz\n", digest, 1000 + i, i);
+            }
+        }
+        return content;
+    }
+
+    template <typename Parse>
+    void measure(const std::string &name, std::size_t rounds, Parse &&parse)
+    {
+        // One round to warm up and to count the allocations
+        auto before = allocations.load();
+        auto bytes = allocated_bytes.load();
+        parse();
+        auto count = allocations.load() - before;
+        bytes = allocated_bytes.load() - bytes;
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < rounds; ++i)
+        {
+            parse();
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(rounds);
+        std::cout << std::format("{:<22} {:>10} allocations {:>12} bytes {:>10.1f} us/release", name, count, bytes, elapsed) << std::endl;
+    }
+}
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (auto pointer = std::malloc(size == 0 ? 1 : size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    if (auto pointer = std::aligned_alloc(align, (size + align - 1) / align * align))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_level(spdlog::level::err);
+
+    std::size_t references = argc > 1 ? std::stoul(argv[1]) : 2000;
+    std::size_t rounds = argc > 2 ? std::stoul(argv[2]) : 50;
+    auto download = aptrepo::internal::Download("http://archive.ubuntu.com/ubuntu/dists/noble/InRelease", "", make_in_release(references));
+
+    measure("Release arena", rounds, [&]()
+            { aptrepo::Release release(download); });
+
+    // A caller parsing many releases keeps one buffer and releases it in between
+    std::vector<std::byte> buffer(download.get_content().size() * 5);
+    std::pmr::monotonic_buffer_resource reused(buffer.data(), buffer.size());
+    measure("Release reused arena", rounds, [&]()
+            {
+                {
+                    aptrepo::Release release(download, &reused);
+                }
+                reused.release(); });
+
+    measure("Release heap", rounds, [&]()
+            { aptrepo::Release release(download, std::pmr::new_delete_resource()); });
+
+    return 0;
+}
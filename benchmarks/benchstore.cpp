@@ -0,0 +1,142 @@
+/******************************************************************************
+ * Contention benchmark for aptrepo::ReleaseStore.
+ *
+ * Reader threads repeatedly look up a Release and read some fields while a
+ * writer thread publishes a new Release every millisecond. The snapshot
+ * store is compared to a std::shared_mutex protected map.
+ ******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/release.hpp"
+#include "aptrepo/store.hpp"
+
+namespace
+{
+    constexpr auto duration = std::chrono::milliseconds(500);
+    constexpr auto url = "http://archive.ubuntu.com/ubuntu/dists/noble/InRelease";
+
+    aptrepo::Release make_release(int generation)
+    {
+        std::string content = "Origin: Ubuntu\nSuite: noble\nCodename: noble\nVersion: " + std::to_string(generation) + "\nSHA256:\n";
+        for (int i = 0; i < 200; ++i)
+        {
+            content += " e945cdeadad8067c9b569e66c058f709d5aa4cd11d8099cc088dc192705e7bc7 1234 main/binary-amd64/Packages" + std::to_string(i) + "\n";
+        }
+        return aptrepo::Release(aptrepo::internal::Download(url, std::to_string(generation), content));
+    }
+
+    class MutexStore
+    {
+    public:
+        bool has_suite(const std::string &key) const
+        {
+            std::shared_lock lock(m_mutex);
+            auto it = m_releases.find(key);
+            return it != m_releases.end() && !it->second->get_suite().empty();
+        }
+
+        void publish(aptrepo::Release release)
+        {
+            auto shared = std::make_shared<const aptrepo::Release>(std::move(release));
+            std::unique_lock lock(m_mutex);
+            m_releases[shared->get_url()] = shared;
+        }
+
+    private:
+        mutable std::shared_mutex m_mutex;
+        std::map<std::string, std::shared_ptr<const aptrepo::Release>> m_releases;
+    };
+
+    template <typename Read, typename Write>
+    double run(int readers, Read &&read, Write &&write)
+    {
+        std::atomic<bool> stop = false;
+        std::atomic<std::uint64_t> reads = 0;
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < readers; ++i)
+        {
+            threads.emplace_back([&]()
+                                 {
+                                     std::uint64_t count = 0;
+                                     while (!stop.load(std::memory_order_relaxed))
+                                     {
+                                         count += read() ? 1 : 0;
+                                     }
+                                     reads += count;
+                                 });
+        }
+        threads.emplace_back([&]()
+                             {
+                                 int generation = 0;
+                                 while (!stop.load(std::memory_order_relaxed))
+                                 {
+                                     write(make_release(++generation));
+                                     std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                                 }
+                             });
+
+        std::this_thread::sleep_for(duration);
+        stop = true;
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        auto seconds = std::chrono::duration<double>(duration).count();
+        return static_cast<double>(reads.load()) / seconds / 1e6;
+    }
+}
+
+int main()
+{
+    spdlog::set_level(spdlog::level::err);
+
+    std::cout << "readers  snapshot [Mreads/s]  shared_mutex [Mreads/s]" << std::endl;
+
+    for (int readers : {1, 2, 4, 8, 16, 32, 64})
+    {
+        aptrepo::ReleaseStore store;
+        store.publish(make_release(0));
+        auto snapshot_rate = run(
+            readers,
+            [&store]()
+            {
+                return store.read([](const aptrepo::StoreSnapshot &snapshot)
+                                  {
+                                      auto it = snapshot.releases.find(url);
+                                      return it != snapshot.releases.end() && !it->second->get_suite().empty();
+                                  });
+            },
+            [&store](aptrepo::Release release)
+            { store.publish(std::move(release)); });
+
+        MutexStore mutex_store;
+        mutex_store.publish(make_release(0));
+        auto mutex_rate = run(
+            readers,
+            [&mutex_store]()
+            {
+                return mutex_store.has_suite(url);
+            },
+            [&mutex_store](aptrepo::Release release)
+            { mutex_store.publish(std::move(release)); });
+
+        std::cout << std::format("{:>7}  {:>19.2f}  {:>23.2f}", readers, snapshot_rate, mutex_rate) << std::endl;
+    }
+
+    return 0;
+}
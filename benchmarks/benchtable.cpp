@@ -0,0 +1,99 @@
+/******************************************************************************
+ * Query benchmark for aptrepo::PackageTable.
+ *
+ * A synthetic Packages index is added to the table once per suite. The
+ * compliance query "Section=libs, Priority=required, Installed-Size > X"
+ * is evaluated with the columnar filters and, for comparison, row by row
+ * over the parsed stanzas.
+ *
+ * Usage: benchtable [packages per suite] [suites]
+ ******************************************************************************/
+
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/package_table.hpp"
+#include "aptrepo/packages.hpp"
+
+namespace
+{
+    constexpr int repetitions = 10;
+
+    aptrepo::Packages make_packages(std::size_t count)
+    {
+        const std::vector<std::string> sections = {"libs", "utils", "net", "devel", "python", "admin", "doc", "x11"};
+        const std::vector<std::string> priorities = {"optional", "optional", "optional", "extra", "standard", "important", "required"};
+
+        std::string content;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            content += std::format("Package: package-{}\nVersion: 1.{}-1\nArchitecture: amd64\nSection: {}\nPriority: {}\nInstalled-Size: {}\nSize: {}\n\n",
+                                   i, i % 17, sections[i % sections.size()], priorities[i % priorities.size()], (i * 7919) % 100000, (i * 104729) % 10000000);
+        }
+        return aptrepo::Packages(aptrepo::internal::Download("http://example.org/Packages", "", content));
+    }
+
+    template <typename Query>
+    double measure(Query &&query, std::size_t &matches)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i)
+        {
+            matches = query();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repetitions;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_level(spdlog::level::err);
+
+    std::size_t count = argc > 1 ? std::stoul(argv[1]) : 200000;
+    std::size_t suites = argc > 2 ? std::stoul(argv[2]) : 12;
+    constexpr std::uint64_t installed_size = 50000;
+
+    auto packages = make_packages(count);
+    aptrepo::PackageTable table;
+    for (std::size_t suite = 0; suite < suites; ++suite)
+    {
+        table.add(packages, "suite-" + std::to_string(suite));
+    }
+
+    std::size_t columnar_matches = 0;
+    auto columnar = measure([&]()
+                            {
+                                auto result = table.equals("Section", "libs") & table.equals("Priority", "required") &
+                                              table.greater(aptrepo::PackageTable::Numeric::InstalledSize, installed_size);
+                                return result.count(); },
+                            columnar_matches);
+
+    std::size_t row_matches = 0;
+    auto rows = measure([&]()
+                        {
+                            std::size_t result = 0;
+                            for (std::size_t suite = 0; suite < suites; ++suite)
+                            {
+                                for (const auto &package : packages.get_packages())
+                                {
+                                    if (package.get_section() == "libs" && package.get_priority() == "required" &&
+                                        package.get_installed_size() > installed_size)
+                                    {
+                                        ++result;
+                                    }
+                                }
+                            }
+                            return result; },
+                        row_matches);
+
+    std::cout << std::format("rows: {}  matches: {} / {}", table.size(), columnar_matches, row_matches) << std::endl;
+    std::cout << std::format("columnar [ms]: {:.2f}  row by row [ms]: {:.2f}  speedup: {:.1f}x", columnar, rows, rows / columnar) << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+/******************************************************************************
+ * Throughput benchmark for the verification of InRelease files.
+ *
+ * An InRelease file is parsed repeatedly, once without and once with
+ * verification of its signature against a preloaded keyring. The number
+ * of releases per second on one core is reported.
+ *
+ * Usage: benchverify <keyring> <InRelease> [rounds]
+ ******************************************************************************/
+
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/keyring.hpp"
+#include "aptrepo/release.hpp"
+
+namespace
+{
+    template <typename Parse>
+    void measure(const std::string &name, std::size_t rounds, Parse &&parse)
+    {
+        std::size_t references = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < rounds; ++i)
+        {
+            references += parse().get_references().size();
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("{:<14} {:>10.0f} releases/s ({} references)", name, static_cast<double>(rounds) / elapsed, references / rounds) << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: benchverify <keyring> <InRelease> [rounds]" << std::endl;
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::err);
+
+    auto keyring = aptrepo::Keyring::load(argv[1]);
+    std::ifstream file(argv[2], std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    auto download = aptrepo::internal::Download("http://example.org/InRelease", "", content.str());
+    std::size_t rounds = argc > 3 ? std::stoul(argv[3]) : 2000;
+
+    measure("parse", rounds, [&]()
+            { return aptrepo::Release(download); });
+    measure("parse+verify", rounds, [&]()
+            { return aptrepo::Release(download, *keyring); });
+
+    return 0;
+}
@@ -11,8 +11,15 @@
 #include <map>
 #include <cstddef>
 #include <memory>
+#include <optional>
+#include <filesystem>
+#include <vector>
 
+#include "aptrepo/keyring.hpp"
 #include "aptrepo/release.hpp"
+#include "aptrepo/packages.hpp"
+#include "aptrepo/diff.hpp"
+#include "aptrepo/deb.hpp"
 
 namespace aptrepo
 {
@@ -23,4 +30,65 @@ namespace aptrepo
      * @return A Release object containing the parsed information.
      ******************************************************************************/
     Release parse_release(std::string url);
+
+    /******************************************************************************
+     * The parse_release function is used to parse and verify a clearsigned
+     * InRelease file from a given URL.
+     *
+     * Throws std::runtime_error if no signature of a key of the keyring is valid.
+     *
+     * @param url     The URL of the InRelease file to be parsed.
+     * @param keyring The trusted keys.
+     * @return A Release object containing the parsed information.
+     ******************************************************************************/
+    Release parse_release(std::string url, const Keyring &keyring);
+
+    /******************************************************************************
+     * The parse_packages function is used to parse a Packages index from a given URL.
+     *
+     * @param url The URL of the uncompressed Packages index to be parsed.
+     * @return A Packages object containing the parsed stanzas.
+     ******************************************************************************/
+    Packages parse_packages(std::string url);
+
+    /******************************************************************************
+     * The download_reference function downloads a file listed in a Release.
+     *
+     * Interrupted downloads are resumed with HTTP range requests. Large files
+     * can be split into segments which are downloaded in parallel, optionally
+     * spread over several mirrors. The size and SHA-256 hash of the result are
+     * verified against the Release.
+     *
+     * @param reference The referenced file.
+     * @param path      Target path of the file.
+     * @param segments  Maximum number of parallel segments, each at least 1 MiB.
+     * @param mirrors   Base URLs of additional mirrors of the repository, the
+     *                  directory containing dists/.
+     ******************************************************************************/
+    void download_reference(const Reference &reference, const std::filesystem::path &path,
+                            std::size_t segments = 1, const std::vector<std::string> &mirrors = {});
+
+    /******************************************************************************
+     * The inspect_deb function reads the control metadata of a .deb file.
+     *
+     * Only the control member is read: remote files with HTTP range
+     * requests, local files through a memory mapping.
+     *
+     * @param url The URL or local path of the .deb file.
+     * @return A Deb object containing the control metadata.
+     ******************************************************************************/
+    Deb inspect_deb(std::string url);
+
+    /******************************************************************************
+     * The inspect_debs function reads the control metadata of many .deb files
+     * in parallel.
+     *
+     * Files which cannot be read are logged.
+     *
+     * @param urls The URLs or local paths of the .deb files.
+     * @param jobs Number of parallel requests.
+     * @return A Deb object for each URL in the same order, std::nullopt for
+     *         the files which could not be read.
+     ******************************************************************************/
+    std::vector<std::optional<Deb>> inspect_debs(const std::vector<std::string> &urls, std::size_t jobs = 8);
 }
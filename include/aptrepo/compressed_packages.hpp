@@ -0,0 +1,168 @@
+/******************************************************************************
+ * @file compressed_packages.hpp
+ * @brief Header file for aptrepo::CompressedPackages.
+ *
+ * A aptrepo::CompressedPackages is a memory saving alternative to keeping a
+ * parsed aptrepo::Packages resident. The stanzas are stored as text in
+ * small compressed blocks, which are decoded on access. A dictionary
+ * built from the index improves the compression of small blocks, and an
+ * LRU cache keeps hot blocks decoded. Blocks are compressed with zstd and
+ * a dictionary trained on the stanzas if aptrepo is built with libzstd,
+ * otherwise with raw deflate and a preset dictionary of frequent lines.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "aptrepo/packages.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * CompressedPackages class to store a Packages index in compressed blocks.
+     *
+     * All methods are thread safe.
+     ******************************************************************************/
+    class CompressedPackages
+    {
+    public:
+        /******************************************************************************
+         * Options for the compressed storage.
+         ******************************************************************************/
+        struct Options
+        {
+            /// Uncompressed size of a block; smaller blocks decode faster but compress worse.
+            std::size_t block_size = 16 * 1024;
+            /// Number of decoded blocks kept in the LRU cache.
+            std::size_t cache_blocks = 32;
+            /// Size of the dictionary, 0 to disable; deflate uses at most 32 KiB.
+            std::size_t dictionary_size = 32 * 1024;
+        };
+
+        /******************************************************************************
+         * Statistics of the compressed storage.
+         ******************************************************************************/
+        struct Statistics
+        {
+            /// Compression of the blocks, "zstd" or "deflate".
+            std::string compression;
+            std::size_t blocks = 0;
+            /// Size of the stanza text.
+            std::size_t uncompressed_bytes = 0;
+            /// Size of the compressed blocks.
+            std::size_t compressed_bytes = 0;
+            std::size_t dictionary_bytes = 0;
+            /// Size of the package index: offsets and names.
+            std::size_t index_bytes = 0;
+            std::size_t cache_hits = 0;
+            std::size_t cache_misses = 0;
+        };
+
+        /******************************************************************************
+         * Constructor for CompressedPackages class.
+         *
+         * @param packages The parsed Packages index.
+         * @param options  Options for the compressed storage.
+         ******************************************************************************/
+        CompressedPackages(const aptrepo::Packages &packages, Options options);
+
+        /******************************************************************************
+         * Constructor for CompressedPackages class using default options.
+         *
+         * @param packages The parsed Packages index.
+         ******************************************************************************/
+        explicit CompressedPackages(const aptrepo::Packages &packages);
+
+        /******************************************************************************
+         * Destructor for CompressedPackages class.
+         ******************************************************************************/
+        ~CompressedPackages();
+
+        /******************************************************************************
+         * Get the URL of the Packages index.
+         *
+         * @return URL as a string.
+         ******************************************************************************/
+        std::string get_url() const;
+
+        /******************************************************************************
+         * Get the number of packages.
+         *
+         * @return Number of packages.
+         ******************************************************************************/
+        std::size_t size() const;
+
+        /******************************************************************************
+         * Get a package by its position in the index.
+         *
+         * @param index Position of the package.
+         * @return The decoded package.
+         ******************************************************************************/
+        aptrepo::Package get(std::size_t index) const;
+
+        /******************************************************************************
+         * Find a package by name.
+         *
+         * @param name Name of the package.
+         * @return The first package with this name in index order, if any.
+         ******************************************************************************/
+        std::optional<aptrepo::Package> find(std::string_view name) const;
+
+        /******************************************************************************
+         * Get the statistics of the storage.
+         *
+         * @return The statistics.
+         ******************************************************************************/
+        Statistics get_statistics() const;
+
+        /******************************************************************************
+         * Get the resident size of the storage without the cache.
+         *
+         * @return Size in bytes.
+         ******************************************************************************/
+        std::size_t get_memory_usage() const;
+
+    private:
+        struct Entry
+        {
+            std::uint32_t block;
+            std::uint32_t offset;
+            std::uint32_t length;
+            std::uint32_t name_offset;
+        };
+
+        /// Decompression state shared by all blocks, e.g. a digested dictionary.
+        struct Codec;
+
+        std::shared_ptr<const std::string> block(std::size_t index) const;
+        std::string_view name(std::uint32_t entry) const;
+
+        Options m_options;
+        std::string m_url;
+        std::string m_dictionary;
+        std::unique_ptr<Codec> m_codec;
+        std::vector<std::string> m_blocks;
+        std::vector<std::uint32_t> m_block_sizes;
+        std::vector<Entry> m_entries;
+        /// Names of all packages, each terminated by a newline.
+        std::string m_names;
+        /// Entry indexes sorted by name.
+        std::vector<std::uint32_t> m_sorted;
+
+        mutable std::mutex m_mutex;
+        mutable std::list<std::pair<std::size_t, std::shared_ptr<const std::string>>> m_lru;
+        mutable std::unordered_map<std::size_t, decltype(m_lru)::iterator> m_cache;
+        mutable std::size_t m_hits = 0;
+        mutable std::size_t m_misses = 0;
+    };
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+ * @file deb.hpp
+ * @brief Header file for aptrepo::Deb.
+ *
+ * A aptrepo::Deb represents the control metadata of a single .deb file:
+ * the control stanza, the maintainer scripts and the list of installed
+ * files from md5sums.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <vector>
+
+#include "aptrepo/packages.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * File installed by a .deb, as listed in its md5sums.
+     ******************************************************************************/
+    struct DebFile
+    {
+        /// Absolute path of the installed file.
+        std::string path;
+        /// MD5 digest as hex string.
+        std::string md5sum;
+    };
+
+    /******************************************************************************
+     * Deb class to encapsulate the control metadata of a .deb file.
+     ******************************************************************************/
+    class Deb
+    {
+    public:
+        /******************************************************************************
+         * Constructor for Deb class.
+         *
+         * @param url         URL or path of the .deb file.
+         * @param control_tar The uncompressed control.tar member.
+         ******************************************************************************/
+        Deb(std::string url, std::string_view control_tar);
+
+        /******************************************************************************
+         * Get the URL of the .deb file.
+         *
+         * @return URL as a string.
+         ******************************************************************************/
+        std::string get_url() const;
+
+        /******************************************************************************
+         * Get the control stanza of the .deb file.
+         *
+         * @return The control fields as aptrepo::Package.
+         ******************************************************************************/
+        const aptrepo::Package &get_control() const;
+
+        /******************************************************************************
+         * Get the names of the files in the control member.
+         *
+         * @return Names like "control", "md5sums" or "postinst".
+         ******************************************************************************/
+        std::vector<std::string> get_control_files() const;
+
+        /******************************************************************************
+         * Get a file of the control member.
+         *
+         * @param name Name of the file, e.g. "postinst".
+         * @return Content of the file, or an empty string if it does not exist.
+         ******************************************************************************/
+        std::string get_control_file(const std::string &name) const;
+
+        /******************************************************************************
+         * Get the files installed by the .deb, as listed in md5sums.
+         *
+         * @return Installed files in md5sums order.
+         ******************************************************************************/
+        const std::vector<aptrepo::DebFile> &get_files() const;
+
+        /******************************************************************************
+         * Get the configuration files of the .deb.
+         *
+         * @return Absolute paths listed in conffiles.
+         ******************************************************************************/
+        std::vector<std::string> get_conffiles() const;
+
+    private:
+        std::string m_url;
+        aptrepo::Package m_control;
+        std::map<std::string, std::string> m_control_files;
+        std::vector<aptrepo::DebFile> m_files;
+    };
+}
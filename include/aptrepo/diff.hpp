@@ -0,0 +1,60 @@
+/******************************************************************************
+ * @file diff.hpp
+ * @brief Header file for aptrepo::ReleaseDiff.
+ *
+ * A aptrepo::ReleaseDiff lists the index files which were added, removed or
+ * changed between two versions of a Release, so that only the changed
+ * indexes need to be downloaded and parsed again.
+ ******************************************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include "aptrepo/reference.hpp"
+#include "aptrepo/release.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * ReleaseDiff class to encapsulate the differences of two Releases.
+     ******************************************************************************/
+    class ReleaseDiff
+    {
+    public:
+        /******************************************************************************
+         * References only contained in the new Release.
+         ******************************************************************************/
+        std::vector<aptrepo::Reference> added;
+
+        /******************************************************************************
+         * References only contained in the old Release.
+         ******************************************************************************/
+        std::vector<aptrepo::Reference> removed;
+
+        /******************************************************************************
+         * References of the new Release whose size or digest changed.
+         ******************************************************************************/
+        std::vector<aptrepo::Reference> changed;
+
+        /******************************************************************************
+         * Check if the Releases reference the same index files.
+         *
+         * @return True if nothing was added, removed or changed.
+         ******************************************************************************/
+        bool empty() const;
+    };
+
+    /******************************************************************************
+     * Compare the references of two Releases by path and digest.
+     *
+     * The references of a Release are sorted by path, so the comparison is a
+     * single merge pass. Digests are compared in binary form, using the
+     * strongest hash algorithm both references provide.
+     *
+     * @param old_release The previous version of the Release.
+     * @param new_release The current version of the Release.
+     * @return The added, removed and changed references.
+     ******************************************************************************/
+    ReleaseDiff diff(const aptrepo::Release &old_release, const aptrepo::Release &new_release);
+}
@@ -0,0 +1,201 @@
+/******************************************************************************
+ * @file history.hpp
+ * @brief Header file for aptrepo::History.
+ *
+ * A aptrepo::History keeps many snapshots of the same suites over time, e.g.
+ * one per day, and answers what a suite looked like at a given date. Index
+ * files and package stanzas which did not change between snapshots are
+ * stored once.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "aptrepo/packages.hpp"
+#include "aptrepo/reference.hpp"
+#include "aptrepo/release.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * Stored Packages index, shared by all snapshots which reference it.
+     ******************************************************************************/
+    struct HistoryIndex
+    {
+        /// Hash algorithm of the digest, as named in the Release.
+        std::string algorithm;
+        /// Binary digest of the uncompressed index.
+        std::string digest;
+        /// Stanzas in index order, each shared by all indexes containing it.
+        std::vector<std::shared_ptr<const aptrepo::Package>> packages;
+    };
+
+    /******************************************************************************
+     * Immutable view of a suite at one point in time.
+     ******************************************************************************/
+    class HistorySnapshot
+    {
+    public:
+        /******************************************************************************
+         * The Release of the snapshot.
+         ******************************************************************************/
+        std::shared_ptr<const aptrepo::Release> release;
+
+        /******************************************************************************
+         * Packages indexes by path, relative to the base URL of the Release.
+         ******************************************************************************/
+        std::map<std::string, std::shared_ptr<const HistoryIndex>> indexes;
+
+        /******************************************************************************
+         * Find a Packages index by path.
+         *
+         * @param path Path of the uncompressed index, e.g. "main/binary-amd64/Packages".
+         * @return The index, or nullptr if it is not part of the snapshot.
+         ******************************************************************************/
+        std::shared_ptr<const HistoryIndex> find_index(const std::string &path) const;
+    };
+
+    /******************************************************************************
+     * History class for deduplicated snapshots of Releases and Packages indexes.
+     *
+     * Snapshots are keyed by the InRelease URL, the Date of the Release and
+     * its ETag. Adding a snapshot loads only the indexes whose digest in the
+     * Release is not stored yet; stanzas of a new index which are equal to a
+     * stored stanza, compared by a SHA-256 hash of their fields, share that
+     * stanza. The views are complete when they are added, so looking up the
+     * state at a date is a search in an ordered map and doesn't parse text.
+     *
+     * All methods are thread safe. The index loader is called without holding
+     * the lock.
+     ******************************************************************************/
+    class History
+    {
+    public:
+        /// Date of a Release.
+        using Date = std::chrono::time_point<std::chrono::utc_clock, std::chrono::seconds>;
+
+        /// Loader of a Packages index referenced by a Release, std::nullopt to skip it.
+        using IndexLoader = std::function<std::optional<aptrepo::Packages>(const aptrepo::Release &release,
+                                                                           const aptrepo::Reference &reference)>;
+
+        /******************************************************************************
+         * Sizes of the history, stored and referenced.
+         ******************************************************************************/
+        struct Statistics
+        {
+            /// Number of snapshots.
+            std::size_t snapshots = 0;
+            /// Number of distinct stored indexes.
+            std::size_t indexes = 0;
+            /// Number of indexes of all snapshots.
+            std::size_t index_references = 0;
+            /// Number of distinct stored stanzas.
+            std::size_t stanzas = 0;
+            /// Number of stanzas of all stored indexes.
+            std::size_t stanza_references = 0;
+            /// Number of indexes loaded by the index loader.
+            std::size_t loads = 0;
+        };
+
+        /******************************************************************************
+         * Constructor for History class.
+         *
+         * @param loader Loader of the Packages indexes of new snapshots.
+         ******************************************************************************/
+        explicit History(IndexLoader loader);
+
+        /******************************************************************************
+         * Constructor for History class downloading the indexes.
+         ******************************************************************************/
+        History();
+
+        History(const History &) = delete;
+        History &operator=(const History &) = delete;
+
+        /******************************************************************************
+         * Add a snapshot of a suite.
+         *
+         * The Packages indexes listed in the Release are loaded unless an index
+         * with the same digest is stored already. Throws if the loader throws,
+         * nothing is added then.
+         *
+         * @param release The Release of the snapshot.
+         * @return False if a snapshot with the same URL, Date and ETag is stored.
+         ******************************************************************************/
+        bool add(std::shared_ptr<const aptrepo::Release> release);
+
+        /******************************************************************************
+         * Get the state of a suite at a date.
+         *
+         * @param url  URL of the InRelease file.
+         * @param date The point in time.
+         * @return The last snapshot with a Date not after date, or nullptr if
+         *         there is none.
+         ******************************************************************************/
+        std::shared_ptr<const HistorySnapshot> at(const std::string &url, Date date) const;
+
+        /******************************************************************************
+         * Get the latest snapshot of a suite.
+         *
+         * @param url URL of the InRelease file.
+         * @return The snapshot with the latest Date, or nullptr if there is none.
+         ******************************************************************************/
+        std::shared_ptr<const HistorySnapshot> latest(const std::string &url) const;
+
+        /******************************************************************************
+         * Get the dates of the snapshots of a suite.
+         *
+         * @param url URL of the InRelease file.
+         * @return Dates in ascending order, repeated for snapshots of the same date.
+         ******************************************************************************/
+        std::vector<Date> get_dates(const std::string &url) const;
+
+        /******************************************************************************
+         * Get the sizes of the history.
+         *
+         * @return The statistics.
+         ******************************************************************************/
+        Statistics get_statistics() const;
+
+        /******************************************************************************
+         * Check if a Reference is a Packages index stored by a History.
+         *
+         * @param reference A Reference of a Release.
+         * @return True for uncompressed Packages indexes.
+         ******************************************************************************/
+        static bool is_packages_index(const aptrepo::Reference &reference);
+
+        /******************************************************************************
+         * Get a loader which downloads the indexes.
+         *
+         * A compressed variant listed in the Release is preferred. The
+         * uncompressed content is verified against the SHA256 of the Reference.
+         *
+         * @return The loader.
+         ******************************************************************************/
+        static IndexLoader download_index();
+
+    private:
+        static std::string index_key(const aptrepo::Reference &reference);
+        std::shared_ptr<const HistoryIndex> store(const aptrepo::Reference &reference, const aptrepo::Packages &packages,
+                                                  const std::vector<std::string> &hashes);
+
+        IndexLoader m_loader;
+
+        mutable std::mutex m_mutex;
+        std::map<std::string, std::multimap<Date, std::shared_ptr<const HistorySnapshot>>> m_snapshots;
+        std::unordered_map<std::string, std::shared_ptr<const HistoryIndex>> m_indexes;
+        std::unordered_map<std::string, std::shared_ptr<const aptrepo::Package>> m_stanzas;
+        Statistics m_statistics;
+    };
+}
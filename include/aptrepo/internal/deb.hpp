@@ -0,0 +1,78 @@
+/******************************************************************************
+ * @file deb.hpp
+ * @brief Header file for aptrepo internal .deb archive functions.
+ *
+ * A .deb file is an ar archive of the members "debian-binary",
+ * "control.tar[.gz|.xz|.zst]" and "data.tar[...]". The control member is
+ * small and stored before the data member, so it can be read without
+ * downloading the whole package.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <functional>
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /******************************************************************************
+         * Location of a member of an ar archive.
+         ******************************************************************************/
+        struct ArMember
+        {
+            std::string name;
+            /// Offset of the member content in the archive.
+            std::size_t offset = 0;
+            std::size_t size = 0;
+        };
+
+        /******************************************************************************
+         * Entry of a tar archive.
+         ******************************************************************************/
+        struct TarEntry
+        {
+            /// Path of the entry without a leading "./".
+            std::string name;
+            /// Type flag, '0' for regular files, '5' for directories.
+            char type = '0';
+            std::string_view content;
+        };
+
+        /******************************************************************************
+         * Parse the header of an ar archive member.
+         *
+         * @param header The 60 byte member header.
+         * @param offset Offset of the header in the archive.
+         * @return Location of the member.
+         ******************************************************************************/
+        aptrepo::internal::ArMember parse_ar_header(std::string_view header, std::size_t offset);
+
+        /******************************************************************************
+         * Read all entries of an uncompressed tar archive.
+         *
+         * Supports ustar, GNU long names and pax path records.
+         *
+         * @param data     The tar archive.
+         * @param callback Function called for each entry.
+         ******************************************************************************/
+        void read_tar(std::string_view data, const std::function<void(const aptrepo::internal::TarEntry &)> &callback);
+
+        /******************************************************************************
+         * Read the control member of a .deb file.
+         *
+         * Local files, given as path or file:// URL, are memory mapped. Remote
+         * files are read with HTTP range requests: one request for the
+         * archive header, and one for the rest of the control member if it
+         * does not fit into the first response.
+         *
+         * @param source Path or URL of the .deb file.
+         * @param name   Set to the name of the control member, e.g. "control.tar.xz".
+         * @return The compressed control member.
+         ******************************************************************************/
+        std::string read_deb_control(const std::string &source, std::string &name);
+    }
+}
@@ -0,0 +1,62 @@
+/******************************************************************************
+ * @file decompress.hpp
+ * @brief Header file for aptrepo internal decompression functions.
+ *
+ * APT repositories publish index files compressed; the compression is
+ * indicated by the file extension of the referenced path. Files made of
+ * independently decodable blocks (xz files with several blocks, zstd files
+ * with several frames, gzip files with BGZF members) are decoded by
+ * several threads.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <functional>
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /******************************************************************************
+         * Check if the compression of a file is supported.
+         *
+         * @param path Path or URL of the file.
+         * @return True if the file is uncompressed or the compression is supported.
+         ******************************************************************************/
+        bool is_supported_compression(std::string_view path);
+
+        /// Receiver of decompressed data, called with consecutive pieces in order.
+        using DecompressSink = std::function<void(std::string_view data)>;
+
+        /******************************************************************************
+         * Decompress data according to the file extension of its path.
+         *
+         * Files without a known compression extension are returned unchanged.
+         *
+         * @param data    The compressed data.
+         * @param path    Path or URL of the file, used to detect the compression.
+         * @param threads Maximum number of threads decoding blocks in parallel,
+         *                0 for the number of hardware threads.
+         * @return The decompressed data.
+         ******************************************************************************/
+        std::string decompress(std::string_view data, std::string_view path, std::size_t threads = 0);
+
+        /******************************************************************************
+         * Decompress data block by block into a sink.
+         *
+         * The blocks are decoded in parallel, a few blocks ahead of the sink,
+         * and passed to the sink in file order. The sink is called by the
+         * calling thread. Data without independent blocks is passed in one piece.
+         *
+         * @param data    The compressed data.
+         * @param path    Path or URL of the file, used to detect the compression.
+         * @param sink    Receiver of the decompressed data.
+         * @param threads Maximum number of threads decoding blocks in parallel,
+         *                0 for the number of hardware threads.
+         ******************************************************************************/
+        void decompress(std::string_view data, std::string_view path, const DecompressSink &sink, std::size_t threads = 0);
+    }
+}
@@ -9,11 +9,27 @@
 #pragma once
 
 #include <string>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace cpr
+{
+    class Session;
+}
 
 namespace aptrepo
 {
     namespace internal
     {
+        /******************************************************************************
+         * Maximum time to establish a connection, used for all requests.
+         ******************************************************************************/
+        constexpr std::chrono::seconds connect_timeout = std::chrono::seconds(10);
 
         /******************************************************************************
          * Download class to encapsulate the URL, etag, and content of a
@@ -49,9 +65,9 @@ namespace aptrepo
             /******************************************************************************
              * Get the content of the downloaded resource.
              *
-             * @return Content as a string.
+             * @return Content as a string, valid as long as the Download.
              ******************************************************************************/
-            std::string get_content() const;
+            const std::string &get_content() const;
 
         private:
             std::string m_url;
@@ -62,12 +78,15 @@ namespace aptrepo
         /******************************************************************************
          * Download the contents of a URL as std::string.
          *
+         * Besides HTTP(S), local file:// URLs are supported.
+         *
          * This function is intended for internal use.
          *
-         * @param url URL to download.
+         * @param url     URL to download.
+         * @param timeout Maximum time of the whole transfer, 0 for no limit.
          * @return Download object containing the URL, etag, and content.
          ******************************************************************************/
-        aptrepo::internal::Download download(std::string url);
+        aptrepo::internal::Download download(std::string url, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
 
         /******************************************************************************
          * Checks if the given URL was updated, using the provided etag.
@@ -78,5 +97,115 @@ namespace aptrepo
          * @return true if the URL was updated, false otherwise.
          ******************************************************************************/
         bool needs_update(std::string url, std::string etag);
+
+        /******************************************************************************
+         * HTTP client for conditional requests which keeps its connection open.
+         *
+         * Repeated polls of the same host reuse the connection, so they don't
+         * pay for the TCP and TLS handshakes again. A client must only be used
+         * by one thread at a time.
+         ******************************************************************************/
+        class ConditionalClient
+        {
+        public:
+            /******************************************************************************
+             * Constructor for ConditionalClient class.
+             ******************************************************************************/
+            ConditionalClient();
+            ~ConditionalClient();
+
+            ConditionalClient(const ConditionalClient &) = delete;
+            ConditionalClient &operator=(const ConditionalClient &) = delete;
+
+            /******************************************************************************
+             * Download a URL unless its ETag is unchanged.
+             *
+             * The request is a GET with If-None-Match, so a changed resource is
+             * fetched in the same round trip. Besides HTTP(S), local file:// URLs
+             * are supported. Throws std::runtime_error on failed transfers.
+             *
+             * @param url     URL to download.
+             * @param etag    ETag of the known version, empty to always download.
+             * @param timeout Maximum time of the whole transfer, 0 for no limit.
+             * @return The download, or std::nullopt if the resource is unchanged.
+             ******************************************************************************/
+            std::optional<aptrepo::internal::Download> get_if_changed(const std::string &url, const std::string &etag,
+                                                                      std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+        private:
+            std::unique_ptr<cpr::Session> m_session;
+        };
+
+        /******************************************************************************
+         * Download the contents of a URL to a file.
+         *
+         * The content is streamed to the file and hashed on the fly. On error
+         * the file is removed and an exception is thrown.
+         *
+         * This function is intended for internal use.
+         *
+         * @param url      URL to download.
+         * @param path     Path of the file to write.
+         * @param throttle Called with the size of each received chunk before it is written, e.g. to limit the bandwidth.
+         * @return Binary SHA-256 digest of the downloaded content.
+         ******************************************************************************/
+        std::string download_to_file(std::string url, const std::filesystem::path &path, const std::function<void(std::size_t)> &throttle = {});
+
+        /******************************************************************************
+         * Download the contents of a URL to a file, resuming interrupted transfers.
+         *
+         * The content is written to "<path>.partial" and the ETag of the
+         * response to "<path>.partial.etag". If these files exist, e.g. after a
+         * dropped connection or an earlier failed call, only the missing bytes
+         * are requested with Range and If-Range. A changed file is downloaded
+         * from the start. Both files are removed when the download is complete.
+         *
+         * This function is intended for internal use.
+         *
+         * @param url      URL to download.
+         * @param path     Path of the file to write.
+         * @param retries  Number of retries after an interrupted transfer.
+         * @param throttle Called with the size of each received chunk before it is written, e.g. to limit the bandwidth.
+         * @return Binary SHA-256 digest of the downloaded content.
+         ******************************************************************************/
+        std::string download_resumable(std::string url, const std::filesystem::path &path, std::size_t retries = 3,
+                                       const std::function<void(std::size_t)> &throttle = {});
+
+        /******************************************************************************
+         * Download a large file as parallel byte-range segments.
+         *
+         * The URLs must serve identical content, e.g. one file on several
+         * mirrors. Segments are spread over the URLs, and each retry of a
+         * segment uses the next URL. The progress of the segments is kept in
+         * "<path>.partial.segments", so a failed download resumes on the next call.
+         * As the URLs may have different ETags, the caller must verify the
+         * returned digest.
+         *
+         * This function is intended for internal use.
+         *
+         * @param urls     URLs of the file.
+         * @param path     Path of the file to write.
+         * @param size     Size of the file in bytes.
+         * @param segments Number of parallel segments.
+         * @param retries  Number of retries per segment.
+         * @return Binary SHA-256 digest of the downloaded content.
+         ******************************************************************************/
+        std::string download_segments(const std::vector<std::string> &urls, const std::filesystem::path &path, std::size_t size, std::size_t segments, std::size_t retries = 3);
+
+        /******************************************************************************
+         * Download a byte range of a URL.
+         *
+         * If the server ignores the Range header, the transfer is cancelled
+         * as soon as the range is complete. The result is shorter than
+         * requested if the file ends before the end of the range.
+         *
+         * This function is intended for internal use.
+         *
+         * @param url   URL to download.
+         * @param begin Offset of the first byte.
+         * @param end   Offset after the last byte.
+         * @return The content of the range.
+         ******************************************************************************/
+        std::string download_range(std::string url, std::size_t begin, std::size_t end);
     }
 }
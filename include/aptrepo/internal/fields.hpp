@@ -0,0 +1,340 @@
+/******************************************************************************
+ * @file fields.hpp
+ * @brief Header file for the aptrepo Deb822 field table.
+ *
+ * Well-known Deb822 field names (Release and Packages stanzas) are mapped to
+ * fixed slots by a perfect hash which is computed at compile time. Parsed
+ * values of known fields are stored in these slots, so getters become a
+ * direct array access. Unknown fields are kept in an overflow vector.
+ ******************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /******************************************************************************
+         * Well-known Deb822 fields of Release files and Packages stanzas.
+         ******************************************************************************/
+        enum class Field : std::uint8_t
+        {
+            // Release fields
+            Origin,
+            Label,
+            Suite,
+            Version,
+            Codename,
+            Date,
+            ValidUntil,
+            Architectures,
+            Components,
+            Description,
+            AcquireByHash,
+            SignedBy,
+            Changelogs,
+            NotAutomatic,
+            ButAutomaticUpgrades,
+            NoSupportForArchitectureAll,
+            // Packages fields
+            Package,
+            Source,
+            Architecture,
+            Priority,
+            Section,
+            Maintainer,
+            OriginalMaintainer,
+            InstalledSize,
+            Depends,
+            PreDepends,
+            Recommends,
+            Suggests,
+            Enhances,
+            Conflicts,
+            Breaks,
+            Replaces,
+            Provides,
+            BuiltUsing,
+            StaticBuiltUsing,
+            MultiArch,
+            Essential,
+            Protected,
+            Important,
+            Filename,
+            Size,
+            MD5sum,
+            SHA1,
+            SHA256,
+            SHA512,
+            DescriptionMd5,
+            Homepage,
+            Bugs,
+            Task,
+            Tag,
+            Count
+        };
+
+        /******************************************************************************
+         * Number of well-known fields, i.e. number of slots in a FieldTable.
+         ******************************************************************************/
+        inline constexpr std::size_t field_count = static_cast<std::size_t>(Field::Count);
+
+        /******************************************************************************
+         * Canonical spelling of the well-known fields, indexed by Field.
+         ******************************************************************************/
+        inline constexpr std::array<std::string_view, field_count> field_names = {
+            "Origin",
+            "Label",
+            "Suite",
+            "Version",
+            "Codename",
+            "Date",
+            "Valid-Until",
+            "Architectures",
+            "Components",
+            "Description",
+            "Acquire-By-Hash",
+            "Signed-By",
+            "Changelogs",
+            "NotAutomatic",
+            "ButAutomaticUpgrades",
+            "No-Support-for-Architecture-all",
+            "Package",
+            "Source",
+            "Architecture",
+            "Priority",
+            "Section",
+            "Maintainer",
+            "Original-Maintainer",
+            "Installed-Size",
+            "Depends",
+            "Pre-Depends",
+            "Recommends",
+            "Suggests",
+            "Enhances",
+            "Conflicts",
+            "Breaks",
+            "Replaces",
+            "Provides",
+            "Built-Using",
+            "Static-Built-Using",
+            "Multi-Arch",
+            "Essential",
+            "Protected",
+            "Important",
+            "Filename",
+            "Size",
+            "MD5sum",
+            "SHA1",
+            "SHA256",
+            "SHA512",
+            "Description-md5",
+            "Homepage",
+            "Bugs",
+            "Task",
+            "Tag",
+        };
+
+        namespace detail
+        {
+            inline constexpr std::size_t field_hash_slots = 256;
+
+            constexpr char to_lower(char c)
+            {
+                return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+            }
+
+            // Deb822 field names are case-insensitive, so the hash is as well.
+            constexpr std::uint32_t field_hash(std::string_view name, std::uint32_t seed)
+            {
+                std::uint32_t h = 2166136261u ^ seed;
+                for (char c : name)
+                {
+                    h ^= static_cast<unsigned char>(to_lower(c));
+                    h *= 16777619u;
+                }
+                return (h ^ (h >> 15)) & (field_hash_slots - 1);
+            }
+
+            constexpr bool iequals(std::string_view a, std::string_view b)
+            {
+                if (a.size() != b.size())
+                {
+                    return false;
+                }
+                for (std::size_t i = 0; i < a.size(); ++i)
+                {
+                    if (to_lower(a[i]) != to_lower(b[i]))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            consteval std::uint32_t find_field_seed()
+            {
+                for (std::uint32_t seed = 0; seed < 100000; ++seed)
+                {
+                    std::array<bool, field_hash_slots> used{};
+                    bool collision = false;
+                    for (auto name : field_names)
+                    {
+                        auto slot = field_hash(name, seed);
+                        if (used[slot])
+                        {
+                            collision = true;
+                            break;
+                        }
+                        used[slot] = true;
+                    }
+                    if (!collision)
+                    {
+                        return seed;
+                    }
+                }
+                return UINT32_MAX;
+            }
+
+            inline constexpr std::uint32_t field_seed = find_field_seed();
+            static_assert(field_seed != UINT32_MAX, "No perfect hash seed found for the Deb822 field names.");
+
+            consteval std::array<std::uint8_t, field_hash_slots> make_field_slots()
+            {
+                // 0 marks an empty slot, otherwise the slot stores field index + 1.
+                std::array<std::uint8_t, field_hash_slots> slots{};
+                for (std::size_t i = 0; i < field_count; ++i)
+                {
+                    slots[field_hash(field_names[i], field_seed)] = static_cast<std::uint8_t>(i + 1);
+                }
+                return slots;
+            }
+
+            inline constexpr auto field_slots = make_field_slots();
+        }
+
+        /******************************************************************************
+         * Lookup the Field for a Deb822 field name.
+         *
+         * The lookup is case-insensitive and costs one hash and one compare.
+         *
+         * @param name Field name as found in the Deb822 document.
+         * @return The matching Field, or std::nullopt if the field is not well-known.
+         ******************************************************************************/
+        constexpr std::optional<Field> find_field(std::string_view name)
+        {
+            auto slot = detail::field_slots[detail::field_hash(name, detail::field_seed)];
+            if (slot == 0 || !detail::iequals(field_names[slot - 1], name))
+            {
+                return std::nullopt;
+            }
+            return static_cast<Field>(slot - 1);
+        }
+
+        /******************************************************************************
+         * Get the canonical name of a well-known field.
+         *
+         * @param field The field.
+         * @return Canonical spelling of the field name.
+         ******************************************************************************/
+        constexpr std::string_view field_name(Field field)
+        {
+            return field_names[static_cast<std::size_t>(field)];
+        }
+
+        /******************************************************************************
+         * FieldTable class to store the fields of a Deb822 paragraph.
+         *
+         * Values of well-known fields are stored in fixed slots, all other
+         * fields are stored in insertion order in an overflow vector.
+         ******************************************************************************/
+        class FieldTable
+        {
+        public:
+            /******************************************************************************
+             * Set a field value, replacing any previous value.
+             *
+             * @param key   The name of the field.
+             * @param value The value of the field.
+             ******************************************************************************/
+            void set(std::string_view key, std::string value);
+
+            /******************************************************************************
+             * Set the value of a well-known field, replacing any previous value.
+             *
+             * @param field The field.
+             * @param value The value of the field.
+             ******************************************************************************/
+            void set(Field field, std::string value)
+            {
+                m_known[static_cast<std::size_t>(field)] = std::move(value);
+            }
+
+            /******************************************************************************
+             * Get the value of a well-known field.
+             *
+             * @param field The field.
+             * @return The value, or an empty string if the field is not set.
+             ******************************************************************************/
+            const std::string &get(Field field) const
+            {
+                return m_known[static_cast<std::size_t>(field)];
+            }
+
+            /******************************************************************************
+             * Find a field by name.
+             *
+             * @param key The name of the field.
+             * @return Pointer to the value, or nullptr if the field is not set.
+             ******************************************************************************/
+            const std::string *find(std::string_view key) const;
+
+            /******************************************************************************
+             * Get all fields which are not well-known.
+             *
+             * @return Vector of key value pairs in insertion order.
+             ******************************************************************************/
+            const std::vector<std::pair<std::string, std::string>> &get_overflow() const
+            {
+                return m_overflow;
+            }
+
+            /******************************************************************************
+             * Call the given function for each set field.
+             *
+             * Well-known fields are visited in Field order, followed by the
+             * overflow fields in insertion order.
+             *
+             * @param fn Callable accepting (std::string_view key, const std::string &value).
+             ******************************************************************************/
+            template <typename Fn>
+            void for_each(Fn &&fn) const
+            {
+                for (std::size_t i = 0; i < field_count; ++i)
+                {
+                    if (!m_known[i].empty())
+                    {
+                        fn(field_names[i], m_known[i]);
+                    }
+                }
+                for (const auto &field : m_overflow)
+                {
+                    fn(std::string_view(field.first), field.second);
+                }
+            }
+
+        private:
+            std::array<std::string, field_count> m_known;
+            std::vector<std::pair<std::string, std::string>> m_overflow;
+        };
+    }
+}
@@ -0,0 +1,65 @@
+/******************************************************************************
+ * @file hash.hpp
+ * @brief Header file for aptrepo internal hash functions.
+ *
+ * Self-contained SHA-256 implementation, used to verify downloaded files
+ * against the digests listed in Release files and Packages indexes.
+ ******************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /******************************************************************************
+         * Incremental SHA-256 hash.
+         ******************************************************************************/
+        class Sha256
+        {
+        public:
+            /******************************************************************************
+             * Constructor for Sha256 class.
+             ******************************************************************************/
+            Sha256();
+
+            /******************************************************************************
+             * Add data to the hash.
+             *
+             * @param data The data to hash.
+             ******************************************************************************/
+            void update(std::string_view data);
+
+            /******************************************************************************
+             * Finish the hash.
+             *
+             * The object must not be updated afterwards.
+             *
+             * @return The binary digest (32 bytes).
+             ******************************************************************************/
+            std::string digest();
+
+        private:
+            void transform(const unsigned char *block);
+
+            std::array<std::uint32_t, 8> m_state;
+            std::array<unsigned char, 64> m_buffer;
+            std::size_t m_buffered = 0;
+            std::uint64_t m_length = 0;
+        };
+
+        /******************************************************************************
+         * Compute the SHA-256 digest of data.
+         *
+         * @param data The data to hash.
+         * @return The binary digest (32 bytes).
+         ******************************************************************************/
+        std::string sha256(std::string_view data);
+    }
+}
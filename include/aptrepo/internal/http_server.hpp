@@ -0,0 +1,166 @@
+/******************************************************************************
+ * @file http_server.hpp
+ * @brief Header file for the aptrepo internal HTTP server.
+ *
+ * A small HTTP/1.1 server on POSIX sockets, used by the caching proxy and
+ * as local upstream stand-in in tests and benchmarks. Each connection is
+ * served by its own thread; keep-alive is supported. File responses are
+ * sent with sendfile where available.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /******************************************************************************
+         * Case-insensitive ordering of HTTP header names.
+         ******************************************************************************/
+        struct HeaderLess
+        {
+            bool operator()(const std::string &a, const std::string &b) const;
+        };
+
+        /******************************************************************************
+         * HTTP headers with case-insensitive names.
+         ******************************************************************************/
+        using HttpHeaders = std::map<std::string, std::string, HeaderLess>;
+
+        /******************************************************************************
+         * Parsed HTTP request.
+         ******************************************************************************/
+        class HttpRequest
+        {
+        public:
+            /// Request method, e.g. "GET".
+            std::string method;
+            /// Request target, a path or an absolute URL for proxy requests.
+            std::string target;
+            /// Request headers, case-insensitive keys.
+            HttpHeaders headers;
+
+            /******************************************************************************
+             * Get a request header.
+             *
+             * @param key The header name.
+             * @return The header value, or an empty string if not present.
+             ******************************************************************************/
+            std::string get_header(const std::string &key) const;
+        };
+
+        /******************************************************************************
+         * HTTP response, returned by the request handler.
+         *
+         * The body is either the string body or, if file is set, a range of a
+         * file, which is sent without copying through user space.
+         ******************************************************************************/
+        class HttpResponse
+        {
+        public:
+            /// HTTP status code.
+            int status = 200;
+            /// Response headers; Content-Length is set by the server.
+            HttpHeaders headers;
+            /// Response body, used if file is empty.
+            std::string body;
+            /// File to send as body.
+            std::filesystem::path file;
+            /// Offset of the body in file.
+            std::size_t file_offset = 0;
+            /// Length of the body in file, std::string::npos for the rest of the file.
+            std::size_t file_length = std::string::npos;
+            /// Close the connection after this many body bytes, to simulate a
+            /// dropped connection; std::string::npos to send the whole body.
+            std::size_t abort_after = std::string::npos;
+            /// Send the body at most this many bytes per second, to simulate
+            /// a slow link; 0 for no limit.
+            std::size_t rate = 0;
+        };
+
+        /******************************************************************************
+         * HttpServer class implementing a minimal HTTP/1.1 server.
+         ******************************************************************************/
+        class HttpServer
+        {
+        public:
+            /******************************************************************************
+             * Request handler type.
+             ******************************************************************************/
+            using Handler = std::function<HttpResponse(const HttpRequest &request)>;
+
+            /******************************************************************************
+             * Constructor for HttpServer class.
+             *
+             * The server listens as soon as it is constructed.
+             *
+             * @param handler Function creating the response for a request.
+             * @param address IPv4 address to bind to.
+             * @param port    Port to bind to, 0 for an ephemeral port.
+             ******************************************************************************/
+            HttpServer(Handler handler, const std::string &address = "127.0.0.1", std::uint16_t port = 0);
+
+            /******************************************************************************
+             * Destructor for HttpServer class, stops the server.
+             ******************************************************************************/
+            ~HttpServer();
+
+            HttpServer(const HttpServer &) = delete;
+            HttpServer &operator=(const HttpServer &) = delete;
+
+            /******************************************************************************
+             * Get the port the server listens on.
+             *
+             * @return The port.
+             ******************************************************************************/
+            std::uint16_t get_port() const;
+
+            /******************************************************************************
+             * Get the base URL of the server.
+             *
+             * @return URL like "http://127.0.0.1:8080".
+             ******************************************************************************/
+            std::string get_url() const;
+
+            /******************************************************************************
+             * Stop accepting connections and close all open connections.
+             ******************************************************************************/
+            void stop();
+
+        private:
+            void accept_loop();
+            void serve(int socket);
+            bool send_response(int socket, const HttpRequest &request, const HttpResponse &response);
+
+            Handler m_handler;
+            std::string m_address;
+            std::uint16_t m_port = 0;
+            int m_listen_socket = -1;
+            std::atomic<bool> m_running = false;
+            std::thread m_accept_thread;
+            std::mutex m_connections_mutex;
+            std::condition_variable m_connections_done;
+            std::set<int> m_connections;
+        };
+
+        /******************************************************************************
+         * Get the reason phrase of a HTTP status code.
+         *
+         * @param status The status code.
+         * @return The reason phrase, e.g. "Not Found".
+         ******************************************************************************/
+        std::string http_reason(int status);
+    }
+}
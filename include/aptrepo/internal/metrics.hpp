@@ -0,0 +1,99 @@
+/******************************************************************************
+ * @file metrics.hpp
+ * @brief Header file for reporting metrics inside the aptrepo library.
+ *
+ * Thin helpers forwarding to the installed aptrepo::MetricsSink. Without a
+ * sink, reporting costs one relaxed atomic load.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string_view>
+#include <atomic>
+#include <chrono>
+
+#include "aptrepo/metrics.hpp"
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /// Set while a metrics sink is installed.
+        extern std::atomic<bool> metrics_active;
+
+        /******************************************************************************
+         * Check if a metrics sink is installed.
+         *
+         * Callers building labels should check this first to avoid the allocations.
+         *
+         * @return True if metrics are recorded.
+         ******************************************************************************/
+        inline bool metrics_enabled()
+        {
+            return metrics_active.load(std::memory_order_relaxed);
+        }
+
+        /******************************************************************************
+         * Increment a counter of the installed sink.
+         *
+         * @param name   Name of the counter.
+         * @param value  Increment.
+         * @param labels Labels of the counter.
+         ******************************************************************************/
+        void count(std::string_view name, double value = 1, const aptrepo::MetricLabels &labels = {});
+
+        /******************************************************************************
+         * Set a gauge of the installed sink.
+         *
+         * @param name   Name of the gauge.
+         * @param value  New value.
+         * @param labels Labels of the gauge.
+         ******************************************************************************/
+        void gauge(std::string_view name, double value, const aptrepo::MetricLabels &labels = {});
+
+        /******************************************************************************
+         * Record a sample of a histogram of the installed sink.
+         *
+         * @param name   Name of the histogram.
+         * @param value  Sample value.
+         * @param labels Labels of the histogram.
+         ******************************************************************************/
+        void observe(std::string_view name, double value, const aptrepo::MetricLabels &labels = {});
+
+        /******************************************************************************
+         * ScopedTimer class recording the lifetime of the object, in seconds, as
+         * a histogram sample.
+         ******************************************************************************/
+        class ScopedTimer
+        {
+        public:
+            /******************************************************************************
+             * Constructor for ScopedTimer class, starts the timer.
+             *
+             * @param name   Name of the histogram.
+             * @param labels Labels of the histogram.
+             ******************************************************************************/
+            explicit ScopedTimer(std::string_view name, aptrepo::MetricLabels labels = {});
+
+            /******************************************************************************
+             * Destructor for ScopedTimer class, records the sample.
+             ******************************************************************************/
+            ~ScopedTimer();
+
+            ScopedTimer(const ScopedTimer &) = delete;
+            ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+            /******************************************************************************
+             * Get the time since the timer was started.
+             *
+             * @return Elapsed time in seconds.
+             ******************************************************************************/
+            double elapsed() const;
+
+        private:
+            std::string_view m_name;
+            aptrepo::MetricLabels m_labels;
+            std::chrono::steady_clock::time_point m_start;
+        };
+    }
+}
@@ -0,0 +1,127 @@
+/******************************************************************************
+ * @file openpgp.hpp
+ * @brief Header file for aptrepo internal OpenPGP functions.
+ *
+ * Minimal OpenPGP (RFC 4880) support to verify clearsigned InRelease files
+ * without running gpgv: version 4 public keys and signatures with RSA or
+ * EdDSA (Ed25519) keys. Cryptography is done by OpenSSL.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct evp_md_ctx_st;
+struct evp_pkey_st;
+
+namespace aptrepo
+{
+    class Keyring;
+
+    namespace internal
+    {
+        /******************************************************************************
+         * OpenPGP public key or subkey usable to verify signatures.
+         ******************************************************************************/
+        struct PublicKey
+        {
+            /// Hex fingerprint, upper case.
+            std::string fingerprint;
+            /// Key ID, the low 64 bits of the fingerprint.
+            std::uint64_t key_id = 0;
+            /// Public key algorithm, 1 or 3 for RSA, 22 for EdDSA.
+            int algorithm = 0;
+            /// Size of the RSA modulus in bytes, signatures are padded to it.
+            std::size_t modulus_size = 0;
+            /// The OpenSSL key.
+            std::shared_ptr<evp_pkey_st> key;
+        };
+
+        /******************************************************************************
+         * Parse the public keys of a keyring or exported key.
+         *
+         * Keys of unsupported algorithms are skipped.
+         *
+         * @param data Binary OpenPGP packets or an ASCII armored key block.
+         * @return Primary keys and subkeys.
+         ******************************************************************************/
+        std::vector<PublicKey> parse_public_keys(std::string_view data);
+
+        /******************************************************************************
+         * Decode the data of an ASCII armored block.
+         *
+         * @param text The armored text, from the BEGIN line to the END line.
+         * @return The binary data.
+         ******************************************************************************/
+        std::string dearmor(std::string_view text);
+
+        /******************************************************************************
+         * Verifier of a clearsigned message, fed line by line.
+         *
+         * The signed text is canonicalized and hashed while the lines are
+         * added, so the message is read only once.
+         ******************************************************************************/
+        class ClearsignVerifier
+        {
+        public:
+            /******************************************************************************
+             * Constructor for ClearsignVerifier class.
+             *
+             * @param keyring Trusted keys.
+             ******************************************************************************/
+            explicit ClearsignVerifier(const aptrepo::Keyring &keyring);
+            ~ClearsignVerifier();
+
+            ClearsignVerifier(const ClearsignVerifier &) = delete;
+            ClearsignVerifier &operator=(const ClearsignVerifier &) = delete;
+
+            /******************************************************************************
+             * Add the next line of the message.
+             *
+             * @param line The line without line ending.
+             * @return True if the line is part of the signed text.
+             ******************************************************************************/
+            bool add_line(std::string_view line);
+
+            /******************************************************************************
+             * Verify the signatures after all lines were added.
+             *
+             * Throws std::runtime_error if the message is not clearsigned or no
+             * signature of a key of the keyring is valid.
+             *
+             * @return Fingerprint of the key of the first valid signature.
+             ******************************************************************************/
+            std::string verify();
+
+        private:
+            enum class State
+            {
+                Start,
+                Headers,
+                Text,
+                SignatureHeaders,
+                Signature,
+                End
+            };
+
+            struct Hash
+            {
+                int algorithm;
+                evp_md_ctx_st *context;
+            };
+
+            void add_hash(std::string_view name);
+
+            const aptrepo::Keyring &m_keyring;
+            State m_state = State::Start;
+            bool m_first_line = true;
+            std::vector<Hash> m_hashes;
+            std::string m_signature;
+        };
+    }
+}
@@ -0,0 +1,158 @@
+/******************************************************************************
+ * @file scheduler.hpp
+ * @brief Header file for the aptrepo internal download scheduler.
+ *
+ * Downloads get a priority derived from the kind and size of the file.
+ * The scheduler pauses transfers while a transfer of a higher priority is
+ * running, so small latency-critical files like InRelease and Packages do
+ * not share the link with a large Contents file, and limits the bandwidth
+ * of all transfers with one token bucket.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string_view>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+#include "aptrepo/reference.hpp"
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /******************************************************************************
+         * Priority of a download, higher priorities are fetched first.
+         ******************************************************************************/
+        enum class Priority
+        {
+            /// Release files and Packages or Sources indexes.
+            High = 0,
+            /// Other indexes and pool files.
+            Normal = 1,
+            /// Contents indexes and very large files.
+            Low = 2
+        };
+
+        /// Number of priorities.
+        constexpr std::size_t priority_count = 3;
+
+        /// Files of at least this size get Priority::Low.
+        constexpr std::size_t large_download_size = 64 * 1024 * 1024;
+
+        /******************************************************************************
+         * Get the priority of a download.
+         *
+         * @param path Path or URL of the file.
+         * @param size Size of the file in bytes, 0 if unknown.
+         * @return The priority.
+         ******************************************************************************/
+        Priority download_priority(std::string_view path, std::size_t size);
+
+        /******************************************************************************
+         * Get the priority of the download of a Reference.
+         *
+         * @param reference The Reference.
+         * @return The priority.
+         ******************************************************************************/
+        Priority download_priority(const aptrepo::Reference &reference);
+
+        /******************************************************************************
+         * Token bucket limiting a byte rate.
+         *
+         * Tokens are taken before the bytes are known to be available, so the
+         * bucket may go into debt; the caller then sleeps until the debt is
+         * paid. This keeps the lock hold time constant.
+         ******************************************************************************/
+        class TokenBucket
+        {
+        public:
+            /******************************************************************************
+             * Constructor for TokenBucket class.
+             *
+             * @param rate  Rate in bytes per second, 0 for no limit.
+             * @param burst Bytes which may be taken at once after an idle period.
+             ******************************************************************************/
+            TokenBucket(std::size_t rate, std::size_t burst);
+
+            /******************************************************************************
+             * Take tokens, sleeping until the rate allows the bytes.
+             *
+             * @param bytes Number of bytes.
+             * @return Time spent waiting.
+             ******************************************************************************/
+            std::chrono::steady_clock::duration acquire(std::size_t bytes);
+
+        private:
+            std::mutex m_mutex;
+            double m_rate;
+            double m_burst;
+            double m_tokens;
+            std::chrono::steady_clock::time_point m_updated;
+        };
+
+        /******************************************************************************
+         * Scheduler shared by concurrent downloads.
+         *
+         * Each transfer holds a Slot and calls Slot::throttle with the size of
+         * every received chunk. All methods are thread safe.
+         ******************************************************************************/
+        class DownloadScheduler
+        {
+        public:
+            /******************************************************************************
+             * Registration of a running transfer.
+             ******************************************************************************/
+            class Slot
+            {
+            public:
+                Slot(DownloadScheduler &scheduler, Priority priority);
+                ~Slot();
+
+                Slot(const Slot &) = delete;
+                Slot &operator=(const Slot &) = delete;
+
+                /******************************************************************************
+                 * Account received bytes of the transfer.
+                 *
+                 * Blocks while a transfer of a higher priority is running and
+                 * while the bandwidth limit is exceeded.
+                 *
+                 * @param bytes Number of bytes received.
+                 ******************************************************************************/
+                void throttle(std::size_t bytes);
+
+            private:
+                DownloadScheduler &m_scheduler;
+                Priority m_priority;
+            };
+
+            /******************************************************************************
+             * Constructor for DownloadScheduler class.
+             *
+             * @param rate_limit Bandwidth limit of all transfers in bytes per second, 0 for no limit.
+             ******************************************************************************/
+            explicit DownloadScheduler(std::size_t rate_limit = 0);
+
+            /******************************************************************************
+             * Get the number of times transfers were paused for a higher priority.
+             *
+             * @return Number of pauses.
+             ******************************************************************************/
+            std::size_t get_preemptions() const;
+
+        private:
+            void wait_for_turn(Priority priority);
+
+            TokenBucket m_bucket;
+            bool m_limited;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_changed;
+            std::array<std::size_t, priority_count> m_active{};
+            std::size_t m_preemptions = 0;
+        };
+    }
+}
@@ -0,0 +1,83 @@
+/******************************************************************************
+ * @file timer_wheel.hpp
+ * @brief Header file for the aptrepo internal timer wheel.
+ *
+ * A hashed timer wheel schedules many timers with a fixed resolution.
+ * Scheduling a timer and expiring the timers of a tick take constant time
+ * on average, independent of the number of timers, which suits polling
+ * thousands of URLs.
+ ******************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /******************************************************************************
+         * TimerWheel class holding timers identified by numbers.
+         *
+         * Timers are put into the slot of their due tick modulo the number of
+         * slots; timers more than one revolution ahead stay in their slot until
+         * the wheel reaches their tick. The class is not thread safe.
+         ******************************************************************************/
+        class TimerWheel
+        {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            /******************************************************************************
+             * Constructor for TimerWheel class.
+             *
+             * @param tick  Resolution of the timers.
+             * @param slots Number of slots, the ticks of one revolution.
+             * @param start Time of the first tick.
+             ******************************************************************************/
+            TimerWheel(std::chrono::milliseconds tick, std::size_t slots, Clock::time_point start = Clock::now());
+
+            /******************************************************************************
+             * Schedule a timer.
+             *
+             * The timer expires at the first tick at or after its due time. Due
+             * times in the past expire with the next call of expire.
+             *
+             * @param id  Identifier of the timer, returned when it expires.
+             * @param due Due time of the timer.
+             ******************************************************************************/
+            void schedule(std::size_t id, Clock::time_point due);
+
+            /******************************************************************************
+             * Remove the expired timers.
+             *
+             * @param now The current time.
+             * @return Identifiers of the timers due until now.
+             ******************************************************************************/
+            std::vector<std::size_t> expire(Clock::time_point now = Clock::now());
+
+            /******************************************************************************
+             * Get the number of scheduled timers.
+             *
+             * @return Number of timers.
+             ******************************************************************************/
+            std::size_t size() const;
+
+        private:
+            struct Timer
+            {
+                std::uint64_t tick;
+                std::size_t id;
+            };
+
+            std::chrono::milliseconds m_tick;
+            Clock::time_point m_start;
+            std::uint64_t m_current = 0;
+            std::vector<std::vector<Timer>> m_slots;
+            std::size_t m_size = 0;
+        };
+    }
+}
@@ -0,0 +1,122 @@
+/******************************************************************************
+ * @file unix_socket.hpp
+ * @brief Header file for aptrepo internal Unix domain socket helpers.
+ *
+ * Long-running aptclient modes talk to local processes over Unix domain
+ * sockets, which need no port allocation and are protected by the file
+ * permissions of the socket path. Services for a single user also check
+ * the credentials of the peer, since a socket at a predictable path may
+ * have been created by another user.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string_view>
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        /******************************************************************************
+         * Create a listening Unix domain stream socket.
+         *
+         * A stale socket file at the path is removed. Throws std::runtime_error
+         * if the socket can't be created.
+         *
+         * @param path Path of the socket file.
+         * @return The listening socket.
+         ******************************************************************************/
+        int listen_unix(const std::filesystem::path &path);
+
+        /******************************************************************************
+         * Connect to a Unix domain stream socket.
+         *
+         * @param path Path of the socket file.
+         * @return The connected socket, or -1 if nothing listens at the path.
+         ******************************************************************************/
+        int connect_unix(const std::filesystem::path &path);
+
+        /******************************************************************************
+         * Send all data to a connected Unix domain socket.
+         *
+         * @param socket The connected socket.
+         * @param data   Data to send.
+         * @return False if the peer disconnected or the send timed out.
+         ******************************************************************************/
+        bool send_unix(int socket, std::string_view data);
+
+        /******************************************************************************
+         * Check that the peer of a connected Unix domain socket runs as the
+         * effective user of this process.
+         *
+         * @param socket The connected socket.
+         * @return True if the credentials of the peer have the same user ID.
+         ******************************************************************************/
+        bool is_same_user(int socket);
+
+        /******************************************************************************
+         * Create a directory only accessible by the effective user, or check
+         * an existing one.
+         *
+         * Throws std::runtime_error if the path is not a directory, e.g. a
+         * symbolic link, is owned by another user or is accessible by others.
+         *
+         * @param path Path of the directory.
+         ******************************************************************************/
+        void make_private_directory(const std::filesystem::path &path);
+
+        /******************************************************************************
+         * UnixBroadcaster class sending a stream of records to all clients
+         * connected to a Unix domain socket.
+         *
+         * Clients only receive the records sent after they connected. Clients
+         * which disconnect or don't read for a second are dropped, so a stuck
+         * client can't block the sender.
+         * Connections of other users are closed.
+         ******************************************************************************/
+        class UnixBroadcaster
+        {
+        public:
+            /******************************************************************************
+             * Constructor for UnixBroadcaster class, the socket listens immediately.
+             *
+             * @param path Path of the socket file, removed again by the destructor.
+             ******************************************************************************/
+            explicit UnixBroadcaster(const std::filesystem::path &path);
+            ~UnixBroadcaster();
+
+            UnixBroadcaster(const UnixBroadcaster &) = delete;
+            UnixBroadcaster &operator=(const UnixBroadcaster &) = delete;
+
+            /******************************************************************************
+             * Send data to all connected clients.
+             *
+             * @param data Complete records, e.g. NDJSON lines.
+             ******************************************************************************/
+            void send(std::string_view data);
+
+            /******************************************************************************
+             * Get the number of connected clients.
+             *
+             * @return Number of clients.
+             ******************************************************************************/
+            std::size_t get_clients() const;
+
+        private:
+            void accept_loop();
+
+            std::filesystem::path m_path;
+            int m_listen_socket = -1;
+            int m_wakeup[2] = {-1, -1};
+            std::thread m_accept_thread;
+            mutable std::mutex m_mutex;
+            std::vector<int> m_clients;
+        };
+    }
+}
@@ -6,6 +6,9 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
 
 namespace aptrepo
 {
@@ -18,5 +21,57 @@ namespace aptrepo
          * @return A new string with leading and trailing whitespace removed.
          ******************************************************************************/
         std::string trim(const std::string &source);
+
+        /******************************************************************************
+         * Check if a path from repository metadata stays below the directory it
+         * is joined to.
+         *
+         * @param path Relative path, e.g. a Filename field or the path of a Reference.
+         * @return False for empty or absolute paths, and paths with empty, "." or
+         *         ".." segments.
+         ******************************************************************************/
+        bool is_safe_path(std::string_view path);
+
+        /******************************************************************************
+         * Decode a hex string to bytes.
+         *
+         * @param hex The hex string, upper or lower case.
+         * @return The decoded bytes, or an empty string if hex is not valid.
+         ******************************************************************************/
+        std::string hex_to_bytes(std::string_view hex);
+
+        /******************************************************************************
+         * Decode a hex string to bytes into a buffer.
+         *
+         * @param hex The hex string, upper or lower case.
+         * @param bytes Buffer of at least half the size of hex.
+         * @return False if hex is not valid, the buffer content is undefined then.
+         ******************************************************************************/
+        bool hex_to_bytes(std::string_view hex, char *bytes);
+
+        /******************************************************************************
+         * Encode bytes as lowercase hex string.
+         *
+         * @param bytes The bytes.
+         * @return The hex string.
+         ******************************************************************************/
+        std::string bytes_to_hex(std::string_view bytes);
+
+        /******************************************************************************
+         * Append an unsigned integer as LEB128 varint to a byte buffer.
+         *
+         * @param buffer The buffer to append to.
+         * @param value  The value to encode.
+         ******************************************************************************/
+        void append_varint(std::string &buffer, std::uint64_t value);
+
+        /******************************************************************************
+         * Read a LEB128 varint from a byte buffer.
+         *
+         * @param buffer The buffer to read from.
+         * @param pos    Read position, advanced behind the varint.
+         * @return The decoded value.
+         ******************************************************************************/
+        std::uint64_t read_varint(std::string_view buffer, std::size_t &pos);
     }
 }
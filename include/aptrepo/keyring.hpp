@@ -0,0 +1,92 @@
+/******************************************************************************
+ * @file keyring.hpp
+ * @brief Header file for aptrepo::Keyring.
+ *
+ * A aptrepo::Keyring holds the trusted OpenPGP keys used to verify
+ * InRelease files, like the files in /etc/apt/trusted.gpg.d or the
+ * Signed-By keyring of an APT source.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "aptrepo/internal/openpgp.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * Keyring class holding trusted public keys.
+     *
+     * The keys are parsed and converted once, when they are added, so a
+     * verification only looks up the key of the signature.
+     * Supported are version 4 RSA and EdDSA (Ed25519) keys.
+     ******************************************************************************/
+    class Keyring
+    {
+    public:
+        /******************************************************************************
+         * Constructor for an empty Keyring.
+         ******************************************************************************/
+        Keyring() = default;
+
+        /******************************************************************************
+         * Constructor for Keyring class loading keys from disk.
+         *
+         * @param path A binary (.gpg) or ASCII armored (.asc) keyring, or a
+         *             directory of such files like /etc/apt/trusted.gpg.d.
+         ******************************************************************************/
+        explicit Keyring(const std::filesystem::path &path);
+
+        /******************************************************************************
+         * Get a cached Keyring for a path.
+         *
+         * The keyring is loaded on the first call and again only if the
+         * modification time of the path changed.
+         *
+         * @param path Path of the keyring file or directory.
+         * @return The shared Keyring.
+         ******************************************************************************/
+        static std::shared_ptr<const Keyring> load(const std::filesystem::path &path);
+
+        /******************************************************************************
+         * Add keys.
+         *
+         * @param data Binary OpenPGP packets or an ASCII armored key block.
+         * @return Number of keys and subkeys added.
+         ******************************************************************************/
+        std::size_t add(std::string_view data);
+
+        /******************************************************************************
+         * Get the number of keys and subkeys.
+         *
+         * @return Number of keys.
+         ******************************************************************************/
+        std::size_t size() const;
+
+        /******************************************************************************
+         * Get the fingerprints of all keys and subkeys.
+         *
+         * @return Hex fingerprints, upper case.
+         ******************************************************************************/
+        std::vector<std::string> get_fingerprints() const;
+
+        /******************************************************************************
+         * Find a key by its key ID.
+         *
+         * @param key_id The key ID, the low 64 bits of the fingerprint.
+         * @return The key, or nullptr if it is not in the keyring.
+         ******************************************************************************/
+        const aptrepo::internal::PublicKey *find(std::uint64_t key_id) const;
+
+    private:
+        std::unordered_map<std::uint64_t, aptrepo::internal::PublicKey> m_keys;
+    };
+}
@@ -0,0 +1,151 @@
+/******************************************************************************
+ * @file metrics.hpp
+ * @brief Header file for the aptrepo metrics interface.
+ *
+ * The library reports counters, gauges and latency samples of downloads,
+ * parsing, the mirror and the proxy to an application provided
+ * aptrepo::MetricsSink. aptrepo::PrometheusExporter is a sink rendering the
+ * Prometheus text exposition format.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * Labels of a metric sample as name and value pairs.
+     ******************************************************************************/
+    using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+    /******************************************************************************
+     * MetricsSink interface receiving the metrics of the library.
+     *
+     * Implementations must be thread-safe, the library reports from all
+     * threads, e.g. the download workers of the mirror. Metric names follow
+     * the Prometheus conventions, e.g. "aptrepo_download_bytes_total".
+     ******************************************************************************/
+    class MetricsSink
+    {
+    public:
+        virtual ~MetricsSink() = default;
+
+        /******************************************************************************
+         * Increment a counter.
+         *
+         * @param name   Name of the counter.
+         * @param value  Increment.
+         * @param labels Labels of the counter.
+         ******************************************************************************/
+        virtual void increment(std::string_view name, double value, const MetricLabels &labels) = 0;
+
+        /******************************************************************************
+         * Set a gauge.
+         *
+         * @param name   Name of the gauge.
+         * @param value  New value.
+         * @param labels Labels of the gauge.
+         ******************************************************************************/
+        virtual void set(std::string_view name, double value, const MetricLabels &labels) = 0;
+
+        /******************************************************************************
+         * Record a sample of a distribution, e.g. a latency in seconds.
+         *
+         * @param name   Name of the histogram.
+         * @param value  Sample value.
+         * @param labels Labels of the histogram.
+         ******************************************************************************/
+        virtual void observe(std::string_view name, double value, const MetricLabels &labels) = 0;
+    };
+
+    /******************************************************************************
+     * Install the sink receiving the metrics of the library.
+     *
+     * Without a sink, which is the default, no metrics are recorded.
+     *
+     * @param sink The sink, or nullptr to disable metrics.
+     ******************************************************************************/
+    void set_metrics_sink(std::shared_ptr<MetricsSink> sink);
+
+    /******************************************************************************
+     * Get the installed metrics sink.
+     *
+     * @return The sink, or nullptr if metrics are disabled.
+     ******************************************************************************/
+    std::shared_ptr<MetricsSink> get_metrics_sink();
+
+    /******************************************************************************
+     * PrometheusExporter class collecting metrics in the Prometheus text
+     * exposition format.
+     ******************************************************************************/
+    class PrometheusExporter : public MetricsSink
+    {
+    public:
+        /******************************************************************************
+         * Constructor for PrometheusExporter class using the default buckets,
+         * suited for latencies in seconds.
+         ******************************************************************************/
+        PrometheusExporter();
+
+        /******************************************************************************
+         * Constructor for PrometheusExporter class.
+         *
+         * @param buckets Ascending upper bounds of the histogram buckets.
+         ******************************************************************************/
+        explicit PrometheusExporter(std::vector<double> buckets);
+
+        void increment(std::string_view name, double value, const MetricLabels &labels) override;
+        void set(std::string_view name, double value, const MetricLabels &labels) override;
+        void observe(std::string_view name, double value, const MetricLabels &labels) override;
+
+        /******************************************************************************
+         * Get the value of a counter or gauge.
+         *
+         * @param name   Name of the metric.
+         * @param labels Labels of the metric.
+         * @return The value, or 0 if the metric was not reported.
+         ******************************************************************************/
+        double get(std::string_view name, const MetricLabels &labels = {}) const;
+
+        /******************************************************************************
+         * Render all metrics in the Prometheus text exposition format.
+         *
+         * @return The metrics, ordered by name and labels.
+         ******************************************************************************/
+        std::string render() const;
+
+    private:
+        enum class Type
+        {
+            Counter,
+            Gauge,
+            Histogram
+        };
+
+        struct Series
+        {
+            double value = 0;
+            std::vector<std::size_t> buckets;
+            std::size_t count = 0;
+        };
+
+        struct Family
+        {
+            Type type;
+            std::map<std::string, Series> series;
+        };
+
+        Series &series(std::string_view name, Type type, const MetricLabels &labels);
+
+        std::vector<double> m_buckets;
+        mutable std::mutex m_mutex;
+        std::map<std::string, Family, std::less<>> m_families;
+    };
+}
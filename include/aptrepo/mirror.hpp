@@ -0,0 +1,126 @@
+/******************************************************************************
+ * @file mirror.hpp
+ * @brief Header file for aptrepo::MirrorSync.
+ *
+ * A aptrepo::MirrorSync incrementally synchronizes a distribution of an APT
+ * repository to a local directory. It follows InRelease, the Packages
+ * indexes and the referenced pool files and fetches only new or changed
+ * files.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        class DownloadScheduler;
+    }
+
+    /******************************************************************************
+     * MirrorSync class to synchronize a distribution to a local mirror.
+     *
+     * All files are verified against the SHA-256 digests of the Release and
+     * the Packages indexes and are stored in a content-addressed object store
+     * inside the mirror. Identical content, e.g. by-hash files or pool files
+     * shared by several suites, is hardlinked from this store. The InRelease
+     * file is published atomically after all other files are in place.
+     *
+     * Downloads are scheduled by priority: Packages and Sources indexes are
+     * fetched before other files, and Contents indexes and very large files
+     * are paused while files of a higher priority are transferred.
+     ******************************************************************************/
+    class MirrorSync
+    {
+    public:
+        /******************************************************************************
+         * Options for the synchronization.
+         ******************************************************************************/
+        struct Options
+        {
+            /// Architectures to mirror, empty for all. "all" is always mirrored.
+            std::vector<std::string> architectures;
+            /// Components to mirror, empty for all.
+            std::vector<std::string> components;
+            /// Number of parallel downloads.
+            std::size_t jobs = 8;
+            /// Bandwidth limit of all downloads in bytes per second, 0 for no limit.
+            std::size_t rate_limit = 0;
+            /// Keyring to verify the InRelease file with, empty to not verify it.
+            std::filesystem::path keyring;
+        };
+
+        /******************************************************************************
+         * Statistics of a synchronization.
+         ******************************************************************************/
+        struct Statistics
+        {
+            std::size_t downloaded = 0;
+            std::size_t linked = 0;
+            std::size_t unchanged = 0;
+            /// Optional files, i.e. uncompressed variants of indexes, not found upstream.
+            std::size_t missing = 0;
+            std::size_t failed = 0;
+            std::size_t bytes = 0;
+        };
+
+        /******************************************************************************
+         * Constructor for MirrorSync class.
+         *
+         * @param repo_url Base URL of the repository, http(s):// or file://.
+         * @param distro   Name of the distribution, e.g. "noble".
+         * @param target   Root directory of the local mirror.
+         * @param options  Options for the synchronization.
+         ******************************************************************************/
+        MirrorSync(std::string repo_url, std::string distro, std::filesystem::path target, Options options);
+
+        /******************************************************************************
+         * Constructor for MirrorSync class using default options.
+         *
+         * @param repo_url Base URL of the repository, http(s):// or file://.
+         * @param distro   Name of the distribution, e.g. "noble".
+         * @param target   Root directory of the local mirror.
+         ******************************************************************************/
+        MirrorSync(std::string repo_url, std::string distro, std::filesystem::path target);
+
+        /******************************************************************************
+         * Synchronize the mirror.
+         *
+         * @return Statistics of the synchronization.
+         ******************************************************************************/
+        Statistics sync();
+
+    private:
+        struct Job
+        {
+            std::string url;
+            std::filesystem::path path;
+            std::size_t size;
+            std::string digest;
+            bool optional;
+        };
+
+        enum class Outcome
+        {
+            Downloaded,
+            Linked,
+            Failed
+        };
+
+        void fetch(const std::vector<Job> &jobs, Statistics &statistics, aptrepo::internal::DownloadScheduler &scheduler) const;
+        Outcome fetch_one(const Job &job, const std::function<void(std::size_t)> &throttle) const;
+        std::filesystem::path object_path(const std::string &digest) const;
+        bool is_current(const std::filesystem::path &path, std::size_t size, const std::string &digest) const;
+
+        std::string m_repo_url;
+        std::string m_distro;
+        std::filesystem::path m_target;
+        Options m_options;
+    };
+}
@@ -0,0 +1,182 @@
+/******************************************************************************
+ * @file mirror_set.hpp
+ * @brief Header file for aptrepo::MirrorSet.
+ *
+ * A aptrepo::MirrorSet downloads repository files from a list of equivalent
+ * mirrors. Mirrors are ranked by their measured latency, and slow requests
+ * are hedged by requesting the same file from a second mirror.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/keyring.hpp"
+#include "aptrepo/release.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * Measured state of one mirror.
+     ******************************************************************************/
+    struct MirrorStatus
+    {
+        /// Base URL of the mirror.
+        std::string url;
+        /// Smoothed round trip time of the probes in seconds, 0 if not probed.
+        double rtt = 0;
+        /// Smoothed request latency in seconds, 0 if unknown.
+        double latency = 0;
+        /// Smoothed download throughput in bytes per second, 0 if unknown.
+        double throughput = 0;
+        std::size_t requests = 0;
+        std::size_t failures = 0;
+    };
+
+    /******************************************************************************
+     * MirrorSet class for latency-aware downloads from several mirrors.
+     *
+     * Mirrors are ranked by their request latency, or by the round trip time
+     * of the probes until a request was measured. Each download is first
+     * requested from the best ranked mirror. If it is
+     * not complete after the hedge delay, the 95th percentile of the recent
+     * request latencies of this mirror, the same file is requested from the
+     * next mirror. The first complete response with a valid hash wins; the
+     * other request is cancelled. Failed requests fall over to the next
+     * mirror immediately.
+     ******************************************************************************/
+    class MirrorSet
+    {
+    public:
+        /******************************************************************************
+         * Options for the mirror set.
+         ******************************************************************************/
+        struct Options
+        {
+            /// Maximum time of a single request.
+            std::chrono::milliseconds timeout = std::chrono::seconds(60);
+            /// Hedge delay used until enough latencies are measured.
+            std::chrono::milliseconds initial_hedge_delay = std::chrono::milliseconds(250);
+            /// Lower bound of the hedge delay.
+            std::chrono::milliseconds min_hedge_delay = std::chrono::milliseconds(20);
+            /// Upper bound of the hedge delay.
+            std::chrono::milliseconds max_hedge_delay = std::chrono::seconds(5);
+            /// Interval of the background probes.
+            std::chrono::seconds probe_interval = std::chrono::seconds(60);
+            /// Path, relative to the mirror URL, requested with HEAD by the probes.
+            std::string probe_path;
+        };
+
+        /******************************************************************************
+         * Constructor for MirrorSet class.
+         *
+         * @param mirrors Base URLs of the mirrors, in order of preference.
+         * @param options Options for the mirror set.
+         ******************************************************************************/
+        MirrorSet(std::vector<std::string> mirrors, Options options);
+
+        /******************************************************************************
+         * Constructor for MirrorSet class using default options.
+         *
+         * @param mirrors Base URLs of the mirrors, in order of preference.
+         ******************************************************************************/
+        explicit MirrorSet(std::vector<std::string> mirrors);
+
+        /******************************************************************************
+         * Destructor for MirrorSet class, stops the background probes.
+         ******************************************************************************/
+        ~MirrorSet();
+
+        MirrorSet(const MirrorSet &) = delete;
+        MirrorSet &operator=(const MirrorSet &) = delete;
+
+        /******************************************************************************
+         * Download a file with hedged requests.
+         *
+         * @param path   Path of the file relative to the mirror URLs.
+         * @param sha256 Expected hex SHA-256 digest, or an empty string to accept
+         *               any successful response.
+         * @return Download object of the winning mirror.
+         ******************************************************************************/
+        aptrepo::internal::Download download(const std::string &path, const std::string &sha256 = "");
+
+        /******************************************************************************
+         * Download and parse the InRelease file of a distribution.
+         *
+         * @param distro Name of the distribution, e.g. "noble".
+         * @return The parsed Release.
+         ******************************************************************************/
+        aptrepo::Release parse_release(const std::string &distro);
+
+        /******************************************************************************
+         * Download, verify and parse the InRelease file of a distribution.
+         *
+         * Throws std::runtime_error if no signature of a key of the keyring is
+         * valid.
+         *
+         * @param distro  Name of the distribution, e.g. "noble".
+         * @param keyring Trusted keys.
+         * @return The verified Release.
+         ******************************************************************************/
+        aptrepo::Release parse_release(const std::string &distro, const aptrepo::Keyring &keyring);
+
+        /******************************************************************************
+         * Measure the round trip time of all mirrors with a HEAD request.
+         ******************************************************************************/
+        void probe();
+
+        /******************************************************************************
+         * Start probing the mirrors periodically in a background thread.
+         ******************************************************************************/
+        void start_probing();
+
+        /******************************************************************************
+         * Stop the background probes.
+         ******************************************************************************/
+        void stop_probing();
+
+        /******************************************************************************
+         * Get the state of all mirrors.
+         *
+         * @return Mirror states, best ranked mirror first.
+         ******************************************************************************/
+        std::vector<aptrepo::MirrorStatus> get_status() const;
+
+        /******************************************************************************
+         * Get the current hedge delay of the best ranked mirror.
+         *
+         * @return The hedge delay.
+         ******************************************************************************/
+        std::chrono::milliseconds get_hedge_delay() const;
+
+    private:
+        struct Mirror
+        {
+            aptrepo::MirrorStatus status;
+            std::size_t failures_in_row = 0;
+            std::vector<double> latencies;
+            std::size_t next_latency = 0;
+        };
+
+        std::vector<std::size_t> ranking() const;
+        std::chrono::milliseconds hedge_delay(std::size_t mirror) const;
+        void record(std::size_t mirror, bool ok, double latency, std::size_t bytes);
+        void record_cancelled(std::size_t mirror, double elapsed);
+        static void add_latency(Mirror &mirror, double latency);
+
+        Options m_options;
+        mutable std::mutex m_mutex;
+        std::vector<Mirror> m_mirrors;
+
+        std::mutex m_probe_mutex;
+        std::condition_variable_any m_probe_wake;
+        std::jthread m_prober;
+    };
+}
@@ -0,0 +1,135 @@
+/******************************************************************************
+ * @file name_index.hpp
+ * @brief Header file for aptrepo::NameIndex.
+ *
+ * A aptrepo::NameIndex is a search index over package names. The names are
+ * stored as sorted, front-coded dictionary, which supports prefix, glob and
+ * bounded edit distance queries and can be serialized next to the parsed
+ * Packages data.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <vector>
+
+#include "aptrepo/packages.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * NameIndex class to search package names.
+     *
+     * Names are deduplicated and sorted. Each name is identified by its rank
+     * in the sorted dictionary. Names are grouped in blocks; the first name of
+     * each block is stored in full, all other names store the length of the
+     * prefix shared with their predecessor and the remaining suffix.
+     ******************************************************************************/
+    class NameIndex
+    {
+    public:
+        /******************************************************************************
+         * Constructor for an empty NameIndex.
+         ******************************************************************************/
+        NameIndex() = default;
+
+        /******************************************************************************
+         * Constructor for NameIndex class.
+         *
+         * @param names Package names, duplicates are allowed.
+         ******************************************************************************/
+        explicit NameIndex(std::vector<std::string> names);
+
+        /******************************************************************************
+         * Constructor for NameIndex class indexing several Packages indexes,
+         * e.g. of all tracked suites.
+         *
+         * @param packages Parsed Packages indexes.
+         ******************************************************************************/
+        explicit NameIndex(const std::vector<aptrepo::Packages> &packages);
+
+        /******************************************************************************
+         * Get the number of distinct names in the index.
+         *
+         * @return Number of names.
+         ******************************************************************************/
+        std::size_t size() const;
+
+        /******************************************************************************
+         * Get the name with the given id.
+         *
+         * @param id Id of the name, i.e. its rank in sorted order.
+         * @return The name.
+         ******************************************************************************/
+        std::string get_name(std::size_t id) const;
+
+        /******************************************************************************
+         * Find the id of a name.
+         *
+         * @param name The exact name.
+         * @return Id of the name, or std::nullopt if it is not indexed.
+         ******************************************************************************/
+        std::optional<std::size_t> find(std::string_view name) const;
+
+        /******************************************************************************
+         * Find all names starting with a prefix.
+         *
+         * @param prefix The prefix.
+         * @param limit  Maximum number of results, 0 for no limit.
+         * @return Matching names in sorted order.
+         ******************************************************************************/
+        std::vector<std::string> find_prefix(std::string_view prefix, std::size_t limit = 0) const;
+
+        /******************************************************************************
+         * Find all names matching a glob pattern.
+         *
+         * Supported are '*' (any sequence), '?' (any character) and character
+         * classes like '[a-z]' or '[!0-9]'.
+         *
+         * @param pattern The glob pattern.
+         * @param limit   Maximum number of results, 0 for no limit.
+         * @return Matching names in sorted order.
+         ******************************************************************************/
+        std::vector<std::string> find_glob(std::string_view pattern, std::size_t limit = 0) const;
+
+        /******************************************************************************
+         * Find all names within a Levenshtein distance of a term.
+         *
+         * @param term      The search term.
+         * @param max_edits Maximum number of insertions, deletions and substitutions.
+         * @param limit     Maximum number of results, 0 for no limit.
+         * @return Matching names in sorted order.
+         ******************************************************************************/
+        std::vector<std::string> find_fuzzy(std::string_view term, std::size_t max_edits, std::size_t limit = 0) const;
+
+        /******************************************************************************
+         * Serialize the index to a binary stream.
+         *
+         * @param out The output stream.
+         ******************************************************************************/
+        void save(std::ostream &out) const;
+
+        /******************************************************************************
+         * Load an index from a binary stream written by save.
+         *
+         * @param in The input stream.
+         * @return The loaded index.
+         ******************************************************************************/
+        static NameIndex load(std::istream &in);
+
+    private:
+        std::size_t lower_bound(std::string_view name) const;
+
+        template <typename Fn>
+        void scan(std::size_t first, Fn &&fn) const;
+
+        std::size_t m_size = 0;
+        std::string m_data;
+        std::vector<std::uint32_t> m_block_offsets;
+    };
+}
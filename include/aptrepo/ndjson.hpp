@@ -0,0 +1,155 @@
+/******************************************************************************
+ * @file ndjson.hpp
+ * @brief Header file for aptrepo::NdjsonWriter.
+ *
+ * A aptrepo::NdjsonWriter exports repository data as newline delimited
+ * JSON, one record per line:
+ *
+ *   {"type":"release","url":...,"etag":...,"fields":{"Origin":...}}
+ *   {"type":"reference","release":...,"path":...,"url":...,"size":...,"hashes":{"SHA256":...}}
+ *   {"type":"package","index":...,"fields":{"Package":...}}
+ *   {"type":"diff","release":...,"etag":...,"added":[...],"removed":[...],"changed":[...]}
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+
+#include "aptrepo/internal/fields.hpp"
+#include "aptrepo/diff.hpp"
+#include "aptrepo/packages.hpp"
+#include "aptrepo/reference.hpp"
+#include "aptrepo/release.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * NdjsonWriter class to write repository data as NDJSON.
+     *
+     * Records are serialized directly into a fixed output buffer, which is
+     * written to the file descriptor when full. Writing package records does
+     * not allocate memory.
+     ******************************************************************************/
+    class NdjsonWriter
+    {
+    public:
+        /// Default size of the output buffer.
+        static constexpr std::size_t default_buffer_size = 1024 * 1024;
+
+        /// Receiver of the serialized records, called with complete lines.
+        using Sink = std::function<void(std::string_view data)>;
+
+        /******************************************************************************
+         * Constructor for NdjsonWriter class writing to an open file descriptor.
+         *
+         * @param fd          File descriptor, e.g. STDOUT_FILENO. It is not closed.
+         * @param buffer_size Size of the output buffer.
+         ******************************************************************************/
+        explicit NdjsonWriter(int fd, std::size_t buffer_size = default_buffer_size);
+
+        /******************************************************************************
+         * Constructor for NdjsonWriter class writing to a file.
+         *
+         * @param path        Path of the file, which is created or truncated.
+         * @param buffer_size Size of the output buffer.
+         ******************************************************************************/
+        explicit NdjsonWriter(const std::filesystem::path &path, std::size_t buffer_size = default_buffer_size);
+
+        /******************************************************************************
+         * Constructor for NdjsonWriter class passing the output to a function,
+         * e.g. to send it to several sockets.
+         *
+         * The buffer is only passed on at record boundaries, so the sink
+         * always receives complete lines.
+         *
+         * @param sink        Receiver of the output.
+         * @param buffer_size Size of the output buffer.
+         ******************************************************************************/
+        explicit NdjsonWriter(Sink sink, std::size_t buffer_size = default_buffer_size);
+
+        /******************************************************************************
+         * Destructor for NdjsonWriter class, flushes the buffer.
+         ******************************************************************************/
+        ~NdjsonWriter();
+
+        NdjsonWriter(const NdjsonWriter &) = delete;
+        NdjsonWriter &operator=(const NdjsonWriter &) = delete;
+
+        /******************************************************************************
+         * Write a release record.
+         *
+         * @param release The Release.
+         ******************************************************************************/
+        void write(const aptrepo::Release &release);
+
+        /******************************************************************************
+         * Write a reference record.
+         *
+         * @param reference   The Reference.
+         * @param release_url URL of the Release listing the reference.
+         ******************************************************************************/
+        void write(const aptrepo::Reference &reference, std::string_view release_url);
+
+        /******************************************************************************
+         * Write a package record.
+         *
+         * @param package   The Package.
+         * @param index_url URL of the Packages index containing the package.
+         ******************************************************************************/
+        void write(const aptrepo::Package &package, std::string_view index_url);
+
+        /******************************************************************************
+         * Write a diff record with the paths of the changed references.
+         *
+         * @param diff    The differences to the previous version of the Release.
+         * @param release The new version of the Release.
+         ******************************************************************************/
+        void write(const aptrepo::ReleaseDiff &diff, const aptrepo::Release &release);
+
+        /******************************************************************************
+         * Write all buffered records to the file.
+         ******************************************************************************/
+        void flush();
+
+        /******************************************************************************
+         * Get the number of records written.
+         *
+         * @return Number of records.
+         ******************************************************************************/
+        std::size_t get_records() const;
+
+        /******************************************************************************
+         * Get the number of bytes written, including buffered bytes.
+         *
+         * @return Number of bytes.
+         ******************************************************************************/
+        std::size_t get_bytes() const;
+
+    private:
+        void make_room();
+        void put(char c);
+        void put(std::string_view text);
+        void put_string(std::string_view value);
+        void put_number(std::uint64_t value);
+        void put_member(std::string_view key, std::string_view value);
+        void put_fields(const aptrepo::internal::FieldTable &fields);
+        void put_paths(std::string_view key, const std::vector<aptrepo::Reference> &references);
+        void end_record();
+
+        int m_fd = -1;
+        bool m_owned = false;
+        Sink m_sink;
+        std::unique_ptr<char[]> m_buffer;
+        std::size_t m_capacity = 0;
+        std::size_t m_used = 0;
+        std::size_t m_record_start = 0;
+        std::size_t m_records = 0;
+        std::size_t m_flushed = 0;
+    };
+}
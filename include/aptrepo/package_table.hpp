@@ -0,0 +1,257 @@
+/******************************************************************************
+ * @file package_table.hpp
+ * @brief Header file for aptrepo::PackageTable and aptrepo::Bitmap.
+ *
+ * A aptrepo::PackageTable stores the packages of one or more Packages
+ * indexes column by column: string fields are dictionary encoded, Size and
+ * Installed-Size are numeric columns. Predicates are evaluated by scanning
+ * a single column and return a aptrepo::Bitmap of the matching rows, which
+ * can be combined with bitwise operators.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "aptrepo/packages.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * Bitmap class to represent a set of table rows.
+     ******************************************************************************/
+    class Bitmap
+    {
+    public:
+        Bitmap() = default;
+
+        /******************************************************************************
+         * Constructor for Bitmap class.
+         *
+         * @param size  Number of bits.
+         * @param value Initial value of all bits.
+         ******************************************************************************/
+        explicit Bitmap(std::size_t size, bool value = false);
+
+        /******************************************************************************
+         * Constructor for Bitmap class from 64 bit words.
+         *
+         * @param words Words of the bitmap, bit i of word w is row 64 * w + i.
+         * @param size  Number of bits.
+         ******************************************************************************/
+        Bitmap(std::vector<std::uint64_t> words, std::size_t size);
+
+        /******************************************************************************
+         * Get the number of bits.
+         *
+         * @return Number of bits.
+         ******************************************************************************/
+        std::size_t size() const;
+
+        /******************************************************************************
+         * Get the number of set bits.
+         *
+         * @return Number of set bits.
+         ******************************************************************************/
+        std::size_t count() const;
+
+        /******************************************************************************
+         * Test a bit.
+         *
+         * @param index Index of the bit.
+         * @return True if the bit is set.
+         ******************************************************************************/
+        bool test(std::size_t index) const;
+
+        /******************************************************************************
+         * Set a bit.
+         *
+         * @param index Index of the bit.
+         ******************************************************************************/
+        void set(std::size_t index);
+
+        /******************************************************************************
+         * Get the indexes of all set bits.
+         *
+         * @return Indexes in ascending order.
+         ******************************************************************************/
+        std::vector<std::size_t> indexes() const;
+
+        /******************************************************************************
+         * Get the words of the bitmap.
+         *
+         * @return Words, bits beyond size() are zero.
+         ******************************************************************************/
+        const std::vector<std::uint64_t> &get_words() const;
+
+        Bitmap &operator&=(const Bitmap &other);
+        Bitmap &operator|=(const Bitmap &other);
+        Bitmap operator~() const;
+        friend Bitmap operator&(Bitmap a, const Bitmap &b) { return a &= b; }
+        friend Bitmap operator|(Bitmap a, const Bitmap &b) { return a |= b; }
+
+    private:
+        std::vector<std::uint64_t> m_words;
+        std::size_t m_size = 0;
+    };
+
+    /******************************************************************************
+     * PackageTable class for columnar queries over Packages indexes.
+     ******************************************************************************/
+    class PackageTable
+    {
+    public:
+        /// Name of the column which stores the suite label given to add().
+        static constexpr std::string_view suite_column = "Suite";
+
+        /******************************************************************************
+         * Numeric columns of the table.
+         ******************************************************************************/
+        enum class Numeric
+        {
+            /// Size of the .deb file in bytes.
+            Size,
+            /// Installed size in KiB.
+            InstalledSize
+        };
+
+        /******************************************************************************
+         * Constructor for PackageTable class with the columns Suite, Package,
+         * Source, Version, Architecture, Section and Priority.
+         ******************************************************************************/
+        PackageTable();
+
+        /******************************************************************************
+         * Constructor for PackageTable class.
+         *
+         * @param columns Names of the string fields to store. The Suite column
+         *                is always added.
+         ******************************************************************************/
+        explicit PackageTable(const std::vector<std::string> &columns);
+
+        /******************************************************************************
+         * Append all packages of a Packages index.
+         *
+         * @param packages The parsed index.
+         * @param suite    Label stored in the Suite column, e.g. "noble/main".
+         ******************************************************************************/
+        void add(const aptrepo::Packages &packages, const std::string &suite);
+
+        /******************************************************************************
+         * Append a single package.
+         *
+         * @param package The package.
+         * @param suite   Label stored in the Suite column.
+         ******************************************************************************/
+        void add(const aptrepo::Package &package, const std::string &suite);
+
+        /******************************************************************************
+         * Get the number of rows.
+         *
+         * @return Number of rows.
+         ******************************************************************************/
+        std::size_t size() const;
+
+        /******************************************************************************
+         * Get the names of the string columns.
+         *
+         * @return Column names, Suite first.
+         ******************************************************************************/
+        std::vector<std::string> get_columns() const;
+
+        /******************************************************************************
+         * Get the value of a string column.
+         *
+         * @param column Name of the column.
+         * @param row    Index of the row.
+         * @return The value, empty if the field is not set.
+         ******************************************************************************/
+        const std::string &get(std::string_view column, std::size_t row) const;
+
+        /******************************************************************************
+         * Get the value of a numeric column.
+         *
+         * @param column The column.
+         * @param row    Index of the row.
+         * @return The value, 0 if the field is not set.
+         ******************************************************************************/
+        std::uint64_t get(Numeric column, std::size_t row) const;
+
+        /******************************************************************************
+         * Get the distinct values of a string column.
+         *
+         * @param column Name of the column.
+         * @return Values in order of first appearance.
+         ******************************************************************************/
+        const std::vector<std::string> &get_values(std::string_view column) const;
+
+        /******************************************************************************
+         * Find the rows where a string column has a value.
+         *
+         * @param column Name of the column.
+         * @param value  The value.
+         * @return Bitmap of the matching rows.
+         ******************************************************************************/
+        aptrepo::Bitmap equals(std::string_view column, std::string_view value) const;
+
+        /******************************************************************************
+         * Find the rows where a string column has one of several values.
+         *
+         * @param column Name of the column.
+         * @param values The values.
+         * @return Bitmap of the matching rows.
+         ******************************************************************************/
+        aptrepo::Bitmap any_of(std::string_view column, const std::vector<std::string> &values) const;
+
+        /******************************************************************************
+         * Find the rows where a numeric column is greater than a value.
+         *
+         * @param column The column.
+         * @param value  The exclusive lower bound.
+         * @return Bitmap of the matching rows.
+         ******************************************************************************/
+        aptrepo::Bitmap greater(Numeric column, std::uint64_t value) const;
+
+        /******************************************************************************
+         * Find the rows where a numeric column is less than a value.
+         *
+         * @param column The column.
+         * @param value  The exclusive upper bound.
+         * @return Bitmap of the matching rows.
+         ******************************************************************************/
+        aptrepo::Bitmap less(Numeric column, std::uint64_t value) const;
+
+    private:
+        struct StringHash
+        {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view value) const { return std::hash<std::string_view>()(value); }
+        };
+
+        /******************************************************************************
+         * Dictionary encoded string column.
+         ******************************************************************************/
+        struct Column
+        {
+            std::string name;
+            std::vector<std::string> values;
+            std::unordered_map<std::string, std::uint32_t, StringHash, std::equal_to<>> codes;
+            std::vector<std::uint32_t> rows;
+
+            void append(std::string_view value);
+        };
+
+        const Column &column(std::string_view name) const;
+        const std::vector<std::uint64_t> &numeric(Numeric column) const;
+
+        std::vector<Column> m_columns;
+        std::vector<std::uint64_t> m_sizes;
+        std::vector<std::uint64_t> m_installed_sizes;
+    };
+}
@@ -0,0 +1,181 @@
+/******************************************************************************
+ * @file packages.hpp
+ * @brief Header file for aptrepo::Package and aptrepo::Packages.
+ *
+ * A aptrepo::Packages represents a parsed Packages index of an APT
+ * repository. Each stanza of the index is represented as aptrepo::Package.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <vector>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/fields.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * Package class to encapsulate one stanza of a Packages index.
+     ******************************************************************************/
+    class Package
+    {
+    public:
+        Package() = default;
+
+        /******************************************************************************
+         * Constructor for Package class, parsing a single stanza.
+         *
+         * @param stanza Text of the stanza in Deb822 format. Only the first
+         *               stanza is used if the text contains several.
+         ******************************************************************************/
+        explicit Package(std::string_view stanza);
+
+        /******************************************************************************
+         * Add a field to the Package.
+         *
+         * @param key   The key of the field.
+         * @param value The value of the field.
+         ******************************************************************************/
+        void add_field(std::string_view key, std::string value);
+
+        /******************************************************************************
+         * Get the value of a field.
+         *
+         * @param key The key of the field.
+         * @return Value as a string, or an empty string if the field is not set.
+         ******************************************************************************/
+        std::string get_field(std::string_view key) const;
+
+        /******************************************************************************
+         * Get the fields of the Package.
+         *
+         * @return Field table of the package stanza.
+         ******************************************************************************/
+        const aptrepo::internal::FieldTable &get_fields() const;
+
+        /******************************************************************************
+         * Convert the Package to a string representation.
+         *
+         * @return String representation of the Package.
+         ******************************************************************************/
+        operator std::string() const;
+
+        /******************************************************************************
+         * Get the name of the Package.
+         *
+         * @return Package name as a string.
+         ******************************************************************************/
+        const std::string &get_name() const;
+
+        /******************************************************************************
+         * Get the version of the Package.
+         *
+         * @return Version as a string.
+         ******************************************************************************/
+        const std::string &get_version() const;
+
+        /******************************************************************************
+         * Get the architecture of the Package.
+         *
+         * @return Architecture as a string.
+         ******************************************************************************/
+        const std::string &get_architecture() const;
+
+        /******************************************************************************
+         * Get the section of the Package.
+         *
+         * @return Section as a string.
+         ******************************************************************************/
+        const std::string &get_section() const;
+
+        /******************************************************************************
+         * Get the priority of the Package.
+         *
+         * @return Priority as a string.
+         ******************************************************************************/
+        const std::string &get_priority() const;
+
+        /******************************************************************************
+         * Get the pool path of the Package, relative to the repository root.
+         *
+         * @return Filename as a string.
+         ******************************************************************************/
+        const std::string &get_filename() const;
+
+        /******************************************************************************
+         * Get the description of the Package.
+         *
+         * @return Description, short description in the first line.
+         ******************************************************************************/
+        const std::string &get_description() const;
+
+        /******************************************************************************
+         * Get the size of the .deb file of the Package.
+         *
+         * @return Size in bytes, or 0 if unknown.
+         ******************************************************************************/
+        std::size_t get_size() const;
+
+        /******************************************************************************
+         * Get the installed size of the Package.
+         *
+         * @return Installed size in KiB, or 0 if unknown.
+         ******************************************************************************/
+        std::size_t get_installed_size() const;
+
+    private:
+        aptrepo::internal::FieldTable m_fields;
+    };
+
+    /******************************************************************************
+     * Packages class to encapsulate a parsed Packages index.
+     ******************************************************************************/
+    class Packages
+    {
+    public:
+        /******************************************************************************
+         * Constructor for Packages class.
+         *
+         * @param download Download object containing the URL, ETag, and content
+         *                 of the uncompressed Packages index.
+         ******************************************************************************/
+        explicit Packages(aptrepo::internal::Download download);
+
+        /******************************************************************************
+         * Get the URL of the Packages index.
+         *
+         * @return URL as a string.
+         ******************************************************************************/
+        std::string get_url() const;
+
+        /******************************************************************************
+         * Get the ETag of the Packages index.
+         *
+         * @return ETag as a string.
+         ******************************************************************************/
+        std::string get_etag() const;
+
+        /******************************************************************************
+         * Get all packages of the index.
+         *
+         * @return Vector of aptrepo::Package objects in index order.
+         ******************************************************************************/
+        const std::vector<aptrepo::Package> &get_packages() const;
+
+        /******************************************************************************
+         * Get the names of all packages of the index.
+         *
+         * @return Vector of package names in index order.
+         ******************************************************************************/
+        std::vector<std::string> get_names() const;
+
+    private:
+        std::string m_url;
+        std::string m_etag;
+        std::vector<aptrepo::Package> m_packages;
+    };
+}
@@ -0,0 +1,172 @@
+/******************************************************************************
+ * @file proxy.hpp
+ * @brief Header file for aptrepo::CachingProxy.
+ *
+ * A aptrepo::CachingProxy is a caching HTTP proxy for APT clients. It
+ * stores the fetched repository files in a local directory and serves
+ * concurrent clients, e.g. CI runners, from this cache.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "aptrepo/internal/http_server.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * CachingProxy class implementing a caching proxy for APT repositories.
+     *
+     * Clients either use the proxy as repository base URL, i.e. request paths
+     * relative to the upstream URL, or configure it as HTTP proxy and request
+     * absolute URLs. Concurrent requests for the same file are coalesced into
+     * one upstream fetch. InRelease and Release files are revalidated with
+     * their ETag after the TTL expired. Index files below dists/ are
+     * validated against the SHA-256 digests of the cached InRelease; pool
+     * and by-hash files are immutable and are cached forever.
+     ******************************************************************************/
+    class CachingProxy
+    {
+    public:
+        /******************************************************************************
+         * Options for the proxy.
+         ******************************************************************************/
+        struct Options
+        {
+            /// IPv4 address to listen on.
+            std::string address = "127.0.0.1";
+            /// Port to listen on, 0 for an ephemeral port.
+            std::uint16_t port = 3142;
+            /// Time after which InRelease files are revalidated upstream.
+            std::chrono::seconds ttl = std::chrono::seconds(300);
+        };
+
+        /******************************************************************************
+         * Statistics of the proxy.
+         ******************************************************************************/
+        struct Statistics
+        {
+            std::size_t requests = 0;
+            /// Requests served from the cache without upstream access.
+            std::size_t hits = 0;
+            /// Requests which needed an upstream request.
+            std::size_t misses = 0;
+            /// Requests which waited for the upstream fetch of another request.
+            std::size_t coalesced = 0;
+            /// Upstream fetches answered with 304 Not Modified.
+            std::size_t revalidated = 0;
+            /// Upstream files rejected because of a digest mismatch.
+            std::size_t rejected = 0;
+            std::size_t upstream_bytes = 0;
+        };
+
+        /******************************************************************************
+         * Constructor for CachingProxy class.
+         *
+         * @param upstream_url Base URL of the upstream repository, or an empty string
+         *                     to only serve absolute http:// URLs like a forward proxy.
+         * @param cache_dir    Directory of the cache.
+         * @param options      Options for the proxy.
+         ******************************************************************************/
+        CachingProxy(std::string upstream_url, std::filesystem::path cache_dir, Options options);
+
+        /******************************************************************************
+         * Constructor for CachingProxy class using default options.
+         *
+         * @param upstream_url Base URL of the upstream repository.
+         * @param cache_dir    Directory of the cache.
+         ******************************************************************************/
+        CachingProxy(std::string upstream_url, std::filesystem::path cache_dir);
+
+        /******************************************************************************
+         * Destructor for CachingProxy class, stops the proxy.
+         ******************************************************************************/
+        ~CachingProxy();
+
+        CachingProxy(const CachingProxy &) = delete;
+        CachingProxy &operator=(const CachingProxy &) = delete;
+
+        /******************************************************************************
+         * Start serving requests.
+         ******************************************************************************/
+        void start();
+
+        /******************************************************************************
+         * Stop serving requests; waits for open connections.
+         ******************************************************************************/
+        void stop();
+
+        /******************************************************************************
+         * Get the base URL of the running proxy.
+         *
+         * @return URL like "http://127.0.0.1:3142".
+         ******************************************************************************/
+        std::string get_url() const;
+
+        /******************************************************************************
+         * Get the statistics of the proxy.
+         *
+         * @return Statistics since construction.
+         ******************************************************************************/
+        Statistics get_statistics() const;
+
+        /******************************************************************************
+         * Handle a request; used by the HTTP server.
+         *
+         * @param request The client request.
+         * @return The response.
+         ******************************************************************************/
+        aptrepo::internal::HttpResponse handle(const aptrepo::internal::HttpRequest &request);
+
+    private:
+        enum class Kind
+        {
+            Volatile,
+            Index,
+            Immutable
+        };
+
+        struct Entry
+        {
+            std::string etag;
+            /// Hex SHA-256 digest of the cached file.
+            std::string digest;
+            std::chrono::steady_clock::time_point fetched;
+        };
+
+        int resolve(const std::string &base, const std::string &key);
+        int fetch(const std::string &base, const std::string &key, Kind kind, const std::string &expected);
+        std::string expected_digest(const std::string &base, const std::string &key);
+        static Kind classify(const std::string &key);
+
+        std::string m_upstream_url;
+        std::filesystem::path m_cache_dir;
+        Options m_options;
+        std::unique_ptr<aptrepo::internal::HttpServer> m_server;
+
+        std::mutex m_mutex;
+        std::map<std::string, Entry> m_entries;
+        std::map<std::string, std::shared_future<int>> m_inflight;
+        /// SHA-256 digests of the index files by InRelease cache key and path.
+        std::map<std::string, std::map<std::string, std::string>> m_release_digests;
+        std::size_t m_tmp_counter = 0;
+
+        std::atomic<std::size_t> m_requests = 0;
+        std::atomic<std::size_t> m_hits = 0;
+        std::atomic<std::size_t> m_misses = 0;
+        std::atomic<std::size_t> m_coalesced = 0;
+        std::atomic<std::size_t> m_revalidated = 0;
+        std::atomic<std::size_t> m_rejected = 0;
+        std::atomic<std::size_t> m_upstream_bytes = 0;
+    };
+}
@@ -0,0 +1,268 @@
+/******************************************************************************
+ * @file query_server.hpp
+ * @brief Header file for aptrepo::QueryServer and aptrepo::QueryClient.
+ *
+ * A aptrepo::QueryServer keeps parsed Releases and Packages indexes resident
+ * and answers lookups over a Unix domain socket, so short-lived clients like
+ * build scripts don't download and parse the InRelease for every question.
+ *
+ * The protocol is line based. A request is one line of space separated
+ * words, the command followed by its arguments:
+ *
+ *     ping
+ *     release <url>                        summary of the Release
+ *     field <url> <name>                   value of a Release field
+ *     architectures <url>                  one architecture per line
+ *     components <url>                     one component per line
+ *     references <url>                     "<path> <size> <hex digest>" per index
+ *     digest <url> <path> [algorithm]      hex digest of an index
+ *     package <url> <index path> <name>    stanzas of a package in an index
+ *     refresh <url>                        "changed" or "unchanged"
+ *     stats                                "<counter> <value>" per line
+ *
+ * where <url> is the URL of an InRelease file and <index path> is relative
+ * to its directory, e.g. "main/binary-amd64/Packages". The response is
+ * "OK <n>" followed by n lines, or a single "ERR <message>" line. A client
+ * may send any number of requests on one connection.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/keyring.hpp"
+#include "aptrepo/store.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * QueryServer class answering repository lookups from resident data.
+     *
+     * The first query for an InRelease URL downloads and parses it, the first
+     * query for an index downloads the smallest variant listed in the Release
+     * and verifies its SHA256. Both stay resident in a ReleaseStore, so later
+     * lookups only read an immutable snapshot; package names are looked up
+     * in a sorted table built once per version of an index. A background
+     * thread polls the resident Releases with conditional requests; when a
+     * Release changed, the resident indexes whose digest changed are loaded
+     * again before the new Release is published, so a snapshot never mixes
+     * versions.
+     *
+     * Each connection is served by its own thread. Connections of other users
+     * are rejected.
+     ******************************************************************************/
+    class QueryServer
+    {
+    public:
+        /******************************************************************************
+         * Options for the server.
+         ******************************************************************************/
+        struct Options
+        {
+            /// Path of the Unix socket; empty for default_socket().
+            std::filesystem::path socket;
+            /// Time between two polls of a resident Release.
+            std::chrono::milliseconds interval = std::chrono::minutes(5);
+            /// Maximum time of one poll.
+            std::chrono::milliseconds timeout = std::chrono::seconds(30);
+            /// Keyring to verify the InRelease files with, empty to not verify them.
+            std::filesystem::path keyring;
+        };
+
+        /******************************************************************************
+         * Statistics of the server.
+         ******************************************************************************/
+        struct Statistics
+        {
+            /// Answered requests, including failed ones.
+            std::size_t queries = 0;
+            /// Requests answered with an error.
+            std::size_t failed = 0;
+            /// Releases and indexes downloaded for a query.
+            std::size_t loads = 0;
+            /// Polls of resident Releases.
+            std::size_t polls = 0;
+            /// Polls which published a new Release.
+            std::size_t changed = 0;
+            /// Accepted connections.
+            std::size_t connections = 0;
+        };
+
+        /******************************************************************************
+         * Constructor for QueryServer class.
+         *
+         * @param options Options for the server.
+         ******************************************************************************/
+        explicit QueryServer(Options options);
+
+        /******************************************************************************
+         * Constructor for QueryServer class using default options.
+         ******************************************************************************/
+        QueryServer();
+
+        /******************************************************************************
+         * Destructor for QueryServer class, stops the server.
+         ******************************************************************************/
+        ~QueryServer();
+
+        QueryServer(const QueryServer &) = delete;
+        QueryServer &operator=(const QueryServer &) = delete;
+
+        /******************************************************************************
+         * Start listening on the socket and polling the resident Releases.
+         *
+         * Throws std::runtime_error if another server listens on the socket.
+         ******************************************************************************/
+        void start();
+
+        /******************************************************************************
+         * Stop the server; closes all connections and removes the socket.
+         ******************************************************************************/
+        void stop();
+
+        /******************************************************************************
+         * Answer a request without a socket, e.g. if no server is running.
+         *
+         * Throws std::runtime_error for invalid requests and failed downloads.
+         *
+         * @param request The request line, without the newline.
+         * @return The lines of the response.
+         ******************************************************************************/
+        std::vector<std::string> query(std::string_view request);
+
+        /******************************************************************************
+         * Poll all resident Releases once.
+         *
+         * @return Number of Releases which changed.
+         ******************************************************************************/
+        std::size_t refresh();
+
+        /******************************************************************************
+         * Get the path of the socket.
+         *
+         * @return The path.
+         ******************************************************************************/
+        const std::filesystem::path &get_socket() const;
+
+        /******************************************************************************
+         * Get the statistics of the server.
+         *
+         * @return Statistics since construction.
+         ******************************************************************************/
+        Statistics get_statistics() const;
+
+        /******************************************************************************
+         * Get the default path of the socket.
+         *
+         * Throws std::runtime_error if the per-user directory in the temporary
+         * directory exists but is not private to this user.
+         *
+         * @return aptclient.sock in $XDG_RUNTIME_DIR, or in a per-user directory
+         *         with mode 0700 in the temporary directory.
+         ******************************************************************************/
+        static std::filesystem::path default_socket();
+
+    private:
+        struct Connection
+        {
+            std::thread thread;
+            std::atomic<bool> done = false;
+        };
+
+        /// Positions of the stanzas of a resident index, sorted by name.
+        struct NameLookup
+        {
+            std::shared_ptr<const aptrepo::Packages> packages;
+            std::vector<std::pair<std::string_view, std::size_t>> positions;
+        };
+
+        std::shared_ptr<const aptrepo::Release> find_release(const std::string &url);
+        std::shared_ptr<const aptrepo::Packages> find_packages(const std::string &url, const std::string &path);
+        std::shared_ptr<const NameLookup> find_names(std::shared_ptr<const aptrepo::Packages> packages);
+        std::shared_ptr<const aptrepo::Release> parse(aptrepo::internal::Download download) const;
+        bool refresh(const std::string &url);
+        std::string handle(std::string_view request);
+        void accept_loop();
+        void serve(int client, Connection &connection);
+        void poll_loop();
+
+        Options m_options;
+        std::shared_ptr<const aptrepo::Keyring> m_keyring;
+        aptrepo::ReleaseStore m_store;
+
+        // Serializes downloads; the client is only used under this lock
+        std::mutex m_load_mutex;
+        aptrepo::internal::ConditionalClient m_client;
+
+        std::mutex m_lookup_mutex;
+        std::map<std::string, std::shared_ptr<const NameLookup>> m_lookups;
+
+        int m_listen_socket = -1;
+        int m_wakeup[2] = {-1, -1};
+        std::thread m_accept_thread;
+        std::thread m_poll_thread;
+        std::list<Connection> m_connections;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_stopped;
+        bool m_stop = false;
+        Statistics m_statistics;
+    };
+
+    /******************************************************************************
+     * QueryClient class sending requests to a running QueryServer.
+     ******************************************************************************/
+    class QueryClient
+    {
+    public:
+        /******************************************************************************
+         * Connect to a QueryServer.
+         *
+         * @param socket Path of the Unix socket.
+         * @return The client, or nullptr if no server of this user listens on
+         *         the socket.
+         ******************************************************************************/
+        static std::unique_ptr<QueryClient> connect(const std::filesystem::path &socket);
+
+        /******************************************************************************
+         * Destructor for QueryClient class, closes the connection.
+         ******************************************************************************/
+        ~QueryClient();
+
+        QueryClient(const QueryClient &) = delete;
+        QueryClient &operator=(const QueryClient &) = delete;
+
+        /******************************************************************************
+         * Send a request and wait for the response.
+         *
+         * Throws std::runtime_error if the server answers with an error or the
+         * connection is lost.
+         *
+         * @param request The request line, without the newline.
+         * @return The lines of the response.
+         ******************************************************************************/
+        std::vector<std::string> query(std::string_view request);
+
+    private:
+        explicit QueryClient(int socket);
+        std::string read_line();
+
+        int m_socket;
+        std::string m_buffer;
+        std::size_t m_offset = 0;
+    };
+}
@@ -3,13 +3,16 @@
  * @brief Header file for aptrepo::Reference.
  *
  * A aptrepo::Reference represents a reference to a file in an APT repository,
- * including its URL, size, and hashes.
+ * including its URL, size, and hashes. References are allocator aware, so a
+ * aptrepo::Release can keep all of its references in one arena.
  ******************************************************************************/
 
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <map>
+#include <memory_resource>
 #include <cstddef>
 
 namespace aptrepo
@@ -18,19 +21,49 @@ namespace aptrepo
      * Reference class to encapsulate a reference to a file in an APT repository.
      *
      * This class includes the URL, size in bytes, and hashes of the
-     * referenced file.
+     * referenced file. Copies use the default memory resource unless an
+     * allocator is given, so copies returned by aptrepo::Release outlive it.
      ******************************************************************************/
     class Reference
     {
     public:
+        /// Allocator of the strings and the hash map.
+        using allocator_type = std::pmr::polymorphic_allocator<>;
+
+        /// Map of hash algorithm name to hex hash.
+        using Hashes = std::pmr::map<std::pmr::string, std::pmr::string, std::less<>>;
+
         /******************************************************************************
          * Constructor for Reference class.
          *
          * @param base_url Base URL to complete the path.
          * @param path Path to the referenced file.
          * @param size_bytes Size of the referenced file in bytes.
+         * @param allocator Allocator of the members.
+         ******************************************************************************/
+        Reference(std::string_view base_url, std::string_view path, std::size_t size_bytes,
+                  const allocator_type &allocator = {});
+
+        Reference(const Reference &other) = default;
+        Reference(Reference &&other) = default;
+        Reference &operator=(const Reference &other) = default;
+        Reference &operator=(Reference &&other) = default;
+
+        /******************************************************************************
+         * Copy constructor using the given allocator.
+         *
+         * @param other The Reference to copy.
+         * @param allocator Allocator of the members.
+         ******************************************************************************/
+        Reference(const Reference &other, const allocator_type &allocator);
+
+        /******************************************************************************
+         * Move constructor using the given allocator, copies if the allocators differ.
+         *
+         * @param other The Reference to move.
+         * @param allocator Allocator of the members.
          ******************************************************************************/
-        Reference(std::string base_url, std::string path, std::size_t size_bytes);
+        Reference(Reference &&other, const allocator_type &allocator);
 
         /******************************************************************************
          * Add a hash for the referenced file.
@@ -38,7 +71,7 @@ namespace aptrepo
          * @param algorithm Hash algorithm (e.g., "sha256").
          * @param hash Hash value of the file.
          ******************************************************************************/
-        void add_hash(std::string algorithm, std::string hash);
+        void add_hash(std::string_view algorithm, std::string_view hash);
 
         /******************************************************************************
          * Convert the Reference to a string representation.
@@ -61,12 +94,71 @@ namespace aptrepo
          ******************************************************************************/
         std::string get_component() const;
 
+        /******************************************************************************
+         * Get the path of the Reference, relative to the base URL.
+         *
+         * @return Path as a string.
+         ******************************************************************************/
+        std::string get_path() const;
+
+        /******************************************************************************
+         * Get the full URL of the referenced file.
+         *
+         * @return URL as a string.
+         ******************************************************************************/
+        std::string get_url() const;
+
+        /******************************************************************************
+         * Get the size of the referenced file.
+         *
+         * @return Size in bytes.
+         ******************************************************************************/
+        std::size_t get_size() const;
+
+        /******************************************************************************
+         * Get a hash of the referenced file.
+         *
+         * @param algorithm Hash algorithm as named in the Release (e.g., "SHA256").
+         * @return Hash as hex string, or an empty string if not available.
+         ******************************************************************************/
+        std::string get_hash(const std::string &algorithm) const;
+
+        /******************************************************************************
+         * Get the name of the strongest hash algorithm available.
+         *
+         * @return Algorithm name, or an empty string if no hash is known.
+         ******************************************************************************/
+        std::string get_digest_algorithm() const;
+
+        /******************************************************************************
+         * Get the binary digest of the strongest hash algorithm available.
+         *
+         * @return Raw digest bytes, empty if no hash is known.
+         ******************************************************************************/
+        std::string_view get_digest() const;
+
+        /******************************************************************************
+         * Get all hashes of the Reference.
+         *
+         * @return Map of algorithm name to hex hash.
+         ******************************************************************************/
+        const Hashes &get_hashes() const;
+
+        /******************************************************************************
+         * Get the allocator of the Reference.
+         *
+         * @return The allocator.
+         ******************************************************************************/
+        allocator_type get_allocator() const;
+
     private:
-        std::string m_arch;
-        std::string m_comp;
-        std::string m_base_url;
-        std::string m_path;
+        std::pmr::string m_arch;
+        std::pmr::string m_comp;
+        std::pmr::string m_base_url;
+        std::pmr::string m_path;
         std::size_t m_size_bytes;
-        std::map<std::string, std::string> m_hashes;
+        Hashes m_hashes;
+        std::pmr::string m_digest_algorithm;
+        std::pmr::string m_digest;
     };
 }
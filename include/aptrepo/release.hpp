@@ -6,19 +6,29 @@
  * URL, ETag, base URL, fields, and references to files in the repository.
  * This class is used to encapsulate the information contained in a Release file
  * and provides methods to add fields and references.
+ *
+ * The references of a Release are allocated from a monotonic arena owned by
+ * the Release, or from a memory resource given by the caller, so parsing and
+ * destroying a Release with thousands of references costs a handful of large
+ * allocations instead of several per reference.
  ******************************************************************************/
 
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <map>
 #include <cstddef>
 #include <memory>
+#include <memory_resource>
 #include <chrono>
 #include <vector>
 
+#include "aptrepo/keyring.hpp"
 #include "aptrepo/reference.hpp"
 #include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/fields.hpp"
+#include "aptrepo/internal/openpgp.hpp"
 
 namespace aptrepo
 {
@@ -36,8 +46,41 @@ namespace aptrepo
          *
          * @param download Download object containing the URL, ETag, and content
          *                 of the release file.
+         * @param resource Memory resource of the references, which must outlive
+         *                 the Release; nullptr to use an arena owned by the Release.
+         ******************************************************************************/
+        explicit Release(aptrepo::internal::Download download, std::pmr::memory_resource *resource = nullptr);
+
+        /******************************************************************************
+         * Constructor for Release class verifying a clearsigned InRelease file.
+         *
+         * The OpenPGP signature is checked in the same pass that parses the
+         * fields, and only fields of the signed text are used. Throws
+         * std::runtime_error if no signature of a key of the keyring is valid.
+         *
+         * @param download Download object containing the URL, ETag, and content
+         *                 of the InRelease file.
+         * @param keyring  Trusted keys.
+         * @param resource Memory resource of the references, which must outlive
+         *                 the Release; nullptr to use an arena owned by the Release.
+         ******************************************************************************/
+        Release(aptrepo::internal::Download download, const aptrepo::Keyring &keyring,
+                std::pmr::memory_resource *resource = nullptr);
+
+        /******************************************************************************
+         * Copy constructor, the copy gets its own arena.
+         *
+         * @param other The Release to copy.
+         ******************************************************************************/
+        Release(const Release &other);
+        Release(Release &&other) = default;
+
+        /******************************************************************************
+         * Assignment operators, like the constructors the copy gets its own
+         * arena and a moved Release keeps its memory resource.
          ******************************************************************************/
-        explicit Release(aptrepo::internal::Download download);
+        Release &operator=(const Release &other);
+        Release &operator=(Release &&other);
 
         /******************************************************************************
          * Add a field to the Release.
@@ -55,7 +98,7 @@ namespace aptrepo
          * @param algorithm  The hash algorithm used (e.g., "sha256").
          * @param hash       The hash value of the file.
          ******************************************************************************/
-        void add_reference(std::string path, std::size_t size, std::string algorithm, std::string hash);
+        void add_reference(std::string_view path, std::size_t size, std::string_view algorithm, std::string_view hash);
 
         /******************************************************************************
          * Convert the Release to a string representation.
@@ -64,6 +107,21 @@ namespace aptrepo
          ******************************************************************************/
         operator std::string() const;
 
+        /******************************************************************************
+         * Get the value of a field of the Release.
+         *
+         * @param key The key of the field.
+         * @return Value as a string, or an empty string if the field is not set.
+         ******************************************************************************/
+        std::string get_field(std::string_view key) const;
+
+        /******************************************************************************
+         * Get the fields of the Release.
+         *
+         * @return Field table of the Release, without the hash lists.
+         ******************************************************************************/
+        const aptrepo::internal::FieldTable &get_fields() const;
+
         /******************************************************************************
          * Get the origin of the Release.
          *
@@ -165,7 +223,7 @@ namespace aptrepo
         /******************************************************************************
          * Get all references in the Release.
          *
-         * @return Vector of aptrepo::Reference objects.
+         * @return Vector of aptrepo::Reference objects, ordered by path.
          ******************************************************************************/
         std::vector<aptrepo::Reference> get_references() const;
 
@@ -194,15 +252,44 @@ namespace aptrepo
          ******************************************************************************/
         std::vector<aptrepo::Reference> get_references_for_arch(std::string arch) const;
 
+        /******************************************************************************
+         * Find the reference of an index file without copying the references.
+         *
+         * @param path  Path of the index, relative to the base URL.
+         * @return The reference, or nullptr if the Release doesn't list the path.
+         *         It is valid as long as the Release.
+         ******************************************************************************/
+        const aptrepo::Reference *find_reference(std::string_view path) const;
+
+        /******************************************************************************
+         * Check if the signature of the Release was verified.
+         *
+         * @return True if the Release was created with a keyring.
+         ******************************************************************************/
+        bool is_verified() const;
+
+        /******************************************************************************
+         * Get the fingerprint of the key which signed the Release.
+         *
+         * @return Hex fingerprint, empty if the Release was not verified.
+         ******************************************************************************/
+        std::string get_signer() const;
+
     private:
+        void parse(const aptrepo::internal::Download &download, aptrepo::internal::ClearsignVerifier *verifier);
+        void swap(Release &other);
+
         bool m_flat;
+        std::string m_signer;
         std::string m_url;
         std::string m_etag;
         std::string m_base_url;
         std::chrono::time_point<std::chrono::utc_clock, std::chrono::seconds> m_date;
         std::vector<std::string> m_architectures;
         std::vector<std::string> m_components;
-        std::map<std::string, std::string> m_fields;
-        std::map<std::string, std::shared_ptr<aptrepo::Reference>> m_references;
+        aptrepo::internal::FieldTable m_fields;
+        // Declared before the references, which are destroyed first
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> m_arena;
+        std::pmr::map<std::pmr::string, aptrepo::Reference, std::less<>> m_references;
     };
 }
@@ -0,0 +1,181 @@
+/******************************************************************************
+ * @file store.hpp
+ * @brief Header file for aptrepo::ReleaseStore.
+ *
+ * A aptrepo::ReleaseStore holds parsed Releases and Packages indexes for
+ * concurrent, read-mostly access. Readers work on immutable snapshots, and
+ * refreshes publish a new snapshot atomically.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "aptrepo/packages.hpp"
+#include "aptrepo/release.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * Immutable view of the content of a ReleaseStore.
+     ******************************************************************************/
+    class StoreSnapshot
+    {
+    public:
+        /******************************************************************************
+         * Parsed Releases by InRelease URL.
+         ******************************************************************************/
+        std::map<std::string, std::shared_ptr<const aptrepo::Release>> releases;
+
+        /******************************************************************************
+         * Parsed Packages indexes by URL.
+         ******************************************************************************/
+        std::map<std::string, std::shared_ptr<const aptrepo::Packages>> packages;
+
+        /******************************************************************************
+         * Number of updates published before this snapshot.
+         ******************************************************************************/
+        std::uint64_t generation = 0;
+
+        /******************************************************************************
+         * Find a Release by URL.
+         *
+         * @param url URL of the InRelease file.
+         * @return The Release, or nullptr if it is not stored.
+         ******************************************************************************/
+        std::shared_ptr<const aptrepo::Release> find_release(const std::string &url) const;
+
+        /******************************************************************************
+         * Find a Packages index by URL.
+         *
+         * @param url URL of the Packages index.
+         * @return The Packages index, or nullptr if it is not stored.
+         ******************************************************************************/
+        std::shared_ptr<const aptrepo::Packages> find_packages(const std::string &url) const;
+    };
+
+    /******************************************************************************
+     * ReleaseStore class for concurrent access to parsed repository data.
+     *
+     * Writers are serialized; each update copies the (shallow) snapshot,
+     * modifies the copy and publishes it by bumping a generation counter.
+     * Unmodified Releases and indexes are shared between snapshots.
+     *
+     * Each reader thread caches the snapshot it saw last. As long as the
+     * generation is unchanged, a read is a single atomic load and touches no
+     * shared cache line; only the first read after a publish takes a short
+     * lock to pick up the new snapshot. A cached snapshot is released when
+     * the thread reads the next generation, so old snapshots stay alive
+     * until every reader moved on.
+     ******************************************************************************/
+    class ReleaseStore
+    {
+    public:
+        /******************************************************************************
+         * Constructor for an empty ReleaseStore.
+         ******************************************************************************/
+        ReleaseStore();
+
+        /******************************************************************************
+         * Destructor for ReleaseStore class.
+         ******************************************************************************/
+        ~ReleaseStore();
+
+        ReleaseStore(const ReleaseStore &) = delete;
+        ReleaseStore &operator=(const ReleaseStore &) = delete;
+
+        /******************************************************************************
+         * Get the current snapshot.
+         *
+         * @return The current, immutable snapshot.
+         ******************************************************************************/
+        std::shared_ptr<const StoreSnapshot> snapshot() const;
+
+        /******************************************************************************
+         * Read the current snapshot without taking a reference.
+         *
+         * This avoids the reference count traffic of snapshot() on hot read
+         * paths. The snapshot must not be used after fn returns. fn may read
+         * this or other stores again; while it runs, the cached snapshots of
+         * the thread are left alone and nested reads take a reference.
+         *
+         * @param fn Callable accepting (const StoreSnapshot &).
+         * @return The result of fn.
+         ******************************************************************************/
+        template <typename Fn>
+        decltype(auto) read(Fn &&fn) const
+        {
+            if (ReadScope::active())
+            {
+                auto snapshot = current();
+                return fn(*snapshot);
+            }
+            ReadScope scope;
+            return fn(*cached());
+        }
+
+        /******************************************************************************
+         * Apply an update and publish the result as new snapshot.
+         *
+         * @param update Function modifying a copy of the current snapshot.
+         ******************************************************************************/
+        void update(const std::function<void(StoreSnapshot &)> &update);
+
+        /******************************************************************************
+         * Store a Release under its URL.
+         *
+         * @param release The Release.
+         ******************************************************************************/
+        void publish(aptrepo::Release release);
+
+        /******************************************************************************
+         * Store a Packages index under its URL.
+         *
+         * @param packages The Packages index.
+         ******************************************************************************/
+        void publish(aptrepo::Packages packages);
+
+        /******************************************************************************
+         * Remove a Release.
+         *
+         * @param url URL of the InRelease file.
+         ******************************************************************************/
+        void remove_release(const std::string &url);
+
+        /******************************************************************************
+         * Download and store a Release if it changed upstream.
+         *
+         * The ETag of the stored Release is used to check for changes.
+         *
+         * @param url URL of the InRelease file.
+         * @return True if a new Release was published, false otherwise.
+         ******************************************************************************/
+        bool refresh(const std::string &url);
+
+    private:
+        // Marks a read() of the calling thread, which uses a cached snapshot
+        struct ReadScope
+        {
+            ReadScope();
+            ~ReadScope();
+            ReadScope(const ReadScope &) = delete;
+            ReadScope &operator=(const ReadScope &) = delete;
+            static bool active();
+        };
+
+        const std::shared_ptr<const StoreSnapshot> &cached() const;
+        std::shared_ptr<const StoreSnapshot> current() const;
+
+        const std::uint64_t m_id;
+        std::atomic<std::uint64_t> m_generation;
+        std::shared_ptr<const StoreSnapshot> m_current;
+        mutable std::mutex m_current_mutex;
+        std::mutex m_writer;
+    };
+}
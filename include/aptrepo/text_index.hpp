@@ -0,0 +1,156 @@
+/******************************************************************************
+ * @file text_index.hpp
+ * @brief Header file for aptrepo::TextIndex.
+ *
+ * A aptrepo::TextIndex is an inverted full-text index over the package
+ * descriptions of Packages indexes and, loaded on demand, the translated
+ * descriptions of Translation-<lang> files.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "aptrepo/packages.hpp"
+#include "aptrepo/release.hpp"
+
+namespace aptrepo
+{
+    /******************************************************************************
+     * TextIndex class for ranked full-text search over package descriptions.
+     *
+     * Documents are package names; all descriptions of a package name are
+     * indexed as one document. Posting lists are stored delta and varint
+     * encoded. Results are ranked with BM25. Searches may run concurrently,
+     * also while translations are loaded.
+     ******************************************************************************/
+    class TextIndex
+    {
+    public:
+        /******************************************************************************
+         * Loader for Translation files, returning the parsed Translation-<lang>
+         * stanzas for the requested language.
+         ******************************************************************************/
+        using TranslationLoader = std::function<std::vector<aptrepo::Packages>(const std::string &lang)>;
+
+        /******************************************************************************
+         * Combination of the query terms.
+         ******************************************************************************/
+        enum class Mode
+        {
+            And,
+            Or
+        };
+
+        /******************************************************************************
+         * Search result.
+         ******************************************************************************/
+        struct Result
+        {
+            std::string package;
+            double score;
+        };
+
+        /******************************************************************************
+         * Constructor for TextIndex class.
+         *
+         * The Description fields of all packages are indexed in parallel.
+         *
+         * @param packages Parsed Packages indexes.
+         * @param threads  Number of indexing threads, 0 to use the hardware concurrency.
+         ******************************************************************************/
+        explicit TextIndex(const std::vector<aptrepo::Packages> &packages, std::size_t threads = 0);
+
+        /******************************************************************************
+         * Set the loader for Translation files.
+         *
+         * Translations are only loaded and indexed when a language is first
+         * requested by search or load_translations.
+         *
+         * @param loader The loader function.
+         ******************************************************************************/
+        void set_translation_loader(TranslationLoader loader);
+
+        /******************************************************************************
+         * Load and index the Translation files of a language, unless they are
+         * already loaded.
+         *
+         * @param lang The language.
+         ******************************************************************************/
+        void load_translations(const std::string &lang);
+
+        /******************************************************************************
+         * Search the index.
+         *
+         * @param query Query terms, separated by whitespace or punctuation.
+         * @param mode  Mode::And to require all terms, Mode::Or to require any term.
+         * @param limit Maximum number of results, 0 for no limit.
+         * @param lang  Language of the Translation files to search, empty to
+         *              search the Description fields of the Packages indexes.
+         * @return Results ordered by descending score.
+         ******************************************************************************/
+        std::vector<Result> search(std::string_view query, Mode mode = Mode::And, std::size_t limit = 10, const std::string &lang = "");
+
+        /******************************************************************************
+         * Check if the Translation files of a language are loaded.
+         *
+         * @param lang The language.
+         * @return True if the language is indexed, false otherwise.
+         ******************************************************************************/
+        bool has_language(const std::string &lang) const;
+
+        /******************************************************************************
+         * Create a TranslationLoader which downloads the Translation-<lang>
+         * files of all components listed in a Release.
+         *
+         * A compressed variant listed in the Release is preferred. The
+         * downloaded file is verified against the SHA256 of its Reference;
+         * the loader throws std::runtime_error on a mismatch.
+         *
+         * @param release The release listing the i18n references.
+         * @return The loader function.
+         ******************************************************************************/
+        static TranslationLoader release_translations(const aptrepo::Release &release);
+
+        /******************************************************************************
+         * Split a text into lowercase alphanumeric terms.
+         *
+         * @param text The text.
+         * @return The terms in order of occurrence.
+         ******************************************************************************/
+        static std::vector<std::string> tokenize(std::string_view text);
+
+    private:
+        struct Posting
+        {
+            std::uint32_t doc_frequency = 0;
+            std::string data;
+        };
+
+        struct Segment
+        {
+            std::unordered_map<std::string, Posting> postings;
+            std::vector<std::uint32_t> doc_lengths;
+            double average_length = 0;
+        };
+
+        std::uint32_t get_doc(const std::string &name);
+        Segment build_segment(const std::vector<std::vector<std::string_view>> &texts, std::size_t threads) const;
+
+        std::vector<std::string> m_docs;
+        std::unordered_map<std::string, std::uint32_t> m_doc_ids;
+        // Exclusive while translations are loaded, shared by searches
+        mutable std::shared_mutex m_mutex;
+        std::map<std::string, Segment> m_segments;
+        TranslationLoader m_loader;
+        std::size_t m_threads;
+    };
+}
@@ -0,0 +1,191 @@
+/******************************************************************************
+ * @file watcher.hpp
+ * @brief Header file for aptrepo::Watcher.
+ *
+ * A aptrepo::Watcher polls many InRelease URLs for changes with conditional
+ * requests and reports each change with the differences to the previously
+ * seen version of the Release.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "aptrepo/internal/timer_wheel.hpp"
+#include "aptrepo/diff.hpp"
+#include "aptrepo/keyring.hpp"
+#include "aptrepo/release.hpp"
+
+namespace aptrepo
+{
+    namespace internal
+    {
+        class ConditionalClient;
+    }
+
+    /******************************************************************************
+     * Watcher class polling InRelease URLs for changes.
+     *
+     * The polls are scheduled on a timer wheel; the poll times get a random
+     * jitter, so the URLs don't drift into bursts, and failing URLs are
+     * polled with an exponential backoff. Polls are GET requests with
+     * If-None-Match, sent by a few threads which each keep one connection
+     * open. The ETags are kept in memory and optionally in a state file, with
+     * the last seen InRelease files next to it, so a restarted watcher
+     * doesn't report unchanged releases again and reports changes with the
+     * diff to the version seen before the restart.
+     ******************************************************************************/
+    class Watcher
+    {
+    public:
+        /******************************************************************************
+         * Options for the polling.
+         ******************************************************************************/
+        struct Options
+        {
+            /// Time between two polls of a URL.
+            std::chrono::milliseconds interval = std::chrono::minutes(5);
+            /// Random deviation of the poll times, as fraction of the interval.
+            double jitter = 0.1;
+            /// Longest time between two polls of a failing URL.
+            std::chrono::milliseconds max_backoff = std::chrono::hours(1);
+            /// Maximum time of one request.
+            std::chrono::milliseconds timeout = std::chrono::seconds(30);
+            /// Number of connections, each used by one polling thread.
+            std::size_t connections = 4;
+            /// File to keep the ETags in across restarts, the InRelease files are kept in
+            /// the directory <state>.releases; empty to keep them in memory only.
+            std::filesystem::path state;
+            /// Keyring to verify the InRelease files with, empty to not verify them.
+            std::filesystem::path keyring;
+            /// Resolution of the timer wheel.
+            std::chrono::milliseconds tick = std::chrono::milliseconds(100);
+        };
+
+        /******************************************************************************
+         * A changed Release.
+         ******************************************************************************/
+        struct Event
+        {
+            /// URL of the InRelease file.
+            std::string url;
+            /// The new version of the Release.
+            std::shared_ptr<const aptrepo::Release> release;
+            /// Differences to the previous version.
+            aptrepo::ReleaseDiff diff;
+            /// True if no previous version was known, all references are added.
+            bool first = false;
+        };
+
+        /******************************************************************************
+         * Counters of the polls.
+         ******************************************************************************/
+        struct Statistics
+        {
+            std::size_t polls = 0;
+            std::size_t unchanged = 0;
+            std::size_t changed = 0;
+            std::size_t failed = 0;
+        };
+
+        /// Receiver of the change events, called by one thread at a time.
+        using Callback = std::function<void(const Event &event)>;
+
+        /******************************************************************************
+         * Constructor for Watcher class.
+         *
+         * @param callback Receiver of the change events.
+         * @param options  Options for the polling.
+         ******************************************************************************/
+        Watcher(Callback callback, Options options);
+
+        /******************************************************************************
+         * Constructor for Watcher class using default options.
+         *
+         * @param callback Receiver of the change events.
+         ******************************************************************************/
+        explicit Watcher(Callback callback);
+
+        /******************************************************************************
+         * Add a URL to watch, also while the watcher is running.
+         *
+         * The first poll is within the jitter of the interval.
+         *
+         * @param url URL of an InRelease file.
+         ******************************************************************************/
+        void add(const std::string &url);
+
+        /******************************************************************************
+         * Get the number of watched URLs.
+         *
+         * @return Number of URLs.
+         ******************************************************************************/
+        std::size_t size() const;
+
+        /******************************************************************************
+         * Poll the URLs until stop is called.
+         ******************************************************************************/
+        void run();
+
+        /******************************************************************************
+         * Stop polling, run returns after the running polls finished.
+         ******************************************************************************/
+        void stop();
+
+        /******************************************************************************
+         * Get the counters of the polls.
+         *
+         * @return The counters.
+         ******************************************************************************/
+        Statistics get_statistics() const;
+
+    private:
+        struct Entry
+        {
+            std::string url;
+            std::string etag;
+            // SHA-256 of the content, for servers which send no ETag
+            std::string digest;
+            std::shared_ptr<const aptrepo::Release> release;
+            std::size_t failures = 0;
+        };
+
+        void work();
+        void poll(aptrepo::internal::ConditionalClient &client, std::size_t id);
+        std::chrono::milliseconds next_delay(std::size_t failures);
+        void load_state();
+        void save_state();
+        std::filesystem::path release_path(const std::string &url) const;
+        std::shared_ptr<const aptrepo::Release> load_release(const std::string &url, const std::string &etag) const;
+        void save_release(const aptrepo::internal::Download &download) const;
+
+        Callback m_callback;
+        Options m_options;
+        std::shared_ptr<const aptrepo::Keyring> m_keyring;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_work;
+        std::condition_variable m_stopped;
+        bool m_stop = false;
+        std::vector<Entry> m_entries;
+        std::map<std::string, std::string> m_saved_etags;
+        std::deque<std::size_t> m_queue;
+        aptrepo::internal::TimerWheel m_wheel;
+        std::mt19937_64 m_random;
+        Statistics m_statistics;
+
+        std::mutex m_callback_mutex;
+        std::mutex m_state_mutex;
+    };
+}
@@ -1,7 +1,18 @@
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
 #include <spdlog/spdlog.h>
 
+#include "aptrepo/internal/deb.hpp"
+#include "aptrepo/internal/decompress.hpp"
 #include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/utils.hpp"
 #include "aptrepo/release.hpp"
+#include "aptrepo/packages.hpp"
 
 #include "aptrepo/aptrepo.hpp"
 
@@ -13,3 +24,104 @@ aptrepo::Release aptrepo::parse_release(std::string url)
 
     return Release(dl);
 }
+
+aptrepo::Release aptrepo::parse_release(std::string url, const Keyring &keyring)
+{
+    spdlog::info("Parsing and verifying release from URL: {}", url);
+
+    auto dl = aptrepo::internal::download(url);
+
+    return Release(dl, keyring);
+}
+
+aptrepo::Packages aptrepo::parse_packages(std::string url)
+{
+    spdlog::info("Parsing packages from URL: {}", url);
+
+    auto dl = aptrepo::internal::download(url);
+
+    return Packages(dl);
+}
+
+void aptrepo::download_reference(const Reference &reference, const std::filesystem::path &path,
+                                 std::size_t segments, const std::vector<std::string> &mirrors)
+{
+    spdlog::info("Downloading {} to {}", reference.get_path(), path.string());
+
+    // Reference paths are relative to dists/<suite>, mirrors are repository
+    // roots; flat repositories have no dists directory
+    auto url = reference.get_url();
+    auto base = url.substr(0, url.size() - reference.get_path().size());
+    auto dists = base.rfind("/dists/");
+    auto relative = dists == std::string::npos ? reference.get_path() : base.substr(dists + 1) + reference.get_path();
+
+    std::vector<std::string> urls = {url};
+    for (auto mirror : mirrors)
+    {
+        while (mirror.ends_with('/'))
+        {
+            mirror.pop_back();
+        }
+        urls.push_back(mirror + "/" + relative);
+    }
+
+    auto digest = aptrepo::internal::download_segments(urls, path, reference.get_size(), segments);
+
+    auto expected = reference.get_hash("SHA256");
+    if (std::filesystem::file_size(path) != reference.get_size() ||
+        (!expected.empty() && aptrepo::internal::bytes_to_hex(digest) != expected))
+    {
+        spdlog::error("Verification of {} failed.", reference.get_path());
+        std::filesystem::remove(path);
+        throw std::runtime_error("Verification failed");
+    }
+}
+
+aptrepo::Deb aptrepo::inspect_deb(std::string url)
+{
+    spdlog::info("Inspecting .deb: {}", url);
+
+    std::string name;
+    auto member = aptrepo::internal::read_deb_control(url, name);
+    return Deb(std::move(url), aptrepo::internal::decompress(member, name));
+}
+
+std::vector<std::optional<aptrepo::Deb>> aptrepo::inspect_debs(const std::vector<std::string> &urls, std::size_t jobs)
+{
+    std::vector<std::optional<Deb>> results(urls.size());
+    std::atomic<std::size_t> next = 0;
+    auto worker = [&]()
+    {
+        for (auto i = next++; i < urls.size(); i = next++)
+        {
+            try
+            {
+                results[i] = inspect_deb(urls[i]);
+                if (aptrepo::internal::metrics_enabled())
+                {
+                    aptrepo::internal::count("aptrepo_deb_inspections_total", 1, {{"result", "ok"}});
+                }
+            }
+            catch (const std::exception &e)
+            {
+                spdlog::warn("Failed to inspect {}: {}", urls[i], e.what());
+                if (aptrepo::internal::metrics_enabled())
+                {
+                    aptrepo::internal::count("aptrepo_deb_inspections_total", 1, {{"result", "failed"}});
+                }
+            }
+        }
+    };
+
+    {
+        auto count = std::clamp<std::size_t>(jobs, 1, std::max<std::size_t>(urls.size(), 1));
+        std::vector<std::jthread> workers;
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            workers.emplace_back(worker);
+        }
+        worker();
+    }
+
+    return results;
+}
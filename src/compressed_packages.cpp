@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#ifdef APTREPO_HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+#include "aptrepo/compressed_packages.hpp"
+
+struct aptrepo::CompressedPackages::Codec
+{
+#ifdef APTREPO_HAVE_ZSTD
+    std::unique_ptr<ZSTD_DDict, decltype(&ZSTD_freeDDict)> dictionary{nullptr, ZSTD_freeDDict};
+#endif
+};
+
+namespace
+{
+    /// zlib uses at most the last 32 KiB of a preset dictionary.
+    constexpr std::size_t max_dictionary_size = 32 * 1024;
+    /// Number of stanzas sampled to build the dictionary.
+    constexpr std::size_t dictionary_samples = 4096;
+
+    /******************************************************************************
+     * Build a preset dictionary from the lines which occur most often in the
+     * stanzas, e.g. common Maintainer, Priority or Depends lines. zlib finds
+     * matches at the end of the dictionary with the shortest distances, so
+     * the most valuable lines are placed last.
+     ******************************************************************************/
+    std::string build_dictionary(const std::vector<std::string> &stanzas, std::size_t size)
+    {
+        std::unordered_map<std::string_view, std::size_t> counts;
+        auto step = std::max<std::size_t>(stanzas.size() / dictionary_samples, 1);
+        for (std::size_t i = 0; i < stanzas.size(); i += step)
+        {
+            std::string_view text = stanzas[i];
+            std::size_t pos = 0;
+            while (pos < text.size())
+            {
+                auto end = std::min(text.find('\n', pos), text.size() - 1);
+                counts[text.substr(pos, end - pos + 1)]++;
+                pos = end + 1;
+            }
+        }
+
+        std::vector<std::pair<std::size_t, std::string_view>> lines;
+        for (const auto &[line, count] : counts)
+        {
+            // Unique lines like hashes and filenames do not help
+            if (count > 1)
+            {
+                lines.emplace_back(count * line.size(), line);
+            }
+        }
+        std::sort(lines.begin(), lines.end(), std::greater<>());
+
+        std::vector<std::string_view> selected;
+        std::size_t total = 0;
+        for (const auto &[score, line] : lines)
+        {
+            if (total + line.size() > size)
+            {
+                continue;
+            }
+            selected.push_back(line);
+            total += line.size();
+        }
+
+        std::string dictionary;
+        dictionary.reserve(total);
+        for (auto line = selected.rbegin(); line != selected.rend(); ++line)
+        {
+            dictionary += *line;
+        }
+        return dictionary;
+    }
+
+#ifdef APTREPO_HAVE_ZSTD
+    /// Compression level of the blocks; higher levels gain little on small blocks but take much longer.
+    constexpr int zstd_level = 3;
+    /// Training data per byte of dictionary, the size zstd recommends.
+    constexpr std::size_t training_ratio = 100;
+
+    /******************************************************************************
+     * Train a zstd dictionary on a sample of the stanzas. Small indexes don't
+     * give enough samples to train on; they get the frequent lines instead,
+     * which zstd uses as a raw content dictionary.
+     ******************************************************************************/
+    std::string train_dictionary(const std::vector<std::string> &stanzas, std::size_t size)
+    {
+        if (size == 0)
+        {
+            return {};
+        }
+
+        std::string samples;
+        std::vector<std::size_t> sample_sizes;
+        auto step = std::max<std::size_t>(stanzas.size() / dictionary_samples, 1);
+        for (std::size_t i = 0; i < stanzas.size() && samples.size() < size * training_ratio; i += step)
+        {
+            samples += stanzas[i];
+            sample_sizes.push_back(stanzas[i].size());
+        }
+
+        std::string dictionary(size, '\0');
+        auto trained = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples.data(),
+                                             sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()));
+        if (ZDICT_isError(trained))
+        {
+            SPDLOG_DEBUG("CompressedPackages: Dictionary training failed: {}", ZDICT_getErrorName(trained));
+            return build_dictionary(stanzas, size);
+        }
+        dictionary.resize(trained);
+        return dictionary;
+    }
+
+    std::string zstd_block(ZSTD_CCtx *context, std::string_view data)
+    {
+        std::string result(ZSTD_compressBound(data.size()), '\0');
+        auto size = ZSTD_compress2(context, result.data(), result.size(), data.data(), data.size());
+        if (ZSTD_isError(size))
+        {
+            throw std::runtime_error("Failed to compress block");
+        }
+        result.resize(size);
+        result.shrink_to_fit();
+        return result;
+    }
+
+    std::string unzstd_block(std::string_view data, std::size_t size, const ZSTD_DDict *dictionary)
+    {
+        // Decoding contexts are expensive to create and are reused per thread
+        thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        if (!context)
+        {
+            throw std::runtime_error("Failed to initialize block decompression");
+        }
+
+        std::string result(size, '\0');
+        auto decoded = dictionary ? ZSTD_decompress_usingDDict(context.get(), result.data(), result.size(), data.data(), data.size(), dictionary)
+                                  : ZSTD_decompressDCtx(context.get(), result.data(), result.size(), data.data(), data.size());
+        if (ZSTD_isError(decoded) || decoded != size)
+        {
+            throw std::runtime_error("Failed to decompress block");
+        }
+        return result;
+    }
+#else
+    std::string deflate_block(z_stream &stream, std::string_view data, const std::string &dictionary)
+    {
+        deflateReset(&stream);
+        if (!dictionary.empty())
+        {
+            deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.data()), static_cast<uInt>(dictionary.size()));
+        }
+
+        std::string result(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = reinterpret_cast<Bytef *>(result.data());
+        stream.avail_out = static_cast<uInt>(result.size());
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+        {
+            throw std::runtime_error("Failed to compress block");
+        }
+        result.resize(result.size() - stream.avail_out);
+        result.shrink_to_fit();
+        return result;
+    }
+
+    std::string inflate_block(std::string_view data, std::size_t size, const std::string &dictionary)
+    {
+        z_stream stream{};
+        // Raw deflate: blocks need no header or checksum
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+        {
+            throw std::runtime_error("Failed to initialize block decompression");
+        }
+        if (!dictionary.empty())
+        {
+            inflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.data()), static_cast<uInt>(dictionary.size()));
+        }
+
+        std::string result(size, '\0');
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = reinterpret_cast<Bytef *>(result.data());
+        stream.avail_out = static_cast<uInt>(result.size());
+        auto status = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        if (status != Z_STREAM_END || stream.avail_out != 0)
+        {
+            throw std::runtime_error("Failed to decompress block");
+        }
+        return result;
+    }
+#endif
+}
+
+aptrepo::CompressedPackages::CompressedPackages(const aptrepo::Packages &packages, Options options)
+    : m_options(std::move(options)), m_url(packages.get_url())
+{
+    const auto &list = packages.get_packages();
+    std::vector<std::string> stanzas;
+    stanzas.reserve(list.size());
+    for (const auto &package : list)
+    {
+        stanzas.push_back(static_cast<std::string>(package));
+    }
+
+    m_codec = std::make_unique<Codec>();
+#ifdef APTREPO_HAVE_ZSTD
+    m_dictionary = train_dictionary(stanzas, m_options.dictionary_size);
+
+    std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    std::unique_ptr<ZSTD_CDict, decltype(&ZSTD_freeCDict)> compression_dictionary(nullptr, ZSTD_freeCDict);
+    if (!context)
+    {
+        throw std::runtime_error("Failed to initialize block compression");
+    }
+    // Sizes are stored with the blocks, so the frame header is kept minimal
+    ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, zstd_level);
+    ZSTD_CCtx_setParameter(context.get(), ZSTD_c_contentSizeFlag, 0);
+    ZSTD_CCtx_setParameter(context.get(), ZSTD_c_dictIDFlag, 0);
+    if (!m_dictionary.empty())
+    {
+        compression_dictionary.reset(ZSTD_createCDict(m_dictionary.data(), m_dictionary.size(), zstd_level));
+        m_codec->dictionary.reset(ZSTD_createDDict(m_dictionary.data(), m_dictionary.size()));
+        if (!compression_dictionary || !m_codec->dictionary)
+        {
+            throw std::runtime_error("Failed to load block dictionary");
+        }
+        ZSTD_CCtx_refCDict(context.get(), compression_dictionary.get());
+    }
+    auto compress = [&](std::string_view data)
+    { return zstd_block(context.get(), data); };
+#else
+    m_dictionary = build_dictionary(stanzas, std::min(m_options.dictionary_size, max_dictionary_size));
+
+    std::unique_ptr<z_stream, void (*)(z_stream *)> stream(new z_stream{}, [](z_stream *stream)
+                                                           { deflateEnd(stream); delete stream; });
+    if (deflateInit2(stream.get(), Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("Failed to initialize block compression");
+    }
+    auto compress = [&](std::string_view data)
+    { return deflate_block(*stream, data, m_dictionary); };
+#endif
+
+    std::string block;
+    auto flush = [&]()
+    {
+        if (!block.empty())
+        {
+            m_blocks.push_back(compress(block));
+            m_block_sizes.push_back(static_cast<std::uint32_t>(block.size()));
+            block.clear();
+        }
+    };
+
+    m_entries.reserve(stanzas.size());
+    for (std::size_t i = 0; i < stanzas.size(); ++i)
+    {
+        // Stanzas are not split, a large stanza gets a block of its own
+        if (!block.empty() && block.size() + stanzas[i].size() > m_options.block_size)
+        {
+            flush();
+        }
+        const auto &name = list[i].get_name();
+        m_entries.push_back({static_cast<std::uint32_t>(m_blocks.size()), static_cast<std::uint32_t>(block.size()),
+                             static_cast<std::uint32_t>(stanzas[i].size()), static_cast<std::uint32_t>(m_names.size())});
+        block += stanzas[i];
+        m_names += name;
+        m_names += '\n';
+    }
+    flush();
+    m_names.shrink_to_fit();
+#ifdef APTREPO_HAVE_ZSTD
+    // The digested dictionary keeps its own copy
+    m_dictionary.clear();
+    m_dictionary.shrink_to_fit();
+#endif
+
+    m_sorted.resize(m_entries.size());
+    for (std::uint32_t i = 0; i < m_sorted.size(); ++i)
+    {
+        m_sorted[i] = i;
+    }
+    std::stable_sort(m_sorted.begin(), m_sorted.end(), [this](std::uint32_t a, std::uint32_t b)
+                     { return name(a) < name(b); });
+
+    auto statistics = get_statistics();
+    spdlog::info("CompressedPackages: Stored {} packages of {} in {} blocks, {} of {} bytes",
+                 m_entries.size(), m_url, statistics.blocks, statistics.compressed_bytes, statistics.uncompressed_bytes);
+}
+
+aptrepo::CompressedPackages::CompressedPackages(const aptrepo::Packages &packages)
+    : CompressedPackages(packages, Options())
+{
+}
+
+aptrepo::CompressedPackages::~CompressedPackages() = default;
+
+std::string aptrepo::CompressedPackages::get_url() const
+{
+    return m_url;
+}
+
+std::size_t aptrepo::CompressedPackages::size() const
+{
+    return m_entries.size();
+}
+
+std::string_view aptrepo::CompressedPackages::name(std::uint32_t entry) const
+{
+    auto offset = m_entries[entry].name_offset;
+    return std::string_view(m_names).substr(offset, m_names.find('\n', offset) - offset);
+}
+
+std::shared_ptr<const std::string> aptrepo::CompressedPackages::block(std::size_t index) const
+{
+    {
+        std::lock_guard lock(m_mutex);
+        if (auto search = m_cache.find(index); search != m_cache.end())
+        {
+            m_hits++;
+            m_lru.splice(m_lru.begin(), m_lru, search->second);
+            return search->second->second;
+        }
+        m_misses++;
+    }
+
+    // Decode without the lock, so misses of other threads are not serialized
+#ifdef APTREPO_HAVE_ZSTD
+    auto decoded = std::make_shared<const std::string>(unzstd_block(m_blocks[index], m_block_sizes[index], m_codec->dictionary.get()));
+#else
+    auto decoded = std::make_shared<const std::string>(inflate_block(m_blocks[index], m_block_sizes[index], m_dictionary));
+#endif
+    if (m_options.cache_blocks == 0)
+    {
+        return decoded;
+    }
+
+    std::lock_guard lock(m_mutex);
+    if (auto search = m_cache.find(index); search != m_cache.end())
+    {
+        // Decoded concurrently by another thread
+        return search->second->second;
+    }
+    m_lru.emplace_front(index, decoded);
+    m_cache[index] = m_lru.begin();
+    if (m_lru.size() > m_options.cache_blocks)
+    {
+        m_cache.erase(m_lru.back().first);
+        m_lru.pop_back();
+    }
+    return decoded;
+}
+
+aptrepo::Package aptrepo::CompressedPackages::get(std::size_t index) const
+{
+    const auto &entry = m_entries.at(index);
+    auto decoded = block(entry.block);
+    return aptrepo::Package(std::string_view(*decoded).substr(entry.offset, entry.length));
+}
+
+std::optional<aptrepo::Package> aptrepo::CompressedPackages::find(std::string_view package) const
+{
+    auto search = std::lower_bound(m_sorted.begin(), m_sorted.end(), package, [this](std::uint32_t entry, std::string_view value)
+                                   { return name(entry) < value; });
+    if (search == m_sorted.end() || name(*search) != package)
+    {
+        return std::nullopt;
+    }
+    return get(*search);
+}
+
+aptrepo::CompressedPackages::Statistics aptrepo::CompressedPackages::get_statistics() const
+{
+    Statistics statistics;
+#ifdef APTREPO_HAVE_ZSTD
+    statistics.compression = "zstd";
+#else
+    statistics.compression = "deflate";
+#endif
+    statistics.blocks = m_blocks.size();
+    for (std::size_t i = 0; i < m_blocks.size(); ++i)
+    {
+        statistics.compressed_bytes += m_blocks[i].size();
+        statistics.uncompressed_bytes += m_block_sizes[i];
+    }
+    statistics.dictionary_bytes = m_dictionary.size();
+#ifdef APTREPO_HAVE_ZSTD
+    statistics.dictionary_bytes += ZSTD_sizeof_DDict(m_codec->dictionary.get());
+#endif
+    statistics.index_bytes = m_entries.size() * sizeof(Entry) + m_sorted.size() * sizeof(std::uint32_t) + m_names.size() +
+                             m_blocks.size() * (sizeof(std::string) + sizeof(std::uint32_t));
+
+    std::lock_guard lock(m_mutex);
+    statistics.cache_hits = m_hits;
+    statistics.cache_misses = m_misses;
+    return statistics;
+}
+
+std::size_t aptrepo::CompressedPackages::get_memory_usage() const
+{
+    auto statistics = get_statistics();
+    return statistics.compressed_bytes + statistics.dictionary_bytes + statistics.index_bytes;
+}
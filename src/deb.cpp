@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/internal/deb.hpp"
+
+#include "aptrepo/deb.hpp"
+
+namespace
+{
+    constexpr std::string_view ar_magic = "!<arch>\n";
+    constexpr std::size_t ar_header_size = 60;
+    constexpr std::size_t tar_block_size = 512;
+    /// Size of the first range request; covers the control member of most packages.
+    constexpr std::size_t probe_size = 64 * 1024;
+
+    std::size_t parse_number(std::string_view field, int base)
+    {
+        std::size_t result = 0;
+        bool digits = false;
+        for (auto c : field)
+        {
+            if (c == ' ' || c == '\0')
+            {
+                if (digits)
+                {
+                    break;
+                }
+                continue;
+            }
+            if (c < '0' || c >= '0' + base)
+            {
+                throw std::runtime_error("Invalid number in archive header");
+            }
+            auto digit = static_cast<std::size_t>(c - '0');
+            if (result > (std::numeric_limits<std::size_t>::max() - digit) / static_cast<std::size_t>(base))
+            {
+                throw std::runtime_error("Number too large in archive header");
+            }
+            result = result * static_cast<std::size_t>(base) + digit;
+            digits = true;
+        }
+        return result;
+    }
+
+    std::size_t parse_tar_size(std::string_view field)
+    {
+        if (static_cast<unsigned char>(field[0]) & 0x80)
+        {
+            // GNU base-256 encoding of large sizes
+            std::size_t result = static_cast<unsigned char>(field[0]) & 0x7f;
+            for (auto c : field.substr(1))
+            {
+                if (result > (std::numeric_limits<std::size_t>::max() >> 8))
+                {
+                    throw std::runtime_error("Number too large in archive header");
+                }
+                result = (result << 8) | static_cast<unsigned char>(c);
+            }
+            return result;
+        }
+        return parse_number(field, 8);
+    }
+
+    std::string_view c_string(std::string_view field)
+    {
+        return field.substr(0, field.find('\0'));
+    }
+
+    std::string normalize(std::string_view name)
+    {
+        while (name.starts_with("./"))
+        {
+            name.remove_prefix(2);
+        }
+        while (name.ends_with('/'))
+        {
+            name.remove_suffix(1);
+        }
+        return std::string(name == "." ? std::string_view() : name);
+    }
+
+    bool is_local(const std::string &source)
+    {
+        return source.starts_with("file://") || source.find("://") == std::string::npos;
+    }
+
+    /******************************************************************************
+     * Random access to the bytes of a .deb file, memory mapped for local files
+     * and read with range requests for remote files.
+     ******************************************************************************/
+    class DebReader
+    {
+    public:
+        explicit DebReader(const std::string &source)
+            : m_url(source)
+        {
+            if (!is_local(source))
+            {
+                return;
+            }
+
+            auto path = source.starts_with("file://") ? source.substr(7) : source;
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat info = {};
+            if (fd < 0 || ::fstat(fd, &info) < 0)
+            {
+                auto error = std::strerror(errno);
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+                spdlog::error("Failed to open {}: {}", path, error);
+                throw std::runtime_error("Failed to open .deb file");
+            }
+
+            m_map_size = static_cast<std::size_t>(info.st_size);
+            if (m_map_size > 0)
+            {
+                m_map = ::mmap(nullptr, m_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            ::close(fd);
+            if (m_map == MAP_FAILED)
+            {
+                m_map = nullptr;
+                spdlog::error("Failed to map {}: {}", path, std::strerror(errno));
+                throw std::runtime_error("Failed to open .deb file");
+            }
+        }
+
+        ~DebReader()
+        {
+            if (m_map)
+            {
+                ::munmap(m_map, m_map_size);
+            }
+        }
+
+        DebReader(const DebReader &) = delete;
+        DebReader &operator=(const DebReader &) = delete;
+
+        std::string_view read(std::size_t begin, std::size_t end)
+        {
+            if (is_local(m_url))
+            {
+                if (end > m_map_size)
+                {
+                    throw std::runtime_error("Truncated .deb file");
+                }
+                return std::string_view(static_cast<const char *>(m_map) + begin, end - begin);
+            }
+
+            if (end > m_buffer.size())
+            {
+                // Only the first request reads ahead, later ones fetch exactly what is missing
+                auto fetch_end = m_buffer.empty() ? std::max(end, probe_size) : end;
+                m_buffer += aptrepo::internal::download_range(m_url, m_buffer.size(), fetch_end);
+                if (end > m_buffer.size())
+                {
+                    throw std::runtime_error("Truncated .deb file");
+                }
+            }
+            return std::string_view(m_buffer).substr(begin, end - begin);
+        }
+
+    private:
+        std::string m_url;
+        void *m_map = nullptr;
+        std::size_t m_map_size = 0;
+        std::string m_buffer;
+    };
+}
+
+aptrepo::internal::ArMember aptrepo::internal::parse_ar_header(std::string_view header, std::size_t offset)
+{
+    if (header.size() < ar_header_size || header.substr(58, 2) != "`\n")
+    {
+        throw std::runtime_error("Invalid ar member header");
+    }
+
+    ArMember member;
+    auto name = header.substr(0, 16);
+    name = name.substr(0, name.find_last_not_of(' ') + 1);
+    // GNU ar terminates names with a slash
+    if (name.ends_with('/'))
+    {
+        name.remove_suffix(1);
+    }
+    member.name = std::string(name);
+    member.offset = offset + ar_header_size;
+    member.size = parse_number(header.substr(48, 10), 10);
+    return member;
+}
+
+void aptrepo::internal::read_tar(std::string_view data, const std::function<void(const aptrepo::internal::TarEntry &)> &callback)
+{
+    std::string long_name;
+    std::size_t offset = 0;
+
+    while (offset + tar_block_size <= data.size())
+    {
+        auto header = data.substr(offset, tar_block_size);
+        if (header.find_first_not_of('\0') == std::string_view::npos)
+        {
+            // End of archive
+            break;
+        }
+
+        // The checksum is computed with the checksum field set to spaces
+        std::size_t checksum = 0;
+        for (std::size_t i = 0; i < tar_block_size; ++i)
+        {
+            checksum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(header[i]);
+        }
+        if (checksum != parse_number(header.substr(148, 8), 8))
+        {
+            throw std::runtime_error("Invalid tar header checksum");
+        }
+
+        auto size = parse_tar_size(header.substr(124, 12));
+        auto type = header[156];
+        offset += tar_block_size;
+        // Written so untrusted sizes can't overflow: offset <= data.size() here
+        if (size > data.size() - offset)
+        {
+            throw std::runtime_error("Truncated tar archive");
+        }
+        auto content = data.substr(offset, size);
+        offset += (size + tar_block_size - 1) / tar_block_size * tar_block_size;
+
+        if (type == 'L')
+        {
+            long_name = std::string(c_string(content));
+            continue;
+        }
+        if (type == 'x')
+        {
+            // Pax records: "<length> <key>=<value>\n"
+            std::size_t pos = 0;
+            while (pos < content.size())
+            {
+                auto space = content.find(' ', pos);
+                if (space == std::string_view::npos)
+                {
+                    break;
+                }
+                // The length covers the digits, the space, the record and the newline
+                auto length = parse_number(content.substr(pos, space - pos), 10);
+                if (length < space - pos + 2 || length > content.size() - pos)
+                {
+                    break;
+                }
+                auto record = content.substr(space + 1, pos + length - space - 2);
+                if (record.starts_with("path="))
+                {
+                    long_name = std::string(record.substr(5));
+                }
+                pos += length;
+            }
+            continue;
+        }
+        if (type == 'g')
+        {
+            continue;
+        }
+
+        TarEntry entry;
+        if (!long_name.empty())
+        {
+            entry.name = normalize(long_name);
+            long_name.clear();
+        }
+        else
+        {
+            auto name = std::string(c_string(header.substr(0, 100)));
+            auto prefix = c_string(header.substr(345, 155));
+            if (header.substr(257, 5) == "ustar" && !prefix.empty())
+            {
+                name = std::string(prefix) + "/" + name;
+            }
+            entry.name = normalize(name);
+        }
+        entry.type = type == '\0' ? '0' : type;
+        entry.content = content;
+        callback(entry);
+    }
+}
+
+std::string aptrepo::internal::read_deb_control(const std::string &source, std::string &name)
+{
+    SPDLOG_DEBUG("Reading control member of {}", source);
+
+    DebReader reader(source);
+    if (reader.read(0, ar_magic.size()) != ar_magic)
+    {
+        spdlog::error("Not a .deb file: {}", source);
+        throw std::runtime_error("Invalid .deb file");
+    }
+
+    std::size_t offset = ar_magic.size();
+    while (true)
+    {
+        auto member = parse_ar_header(reader.read(offset, offset + ar_header_size), offset);
+        if (member.name.starts_with("control.tar"))
+        {
+            name = member.name;
+            return std::string(reader.read(member.offset, member.offset + member.size));
+        }
+        if (member.name.starts_with("data.tar"))
+        {
+            break;
+        }
+        // Members are aligned to 2 bytes
+        offset = member.offset + member.size + member.size % 2;
+    }
+
+    spdlog::error("No control member in {}", source);
+    throw std::runtime_error("Invalid .deb file");
+}
+
+aptrepo::Deb::Deb(std::string url, std::string_view control_tar)
+    : m_url(std::move(url))
+{
+    aptrepo::internal::read_tar(control_tar, [this](const aptrepo::internal::TarEntry &entry)
+                                {
+                                    if (entry.type == '0' && !entry.name.empty())
+                                    {
+                                        m_control_files.emplace(entry.name, std::string(entry.content));
+                                    } });
+
+    auto control = aptrepo::Packages(aptrepo::internal::Download(m_url, "", get_control_file("control")));
+    if (control.get_packages().empty())
+    {
+        spdlog::error("No control file in {}", m_url);
+        throw std::runtime_error("Invalid .deb file");
+    }
+    m_control = control.get_packages().front();
+
+    // md5sums lines: "<md5>  <path relative to />"
+    auto md5sums = get_control_file("md5sums");
+    std::size_t pos = 0;
+    while (pos < md5sums.size())
+    {
+        auto end = md5sums.find('\n', pos);
+        auto line = std::string_view(md5sums).substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end == std::string::npos ? md5sums.size() : end + 1;
+
+        auto space = line.find(' ');
+        auto start = line.find_first_not_of(' ', space);
+        if (space == std::string_view::npos || start == std::string_view::npos)
+        {
+            continue;
+        }
+        auto path = line.substr(start);
+        m_files.push_back({path.starts_with('/') ? std::string(path) : "/" + std::string(path), std::string(line.substr(0, space))});
+    }
+}
+
+std::string aptrepo::Deb::get_url() const
+{
+    return m_url;
+}
+
+const aptrepo::Package &aptrepo::Deb::get_control() const
+{
+    return m_control;
+}
+
+std::vector<std::string> aptrepo::Deb::get_control_files() const
+{
+    std::vector<std::string> names;
+    for (const auto &[name, content] : m_control_files)
+    {
+        names.push_back(name);
+    }
+    return names;
+}
+
+std::string aptrepo::Deb::get_control_file(const std::string &name) const
+{
+    if (auto search = m_control_files.find(name); search != m_control_files.end())
+    {
+        return search->second;
+    }
+    return {};
+}
+
+const std::vector<aptrepo::DebFile> &aptrepo::Deb::get_files() const
+{
+    return m_files;
+}
+
+std::vector<std::string> aptrepo::Deb::get_conffiles() const
+{
+    std::vector<std::string> conffiles;
+    auto content = get_control_file("conffiles");
+    std::size_t pos = 0;
+    while (pos < content.size())
+    {
+        auto end = content.find('\n', pos);
+        auto line = aptrepo::internal::trim(content.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+        pos = end == std::string::npos ? content.size() : end + 1;
+        // Newer dpkg may prefix entries with flags like "remove-on-upgrade"
+        auto slash = line.find('/');
+        if (slash != std::string::npos)
+        {
+            conffiles.push_back(line.substr(slash));
+        }
+    }
+    return conffiles;
+}
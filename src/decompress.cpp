@@ -0,0 +1,545 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <lzma.h>
+#include <zlib.h>
+#ifdef APTREPO_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "aptrepo/internal/decompress.hpp"
+
+namespace
+{
+    std::string gunzip(std::string_view data)
+    {
+        z_stream stream{};
+        // 16 + MAX_WBITS: expect a gzip header
+        if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+        {
+            throw std::runtime_error("Failed to initialize gzip decompression");
+        }
+
+        std::string result;
+        char buffer[64 * 1024];
+
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+
+        int status = Z_OK;
+        while (true)
+        {
+            stream.next_out = reinterpret_cast<Bytef *>(buffer);
+            stream.avail_out = sizeof(buffer);
+            status = inflate(&stream, Z_NO_FLUSH);
+            result.append(buffer, sizeof(buffer) - stream.avail_out);
+
+            if (status == Z_STREAM_END)
+            {
+                if (stream.avail_in == 0)
+                {
+                    break;
+                }
+                // Multi-member gzip file, continue with the next member
+                inflateReset(&stream);
+                continue;
+            }
+            if (status != Z_OK)
+            {
+                inflateEnd(&stream);
+                throw std::runtime_error("Failed to decompress gzip data");
+            }
+        }
+
+        inflateEnd(&stream);
+        return result;
+    }
+
+    std::string unxz(std::string_view data)
+    {
+        lzma_stream stream = LZMA_STREAM_INIT;
+        // Concatenated: like xz(1), decode all streams of the file
+        if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+        {
+            throw std::runtime_error("Failed to initialize xz decompression");
+        }
+
+        std::string result;
+        char buffer[64 * 1024];
+
+        stream.next_in = reinterpret_cast<const std::uint8_t *>(data.data());
+        stream.avail_in = data.size();
+
+        while (true)
+        {
+            stream.next_out = reinterpret_cast<std::uint8_t *>(buffer);
+            stream.avail_out = sizeof(buffer);
+            auto status = lzma_code(&stream, LZMA_FINISH);
+            result.append(buffer, sizeof(buffer) - stream.avail_out);
+
+            if (status == LZMA_STREAM_END)
+            {
+                break;
+            }
+            if (status != LZMA_OK)
+            {
+                lzma_end(&stream);
+                throw std::runtime_error("Failed to decompress xz data");
+            }
+        }
+
+        lzma_end(&stream);
+        return result;
+    }
+
+#ifdef APTREPO_HAVE_ZSTD
+    std::string unzstd(std::string_view data)
+    {
+        std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> stream(ZSTD_createDStream(), ZSTD_freeDStream);
+        if (!stream || ZSTD_isError(ZSTD_initDStream(stream.get())))
+        {
+            throw std::runtime_error("Failed to initialize zstd decompression");
+        }
+
+        std::string result;
+        std::vector<char> buffer(ZSTD_DStreamOutSize());
+
+        ZSTD_inBuffer input{data.data(), data.size(), 0};
+        std::size_t status = 0;
+        while (true)
+        {
+            ZSTD_outBuffer output{buffer.data(), buffer.size(), 0};
+            status = ZSTD_decompressStream(stream.get(), &output, &input);
+            if (ZSTD_isError(status))
+            {
+                throw std::runtime_error("Failed to decompress zstd data");
+            }
+            result.append(buffer.data(), output.pos);
+
+            // Done when all input is consumed and the last frame is complete
+            if (input.pos == input.size && output.pos < output.size)
+            {
+                break;
+            }
+        }
+
+        if (status != 0)
+        {
+            throw std::runtime_error("Failed to decompress zstd data: truncated");
+        }
+        return result;
+    }
+#endif
+
+    /// Largest stated block size decoded into a buffer of that size.
+    constexpr std::uint64_t max_block_size = 256 * 1024 * 1024;
+    /// Largest stated ratio of decoded to compressed size of a block.
+    constexpr std::uint64_t max_block_ratio = 64;
+
+    /// Independently decodable part of a compressed file.
+    struct Block
+    {
+        std::string_view data;
+        /// Size of the decoded block, if the file states it.
+        std::optional<std::uint64_t> size;
+        /// Integrity check of the xz stream of the block.
+        lzma_check check = LZMA_CHECK_NONE;
+    };
+
+    /// Find the blocks of an xz file through the indexes at the end of its streams.
+    std::vector<Block> xz_blocks(std::string_view data)
+    {
+        const auto *bytes = reinterpret_cast<const std::uint8_t *>(data.data());
+        std::vector<Block> blocks;
+        auto end = data.size();
+        while (end > 0)
+        {
+            // Stream padding between and after streams
+            while (end >= 4 && data.substr(end - 4, 4) == std::string_view("\0\0\0\0", 4))
+            {
+                end -= 4;
+            }
+            if (end < 2 * LZMA_STREAM_HEADER_SIZE)
+            {
+                return {};
+            }
+
+            lzma_stream_flags footer;
+            if (lzma_stream_footer_decode(&footer, bytes + end - LZMA_STREAM_HEADER_SIZE) != LZMA_OK ||
+                footer.backward_size > end - 2 * LZMA_STREAM_HEADER_SIZE)
+            {
+                return {};
+            }
+
+            lzma_index *index = nullptr;
+            std::uint64_t memory_limit = UINT64_MAX;
+            std::size_t position = end - LZMA_STREAM_HEADER_SIZE - footer.backward_size;
+            if (lzma_index_buffer_decode(&index, &memory_limit, nullptr, bytes, &position, end - LZMA_STREAM_HEADER_SIZE) != LZMA_OK)
+            {
+                return {};
+            }
+            std::unique_ptr<lzma_index, void (*)(lzma_index *)> guard(index, [](lzma_index *i)
+                                                                      { lzma_index_end(i, nullptr); });
+
+            auto stream_size = lzma_index_stream_size(index);
+            lzma_stream_flags header;
+            if (stream_size > end || lzma_stream_header_decode(&header, bytes + end - stream_size) != LZMA_OK ||
+                lzma_stream_flags_compare(&header, &footer) != LZMA_OK)
+            {
+                return {};
+            }
+            auto start = end - stream_size;
+
+            // The streams are found from the end of the file, their blocks in order
+            std::vector<Block> stream_blocks;
+            lzma_index_iter iter;
+            lzma_index_iter_init(&iter, index);
+            while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_BLOCK))
+            {
+                stream_blocks.push_back({data.substr(start + iter.block.compressed_stream_offset, iter.block.total_size),
+                                         iter.block.uncompressed_size, header.check});
+            }
+            blocks.insert(blocks.begin(), stream_blocks.begin(), stream_blocks.end());
+            end = start;
+        }
+        return blocks;
+    }
+
+    std::string unxz_block(const Block &block)
+    {
+        const auto *bytes = reinterpret_cast<const std::uint8_t *>(block.data.data());
+        lzma_filter filters[LZMA_FILTERS_MAX + 1];
+        lzma_block header{};
+        header.version = 1;
+        header.check = block.check;
+        header.filters = filters;
+        header.header_size = lzma_block_header_size_decode(bytes[0]);
+        if (header.header_size > block.data.size() || lzma_block_header_decode(&header, nullptr, bytes) != LZMA_OK)
+        {
+            throw std::runtime_error("Failed to decompress xz data: invalid block header");
+        }
+
+        std::string result(*block.size, '\0');
+        std::size_t in_position = header.header_size;
+        std::size_t out_position = 0;
+        auto status = lzma_block_buffer_decode(&header, nullptr, bytes, &in_position, block.data.size(),
+                                               reinterpret_cast<std::uint8_t *>(result.data()), &out_position, result.size());
+        for (std::size_t i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i)
+        {
+            std::free(filters[i].options);
+        }
+        if (status != LZMA_OK || out_position != result.size())
+        {
+            throw std::runtime_error("Failed to decompress xz data");
+        }
+        return result;
+    }
+
+    /// Find the members of a gzip file whose headers state their size, as in BGZF.
+    std::vector<Block> gzip_blocks(std::string_view data)
+    {
+        std::vector<Block> blocks;
+        std::size_t position = 0;
+        while (position < data.size())
+        {
+            // Header with FEXTRA: magic, method, flags, mtime, xfl, os, xlen, subfields
+            auto header = data.substr(position);
+            if (header.size() < 18 || header.substr(0, 3) != "\x1f\x8b\x08" || (header[3] & 0x04) == 0)
+            {
+                return {};
+            }
+            auto byte = [&header](std::size_t i)
+            { return static_cast<std::size_t>(static_cast<unsigned char>(header[i])); };
+
+            std::size_t extra_size = byte(10) | (byte(11) << 8);
+            std::size_t member_size = 0;
+            for (std::size_t field = 12; field + 4 <= 12 + extra_size && field + 4 <= header.size();)
+            {
+                std::size_t field_size = byte(field + 2) | (byte(field + 3) << 8);
+                if (header[field] == 'B' && header[field + 1] == 'C' && field_size == 2 && field + 6 <= header.size())
+                {
+                    member_size = (byte(field + 4) | (byte(field + 5) << 8)) + 1;
+                }
+                field += 4 + field_size;
+            }
+            if (member_size < 18 || member_size > header.size())
+            {
+                return {};
+            }
+
+            blocks.push_back({header.substr(0, member_size), std::nullopt});
+            position += member_size;
+        }
+        return blocks;
+    }
+
+#ifdef APTREPO_HAVE_ZSTD
+    /// Find the frames of a zstd file.
+    std::vector<Block> zstd_blocks(std::string_view data)
+    {
+        std::vector<Block> blocks;
+        std::size_t position = 0;
+        while (position < data.size())
+        {
+            auto frame_size = ZSTD_findFrameCompressedSize(data.data() + position, data.size() - position);
+            if (ZSTD_isError(frame_size))
+            {
+                return {};
+            }
+            auto frame = data.substr(position, frame_size);
+            auto size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+            blocks.push_back({frame, size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR ? std::nullopt : std::optional<std::uint64_t>(size)});
+            position += frame_size;
+        }
+        return blocks;
+    }
+
+    std::string unzstd_frame(const Block &block)
+    {
+        if (!block.size)
+        {
+            return unzstd(block.data);
+        }
+        std::string result(*block.size, '\0');
+        auto size = ZSTD_decompress(result.data(), result.size(), block.data.data(), block.data.size());
+        if (ZSTD_isError(size) || size != result.size())
+        {
+            throw std::runtime_error("Failed to decompress zstd data");
+        }
+        return result;
+    }
+#endif
+
+    /// Decoders of a compression format and the blocks of a file.
+    struct Codec
+    {
+        std::vector<Block> blocks;
+        std::string (*decode)(const Block &block);
+        std::string (*serial)(std::string_view data);
+    };
+
+    std::string gunzip_block(const Block &block)
+    {
+        return gunzip(block.data);
+    }
+
+    /// Get the decoders for a file, std::nullopt if it is not compressed.
+    std::optional<Codec> find_codec(std::string_view data, std::string_view path)
+    {
+        if (path.ends_with(".gz"))
+        {
+            return Codec{gzip_blocks(data), gunzip_block, gunzip};
+        }
+        if (path.ends_with(".xz"))
+        {
+            return Codec{xz_blocks(data), unxz_block, unxz};
+        }
+#ifdef APTREPO_HAVE_ZSTD
+        if (path.ends_with(".zst"))
+        {
+            return Codec{zstd_blocks(data), unzstd_frame, unzstd};
+        }
+#endif
+        if (!aptrepo::internal::is_supported_compression(path))
+        {
+            spdlog::error("Unsupported compression of file {}", path);
+            throw std::runtime_error("Unsupported compression");
+        }
+        return std::nullopt;
+    }
+
+    /// Check if the blocks of a file are decoded in parallel, resolving 0 threads.
+    bool use_threads(const Codec &codec, std::string_view path, std::size_t &threads)
+    {
+        if (threads == 0)
+        {
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        threads = std::min(threads, codec.blocks.size());
+        if (threads <= 1)
+        {
+            // A single block, or blocks which can't be found without decoding
+            return false;
+        }
+        // The sizes come from unverified headers and are allocated up front;
+        // the serial decoders only grow their buffers with the decoded data
+        for (const auto &block : codec.blocks)
+        {
+            if (block.size && (*block.size > max_block_size || *block.size > max_block_ratio * block.data.size()))
+            {
+                spdlog::warn("Block of {} states {} bytes from {}, decoding serially", path, *block.size, block.data.size());
+                return false;
+            }
+        }
+        SPDLOG_DEBUG("Decompressing {} blocks of {} with {} threads", codec.blocks.size(), path, threads);
+        return true;
+    }
+
+    /// Decode blocks in parallel, a bounded number ahead of the sink, and pass them on in order.
+    void decode_blocks(const std::vector<Block> &blocks, std::string (*decode)(const Block &block),
+                       const aptrepo::internal::DecompressSink &sink, std::size_t threads)
+    {
+        std::vector<std::optional<std::string>> results(blocks.size());
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable room;
+        std::size_t next = 0;
+        std::size_t emitted = 0;
+        bool stop = false;
+        std::exception_ptr error;
+        // Decoded blocks waiting for the sink, limits the memory held ahead of it
+        const std::size_t window = 2 * threads;
+
+        auto worker = [&]()
+        {
+            while (true)
+            {
+                std::size_t i = 0;
+                {
+                    std::unique_lock lock(mutex);
+                    room.wait(lock, [&]
+                              { return stop || next >= blocks.size() || next < emitted + window; });
+                    if (stop || next >= blocks.size())
+                    {
+                        return;
+                    }
+                    i = next++;
+                }
+                try
+                {
+                    auto result = decode(blocks[i]);
+                    std::lock_guard lock(mutex);
+                    results[i] = std::move(result);
+                }
+                catch (...)
+                {
+                    std::lock_guard lock(mutex);
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                    stop = true;
+                }
+                ready.notify_all();
+            }
+        };
+
+        {
+            std::vector<std::jthread> workers;
+            for (std::size_t i = 0; i < threads; ++i)
+            {
+                workers.emplace_back(worker);
+            }
+
+            try
+            {
+                for (std::size_t i = 0; i < blocks.size(); ++i)
+                {
+                    std::string result;
+                    {
+                        std::unique_lock lock(mutex);
+                        ready.wait(lock, [&]
+                                   { return error || results[i]; });
+                        if (error)
+                        {
+                            break;
+                        }
+                        result = std::move(*results[i]);
+                        results[i].reset();
+                        emitted = i + 1;
+                    }
+                    room.notify_all();
+                    sink(result);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard lock(mutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+
+            {
+                std::lock_guard lock(mutex);
+                stop = true;
+            }
+            room.notify_all();
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+bool aptrepo::internal::is_supported_compression(std::string_view path)
+{
+    auto name = path.substr(path.find_last_of('/') + 1);
+    auto dot = name.find_last_of('.');
+    if (dot == std::string_view::npos)
+    {
+        return true;
+    }
+    auto extension = name.substr(dot);
+#ifdef APTREPO_HAVE_ZSTD
+    if (extension == ".zst")
+    {
+        return true;
+    }
+#endif
+    return extension == ".gz" || extension == ".xz" || (extension != ".bz2" && extension != ".lzma" && extension != ".zst");
+}
+
+std::string aptrepo::internal::decompress(std::string_view data, std::string_view path, std::size_t threads)
+{
+    auto codec = find_codec(data, path);
+    if (!codec)
+    {
+        return std::string(data);
+    }
+    if (!use_threads(*codec, path, threads))
+    {
+        return codec->serial(data);
+    }
+
+    std::string result;
+    std::uint64_t size = 0;
+    for (const auto &block : codec->blocks)
+    {
+        size += block.size.value_or(0);
+    }
+    result.reserve(size);
+    decode_blocks(codec->blocks, codec->decode, [&result](std::string_view piece)
+                  { result.append(piece); }, threads);
+    return result;
+}
+
+void aptrepo::internal::decompress(std::string_view data, std::string_view path, const DecompressSink &sink, std::size_t threads)
+{
+    auto codec = find_codec(data, path);
+    if (!codec)
+    {
+        sink(data);
+    }
+    else if (!use_threads(*codec, path, threads))
+    {
+        sink(codec->serial(data));
+    }
+    else
+    {
+        decode_blocks(codec->blocks, codec->decode, sink, threads);
+    }
+}
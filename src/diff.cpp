@@ -0,0 +1,90 @@
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/reference.hpp"
+#include "aptrepo/release.hpp"
+
+#include "aptrepo/diff.hpp"
+
+namespace
+{
+    bool same_content(const aptrepo::Reference &a, const aptrepo::Reference &b)
+    {
+        if (a.get_size() != b.get_size())
+        {
+            return false;
+        }
+
+        if (!a.get_digest().empty() && a.get_digest_algorithm() == b.get_digest_algorithm())
+        {
+            return a.get_digest() == b.get_digest();
+        }
+
+        for (const auto &algorithm : {"SHA512", "SHA256", "SHA1", "MD5Sum"})
+        {
+            auto hash_a = a.get_hash(algorithm);
+            auto hash_b = b.get_hash(algorithm);
+            if (!hash_a.empty() && !hash_b.empty())
+            {
+                return aptrepo::internal::hex_to_bytes(hash_a) == aptrepo::internal::hex_to_bytes(hash_b);
+            }
+        }
+
+        // Without a common hash the content cannot be proven identical
+        return false;
+    }
+}
+
+bool aptrepo::ReleaseDiff::empty() const
+{
+    return added.empty() && removed.empty() && changed.empty();
+}
+
+aptrepo::ReleaseDiff aptrepo::diff(const aptrepo::Release &old_release, const aptrepo::Release &new_release)
+{
+    // get_references returns the references ordered by path
+    auto old_refs = old_release.get_references();
+    auto new_refs = new_release.get_references();
+
+    ReleaseDiff result;
+
+    auto old_it = old_refs.begin();
+    auto new_it = new_refs.begin();
+    while (old_it != old_refs.end() || new_it != new_refs.end())
+    {
+        if (new_it == new_refs.end())
+        {
+            result.removed.push_back(std::move(*old_it++));
+            continue;
+        }
+        if (old_it == old_refs.end())
+        {
+            result.added.push_back(std::move(*new_it++));
+            continue;
+        }
+
+        auto old_path = old_it->get_path();
+        auto new_path = new_it->get_path();
+        if (old_path < new_path)
+        {
+            result.removed.push_back(std::move(*old_it++));
+        }
+        else if (new_path < old_path)
+        {
+            result.added.push_back(std::move(*new_it++));
+        }
+        else
+        {
+            if (!same_content(*old_it, *new_it))
+            {
+                result.changed.push_back(std::move(*new_it));
+            }
+            ++old_it;
+            ++new_it;
+        }
+    }
+
+    spdlog::info("Release diff: {} added, {} removed, {} changed", result.added.size(), result.removed.size(), result.changed.size());
+
+    return result;
+}
@@ -1,10 +1,170 @@
 #include <exception>
+#include <stdexcept>
+#include <fstream>
+#include <format>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
 
 #include <spdlog/spdlog.h>
 #include <cpr/cpr.h>
 
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/utils.hpp"
 #include "aptrepo/internal/downloads.hpp"
 
+namespace
+{
+    constexpr std::string_view file_scheme = "file://";
+
+    bool is_file_url(const std::string &url)
+    {
+        return url.starts_with(file_scheme);
+    }
+
+    std::filesystem::path file_path(const std::string &url)
+    {
+        return std::filesystem::path(url.substr(file_scheme.size()));
+    }
+
+    std::string file_etag(const std::filesystem::path &path)
+    {
+        // Like common web servers, derive the ETag from size and modification time
+        auto size = std::filesystem::file_size(path);
+        auto mtime = std::filesystem::last_write_time(path).time_since_epoch();
+        return std::format("\"{:x}-{:x}\"", size, std::chrono::duration_cast<std::chrono::nanoseconds>(mtime).count());
+    }
+
+    void record_transfer(const std::string &url, long status, std::size_t bytes)
+    {
+        if (!aptrepo::internal::metrics_enabled())
+        {
+            return;
+        }
+        auto scheme = url.substr(0, url.find(':'));
+        aptrepo::internal::count("aptrepo_download_requests_total", 1, {{"scheme", scheme}, {"status", std::to_string(status)}});
+        aptrepo::internal::count("aptrepo_download_bytes_total", static_cast<double>(bytes), {{"scheme", scheme}});
+    }
+
+    void record_update_check(bool changed)
+    {
+        if (aptrepo::internal::metrics_enabled())
+        {
+            aptrepo::internal::count("aptrepo_update_checks_total", 1, {{"result", changed ? "changed" : "unchanged"}});
+        }
+    }
+
+    constexpr std::size_t min_segment_size = 1024 * 1024;
+    constexpr std::size_t segment_save_interval = 4 * 1024 * 1024;
+
+    /******************************************************************************
+     * State of a ranged GET request, filled from the response headers.
+     ******************************************************************************/
+    struct Transfer
+    {
+        long status = 0;
+        std::string etag;
+        std::size_t range_start = std::string::npos;
+        std::size_t range_total = std::string::npos;
+        bool error = false;
+    };
+
+    std::size_t to_size(std::string_view value)
+    {
+        std::size_t result = std::string::npos;
+        std::from_chars(value.data(), value.data() + value.size(), result);
+        return result;
+    }
+
+    bool is_header(std::string_view line, std::string_view name)
+    {
+        return line.size() > name.size() && line[name.size()] == ':' &&
+               std::equal(name.begin(), name.end(), line.begin(), [](char a, char b)
+                          { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); });
+    }
+
+    Transfer get_range(const std::string &url, std::size_t offset, std::size_t end, const std::string &if_range,
+                       const std::function<bool(const Transfer &, std::string_view)> &write)
+    {
+        cpr::Header header;
+        if (offset > 0 || end != std::string::npos)
+        {
+            header["Range"] = end == std::string::npos ? std::format("bytes={}-", offset) : std::format("bytes={}-{}", offset, end - 1);
+        }
+        if (!if_range.empty())
+        {
+            header["If-Range"] = if_range;
+        }
+
+        Transfer transfer;
+        cpr::Response r = cpr::Get(cpr::Url{url}, header,
+                                   cpr::ConnectTimeout{aptrepo::internal::connect_timeout},
+                                   cpr::HeaderCallback{[&](const std::string_view &line, intptr_t)
+                                                       {
+                                                           auto value = aptrepo::internal::trim(std::string(line.substr(line.find(':') + 1)));
+                                                           if (line.starts_with("HTTP/"))
+                                                           {
+                                                               // Status line, also of redirects and 100 Continue
+                                                               transfer = Transfer();
+                                                               auto code = line.find(' ');
+                                                               transfer.status = static_cast<long>(to_size(line.substr(code + 1, 3)));
+                                                           }
+                                                           else if (is_header(line, "ETag"))
+                                                           {
+                                                               transfer.etag = value;
+                                                           }
+                                                           else if (is_header(line, "Content-Range"))
+                                                           {
+                                                               // "bytes 100-199/1000" or "bytes */1000"
+                                                               auto range = std::string_view(value);
+                                                               auto space = range.find(' ');
+                                                               auto slash = range.find('/');
+                                                               if (space != std::string_view::npos && slash != std::string_view::npos)
+                                                               {
+                                                                   transfer.range_start = to_size(range.substr(space + 1, range.find('-', space) - space - 1));
+                                                                   transfer.range_total = to_size(range.substr(slash + 1));
+                                                               }
+                                                           }
+                                                           return true;
+                                                       }},
+                                   cpr::WriteCallback{[&](const std::string_view &data, intptr_t)
+                                                      { return write(transfer, data); }});
+        transfer.error = static_cast<bool>(r.error);
+        return transfer;
+    }
+
+    std::string read_text(const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    void hash_prefix(aptrepo::internal::Sha256 &hash, const std::filesystem::path &path, std::size_t length)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char buffer[64 * 1024];
+        while (length > 0 && file)
+        {
+            file.read(buffer, static_cast<std::streamsize>(std::min(length, sizeof(buffer))));
+            auto count = static_cast<std::size_t>(file.gcount());
+            hash.update(std::string_view(buffer, count));
+            length -= count;
+        }
+    }
+
+    void backoff(std::size_t attempt)
+    {
+        auto delay = std::chrono::milliseconds(100) * (1 << std::min<std::size_t>(attempt, 6));
+        std::this_thread::sleep_for(std::min<std::chrono::milliseconds>(delay, std::chrono::seconds(5)));
+    }
+}
+
 std::string aptrepo::internal::Download::get_url() const
 {
     return m_url;
@@ -15,21 +175,33 @@ std::string aptrepo::internal::Download::get_etag() const
     return m_etag;
 }
 
-std::string aptrepo::internal::Download::get_content() const
+const std::string &aptrepo::internal::Download::get_content() const
 {
     return m_content;
 }
 
 bool aptrepo::internal::needs_update(std::string url, std::string etag)
 {
-    cpr::Response r = cpr::Head(cpr::Url{url}, cpr::Header{{"If-None-Match", etag}});
+    if (is_file_url(url))
+    {
+        std::error_code ec;
+        auto path = file_path(url);
+        bool changed = !std::filesystem::exists(path, ec) || file_etag(path) != etag;
+        record_update_check(changed);
+        return changed;
+    }
+
+    cpr::Response r = cpr::Head(cpr::Url{url}, cpr::Header{{"If-None-Match", etag}}, cpr::ConnectTimeout{connect_timeout});
 
     if (r.status_code == 304)
     {
         spdlog::info("No update needed for URL: {}", url);
+        record_update_check(false);
         return false;
     }
 
+    record_update_check(true);
+
     if (r.status_code == 200)
     {
         spdlog::info("Update available for URL: {}", url);
@@ -42,22 +214,493 @@ bool aptrepo::internal::needs_update(std::string url, std::string etag)
     return true;
 }
 
-aptrepo::internal::Download aptrepo::internal::download(std::string url)
+aptrepo::internal::Download aptrepo::internal::download(std::string url, std::chrono::milliseconds timeout)
 {
     spdlog::info("Downloading from URL: {}", url);
 
-    cpr::Response r = cpr::Get(cpr::Url{url});
+    ScopedTimer timer("aptrepo_download_seconds");
+
+    if (is_file_url(url))
+    {
+        auto path = file_path(url);
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            spdlog::error("Failed to download from URL: {}. File not found.", url);
+            record_transfer(url, 404, 0);
+            throw std::runtime_error("Download failed");
+        }
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        record_transfer(url, 200, content.size());
+        return Download(url, file_etag(path), std::move(content));
+    }
 
-    spdlog::debug("Response status code: {}", r.status_code);
+    // The body is collected by the callback to measure the time to the first byte
+    std::string content;
+    bool first = true;
+    cpr::Response r = cpr::Get(cpr::Url{url},
+                               cpr::ConnectTimeout{connect_timeout},
+                               cpr::Timeout{timeout},
+                               cpr::WriteCallback{[&](const std::string_view &data, intptr_t)
+                                                  {
+                                                      if (first)
+                                                      {
+                                                          first = false;
+                                                          observe("aptrepo_download_first_byte_seconds", timer.elapsed());
+                                                      }
+                                                      content.append(data);
+                                                      return true;
+                                                  }});
 
-    if (r.status_code != 200)
+    SPDLOG_DEBUG("Response status code: {}", r.status_code);
+
+    record_transfer(url, r.status_code, content.size());
+
+    if (r.status_code != 200 || r.error)
     {
-        spdlog::error("Failed to download from URL: {}. Status code: {}", url, r.status_code);
+        spdlog::error("Failed to download from URL: {}. Status code: {} {}", url, r.status_code, r.error.message);
         throw std::runtime_error("Download failed");
     }
 
     return Download(
         url,
         r.header["etag"],
-        r.text);
+        std::move(content));
+}
+
+aptrepo::internal::ConditionalClient::ConditionalClient()
+    : m_session(std::make_unique<cpr::Session>())
+{
+}
+
+aptrepo::internal::ConditionalClient::~ConditionalClient() = default;
+
+std::optional<aptrepo::internal::Download> aptrepo::internal::ConditionalClient::get_if_changed(const std::string &url, const std::string &etag,
+                                                                                                std::chrono::milliseconds timeout)
+{
+    if (is_file_url(url))
+    {
+        std::error_code ec;
+        auto path = file_path(url);
+        if (!etag.empty() && std::filesystem::exists(path, ec) && file_etag(path) == etag)
+        {
+            record_transfer(url, 304, 0);
+            return std::nullopt;
+        }
+        return download(url, timeout);
+    }
+
+    cpr::Header header;
+    if (!etag.empty())
+    {
+        header["If-None-Match"] = etag;
+    }
+    m_session->SetUrl(cpr::Url{url});
+    m_session->SetHeader(header);
+    m_session->SetConnectTimeout(cpr::ConnectTimeout{connect_timeout});
+    m_session->SetTimeout(cpr::Timeout{timeout});
+    cpr::Response r = m_session->Get();
+
+    record_transfer(url, r.status_code, r.text.size());
+
+    if (r.status_code == 304 && !r.error)
+    {
+        SPDLOG_DEBUG("ConditionalClient: {} is unchanged", url);
+        return std::nullopt;
+    }
+    if (r.status_code != 200 || r.error)
+    {
+        spdlog::error("Failed to download from URL: {}. Status code: {} {}", url, r.status_code, r.error.message);
+        throw std::runtime_error("Download failed");
+    }
+
+    return Download(url, r.header["etag"], std::move(r.text));
+}
+
+std::string aptrepo::internal::download_to_file(std::string url, const std::filesystem::path &path, const std::function<void(std::size_t)> &throttle)
+{
+    SPDLOG_DEBUG("Downloading from URL: {} to {}", url, path.string());
+
+    ScopedTimer timer("aptrepo_download_seconds");
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        spdlog::error("Failed to open file {} for writing.", path.string());
+        throw std::runtime_error("Download failed");
+    }
+
+    Sha256 hash;
+    std::size_t bytes = 0;
+    auto write = [&](std::string_view data)
+    {
+        if (throttle)
+        {
+            throttle(data.size());
+        }
+        bytes += data.size();
+        hash.update(data);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(file);
+    };
+
+    bool ok = true;
+    long status = 200;
+    if (is_file_url(url))
+    {
+        std::ifstream source(file_path(url), std::ios::binary);
+        ok = static_cast<bool>(source);
+        status = ok ? 200 : 404;
+        char buffer[64 * 1024];
+        while (ok && source)
+        {
+            source.read(buffer, sizeof(buffer));
+            ok = write(std::string_view(buffer, static_cast<std::size_t>(source.gcount())));
+        }
+    }
+    else
+    {
+        bool first = true;
+        cpr::Response r = cpr::Get(cpr::Url{url},
+                                   cpr::ConnectTimeout{connect_timeout},
+                                   cpr::WriteCallback{[&](const std::string_view &data, intptr_t)
+                                                      {
+                                                          if (first)
+                                                          {
+                                                              first = false;
+                                                              observe("aptrepo_download_first_byte_seconds", timer.elapsed());
+                                                          }
+                                                          return write(data);
+                                                      }});
+        status = r.status_code;
+        if (r.status_code != 200)
+        {
+            spdlog::error("Failed to download from URL: {}. Status code: {}", url, r.status_code);
+            ok = false;
+        }
+    }
+
+    file.close();
+    record_transfer(url, status, bytes);
+    if (!ok || !file)
+    {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        throw std::runtime_error("Download failed");
+    }
+
+    return hash.digest();
+}
+
+std::string aptrepo::internal::download_resumable(std::string url, const std::filesystem::path &path, std::size_t retries,
+                                                  const std::function<void(std::size_t)> &throttle)
+{
+    if (is_file_url(url))
+    {
+        return download_to_file(url, path, throttle);
+    }
+
+    auto partial = path;
+    partial += ".partial";
+    auto etag_path = path;
+    etag_path += ".partial.etag";
+
+    for (std::size_t attempt = 0;; ++attempt)
+    {
+        std::error_code ec;
+        std::size_t offset = std::filesystem::is_regular_file(partial, ec) ? std::filesystem::file_size(partial) : 0;
+        auto etag = offset > 0 ? read_text(etag_path) : std::string();
+        if (etag.empty())
+        {
+            // A partial file can only be continued if the ETag proves it is unchanged
+            offset = 0;
+        }
+
+        SPDLOG_DEBUG("Downloading from URL: {} to {}, offset {}", url, path.string(), offset);
+
+        Sha256 hash;
+        std::ofstream file;
+        bool opened = false;
+        std::size_t bytes = 0;
+
+        auto open = [&](const Transfer &transfer)
+        {
+            if (transfer.status == 206 && transfer.range_start == offset)
+            {
+                hash_prefix(hash, partial, offset);
+                file.open(partial, std::ios::binary | std::ios::app);
+            }
+            else if (transfer.status == 200)
+            {
+                // Changed upstream, or the server does not support ranges
+                file.open(partial, std::ios::binary | std::ios::trunc);
+            }
+            else
+            {
+                return false;
+            }
+            // The ETag is stored first, so every partial file can be validated
+            std::ofstream(etag_path, std::ios::binary | std::ios::trunc) << transfer.etag;
+            opened = true;
+            return static_cast<bool>(file);
+        };
+
+        auto transfer = get_range(url, offset, std::string::npos, etag, [&](const Transfer &transfer, std::string_view data)
+                                  {
+                                      if (transfer.status != 200 && transfer.status != 206)
+                                      {
+                                          // Error page
+                                          return true;
+                                      }
+                                      if (!opened && !open(transfer))
+                                      {
+                                          return false;
+                                      }
+                                      if (throttle)
+                                      {
+                                          throttle(data.size());
+                                      }
+                                      bytes += data.size();
+                                      hash.update(data);
+                                      file.write(data.data(), static_cast<std::streamsize>(data.size()));
+                                      return static_cast<bool>(file); });
+
+        if (!transfer.error && !opened && (transfer.status == 200 || transfer.status == 206))
+        {
+            // Empty body
+            open(transfer);
+        }
+        if (transfer.status == 416 && transfer.range_total == offset)
+        {
+            // The partial file is already complete
+            hash_prefix(hash, partial, offset);
+            opened = true;
+            transfer.status = 206;
+            transfer.error = false;
+        }
+        file.close();
+        record_transfer(url, transfer.status, bytes);
+
+        if (!transfer.error && opened && file && (transfer.status == 200 || transfer.status == 206))
+        {
+            std::filesystem::rename(partial, path);
+            std::filesystem::remove(etag_path, ec);
+            return hash.digest();
+        }
+
+        if (transfer.status == 416 || (transfer.status == 206 && !opened))
+        {
+            // Partial file does not match the server, start over
+            std::filesystem::remove(partial, ec);
+            std::filesystem::remove(etag_path, ec);
+        }
+        else if (transfer.status >= 400 && transfer.status < 500)
+        {
+            spdlog::error("Failed to download from URL: {}. Status code: {}", url, transfer.status);
+            throw std::runtime_error("Download failed");
+        }
+
+        if (attempt >= retries)
+        {
+            spdlog::error("Failed to download from URL: {}. Giving up after {} attempts.", url, attempt + 1);
+            throw std::runtime_error("Download failed");
+        }
+
+        spdlog::warn("Download of {} interrupted (status {}), resuming.", url, transfer.status);
+        backoff(attempt);
+    }
+}
+
+std::string aptrepo::internal::download_segments(const std::vector<std::string> &urls, const std::filesystem::path &path, std::size_t size, std::size_t segments, std::size_t retries)
+{
+    if (urls.empty())
+    {
+        throw std::invalid_argument("download_segments: no URLs");
+    }
+
+    segments = std::clamp<std::size_t>(segments, 1, std::max<std::size_t>(size / min_segment_size, 1));
+    if (segments == 1 || is_file_url(urls.front()))
+    {
+        return download_resumable(urls.front(), path, retries);
+    }
+
+    auto partial = path;
+    partial += ".partial";
+    auto state_path = path;
+    state_path += ".partial.segments";
+
+    // Bytes of each segment which are flushed to the partial file
+    std::vector<std::size_t> persisted(segments, 0);
+    {
+        std::error_code ec;
+        std::ifstream state(state_path);
+        std::size_t state_size = 0;
+        std::size_t state_segments = 0;
+        if (state >> state_size >> state_segments && state_size == size && state_segments == segments &&
+            std::filesystem::is_regular_file(partial, ec) && std::filesystem::file_size(partial) == size)
+        {
+            for (auto &done : persisted)
+            {
+                state >> done;
+            }
+            if (!state)
+            {
+                std::fill(persisted.begin(), persisted.end(), 0);
+            }
+        }
+        else
+        {
+            std::ofstream(partial, std::ios::binary | std::ios::trunc);
+            std::filesystem::resize_file(partial, size);
+        }
+    }
+
+    std::mutex mutex;
+    auto save = [&]()
+    {
+        std::ofstream state(state_path, std::ios::trunc);
+        state << size << ' ' << segments << '\n';
+        for (auto done : persisted)
+        {
+            state << done << '\n';
+        }
+    };
+
+    std::atomic<bool> failed = false;
+    {
+        std::vector<std::jthread> workers;
+        for (std::size_t i = 0; i < segments; ++i)
+        {
+            workers.emplace_back([&, i]()
+                                 {
+                                     auto begin = size * i / segments;
+                                     auto end = size * (i + 1) / segments;
+                                     std::size_t done = 0;
+                                     {
+                                         std::lock_guard lock(mutex);
+                                         done = std::min(persisted[i], end - begin);
+                                     }
+
+                                     std::fstream file(partial, std::ios::binary | std::ios::in | std::ios::out);
+                                     auto persist = [&]()
+                                     {
+                                         file.flush();
+                                         std::lock_guard lock(mutex);
+                                         persisted[i] = done;
+                                         save();
+                                     };
+
+                                     for (std::size_t attempt = 0; begin + done < end; ++attempt)
+                                     {
+                                         auto offset = begin + done;
+                                         const auto &url = urls[(i + attempt) % urls.size()];
+                                         std::size_t unsaved = 0;
+                                         file.seekp(static_cast<std::streamoff>(offset));
+
+                                         auto transfer = get_range(url, offset, end, "", [&](const Transfer &transfer, std::string_view data)
+                                                                   {
+                                                                       if (transfer.status != 206 || transfer.range_start != offset || data.size() > end - begin - done)
+                                                                       {
+                                                                           return false;
+                                                                       }
+                                                                       file.write(data.data(), static_cast<std::streamsize>(data.size()));
+                                                                       done += data.size();
+                                                                       unsaved += data.size();
+                                                                       if (unsaved >= segment_save_interval)
+                                                                       {
+                                                                           persist();
+                                                                           unsaved = 0;
+                                                                       }
+                                                                       return static_cast<bool>(file); });
+                                         record_transfer(url, transfer.status, begin + done - offset);
+                                         persist();
+
+                                         if (begin + done == end)
+                                         {
+                                             break;
+                                         }
+                                         if (attempt >= retries || !file)
+                                         {
+                                             spdlog::error("Failed to download segment {} of {}. Status code: {}", i, url, transfer.status);
+                                             failed = true;
+                                             break;
+                                         }
+                                         spdlog::warn("Download of segment {} from {} interrupted (status {}), resuming.", i, url, transfer.status);
+                                         backoff(attempt);
+                                     } });
+        }
+    }
+
+    if (failed)
+    {
+        throw std::runtime_error("Download failed");
+    }
+
+    Sha256 hash;
+    hash_prefix(hash, partial, size);
+    std::filesystem::rename(partial, path);
+    std::error_code ec;
+    std::filesystem::remove(state_path, ec);
+    return hash.digest();
+}
+
+std::string aptrepo::internal::download_range(std::string url, std::size_t begin, std::size_t end)
+{
+    SPDLOG_DEBUG("Downloading range {}-{} of URL: {}", begin, end, url);
+
+    std::string content;
+    if (begin >= end)
+    {
+        return content;
+    }
+
+    if (is_file_url(url))
+    {
+        std::ifstream file(file_path(url), std::ios::binary);
+        if (!file)
+        {
+            record_transfer(url, 404, 0);
+            spdlog::error("Failed to open file from URL: {}", url);
+            throw std::runtime_error("Download failed");
+        }
+        content.resize(end - begin);
+        file.seekg(static_cast<std::streamoff>(begin));
+        file.read(content.data(), static_cast<std::streamsize>(content.size()));
+        content.resize(static_cast<std::size_t>(std::max<std::streamsize>(file.gcount(), 0)));
+        record_transfer(url, 206, content.size());
+        return content;
+    }
+
+    std::size_t skipped = 0;
+    auto transfer = get_range(url, begin, end, "", [&](const Transfer &transfer, std::string_view data)
+                              {
+                                  if (transfer.status != 200 && transfer.status != 206)
+                                  {
+                                      // Error page
+                                      return true;
+                                  }
+                                  if (transfer.status == 200 && skipped < begin)
+                                  {
+                                      // Full response, skip the bytes before the range
+                                      auto skip = std::min(begin - skipped, data.size());
+                                      skipped += skip;
+                                      data.remove_prefix(skip);
+                                  }
+                                  else if (transfer.status == 206 && transfer.range_start != begin)
+                                  {
+                                      return false;
+                                  }
+                                  content.append(data.substr(0, end - begin - content.size()));
+                                  // Cancel a full response once the range is complete
+                                  return content.size() < end - begin || transfer.status == 206; });
+    record_transfer(url, transfer.status, content.size());
+
+    bool complete = content.size() == end - begin;
+    if (transfer.status == 416 || ((transfer.status == 200 || transfer.status == 206) && (!transfer.error || complete)))
+    {
+        return content;
+    }
+
+    spdlog::error("Failed to download range of URL: {}. Status code: {}", url, transfer.status);
+    throw std::runtime_error("Download failed");
 }
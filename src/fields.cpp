@@ -0,0 +1,38 @@
+#include "aptrepo/internal/fields.hpp"
+
+void aptrepo::internal::FieldTable::set(std::string_view key, std::string value)
+{
+    if (auto field = aptrepo::internal::find_field(key))
+    {
+        set(*field, std::move(value));
+        return;
+    }
+
+    for (auto &field : m_overflow)
+    {
+        if (aptrepo::internal::detail::iequals(field.first, key))
+        {
+            field.second = std::move(value);
+            return;
+        }
+    }
+    m_overflow.emplace_back(std::string(key), std::move(value));
+}
+
+const std::string *aptrepo::internal::FieldTable::find(std::string_view key) const
+{
+    if (auto field = aptrepo::internal::find_field(key))
+    {
+        const auto &value = get(*field);
+        return value.empty() ? nullptr : &value;
+    }
+
+    for (const auto &field : m_overflow)
+    {
+        if (aptrepo::internal::detail::iequals(field.first, key))
+        {
+            return &field.second;
+        }
+    }
+    return nullptr;
+}
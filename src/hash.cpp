@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstring>
+
+#include "aptrepo/internal/hash.hpp"
+
+namespace
+{
+    constexpr std::array<std::uint32_t, 64> k = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    constexpr std::uint32_t rotr(std::uint32_t x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+}
+
+aptrepo::internal::Sha256::Sha256()
+    : m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}
+{
+}
+
+void aptrepo::internal::Sha256::transform(const unsigned char *block)
+{
+    std::array<std::uint32_t, 64> w;
+    for (std::size_t i = 0; i < 16; ++i)
+    {
+        w[i] = (static_cast<std::uint32_t>(block[4 * i]) << 24) | (static_cast<std::uint32_t>(block[4 * i + 1]) << 16) |
+               (static_cast<std::uint32_t>(block[4 * i + 2]) << 8) | static_cast<std::uint32_t>(block[4 * i + 3]);
+    }
+    for (std::size_t i = 16; i < 64; ++i)
+    {
+        auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    auto [a, b, c, d, e, f, g, h] = m_state;
+    for (std::size_t i = 0; i < 64; ++i)
+    {
+        auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        auto ch = (e & f) ^ (~e & g);
+        auto t1 = h + s1 + ch + k[i] + w[i];
+        auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        auto maj = (a & b) ^ (a & c) ^ (b & c);
+        auto t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+    m_state[5] += f;
+    m_state[6] += g;
+    m_state[7] += h;
+}
+
+void aptrepo::internal::Sha256::update(std::string_view data)
+{
+    auto bytes = reinterpret_cast<const unsigned char *>(data.data());
+    auto size = data.size();
+    m_length += size;
+
+    if (m_buffered > 0)
+    {
+        auto count = std::min(size, m_buffer.size() - m_buffered);
+        std::memcpy(m_buffer.data() + m_buffered, bytes, count);
+        m_buffered += count;
+        bytes += count;
+        size -= count;
+        if (m_buffered < m_buffer.size())
+        {
+            return;
+        }
+        transform(m_buffer.data());
+        m_buffered = 0;
+    }
+
+    for (; size >= 64; bytes += 64, size -= 64)
+    {
+        transform(bytes);
+    }
+
+    std::memcpy(m_buffer.data(), bytes, size);
+    m_buffered = size;
+}
+
+std::string aptrepo::internal::Sha256::digest()
+{
+    auto bits = m_length * 8;
+
+    unsigned char padding[72] = {0x80};
+    auto pad = (m_buffered < 56) ? 56 - m_buffered : 120 - m_buffered;
+    for (std::size_t i = 0; i < 8; ++i)
+    {
+        padding[pad + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+    }
+    update(std::string_view(reinterpret_cast<const char *>(padding), pad + 8));
+
+    std::string result(32, '\0');
+    for (std::size_t i = 0; i < 8; ++i)
+    {
+        result[4 * i] = static_cast<char>(m_state[i] >> 24);
+        result[4 * i + 1] = static_cast<char>(m_state[i] >> 16);
+        result[4 * i + 2] = static_cast<char>(m_state[i] >> 8);
+        result[4 * i + 3] = static_cast<char>(m_state[i]);
+    }
+    return result;
+}
+
+std::string aptrepo::internal::sha256(std::string_view data)
+{
+    Sha256 hash;
+    hash.update(data);
+    return hash.digest();
+}
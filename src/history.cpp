@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/decompress.hpp"
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/utils.hpp"
+
+#include "aptrepo/history.hpp"
+
+namespace
+{
+    /// A Packages index loaded for a new snapshot, with the hashes of its stanzas.
+    struct LoadedIndex
+    {
+        const aptrepo::Reference *reference;
+        aptrepo::Packages packages;
+        std::vector<std::string> hashes;
+    };
+
+    std::string stanza_hash(const aptrepo::Package &package)
+    {
+        // Keys and values are terminated by NUL, which is not valid in a stanza
+        aptrepo::internal::Sha256 hash;
+        package.get_fields().for_each([&hash](std::string_view key, const std::string &value)
+                                      {
+                                          hash.update(key);
+                                          hash.update(std::string_view("", 1));
+                                          hash.update(value);
+                                          hash.update(std::string_view("", 1)); });
+        return hash.digest();
+    }
+}
+
+std::shared_ptr<const aptrepo::HistoryIndex> aptrepo::HistorySnapshot::find_index(const std::string &path) const
+{
+    auto it = indexes.find(path);
+    if (it != indexes.end())
+    {
+        return it->second;
+    }
+    return nullptr;
+}
+
+aptrepo::History::History(IndexLoader loader)
+    : m_loader(std::move(loader))
+{
+}
+
+aptrepo::History::History()
+    : History(download_index())
+{
+}
+
+bool aptrepo::History::add(std::shared_ptr<const aptrepo::Release> release)
+{
+    auto url = release->get_url();
+    auto date = release->get_date();
+    auto etag = release->get_etag();
+
+    auto contains = [&]()
+    {
+        auto suite = m_snapshots.find(url);
+        if (suite == m_snapshots.end())
+        {
+            return false;
+        }
+        auto [first, last] = suite->second.equal_range(date);
+        for (auto it = first; it != last; ++it)
+        {
+            if (it->second->release->get_etag() == etag)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto snapshot = std::make_shared<HistorySnapshot>();
+    snapshot->release = release;
+
+    auto references = release->get_references();
+    std::vector<const aptrepo::Reference *> missing;
+    {
+        std::lock_guard lock(m_mutex);
+        if (contains())
+        {
+            SPDLOG_DEBUG("History: Snapshot of {} with ETag {} is already stored", url, etag);
+            return false;
+        }
+        for (const auto &reference : references)
+        {
+            if (!is_packages_index(reference))
+            {
+                continue;
+            }
+            auto stored = m_indexes.find(index_key(reference));
+            if (stored != m_indexes.end())
+            {
+                snapshot->indexes[reference.get_path()] = stored->second;
+            }
+            else
+            {
+                missing.push_back(&reference);
+            }
+        }
+    }
+
+    // Loading and hashing the new indexes doesn't block readers
+    std::vector<LoadedIndex> loaded;
+    for (const auto *reference : missing)
+    {
+        auto packages = m_loader(*release, *reference);
+        if (!packages)
+        {
+            continue;
+        }
+        LoadedIndex index{reference, std::move(*packages), {}};
+        index.hashes.reserve(index.packages.get_packages().size());
+        for (const auto &package : index.packages.get_packages())
+        {
+            index.hashes.push_back(stanza_hash(package));
+        }
+        loaded.push_back(std::move(index));
+    }
+
+    std::lock_guard lock(m_mutex);
+    if (contains())
+    {
+        return false;
+    }
+    for (const auto &index : loaded)
+    {
+        snapshot->indexes[index.reference->get_path()] = store(*index.reference, index.packages, index.hashes);
+    }
+    m_statistics.loads += loaded.size();
+    m_statistics.snapshots++;
+    m_statistics.index_references += snapshot->indexes.size();
+    spdlog::info("History: Added snapshot of {}, {} of {} indexes loaded", url, loaded.size(), snapshot->indexes.size());
+    m_snapshots[url].emplace(date, std::move(snapshot));
+    return true;
+}
+
+std::shared_ptr<const aptrepo::HistorySnapshot> aptrepo::History::at(const std::string &url, Date date) const
+{
+    std::lock_guard lock(m_mutex);
+    auto suite = m_snapshots.find(url);
+    if (suite == m_snapshots.end())
+    {
+        return nullptr;
+    }
+    // The last snapshot not after date is the one before the first after it
+    auto it = suite->second.upper_bound(date);
+    if (it == suite->second.begin())
+    {
+        return nullptr;
+    }
+    return std::prev(it)->second;
+}
+
+std::shared_ptr<const aptrepo::HistorySnapshot> aptrepo::History::latest(const std::string &url) const
+{
+    std::lock_guard lock(m_mutex);
+    auto suite = m_snapshots.find(url);
+    if (suite == m_snapshots.end() || suite->second.empty())
+    {
+        return nullptr;
+    }
+    return suite->second.rbegin()->second;
+}
+
+std::vector<aptrepo::History::Date> aptrepo::History::get_dates(const std::string &url) const
+{
+    std::vector<Date> dates;
+    std::lock_guard lock(m_mutex);
+    auto suite = m_snapshots.find(url);
+    if (suite != m_snapshots.end())
+    {
+        dates.reserve(suite->second.size());
+        for (const auto &snapshot : suite->second)
+        {
+            dates.push_back(snapshot.first);
+        }
+    }
+    return dates;
+}
+
+aptrepo::History::Statistics aptrepo::History::get_statistics() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_statistics;
+}
+
+bool aptrepo::History::is_packages_index(const aptrepo::Reference &reference)
+{
+    auto path = reference.get_path();
+    return path == "Packages" || path.ends_with("/Packages");
+}
+
+aptrepo::History::IndexLoader aptrepo::History::download_index()
+{
+    return [](const aptrepo::Release &release, const aptrepo::Reference &reference) -> std::optional<aptrepo::Packages>
+    {
+        auto path = reference.get_path();
+        auto url = reference.get_url();
+        auto siblings = release.get_references_for_comp(reference.get_component());
+        for (const auto *extension : {".xz", ".gz", ".zst"})
+        {
+            if (!aptrepo::internal::is_supported_compression(path + extension))
+            {
+                continue;
+            }
+            auto sibling = std::find_if(siblings.begin(), siblings.end(), [&](const aptrepo::Reference &r)
+                                        { return r.get_path() == path + extension; });
+            if (sibling != siblings.end())
+            {
+                url = sibling->get_url();
+                break;
+            }
+        }
+
+        auto download = aptrepo::internal::download(url);
+
+        // Hashed block by block while the following blocks are still decoded
+        std::string content;
+        aptrepo::internal::Sha256 hash;
+        aptrepo::internal::decompress(download.get_content(), url, [&](std::string_view piece)
+                                      {
+                                          hash.update(piece);
+                                          content.append(piece); });
+
+        auto expected = reference.get_hash("SHA256");
+        if (!expected.empty() && aptrepo::internal::bytes_to_hex(hash.digest()) != expected)
+        {
+            spdlog::error("History: Verification of {} failed.", url);
+            throw std::runtime_error("SHA256 mismatch of " + url);
+        }
+        return aptrepo::Packages(aptrepo::internal::Download(reference.get_url(), download.get_etag(), std::move(content)));
+    };
+}
+
+std::string aptrepo::History::index_key(const aptrepo::Reference &reference)
+{
+    if (reference.get_digest().empty())
+    {
+        return {};
+    }
+    return reference.get_digest_algorithm() + ":" + std::string(reference.get_digest());
+}
+
+std::shared_ptr<const aptrepo::HistoryIndex> aptrepo::History::store(const aptrepo::Reference &reference,
+                                                                     const aptrepo::Packages &packages,
+                                                                     const std::vector<std::string> &hashes)
+{
+    // Another snapshot may have stored the same index while this one was loading
+    auto key = index_key(reference);
+    if (!key.empty())
+    {
+        if (auto stored = m_indexes.find(key); stored != m_indexes.end())
+        {
+            return stored->second;
+        }
+    }
+
+    auto index = std::make_shared<HistoryIndex>();
+    index->algorithm = reference.get_digest_algorithm();
+    index->digest = std::string(reference.get_digest());
+    index->packages.reserve(packages.get_packages().size());
+    for (std::size_t i = 0; i < hashes.size(); ++i)
+    {
+        auto &stanza = m_stanzas[hashes[i]];
+        if (!stanza)
+        {
+            stanza = std::make_shared<const aptrepo::Package>(packages.get_packages()[i]);
+        }
+        index->packages.push_back(stanza);
+    }
+    m_statistics.indexes++;
+    m_statistics.stanzas = m_stanzas.size();
+    m_statistics.stanza_references += index->packages.size();
+
+    // Indexes without a digest can't be recognized again, they aren't shared
+    if (!key.empty())
+    {
+        m_indexes.emplace(std::move(key), index);
+    }
+    return index;
+}
@@ -0,0 +1,487 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/internal/http_server.hpp"
+
+namespace
+{
+    constexpr std::size_t max_header_size = 64 * 1024;
+    constexpr std::size_t max_body_size = 1024 * 1024;
+
+    bool send_all(int socket, const char *data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            auto sent = ::send(socket, data, size, MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            data += sent;
+            size -= static_cast<std::size_t>(sent);
+        }
+        return true;
+    }
+
+    bool send_file(int socket, int fd, std::size_t offset, std::size_t length)
+    {
+#ifdef __linux__
+        // Zero-copy path, the page cache is handed to the socket directly
+        auto file_offset = static_cast<off_t>(offset);
+        while (length > 0)
+        {
+            auto sent = ::sendfile(socket, fd, &file_offset, length);
+            if (sent < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN)
+                {
+                    continue;
+                }
+                if (errno != EINVAL && errno != ENOSYS)
+                {
+                    return false;
+                }
+                // Not supported for this file, continue with plain reads
+                offset = static_cast<std::size_t>(file_offset);
+                break;
+            }
+            if (sent == 0)
+            {
+                // File was truncated while sending
+                return false;
+            }
+            length -= static_cast<std::size_t>(sent);
+        }
+        if (length == 0)
+        {
+            return true;
+        }
+#endif
+        char buffer[64 * 1024];
+        while (length > 0)
+        {
+            auto count = ::pread(fd, buffer, std::min(length, sizeof(buffer)), static_cast<off_t>(offset));
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0 || !send_all(socket, buffer, static_cast<std::size_t>(count)))
+            {
+                return false;
+            }
+            offset += static_cast<std::size_t>(count);
+            length -= static_cast<std::size_t>(count);
+        }
+        return true;
+    }
+
+    bool parse_request(std::string_view head, aptrepo::internal::HttpRequest &request, std::string &version)
+    {
+        auto line_end = head.find("\r\n");
+        auto line = head.substr(0, line_end);
+
+        auto method_end = line.find(' ');
+        auto target_end = line.rfind(' ');
+        if (method_end == std::string_view::npos || target_end == method_end)
+        {
+            return false;
+        }
+        request.method = std::string(line.substr(0, method_end));
+        request.target = std::string(line.substr(method_end + 1, target_end - method_end - 1));
+        version = std::string(line.substr(target_end + 1));
+
+        while (line_end != std::string_view::npos)
+        {
+            auto start = line_end + 2;
+            line_end = head.find("\r\n", start);
+            line = head.substr(start, line_end == std::string_view::npos ? std::string_view::npos : line_end - start);
+            auto colon = line.find(':');
+            if (colon == std::string_view::npos)
+            {
+                continue;
+            }
+            request.headers[std::string(line.substr(0, colon))] = aptrepo::internal::trim(std::string(line.substr(colon + 1)));
+        }
+        return true;
+    }
+}
+
+bool aptrepo::internal::HeaderLess::operator()(const std::string &a, const std::string &b) const
+{
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](unsigned char x, unsigned char y)
+                                        { return std::tolower(x) < std::tolower(y); });
+}
+
+std::string aptrepo::internal::HttpRequest::get_header(const std::string &key) const
+{
+    if (auto search = headers.find(key); search != headers.end())
+    {
+        return search->second;
+    }
+    return {};
+}
+
+std::string aptrepo::internal::http_reason(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return "OK";
+    case 206:
+        return "Partial Content";
+    case 304:
+        return "Not Modified";
+    case 400:
+        return "Bad Request";
+    case 403:
+        return "Forbidden";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 413:
+        return "Content Too Large";
+    case 416:
+        return "Range Not Satisfiable";
+    case 500:
+        return "Internal Server Error";
+    case 502:
+        return "Bad Gateway";
+    case 503:
+        return "Service Unavailable";
+    case 504:
+        return "Gateway Timeout";
+    default:
+        return "Unknown";
+    }
+}
+
+aptrepo::internal::HttpServer::HttpServer(Handler handler, const std::string &address, std::uint16_t port)
+    : m_handler(std::move(handler)), m_address(address)
+{
+    m_listen_socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listen_socket < 0)
+    {
+        spdlog::error("HttpServer: Failed to create socket: {}", std::strerror(errno));
+        throw std::runtime_error("HttpServer: socket failed");
+    }
+
+    int enable = 1;
+    ::setsockopt(m_listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+    {
+        ::close(m_listen_socket);
+        spdlog::error("HttpServer: Invalid address: {}", address);
+        throw std::runtime_error("HttpServer: invalid address");
+    }
+
+    if (::bind(m_listen_socket, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(m_listen_socket, SOMAXCONN) < 0)
+    {
+        auto error = std::strerror(errno);
+        ::close(m_listen_socket);
+        spdlog::error("HttpServer: Failed to listen on {}:{}: {}", address, port, error);
+        throw std::runtime_error("HttpServer: listen failed");
+    }
+
+    socklen_t length = sizeof(addr);
+    ::getsockname(m_listen_socket, reinterpret_cast<sockaddr *>(&addr), &length);
+    m_port = ntohs(addr.sin_port);
+
+    m_running = true;
+    m_accept_thread = std::thread(&HttpServer::accept_loop, this);
+
+    spdlog::debug("HttpServer: Listening on {}", get_url());
+}
+
+aptrepo::internal::HttpServer::~HttpServer()
+{
+    stop();
+}
+
+std::uint16_t aptrepo::internal::HttpServer::get_port() const
+{
+    return m_port;
+}
+
+std::string aptrepo::internal::HttpServer::get_url() const
+{
+    return std::format("http://{}:{}", m_address, m_port);
+}
+
+void aptrepo::internal::HttpServer::stop()
+{
+    if (!m_running.exchange(false))
+    {
+        return;
+    }
+
+    // Wakes up the blocking accept
+    ::shutdown(m_listen_socket, SHUT_RDWR);
+    if (m_accept_thread.joinable())
+    {
+        m_accept_thread.join();
+    }
+    ::close(m_listen_socket);
+
+    std::unique_lock lock(m_connections_mutex);
+    for (auto socket : m_connections)
+    {
+        ::shutdown(socket, SHUT_RDWR);
+    }
+    m_connections_done.wait(lock, [this]
+                            { return m_connections.empty(); });
+}
+
+void aptrepo::internal::HttpServer::accept_loop()
+{
+    while (m_running)
+    {
+        int socket = ::accept4(m_listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (socket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (m_running)
+            {
+                spdlog::error("HttpServer: accept failed: {}", std::strerror(errno));
+            }
+            break;
+        }
+
+        int enable = 1;
+        ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        {
+            std::lock_guard lock(m_connections_mutex);
+            if (!m_running)
+            {
+                ::close(socket);
+                break;
+            }
+            m_connections.insert(socket);
+        }
+
+        std::thread([this, socket]
+                    {
+                        serve(socket);
+
+                        std::lock_guard lock(m_connections_mutex);
+                        ::close(socket);
+                        m_connections.erase(socket);
+                        m_connections_done.notify_all(); })
+            .detach();
+    }
+}
+
+void aptrepo::internal::HttpServer::serve(int socket)
+{
+    // A client closing the connection while a file is sent must not raise
+    // SIGPIPE for the whole process; with the signal blocked, sendfile fails with EPIPE.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::string buffer;
+    char chunk[16 * 1024];
+
+    while (m_running)
+    {
+        auto end = buffer.find("\r\n\r\n");
+        if (end == std::string::npos)
+        {
+            if (buffer.size() > max_header_size)
+            {
+                spdlog::warn("HttpServer: Request header too large.");
+                return;
+            }
+            auto count = ::recv(socket, chunk, sizeof(chunk), 0);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                return;
+            }
+            buffer.append(chunk, static_cast<std::size_t>(count));
+            continue;
+        }
+
+        HttpRequest request;
+        std::string version;
+        bool valid = parse_request(std::string_view(buffer).substr(0, end), request, version);
+        buffer.erase(0, end + 4);
+
+        auto connection = request.get_header("Connection");
+        bool keep_alive = version == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+
+        // Request bodies are not used, but must be skipped to keep the connection in sync
+        int status = valid ? 0 : 400;
+        auto content_length = request.get_header("Content-Length");
+        if (valid && !content_length.empty())
+        {
+            std::size_t length = 0;
+            auto [ptr, ec] = std::from_chars(content_length.data(), content_length.data() + content_length.size(), length);
+            if (ec != std::errc() || ptr != content_length.data() + content_length.size())
+            {
+                status = 400;
+            }
+            else if (length > max_body_size)
+            {
+                status = 413;
+            }
+            else
+            {
+                // Discarded as it arrives, only the pipelined rest is kept
+                auto buffered = std::min(length, buffer.size());
+                buffer.erase(0, buffered);
+                length -= buffered;
+                while (length > 0)
+                {
+                    auto count = ::recv(socket, chunk, std::min(sizeof(chunk), length), 0);
+                    if (count < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (count <= 0)
+                    {
+                        return;
+                    }
+                    length -= static_cast<std::size_t>(count);
+                }
+            }
+        }
+
+        HttpResponse response;
+        if (status != 0)
+        {
+            // The rest of the stream can't be parsed, the connection is closed
+            response.status = status;
+            keep_alive = false;
+        }
+        else
+        {
+            try
+            {
+                response = m_handler(request);
+            }
+            catch (const std::exception &e)
+            {
+                spdlog::error("HttpServer: Handler failed for {}: {}", request.target, e.what());
+                response = HttpResponse();
+                response.status = 500;
+            }
+        }
+
+        response.headers["Connection"] = keep_alive ? "keep-alive" : "close";
+
+        if (!send_response(socket, request, response) || !keep_alive)
+        {
+            return;
+        }
+    }
+}
+
+bool aptrepo::internal::HttpServer::send_response(int socket, const HttpRequest &request, const HttpResponse &response)
+{
+    int fd = -1;
+    std::size_t length = response.body.size();
+
+    if (!response.file.empty())
+    {
+        fd = ::open(response.file.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info = {};
+        if (fd < 0 || ::fstat(fd, &info) < 0 || static_cast<std::size_t>(info.st_size) < response.file_offset)
+        {
+            spdlog::error("HttpServer: Failed to open {}.", response.file.string());
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            HttpResponse error;
+            error.status = 500;
+            error.headers["Connection"] = "close";
+            send_response(socket, request, error);
+            return false;
+        }
+        length = std::min(response.file_length, static_cast<std::size_t>(info.st_size) - response.file_offset);
+    }
+
+    std::string head = std::format("HTTP/1.1 {} {}\r\n", response.status, http_reason(response.status));
+    for (const auto &[key, value] : response.headers)
+    {
+        head += key + ": " + value + "\r\n";
+    }
+    head += std::format("Content-Length: {}\r\n\r\n", length);
+
+    bool has_body = request.method != "HEAD" && response.status != 204 && response.status != 304;
+    bool truncated = response.abort_after < length;
+    auto send_length = truncated ? response.abort_after : length;
+    auto send_body = [&](std::size_t offset, std::size_t count)
+    {
+        return fd >= 0 ? send_file(socket, fd, response.file_offset + offset, count)
+                       : send_all(socket, response.body.data() + offset, count);
+    };
+
+    bool ok = send_all(socket, head.data(), head.size());
+    if (ok && has_body)
+    {
+        if (response.rate == 0)
+        {
+            ok = send_body(0, send_length);
+        }
+        else
+        {
+            // Pace the body in small chunks, about 50 per second
+            auto chunk = std::max<std::size_t>(response.rate / 50, 1024);
+            auto start = std::chrono::steady_clock::now();
+            for (std::size_t sent = 0; ok && sent < send_length;)
+            {
+                auto count = std::min(chunk, send_length - sent);
+                ok = send_body(sent, count);
+                sent += count;
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                          std::chrono::duration<double>(static_cast<double>(sent) / static_cast<double>(response.rate))));
+            }
+        }
+    }
+
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    return ok && !(has_body && truncated);
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/keyring.hpp"
+
+namespace
+{
+    std::string read_file(const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            spdlog::error("Keyring: Failed to read {}", path.string());
+            throw std::runtime_error("Keyring: Failed to read " + path.string());
+        }
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+}
+
+aptrepo::Keyring::Keyring(const std::filesystem::path &path)
+{
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(path))
+    {
+        for (const auto &entry : std::filesystem::directory_iterator(path))
+        {
+            auto extension = entry.path().extension();
+            if (entry.is_regular_file() && (extension == ".gpg" || extension == ".asc"))
+            {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+    }
+    else
+    {
+        files.push_back(path);
+    }
+
+    for (const auto &file : files)
+    {
+        add(read_file(file));
+    }
+    spdlog::info("Keyring: Loaded {} keys from {}", m_keys.size(), path.string());
+}
+
+std::shared_ptr<const aptrepo::Keyring> aptrepo::Keyring::load(const std::filesystem::path &path)
+{
+    static std::mutex mutex;
+    static std::map<std::filesystem::path, std::pair<std::filesystem::file_time_type, std::shared_ptr<const Keyring>>> cache;
+
+    auto modified = std::filesystem::last_write_time(path);
+    std::lock_guard lock(mutex);
+    auto &entry = cache[path];
+    if (!entry.second || entry.first != modified)
+    {
+        entry = {modified, std::make_shared<const Keyring>(path)};
+    }
+    return entry.second;
+}
+
+std::size_t aptrepo::Keyring::add(std::string_view data)
+{
+    std::size_t count = 0;
+    for (auto &key : aptrepo::internal::parse_public_keys(data))
+    {
+        SPDLOG_DEBUG("Keyring: Adding key {}", key.fingerprint);
+        m_keys.insert_or_assign(key.key_id, std::move(key));
+        ++count;
+    }
+    return count;
+}
+
+std::size_t aptrepo::Keyring::size() const
+{
+    return m_keys.size();
+}
+
+std::vector<std::string> aptrepo::Keyring::get_fingerprints() const
+{
+    std::vector<std::string> fingerprints;
+    for (const auto &[key_id, key] : m_keys)
+    {
+        fingerprints.push_back(key.fingerprint);
+    }
+    std::sort(fingerprints.begin(), fingerprints.end());
+    return fingerprints;
+}
+
+const aptrepo::internal::PublicKey *aptrepo::Keyring::find(std::uint64_t key_id) const
+{
+    auto search = m_keys.find(key_id);
+    return search == m_keys.end() ? nullptr : &search->second;
+}
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <format>
+
+#include "aptrepo/internal/metrics.hpp"
+
+#include "aptrepo/metrics.hpp"
+
+namespace
+{
+    std::mutex sink_mutex;
+    std::shared_ptr<aptrepo::MetricsSink> sink;
+
+    std::shared_ptr<aptrepo::MetricsSink> active_sink()
+    {
+        if (!aptrepo::internal::metrics_enabled())
+        {
+            return nullptr;
+        }
+        std::lock_guard lock(sink_mutex);
+        return sink;
+    }
+
+    std::string render_labels(const aptrepo::MetricLabels &labels)
+    {
+        if (labels.empty())
+        {
+            return {};
+        }
+
+        auto sorted = labels;
+        std::sort(sorted.begin(), sorted.end());
+
+        std::string result = "{";
+        for (const auto &[key, value] : sorted)
+        {
+            if (result.size() > 1)
+            {
+                result += ',';
+            }
+            result += key + "=\"";
+            for (auto c : value)
+            {
+                switch (c)
+                {
+                case '\\':
+                    result += "\\\\";
+                    break;
+                case '"':
+                    result += "\\\"";
+                    break;
+                case '\n':
+                    result += "\\n";
+                    break;
+                default:
+                    result += c;
+                }
+            }
+            result += '"';
+        }
+        result += '}';
+        return result;
+    }
+
+    std::string format_value(double value)
+    {
+        if (std::isinf(value))
+        {
+            return value > 0 ? "+Inf" : "-Inf";
+        }
+        return std::format("{}", value);
+    }
+}
+
+std::atomic<bool> aptrepo::internal::metrics_active = false;
+
+void aptrepo::set_metrics_sink(std::shared_ptr<MetricsSink> new_sink)
+{
+    std::lock_guard lock(sink_mutex);
+    aptrepo::internal::metrics_active = new_sink != nullptr;
+    sink = std::move(new_sink);
+}
+
+std::shared_ptr<aptrepo::MetricsSink> aptrepo::get_metrics_sink()
+{
+    std::lock_guard lock(sink_mutex);
+    return sink;
+}
+
+void aptrepo::internal::count(std::string_view name, double value, const aptrepo::MetricLabels &labels)
+{
+    if (auto current = active_sink())
+    {
+        current->increment(name, value, labels);
+    }
+}
+
+void aptrepo::internal::gauge(std::string_view name, double value, const aptrepo::MetricLabels &labels)
+{
+    if (auto current = active_sink())
+    {
+        current->set(name, value, labels);
+    }
+}
+
+void aptrepo::internal::observe(std::string_view name, double value, const aptrepo::MetricLabels &labels)
+{
+    if (auto current = active_sink())
+    {
+        current->observe(name, value, labels);
+    }
+}
+
+aptrepo::internal::ScopedTimer::ScopedTimer(std::string_view name, aptrepo::MetricLabels labels)
+    : m_name(name), m_labels(std::move(labels)), m_start(std::chrono::steady_clock::now())
+{
+}
+
+aptrepo::internal::ScopedTimer::~ScopedTimer()
+{
+    observe(m_name, elapsed(), m_labels);
+}
+
+double aptrepo::internal::ScopedTimer::elapsed() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+aptrepo::PrometheusExporter::PrometheusExporter()
+    : PrometheusExporter({0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30})
+{
+}
+
+aptrepo::PrometheusExporter::PrometheusExporter(std::vector<double> buckets)
+    : m_buckets(std::move(buckets))
+{
+    std::sort(m_buckets.begin(), m_buckets.end());
+}
+
+aptrepo::PrometheusExporter::Series &aptrepo::PrometheusExporter::series(std::string_view name, Type type, const MetricLabels &labels)
+{
+    auto family = m_families.find(name);
+    if (family == m_families.end())
+    {
+        family = m_families.emplace(std::string(name), Family{type, {}}).first;
+    }
+    auto &result = family->second.series[render_labels(labels)];
+    if (type == Type::Histogram && result.buckets.empty())
+    {
+        result.buckets.resize(m_buckets.size() + 1);
+    }
+    return result;
+}
+
+void aptrepo::PrometheusExporter::increment(std::string_view name, double value, const MetricLabels &labels)
+{
+    std::lock_guard lock(m_mutex);
+    series(name, Type::Counter, labels).value += value;
+}
+
+void aptrepo::PrometheusExporter::set(std::string_view name, double value, const MetricLabels &labels)
+{
+    std::lock_guard lock(m_mutex);
+    series(name, Type::Gauge, labels).value = value;
+}
+
+void aptrepo::PrometheusExporter::observe(std::string_view name, double value, const MetricLabels &labels)
+{
+    std::lock_guard lock(m_mutex);
+    auto &sample = series(name, Type::Histogram, labels);
+    auto bucket = std::lower_bound(m_buckets.begin(), m_buckets.end(), value) - m_buckets.begin();
+    sample.buckets[static_cast<std::size_t>(bucket)]++;
+    sample.value += value;
+    sample.count++;
+}
+
+double aptrepo::PrometheusExporter::get(std::string_view name, const MetricLabels &labels) const
+{
+    std::lock_guard lock(m_mutex);
+    auto family = m_families.find(name);
+    if (family == m_families.end())
+    {
+        return 0;
+    }
+    auto sample = family->second.series.find(render_labels(labels));
+    return sample != family->second.series.end() ? sample->second.value : 0;
+}
+
+std::string aptrepo::PrometheusExporter::render() const
+{
+    std::lock_guard lock(m_mutex);
+
+    std::string result;
+    for (const auto &[name, family] : m_families)
+    {
+        switch (family.type)
+        {
+        case Type::Counter:
+            result += "# TYPE " + name + " counter\n";
+            break;
+        case Type::Gauge:
+            result += "# TYPE " + name + " gauge\n";
+            break;
+        case Type::Histogram:
+            result += "# TYPE " + name + " histogram\n";
+            break;
+        }
+
+        for (const auto &[labels, sample] : family.series)
+        {
+            if (family.type != Type::Histogram)
+            {
+                result += name + labels + " " + format_value(sample.value) + "\n";
+                continue;
+            }
+
+            // Series labels without the braces, to append the bucket bound
+            auto inner = labels.empty() ? std::string() : labels.substr(1, labels.size() - 2) + ",";
+            std::size_t cumulative = 0;
+            for (std::size_t i = 0; i <= m_buckets.size(); ++i)
+            {
+                cumulative += sample.buckets[i];
+                auto bound = i < m_buckets.size() ? format_value(m_buckets[i]) : "+Inf";
+                result += std::format("{}_bucket{{{}le=\"{}\"}} {}\n", name, inner, bound, cumulative);
+            }
+            result += name + "_sum" + labels + " " + format_value(sample.value) + "\n";
+            result += name + "_count" + labels + " " + std::to_string(sample.count) + "\n";
+        }
+    }
+    return result;
+}
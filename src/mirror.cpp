@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/decompress.hpp"
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/scheduler.hpp"
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/diff.hpp"
+#include "aptrepo/keyring.hpp"
+#include "aptrepo/packages.hpp"
+#include "aptrepo/release.hpp"
+
+#include "aptrepo/mirror.hpp"
+
+namespace
+{
+    const std::filesystem::path objects_dir = ".objects";
+
+    void count_file(const char *result, std::size_t files = 1)
+    {
+        if (aptrepo::internal::metrics_enabled())
+        {
+            aptrepo::internal::count("aptrepo_mirror_files_total", static_cast<double>(files), {{"result", result}});
+        }
+    }
+
+    std::string read_file(const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    /// Join a path from the repository metadata to a directory of the mirror,
+    /// std::nullopt if the result would not be below the directory.
+    std::optional<std::filesystem::path> join_below(const std::filesystem::path &root, std::string_view relative)
+    {
+        if (!aptrepo::internal::is_safe_path(relative))
+        {
+            spdlog::warn("Mirror: Skipping unsafe path {}", relative);
+            return std::nullopt;
+        }
+        auto base = root.lexically_normal();
+        if (base.filename().empty())
+        {
+            base = base.parent_path();
+        }
+        auto path = (base / relative).lexically_normal();
+        if (std::mismatch(base.begin(), base.end(), path.begin(), path.end()).first != base.end())
+        {
+            spdlog::warn("Mirror: Skipping path {} outside of {}", relative, base.string());
+            return std::nullopt;
+        }
+        return path;
+    }
+
+    bool contains(const std::vector<std::string> &list, const std::string &value)
+    {
+        return list.empty() || std::find(list.begin(), list.end(), value) != list.end();
+    }
+
+    bool has_size(const std::filesystem::path &path, std::size_t size)
+    {
+        std::error_code ec;
+        return std::filesystem::is_regular_file(path, ec) && std::filesystem::file_size(path, ec) == size;
+    }
+
+    void link_or_copy(const std::filesystem::path &source, const std::filesystem::path &destination)
+    {
+        std::filesystem::create_directories(destination.parent_path());
+
+        // Link to a temporary name and rename, so the destination is replaced atomically
+        auto temporary = destination;
+        temporary += ".tmp";
+        std::filesystem::remove(temporary);
+
+        std::error_code ec;
+        std::filesystem::create_hard_link(source, temporary, ec);
+        if (ec)
+        {
+            spdlog::debug("Mirror: Hardlink of {} failed ({}), copying", source.string(), ec.message());
+            std::filesystem::copy_file(source, temporary, std::filesystem::copy_options::overwrite_existing);
+        }
+        std::filesystem::rename(temporary, destination);
+    }
+}
+
+aptrepo::MirrorSync::MirrorSync(std::string repo_url, std::string distro, std::filesystem::path target, Options options)
+    : m_repo_url(std::move(repo_url)), m_distro(std::move(distro)), m_target(std::move(target)), m_options(std::move(options))
+{
+    while (m_repo_url.ends_with('/'))
+    {
+        m_repo_url.pop_back();
+    }
+}
+
+aptrepo::MirrorSync::MirrorSync(std::string repo_url, std::string distro, std::filesystem::path target)
+    : MirrorSync(std::move(repo_url), std::move(distro), std::move(target), Options())
+{
+}
+
+std::filesystem::path aptrepo::MirrorSync::object_path(const std::string &digest) const
+{
+    auto hex = aptrepo::internal::bytes_to_hex(digest);
+    return m_target / objects_dir / hex.substr(0, 2) / hex.substr(2);
+}
+
+bool aptrepo::MirrorSync::is_current(const std::filesystem::path &path, std::size_t size, const std::string &digest) const
+{
+    if (!has_size(path, size))
+    {
+        return false;
+    }
+    if (digest.empty())
+    {
+        return true;
+    }
+
+    // Verified files are links of their content object, so comparing the
+    // inodes avoids hashing the file again
+    std::error_code ec;
+    return std::filesystem::equivalent(path, object_path(digest), ec);
+}
+
+aptrepo::MirrorSync::Outcome aptrepo::MirrorSync::fetch_one(const Job &job, const std::function<void(std::size_t)> &throttle) const
+{
+    static std::atomic<std::size_t> counter = 0;
+    static std::mutex active_mutex;
+    static std::set<std::string> active;
+
+    if (!job.digest.empty())
+    {
+        auto object = object_path(job.digest);
+        if (has_size(object, job.size))
+        {
+            link_or_copy(object, job.path);
+            return Outcome::Linked;
+        }
+    }
+
+    // Files with a known digest get a stable name, so an interrupted download
+    // is resumed by the next run. The same object may be listed twice.
+    std::string name;
+    if (!job.digest.empty())
+    {
+        std::lock_guard lock(active_mutex);
+        if (active.insert(job.digest).second)
+        {
+            name = aptrepo::internal::bytes_to_hex(job.digest);
+        }
+    }
+    bool resumable = !name.empty();
+    if (!resumable)
+    {
+        name = std::to_string(counter++);
+    }
+    auto temporary = m_target / objects_dir / ("download-" + name);
+    std::filesystem::create_directories(temporary.parent_path());
+
+    std::string digest;
+    try
+    {
+        digest = resumable ? aptrepo::internal::download_resumable(job.url, temporary, 3, throttle)
+                           : aptrepo::internal::download_to_file(job.url, temporary, throttle);
+    }
+    catch (...)
+    {
+        if (resumable)
+        {
+            std::lock_guard lock(active_mutex);
+            active.erase(job.digest);
+        }
+        throw;
+    }
+    if (resumable)
+    {
+        std::lock_guard lock(active_mutex);
+        active.erase(job.digest);
+    }
+    if (!job.digest.empty() && digest != job.digest)
+    {
+        spdlog::error("Mirror: Hash mismatch for {}", job.url);
+        std::filesystem::remove(temporary);
+        return Outcome::Failed;
+    }
+
+    auto object = object_path(digest);
+    std::filesystem::create_directories(object.parent_path());
+    std::filesystem::rename(temporary, object);
+    link_or_copy(object, job.path);
+    return Outcome::Downloaded;
+}
+
+void aptrepo::MirrorSync::fetch(const std::vector<Job> &jobs, Statistics &statistics, aptrepo::internal::DownloadScheduler &scheduler) const
+{
+    // Latency-critical files first, large files last
+    std::vector<aptrepo::internal::Priority> priorities;
+    std::vector<std::size_t> order;
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+    {
+        priorities.push_back(aptrepo::internal::download_priority(jobs[i].url, jobs[i].size));
+        order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+                     { return priorities[a] < priorities[b]; });
+
+    std::mutex mutex;
+    std::atomic<std::size_t> next = 0;
+    auto worker = [&]()
+    {
+        for (auto n = next++; n < jobs.size(); n = next++)
+        {
+            auto i = order[n];
+            auto outcome = Outcome::Failed;
+            try
+            {
+                aptrepo::internal::DownloadScheduler::Slot slot(scheduler, priorities[i]);
+                outcome = fetch_one(jobs[i], [&](std::size_t bytes)
+                                    { slot.throttle(bytes); });
+            }
+            catch (const std::exception &e)
+            {
+                if (jobs[i].optional)
+                {
+                    SPDLOG_DEBUG("Mirror: Optional file {} not available: {}", jobs[i].url, e.what());
+                }
+                else
+                {
+                    spdlog::warn("Mirror: Failed to fetch {}: {}", jobs[i].url, e.what());
+                }
+            }
+
+            std::lock_guard lock(mutex);
+            switch (outcome)
+            {
+            case Outcome::Downloaded:
+                ++statistics.downloaded;
+                statistics.bytes += jobs[i].size;
+                count_file("downloaded");
+                break;
+            case Outcome::Linked:
+                ++statistics.linked;
+                count_file("linked");
+                break;
+            case Outcome::Failed:
+                if (jobs[i].optional)
+                {
+                    ++statistics.missing;
+                    count_file("missing");
+                }
+                else
+                {
+                    ++statistics.failed;
+                    count_file("failed");
+                }
+                break;
+            }
+        }
+    };
+
+    auto count = std::clamp<std::size_t>(m_options.jobs, 1, std::max<std::size_t>(jobs.size(), 1));
+    std::vector<std::jthread> workers;
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+}
+
+aptrepo::MirrorSync::Statistics aptrepo::MirrorSync::sync()
+{
+    Statistics statistics;
+
+    const auto dists = std::filesystem::path("dists") / m_distro;
+    const auto dists_url = m_repo_url + "/dists/" + m_distro;
+    const auto in_release_path = m_target / dists / "InRelease";
+    // Indexes are fetched next to the objects and only moved to dists once
+    // everything the new InRelease lists has been mirrored
+    const auto staging = m_target / objects_dir / "staging" / m_distro;
+
+    spdlog::info("Mirror: Synchronizing {} to {}", dists_url, m_target.string());
+    std::filesystem::remove_all(staging);
+
+    aptrepo::internal::DownloadScheduler scheduler(m_options.rate_limit);
+
+    auto download = aptrepo::internal::download(dists_url + "/InRelease");
+    auto in_release = download.get_content();
+    auto release = m_options.keyring.empty() ? aptrepo::Release(download)
+                                             : aptrepo::Release(download, *aptrepo::Keyring::load(m_options.keyring));
+
+    // References unchanged since the last synchronization are not fetched again
+    std::set<std::string> changed;
+    std::optional<aptrepo::Release> old_release;
+    if (std::filesystem::exists(in_release_path))
+    {
+        old_release.emplace(aptrepo::internal::Download(dists_url + "/InRelease", "", read_file(in_release_path)));
+        auto difference = aptrepo::diff(*old_release, release);
+        for (const auto &reference : difference.added)
+        {
+            changed.insert(reference.get_path());
+        }
+        for (const auto &reference : difference.changed)
+        {
+            changed.insert(reference.get_path());
+        }
+    }
+
+    std::set<std::string> compressed;
+    for (const auto &reference : release.get_references())
+    {
+        auto path = reference.get_path();
+        auto dot = path.find_last_of('.');
+        if (dot != std::string::npos && dot > path.find_last_of('/') + 1)
+        {
+            compressed.insert(path.substr(0, dot));
+        }
+    }
+
+    std::vector<aptrepo::Reference> indexes;
+    std::vector<std::pair<std::string, std::filesystem::path>> by_hash;
+    std::vector<std::pair<std::filesystem::path, std::filesystem::path>> staged;
+    std::vector<Job> jobs;
+    for (const auto &reference : release.get_references())
+    {
+        auto arch = reference.get_architecture();
+        auto comp = reference.get_component();
+        if (!comp.empty() && !contains(m_options.components, comp))
+        {
+            continue;
+        }
+        if (!arch.empty() && arch != "all" && !contains(m_options.architectures, arch))
+        {
+            continue;
+        }
+
+        auto joined = join_below(m_target / dists, reference.get_path());
+        if (!joined)
+        {
+            ++statistics.failed;
+            continue;
+        }
+        auto path = *joined;
+        if (reference.get_path().contains("/binary-") && reference.get_path().contains("/Packages"))
+        {
+            indexes.push_back(reference);
+        }
+        auto sha256 = reference.get_hash("SHA256");
+        if (release.get_field("Acquire-By-Hash") == "yes" && aptrepo::internal::hex_to_bytes(sha256).size() == 32)
+        {
+            by_hash.emplace_back(aptrepo::internal::hex_to_bytes(sha256), path.parent_path() / "by-hash" / "SHA256" / sha256);
+        }
+        auto digest = aptrepo::internal::hex_to_bytes(reference.get_hash("SHA256"));
+        if (old_release && !changed.contains(reference.get_path()) && is_current(path, reference.get_size(), digest))
+        {
+            ++statistics.unchanged;
+            continue;
+        }
+        // Archives list the uncompressed variants of indexes, but often only
+        // publish the compressed files
+        auto name = reference.get_path().substr(reference.get_path().find_last_of('/') + 1);
+        auto optional = !name.contains('.') && compressed.contains(reference.get_path());
+
+        auto staged_path = staging / reference.get_path();
+        staged.emplace_back(staged_path, path);
+        jobs.push_back({reference.get_url(), staged_path, reference.get_size(), digest, optional});
+    }
+
+    spdlog::info("Mirror: Fetching {} index files", jobs.size());
+    fetch(jobs, statistics, scheduler);
+
+    // Collect the pool files of all Packages indexes, using the first
+    // readable variant of each index
+    std::set<std::string> directories;
+    std::set<std::string> filenames;
+    std::size_t unreadable = 0;
+    jobs.clear();
+    for (const auto &reference : indexes)
+    {
+        auto directory = reference.get_path().substr(0, reference.get_path().find_last_of('/'));
+        if (directories.contains(directory))
+        {
+            continue;
+        }
+
+        auto path = staging / reference.get_path();
+        if (!std::filesystem::exists(path))
+        {
+            path = m_target / dists / reference.get_path();
+        }
+        if (!aptrepo::internal::is_supported_compression(reference.get_path()) || !has_size(path, reference.get_size()))
+        {
+            continue;
+        }
+        directories.insert(directory);
+
+        auto content = aptrepo::internal::decompress(read_file(path), reference.get_path());
+        auto packages = aptrepo::Packages(aptrepo::internal::Download(reference.get_url(), "", std::move(content)));
+        for (const auto &package : packages.get_packages())
+        {
+            const auto &filename = package.get_filename();
+            if (filename.empty() || !filenames.insert(filename).second)
+            {
+                continue;
+            }
+
+            auto file = join_below(m_target, filename);
+            if (!file)
+            {
+                ++statistics.failed;
+                continue;
+            }
+            auto digest = aptrepo::internal::hex_to_bytes(package.get_field("SHA256"));
+            if (is_current(*file, package.get_size(), digest))
+            {
+                ++statistics.unchanged;
+                continue;
+            }
+            jobs.push_back({m_repo_url + "/" + filename, *file, package.get_size(), digest, false});
+        }
+    }
+    for (const auto &reference : indexes)
+    {
+        auto directory = reference.get_path().substr(0, reference.get_path().find_last_of('/'));
+        if (!directories.contains(directory))
+        {
+            spdlog::error("Mirror: No readable Packages index in {}", directory);
+            directories.insert(directory);
+            ++unreadable;
+        }
+    }
+
+    spdlog::info("Mirror: Fetching {} pool files", jobs.size());
+    fetch(jobs, statistics, scheduler);
+
+    if (unreadable > 0 || statistics.failed > 0)
+    {
+        spdlog::error("Mirror: Synchronization incomplete, not publishing {}", in_release_path.string());
+        std::filesystem::remove_all(staging);
+        return statistics;
+    }
+
+    // Move the indexes in place right before the InRelease listing them
+    for (const auto &[staged_path, path] : staged)
+    {
+        if (std::filesystem::exists(staged_path))
+        {
+            std::filesystem::create_directories(path.parent_path());
+            std::filesystem::rename(staged_path, path);
+        }
+    }
+    std::filesystem::remove_all(staging);
+
+    // Clients of Acquire-By-Hash repositories fetch the indexes by digest
+    for (const auto &[digest, path] : by_hash)
+    {
+        auto object = object_path(digest);
+        if (std::filesystem::exists(object) && !std::filesystem::exists(path))
+        {
+            link_or_copy(object, path);
+        }
+    }
+
+    // Publish the new InRelease atomically
+    auto temporary = in_release_path;
+    temporary += ".tmp";
+    std::filesystem::create_directories(in_release_path.parent_path());
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(in_release.data(), static_cast<std::streamsize>(in_release.size()));
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write InRelease");
+        }
+    }
+    std::filesystem::rename(temporary, in_release_path);
+
+    count_file("unchanged", statistics.unchanged);
+
+    spdlog::info("Mirror: {} downloaded ({} bytes), {} linked, {} unchanged, {} missing, {} failed",
+                 statistics.downloaded, statistics.bytes, statistics.linked, statistics.unchanged, statistics.missing, statistics.failed);
+
+    return statistics;
+}
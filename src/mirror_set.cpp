@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+#include <cpr/cpr.h>
+
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/utils.hpp"
+
+#include "aptrepo/mirror_set.hpp"
+
+namespace
+{
+    constexpr std::size_t max_latencies = 64;
+    constexpr std::size_t min_latencies = 5;
+    constexpr double smoothing = 0.3;
+    /// Score penalty in seconds per consecutive failure.
+    constexpr double failure_penalty = 1.0;
+
+    /******************************************************************************
+     * One request of a hedged download, shared with its worker thread.
+     ******************************************************************************/
+    struct Attempt
+    {
+        std::size_t mirror = 0;
+        std::string url;
+        std::chrono::steady_clock::time_point start;
+        bool done = false;
+        bool handled = false;
+        bool ok = false;
+        std::string etag;
+        std::string content;
+    };
+
+    struct HedgeState
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::atomic<bool> cancelled = false;
+        std::vector<std::shared_ptr<Attempt>> attempts;
+    };
+
+    void smooth(double &average, double sample)
+    {
+        average = average == 0 ? sample : average + smoothing * (sample - average);
+    }
+
+    void fetch(const std::shared_ptr<HedgeState> &state, const std::shared_ptr<Attempt> &attempt,
+               const std::string &sha256, std::chrono::milliseconds timeout)
+    {
+        bool ok = false;
+        std::string etag;
+        std::string content;
+
+        if (attempt->url.starts_with("file://"))
+        {
+            try
+            {
+                auto download = aptrepo::internal::download(attempt->url);
+                etag = download.get_etag();
+                content = download.get_content();
+                ok = true;
+            }
+            catch (const std::exception &)
+            {
+            }
+        }
+        else
+        {
+            // The callbacks abort the transfer as soon as another mirror won
+            cpr::Response r = cpr::Get(cpr::Url{attempt->url},
+                                       cpr::ConnectTimeout{aptrepo::internal::connect_timeout},
+                                       cpr::Timeout{timeout},
+                                       cpr::WriteCallback{[&](const std::string_view &data, intptr_t)
+                                                          {
+                                                              content.append(data);
+                                                              return !state->cancelled;
+                                                          }},
+                                       cpr::ProgressCallback{[&](auto, auto, auto, auto, intptr_t)
+                                                             { return !state->cancelled; }});
+            ok = r.status_code == 200 && !r.error;
+            etag = r.header["etag"];
+            if (!ok && !state->cancelled)
+            {
+                spdlog::warn("MirrorSet: Failed to download {}. Status code: {} {}", attempt->url, r.status_code, r.error.message);
+            }
+        }
+
+        if (ok && !sha256.empty() && aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(content)) != sha256)
+        {
+            spdlog::warn("MirrorSet: Hash mismatch for {}", attempt->url);
+            ok = false;
+        }
+
+        std::lock_guard lock(state->mutex);
+        attempt->done = true;
+        attempt->ok = ok;
+        attempt->etag = std::move(etag);
+        attempt->content = std::move(content);
+        state->finished.notify_all();
+    }
+}
+
+aptrepo::MirrorSet::MirrorSet(std::vector<std::string> mirrors, Options options)
+    : m_options(std::move(options))
+{
+    if (mirrors.empty())
+    {
+        throw std::invalid_argument("MirrorSet: no mirrors");
+    }
+
+    for (auto &url : mirrors)
+    {
+        while (url.ends_with('/'))
+        {
+            url.pop_back();
+        }
+        Mirror mirror;
+        mirror.status.url = std::move(url);
+        m_mirrors.push_back(std::move(mirror));
+    }
+}
+
+aptrepo::MirrorSet::MirrorSet(std::vector<std::string> mirrors)
+    : MirrorSet(std::move(mirrors), Options())
+{
+}
+
+aptrepo::MirrorSet::~MirrorSet()
+{
+    stop_probing();
+}
+
+std::vector<std::size_t> aptrepo::MirrorSet::ranking() const
+{
+    auto guess = std::chrono::duration<double>(m_options.initial_hedge_delay).count();
+    auto score = [&](const Mirror &mirror)
+    {
+        // The probes only measure the round trip, not how fast files are served
+        auto base = mirror.status.latency > 0 ? mirror.status.latency
+                    : mirror.status.rtt > 0   ? mirror.status.rtt
+                                              : guess;
+        return base + failure_penalty * static_cast<double>(mirror.failures_in_row);
+    };
+
+    std::vector<std::size_t> order(m_mirrors.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    // Stable, so the configured order breaks ties
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+                     { return score(m_mirrors[a]) < score(m_mirrors[b]); });
+    return order;
+}
+
+std::chrono::milliseconds aptrepo::MirrorSet::hedge_delay(std::size_t mirror) const
+{
+    auto latencies = m_mirrors[mirror].latencies;
+    if (latencies.size() < min_latencies)
+    {
+        return m_options.initial_hedge_delay;
+    }
+
+    auto rank = static_cast<std::size_t>(std::ceil(0.95 * static_cast<double>(latencies.size()))) - 1;
+    std::nth_element(latencies.begin(), latencies.begin() + static_cast<std::ptrdiff_t>(rank), latencies.end());
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(latencies[rank]));
+    return std::clamp(delay, m_options.min_hedge_delay, m_options.max_hedge_delay);
+}
+
+std::chrono::milliseconds aptrepo::MirrorSet::get_hedge_delay() const
+{
+    std::lock_guard lock(m_mutex);
+    return hedge_delay(ranking().front());
+}
+
+void aptrepo::MirrorSet::record(std::size_t index, bool ok, double latency, std::size_t bytes)
+{
+    std::lock_guard lock(m_mutex);
+    auto &mirror = m_mirrors[index];
+    mirror.status.requests++;
+
+    if (!ok)
+    {
+        mirror.status.failures++;
+        mirror.failures_in_row++;
+        return;
+    }
+
+    mirror.failures_in_row = 0;
+    smooth(mirror.status.latency, latency);
+    if (bytes > 0 && latency > 0)
+    {
+        smooth(mirror.status.throughput, static_cast<double>(bytes) / latency);
+    }
+    add_latency(mirror, latency);
+}
+
+void aptrepo::MirrorSet::record_cancelled(std::size_t index, double elapsed)
+{
+    std::lock_guard lock(m_mutex);
+    auto &mirror = m_mirrors[index];
+    mirror.status.requests++;
+
+    // The request would have taken at least this long, so the sample can only
+    // slow the mirror down; it is neither a success nor a failure
+    if (elapsed > mirror.status.latency)
+    {
+        smooth(mirror.status.latency, elapsed);
+    }
+    add_latency(mirror, elapsed);
+}
+
+void aptrepo::MirrorSet::add_latency(Mirror &mirror, double latency)
+{
+    if (mirror.latencies.size() < max_latencies)
+    {
+        mirror.latencies.push_back(latency);
+    }
+    else
+    {
+        mirror.latencies[mirror.next_latency] = latency;
+        mirror.next_latency = (mirror.next_latency + 1) % max_latencies;
+    }
+}
+
+std::vector<aptrepo::MirrorStatus> aptrepo::MirrorSet::get_status() const
+{
+    std::lock_guard lock(m_mutex);
+    std::vector<aptrepo::MirrorStatus> result;
+    for (auto index : ranking())
+    {
+        result.push_back(m_mirrors[index].status);
+    }
+    return result;
+}
+
+aptrepo::internal::Download aptrepo::MirrorSet::download(const std::string &path, const std::string &sha256)
+{
+    std::vector<std::size_t> order;
+    {
+        std::lock_guard lock(m_mutex);
+        order = ranking();
+    }
+
+    // Workers only use the shared state, losing requests may outlive this call
+    auto state = std::make_shared<HedgeState>();
+    std::size_t next = 0;
+    std::size_t running = 0;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+
+    auto start = [&]()
+    {
+        auto attempt = std::make_shared<Attempt>();
+        attempt->mirror = order[next++];
+        attempt->start = std::chrono::steady_clock::now();
+        {
+            std::lock_guard lock(m_mutex);
+            attempt->url = m_mirrors[attempt->mirror].status.url + "/" + path;
+            deadline = attempt->start + hedge_delay(attempt->mirror);
+        }
+        state->attempts.push_back(attempt);
+        running++;
+        std::thread(fetch, state, attempt, sha256, m_options.timeout).detach();
+    };
+
+    std::unique_lock lock(state->mutex);
+    start();
+
+    while (true)
+    {
+        state->finished.wait_until(lock, deadline, [&]()
+                                   { return std::any_of(state->attempts.begin(), state->attempts.end(), [](const auto &attempt)
+                                                        { return attempt->done && !attempt->handled; }); });
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto &attempt : state->attempts)
+        {
+            if (!attempt->done || attempt->handled)
+            {
+                continue;
+            }
+            attempt->handled = true;
+            running--;
+
+            auto latency = std::chrono::duration<double>(now - attempt->start).count();
+            record(attempt->mirror, attempt->ok, latency, attempt->content.size());
+
+            if (attempt->ok)
+            {
+                state->cancelled = true;
+                for (const auto &other : state->attempts)
+                {
+                    if (!other->done)
+                    {
+                        record_cancelled(other->mirror, std::chrono::duration<double>(now - other->start).count());
+                    }
+                }
+                if (aptrepo::internal::metrics_enabled())
+                {
+                    aptrepo::internal::count("aptrepo_mirror_downloads_total", 1, {{"mirror", m_mirrors[attempt->mirror].status.url}});
+                }
+                return aptrepo::internal::Download(attempt->url, attempt->etag, std::move(attempt->content));
+            }
+        }
+
+        if (running == 0 && next == order.size())
+        {
+            spdlog::error("MirrorSet: Failed to download {} from all mirrors.", path);
+            throw std::runtime_error("Download failed");
+        }
+
+        if (next < order.size() && (running == 0 || (running < 2 && now >= deadline)))
+        {
+            if (running > 0)
+            {
+                SPDLOG_DEBUG("MirrorSet: Hedging request for {}", path);
+                aptrepo::internal::count("aptrepo_mirror_hedged_total");
+            }
+            start();
+        }
+        else if (now >= deadline)
+        {
+            // Two requests are in flight, wait for one of them
+            deadline = std::chrono::steady_clock::time_point::max();
+        }
+    }
+}
+
+aptrepo::Release aptrepo::MirrorSet::parse_release(const std::string &distro)
+{
+    return aptrepo::Release(download("dists/" + distro + "/InRelease"));
+}
+
+aptrepo::Release aptrepo::MirrorSet::parse_release(const std::string &distro, const aptrepo::Keyring &keyring)
+{
+    return aptrepo::Release(download("dists/" + distro + "/InRelease"), keyring);
+}
+
+void aptrepo::MirrorSet::probe()
+{
+    std::vector<std::string> urls;
+    {
+        std::lock_guard lock(m_mutex);
+        for (const auto &mirror : m_mirrors)
+        {
+            urls.push_back(mirror.status.url + "/" + m_options.probe_path);
+        }
+    }
+
+    // Probe in parallel, so a stalled mirror does not delay the others
+    std::vector<double> rtts(urls.size(), -1);
+    {
+        std::vector<std::jthread> probes;
+        for (std::size_t i = 0; i < urls.size(); ++i)
+        {
+            probes.emplace_back([&, i]()
+                                {
+                                    auto start = std::chrono::steady_clock::now();
+                                    if (urls[i].starts_with("file://"))
+                                    {
+                                        rtts[i] = 0;
+                                        return;
+                                    }
+                                    auto r = cpr::Head(cpr::Url{urls[i]}, cpr::ConnectTimeout{aptrepo::internal::connect_timeout}, cpr::Timeout{m_options.timeout});
+                                    // Any HTTP response proves the mirror is reachable
+                                    if (r.status_code != 0)
+                                    {
+                                        rtts[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                                    } });
+        }
+    }
+
+    std::lock_guard lock(m_mutex);
+    for (std::size_t i = 0; i < rtts.size(); ++i)
+    {
+        auto &mirror = m_mirrors[i];
+        if (rtts[i] < 0)
+        {
+            spdlog::warn("MirrorSet: Probe of {} failed.", mirror.status.url);
+            mirror.failures_in_row++;
+            continue;
+        }
+        smooth(mirror.status.rtt, rtts[i]);
+        if (aptrepo::internal::metrics_enabled())
+        {
+            aptrepo::internal::gauge("aptrepo_mirror_rtt_seconds", mirror.status.rtt, {{"mirror", mirror.status.url}});
+        }
+    }
+}
+
+void aptrepo::MirrorSet::start_probing()
+{
+    if (m_prober.joinable())
+    {
+        return;
+    }
+
+    m_prober = std::jthread([this](std::stop_token stop)
+                            {
+                                while (!stop.stop_requested())
+                                {
+                                    probe();
+                                    std::unique_lock lock(m_probe_mutex);
+                                    m_probe_wake.wait_for(lock, stop, m_options.probe_interval, []
+                                                          { return false; });
+                                } });
+}
+
+void aptrepo::MirrorSet::stop_probing()
+{
+    if (m_prober.joinable())
+    {
+        m_prober.request_stop();
+        m_prober.join();
+    }
+}
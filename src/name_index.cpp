@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/utils.hpp"
+
+#include "aptrepo/name_index.hpp"
+
+namespace
+{
+    constexpr std::size_t block_size = 16;
+    constexpr std::string_view magic = "APTNIDX1";
+
+    bool match_class(std::string_view pattern, std::size_t &pos, char c)
+    {
+        // pattern[pos] is '[', on success pos is moved behind the closing ']'
+        auto i = pos + 1;
+        bool negate = false;
+        if (i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^'))
+        {
+            negate = true;
+            ++i;
+        }
+        bool matched = false;
+        bool first = true;
+        while (i < pattern.size() && (first || pattern[i] != ']'))
+        {
+            first = false;
+            if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']')
+            {
+                matched |= (c >= pattern[i] && c <= pattern[i + 2]);
+                i += 3;
+            }
+            else
+            {
+                matched |= (c == pattern[i]);
+                ++i;
+            }
+        }
+        pos = i + 1;
+        return matched != negate;
+    }
+
+    bool match_glob(std::string_view pattern, std::string_view name)
+    {
+        std::size_t p = 0;
+        std::size_t n = 0;
+        std::size_t star_p = std::string_view::npos;
+        std::size_t star_n = 0;
+
+        while (n < name.size())
+        {
+            if (p < pattern.size() && pattern[p] == '*')
+            {
+                star_p = p++;
+                star_n = n;
+                continue;
+            }
+            if (p < pattern.size())
+            {
+                auto next = p;
+                bool ok = false;
+                if (pattern[p] == '?')
+                {
+                    ok = true;
+                    next = p + 1;
+                }
+                else if (pattern[p] == '[' && pattern.find(']', p + 2) != std::string_view::npos)
+                {
+                    ok = match_class(pattern, next, name[n]);
+                }
+                else
+                {
+                    ok = pattern[p] == name[n];
+                    next = p + 1;
+                }
+                if (ok)
+                {
+                    p = next;
+                    ++n;
+                    continue;
+                }
+            }
+            if (star_p == std::string_view::npos)
+            {
+                return false;
+            }
+            // Backtrack: let the last '*' consume one more character
+            p = star_p + 1;
+            n = ++star_n;
+        }
+
+        while (p < pattern.size() && pattern[p] == '*')
+        {
+            ++p;
+        }
+        return p == pattern.size();
+    }
+
+    std::size_t common_prefix(std::string_view a, std::string_view b)
+    {
+        auto max = std::min(a.size(), b.size());
+        std::size_t i = 0;
+        while (i < max && a[i] == b[i])
+        {
+            ++i;
+        }
+        return i;
+    }
+}
+
+aptrepo::NameIndex::NameIndex(std::vector<std::string> names)
+{
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    m_size = names.size();
+    m_block_offsets.reserve((m_size + block_size - 1) / block_size);
+
+    std::string_view previous;
+    for (std::size_t i = 0; i < m_size; ++i)
+    {
+        std::string_view name = names[i];
+        std::size_t shared = 0;
+        if (i % block_size == 0)
+        {
+            if (m_data.size() > std::numeric_limits<std::uint32_t>::max())
+            {
+                throw std::length_error("NameIndex: Dictionary too large");
+            }
+            m_block_offsets.push_back(static_cast<std::uint32_t>(m_data.size()));
+        }
+        else
+        {
+            shared = common_prefix(previous, name);
+        }
+        aptrepo::internal::append_varint(m_data, shared);
+        aptrepo::internal::append_varint(m_data, name.size() - shared);
+        m_data.append(name.substr(shared));
+        previous = name;
+    }
+
+    spdlog::debug("NameIndex: Indexed {} names in {} bytes", m_size, m_data.size());
+}
+
+aptrepo::NameIndex::NameIndex(const std::vector<aptrepo::Packages> &packages)
+{
+    std::vector<std::string> names;
+    for (const auto &index : packages)
+    {
+        for (const auto &package : index.get_packages())
+        {
+            names.push_back(package.get_name());
+        }
+    }
+    *this = NameIndex(std::move(names));
+}
+
+template <typename Fn>
+void aptrepo::NameIndex::scan(std::size_t first, Fn &&fn) const
+{
+    // Calls fn(id, name, lcp) for all names starting at id first, where lcp is
+    // the length of the prefix shared with the previously visited name.
+    if (first >= m_size)
+    {
+        return;
+    }
+
+    std::string name;
+    std::size_t pos = m_block_offsets[first / block_size];
+    std::size_t id = first - first % block_size;
+    std::size_t last_visited_shared = 0;
+    bool visited = false;
+
+    for (; id < m_size; ++id)
+    {
+        auto shared = static_cast<std::size_t>(aptrepo::internal::read_varint(m_data, pos));
+        auto length = static_cast<std::size_t>(aptrepo::internal::read_varint(m_data, pos));
+        auto suffix = std::string_view(m_data).substr(pos, length);
+        pos += length;
+
+        if (id % block_size == 0)
+        {
+            // Block heads are stored in full, recompute the shared prefix
+            shared = common_prefix(name, suffix);
+            name.assign(suffix);
+        }
+        else
+        {
+            name.resize(shared);
+            name.append(suffix);
+        }
+
+        // The shared prefix with the last visited name is the minimum of all
+        // shared prefixes since then.
+        last_visited_shared = std::min(last_visited_shared, shared);
+        if (id < first)
+        {
+            continue;
+        }
+        if (!fn(id, std::string_view(name), visited ? last_visited_shared : std::size_t{0}))
+        {
+            return;
+        }
+        visited = true;
+        last_visited_shared = name.size();
+    }
+}
+
+std::size_t aptrepo::NameIndex::lower_bound(std::string_view name) const
+{
+    if (m_size == 0)
+    {
+        return 0;
+    }
+
+    // Binary search for the last block whose head is <= name
+    std::size_t lo = 0;
+    std::size_t hi = m_block_offsets.size();
+    while (hi - lo > 1)
+    {
+        auto mid = lo + (hi - lo) / 2;
+        std::size_t pos = m_block_offsets[mid];
+        aptrepo::internal::read_varint(m_data, pos);
+        auto length = static_cast<std::size_t>(aptrepo::internal::read_varint(m_data, pos));
+        auto head = std::string_view(m_data).substr(pos, length);
+        if (head <= name)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    auto result = m_size;
+    scan(lo * block_size, [&](std::size_t id, std::string_view current, std::size_t)
+         {
+             if (current >= name)
+             {
+                 result = id;
+                 return false;
+             }
+             return true;
+         });
+    return result;
+}
+
+std::size_t aptrepo::NameIndex::size() const
+{
+    return m_size;
+}
+
+std::string aptrepo::NameIndex::get_name(std::size_t id) const
+{
+    if (id >= m_size)
+    {
+        throw std::out_of_range("NameIndex: Invalid name id");
+    }
+
+    std::string result;
+    scan(id, [&](std::size_t, std::string_view name, std::size_t)
+         {
+             result = name;
+             return false;
+         });
+    return result;
+}
+
+std::optional<std::size_t> aptrepo::NameIndex::find(std::string_view name) const
+{
+    auto id = lower_bound(name);
+    if (id < m_size && get_name(id) == name)
+    {
+        return id;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string> aptrepo::NameIndex::find_prefix(std::string_view prefix, std::size_t limit) const
+{
+    std::vector<std::string> result;
+    scan(lower_bound(prefix), [&](std::size_t, std::string_view name, std::size_t)
+         {
+             if (!name.starts_with(prefix))
+             {
+                 return false;
+             }
+             result.emplace_back(name);
+             return limit == 0 || result.size() < limit;
+         });
+    return result;
+}
+
+std::vector<std::string> aptrepo::NameIndex::find_glob(std::string_view pattern, std::size_t limit) const
+{
+    // Names are sorted, so only the range sharing the literal prefix of the
+    // pattern must be checked.
+    auto literal = pattern.substr(0, pattern.find_first_of("*?["));
+
+    std::vector<std::string> result;
+    scan(lower_bound(literal), [&](std::size_t, std::string_view name, std::size_t)
+         {
+             if (!name.starts_with(literal))
+             {
+                 return false;
+             }
+             if (match_glob(pattern, name))
+             {
+                 result.emplace_back(name);
+             }
+             return limit == 0 || result.size() < limit;
+         });
+    return result;
+}
+
+std::vector<std::string> aptrepo::NameIndex::find_fuzzy(std::string_view term, std::size_t max_edits, std::size_t limit) const
+{
+    // Levenshtein rows are computed per character of the name. Consecutive
+    // names share their prefix, so the rows of the shared prefix are reused,
+    // and a prefix which already exceeds max_edits prunes all names sharing it.
+    const auto columns = term.size() + 1;
+    std::vector<std::size_t> rows(columns);
+    for (std::size_t j = 0; j < columns; ++j)
+    {
+        rows[j] = j;
+    }
+
+    std::size_t computed = 0;
+    std::size_t dead = std::numeric_limits<std::size_t>::max();
+
+    std::vector<std::string> result;
+    scan(0, [&](std::size_t, std::string_view name, std::size_t lcp)
+         {
+             computed = std::min(computed, lcp);
+             if (dead <= lcp)
+             {
+                 return true;
+             }
+             dead = std::numeric_limits<std::size_t>::max();
+
+             if (rows.size() < (name.size() + 1) * columns)
+             {
+                 rows.resize((name.size() + 1) * columns);
+             }
+
+             for (auto depth = computed + 1; depth <= name.size(); ++depth)
+             {
+                 auto previous = &rows[(depth - 1) * columns];
+                 auto row = &rows[depth * columns];
+                 row[0] = depth;
+                 auto minimum = row[0];
+                 for (std::size_t j = 1; j < columns; ++j)
+                 {
+                     auto cost = (term[j - 1] == name[depth - 1]) ? 0 : 1;
+                     row[j] = std::min({previous[j] + 1, row[j - 1] + 1, previous[j - 1] + cost});
+                     minimum = std::min(minimum, row[j]);
+                 }
+                 computed = depth;
+                 if (minimum > max_edits)
+                 {
+                     dead = depth;
+                     return true;
+                 }
+             }
+
+             if (rows[name.size() * columns + term.size()] <= max_edits)
+             {
+                 result.emplace_back(name);
+             }
+             return limit == 0 || result.size() < limit;
+         });
+    return result;
+}
+
+void aptrepo::NameIndex::save(std::ostream &out) const
+{
+    std::string header(magic);
+    aptrepo::internal::append_varint(header, m_size);
+    aptrepo::internal::append_varint(header, m_block_offsets.size());
+    for (auto offset : m_block_offsets)
+    {
+        aptrepo::internal::append_varint(header, offset);
+    }
+    aptrepo::internal::append_varint(header, m_data.size());
+
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    out.write(m_data.data(), static_cast<std::streamsize>(m_data.size()));
+    if (!out)
+    {
+        throw std::runtime_error("NameIndex: Failed to write index");
+    }
+}
+
+aptrepo::NameIndex aptrepo::NameIndex::load(std::istream &in)
+{
+    auto read_varint = [&in]()
+    {
+        std::uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            auto byte = in.get();
+            if (byte == std::istream::traits_type::eof())
+            {
+                break;
+            }
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return value;
+            }
+        }
+        throw std::runtime_error("NameIndex: Invalid index data");
+    };
+
+    std::string header(magic.size(), '\0');
+    in.read(header.data(), static_cast<std::streamsize>(header.size()));
+    if (!in || header != magic)
+    {
+        throw std::runtime_error("NameIndex: Invalid index data");
+    }
+
+    NameIndex index;
+    index.m_size = read_varint();
+    auto blocks = read_varint();
+    if (blocks != (index.m_size + block_size - 1) / block_size)
+    {
+        throw std::runtime_error("NameIndex: Invalid index data");
+    }
+    index.m_block_offsets.reserve(blocks);
+    for (std::uint64_t i = 0; i < blocks; ++i)
+    {
+        index.m_block_offsets.push_back(static_cast<std::uint32_t>(read_varint()));
+    }
+
+    index.m_data.resize(read_varint());
+    in.read(index.m_data.data(), static_cast<std::streamsize>(index.m_data.size()));
+    if (!in)
+    {
+        throw std::runtime_error("NameIndex: Invalid index data");
+    }
+    return index;
+}
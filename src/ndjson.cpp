@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/ndjson.hpp"
+
+namespace
+{
+    constexpr char hex_digits[] = "0123456789abcdef";
+
+    bool needs_escape(char c)
+    {
+        return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    }
+
+    void write_all(int fd, const char *data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            auto written = ::write(fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                spdlog::error("NdjsonWriter: Failed to write: {}", std::strerror(errno));
+                throw std::runtime_error("NdjsonWriter: write failed");
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+}
+
+aptrepo::NdjsonWriter::NdjsonWriter(int fd, std::size_t buffer_size)
+    : m_fd(fd), m_buffer(std::make_unique<char[]>(std::max<std::size_t>(buffer_size, 64))), m_capacity(std::max<std::size_t>(buffer_size, 64))
+{
+}
+
+aptrepo::NdjsonWriter::NdjsonWriter(const std::filesystem::path &path, std::size_t buffer_size)
+    : NdjsonWriter(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644), buffer_size)
+{
+    if (m_fd < 0)
+    {
+        spdlog::error("NdjsonWriter: Failed to open {}: {}", path.string(), std::strerror(errno));
+        throw std::runtime_error("NdjsonWriter: open failed");
+    }
+    m_owned = true;
+}
+
+aptrepo::NdjsonWriter::NdjsonWriter(Sink sink, std::size_t buffer_size)
+    : NdjsonWriter(-1, buffer_size)
+{
+    m_sink = std::move(sink);
+}
+
+aptrepo::NdjsonWriter::~NdjsonWriter()
+{
+    try
+    {
+        flush();
+    }
+    catch (const std::exception &)
+    {
+        // Already logged
+    }
+    if (m_owned)
+    {
+        ::close(m_fd);
+    }
+}
+
+void aptrepo::NdjsonWriter::flush()
+{
+    if (m_sink)
+    {
+        if (m_used > 0)
+        {
+            m_sink(std::string_view(m_buffer.get(), m_used));
+        }
+    }
+    else
+    {
+        write_all(m_fd, m_buffer.get(), m_used);
+    }
+    m_flushed += m_used;
+    m_used = 0;
+    m_record_start = 0;
+}
+
+std::size_t aptrepo::NdjsonWriter::get_records() const
+{
+    return m_records;
+}
+
+std::size_t aptrepo::NdjsonWriter::get_bytes() const
+{
+    return m_flushed + m_used;
+}
+
+void aptrepo::NdjsonWriter::make_room()
+{
+    if (!m_sink)
+    {
+        flush();
+        return;
+    }
+
+    // A sink only gets complete records, the current record stays in the buffer
+    if (m_record_start > 0)
+    {
+        m_sink(std::string_view(m_buffer.get(), m_record_start));
+        m_flushed += m_record_start;
+        m_used -= m_record_start;
+        std::memmove(m_buffer.get(), m_buffer.get() + m_record_start, m_used);
+        m_record_start = 0;
+    }
+    if (m_used == m_capacity)
+    {
+        auto buffer = std::make_unique<char[]>(m_capacity * 2);
+        std::memcpy(buffer.get(), m_buffer.get(), m_used);
+        m_buffer = std::move(buffer);
+        m_capacity *= 2;
+    }
+}
+
+void aptrepo::NdjsonWriter::put(char c)
+{
+    if (m_used == m_capacity)
+    {
+        make_room();
+    }
+    m_buffer[m_used++] = c;
+}
+
+void aptrepo::NdjsonWriter::put(std::string_view text)
+{
+    while (!text.empty())
+    {
+        if (m_used == m_capacity)
+        {
+            make_room();
+        }
+        auto count = std::min(text.size(), m_capacity - m_used);
+        std::memcpy(m_buffer.get() + m_used, text.data(), count);
+        m_used += count;
+        text.remove_prefix(count);
+    }
+}
+
+void aptrepo::NdjsonWriter::put_string(std::string_view value)
+{
+    put('"');
+    while (!value.empty())
+    {
+        // Copy runs of plain characters at once
+        auto run = static_cast<std::size_t>(std::find_if(value.begin(), value.end(), needs_escape) - value.begin());
+        put(value.substr(0, run));
+        if (run == value.size())
+        {
+            break;
+        }
+
+        auto c = value[run];
+        switch (c)
+        {
+        case '"':
+            put("\\\"");
+            break;
+        case '\\':
+            put("\\\\");
+            break;
+        case '\n':
+            put("\\n");
+            break;
+        case '\t':
+            put("\\t");
+            break;
+        case '\r':
+            put("\\r");
+            break;
+        default:
+            char escaped[] = {'\\', 'u', '0', '0', hex_digits[(c >> 4) & 0xf], hex_digits[c & 0xf]};
+            put(std::string_view(escaped, sizeof(escaped)));
+            break;
+        }
+        value.remove_prefix(run + 1);
+    }
+    put('"');
+}
+
+void aptrepo::NdjsonWriter::put_number(std::uint64_t value)
+{
+    char digits[20];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    put(std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)));
+}
+
+void aptrepo::NdjsonWriter::put_member(std::string_view key, std::string_view value)
+{
+    put(',');
+    put_string(key);
+    put(':');
+    put_string(value);
+}
+
+void aptrepo::NdjsonWriter::put_fields(const aptrepo::internal::FieldTable &fields)
+{
+    put(",\"fields\":{");
+    bool first = true;
+    fields.for_each([&](std::string_view key, const std::string &value)
+                    {
+                        if (!first)
+                        {
+                            put(',');
+                        }
+                        first = false;
+                        put_string(key);
+                        put(':');
+                        put_string(value); });
+    put('}');
+}
+
+void aptrepo::NdjsonWriter::end_record()
+{
+    put("}\n");
+    m_record_start = m_used;
+    m_records++;
+}
+
+void aptrepo::NdjsonWriter::write(const aptrepo::Release &release)
+{
+    put("{\"type\":\"release\"");
+    put_member("url", release.get_url());
+    put_member("etag", release.get_etag());
+    put_fields(release.get_fields());
+    end_record();
+}
+
+void aptrepo::NdjsonWriter::write(const aptrepo::Reference &reference, std::string_view release_url)
+{
+    put("{\"type\":\"reference\"");
+    put_member("release", release_url);
+    put_member("path", reference.get_path());
+    put_member("url", reference.get_url());
+    put(",\"size\":");
+    put_number(reference.get_size());
+    put_member("architecture", reference.get_architecture());
+    put_member("component", reference.get_component());
+    put(",\"hashes\":{");
+    bool first = true;
+    for (const auto &[algorithm, hash] : reference.get_hashes())
+    {
+        if (!first)
+        {
+            put(',');
+        }
+        first = false;
+        put_string(algorithm);
+        put(':');
+        put_string(hash);
+    }
+    put('}');
+    end_record();
+}
+
+void aptrepo::NdjsonWriter::write(const aptrepo::Package &package, std::string_view index_url)
+{
+    put("{\"type\":\"package\"");
+    put_member("index", index_url);
+    put_fields(package.get_fields());
+    end_record();
+}
+
+void aptrepo::NdjsonWriter::put_paths(std::string_view key, const std::vector<aptrepo::Reference> &references)
+{
+    put(',');
+    put_string(key);
+    put(":[");
+    for (std::size_t i = 0; i < references.size(); ++i)
+    {
+        if (i > 0)
+        {
+            put(',');
+        }
+        put_string(references[i].get_path());
+    }
+    put(']');
+}
+
+void aptrepo::NdjsonWriter::write(const aptrepo::ReleaseDiff &diff, const aptrepo::Release &release)
+{
+    put("{\"type\":\"diff\"");
+    put_member("release", release.get_url());
+    put_member("etag", release.get_etag());
+    put_paths("added", diff.added);
+    put_paths("removed", diff.removed);
+    put_paths("changed", diff.changed);
+    end_record();
+}
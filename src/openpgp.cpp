@@ -0,0 +1,672 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <format>
+#include <optional>
+#include <stdexcept>
+
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/param_build.h>
+#include <openssl/rsa.h>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/keyring.hpp"
+
+#include "aptrepo/internal/openpgp.hpp"
+
+namespace
+{
+    constexpr int tag_signature = 2;
+    constexpr int tag_public_key = 6;
+    constexpr int tag_public_subkey = 14;
+
+    constexpr int algorithm_rsa = 1;
+    constexpr int algorithm_rsa_sign = 3;
+    constexpr int algorithm_eddsa = 22;
+
+    constexpr int signature_canonical_text = 0x01;
+
+    /// OID 1.3.6.1.4.1.11591.15.1 of Ed25519 in EdDSA keys.
+    constexpr std::string_view ed25519_oid = "\x2b\x06\x01\x04\x01\xda\x47\x0f\x01";
+
+    /******************************************************************************
+     * Bounds checked reader of big-endian OpenPGP data.
+     ******************************************************************************/
+    class Reader
+    {
+    public:
+        explicit Reader(std::string_view data)
+            : m_data(data)
+        {
+        }
+
+        bool empty() const
+        {
+            return m_pos >= m_data.size();
+        }
+
+        std::size_t position() const
+        {
+            return m_pos;
+        }
+
+        std::string_view bytes(std::size_t count)
+        {
+            if (count > m_data.size() - m_pos)
+            {
+                throw std::runtime_error("OpenPGP: Truncated packet");
+            }
+            auto result = m_data.substr(m_pos, count);
+            m_pos += count;
+            return result;
+        }
+
+        std::uint32_t number(std::size_t count)
+        {
+            std::uint32_t result = 0;
+            for (auto c : bytes(count))
+            {
+                result = (result << 8) | static_cast<unsigned char>(c);
+            }
+            return result;
+        }
+
+        std::string_view mpi()
+        {
+            auto bits = number(2);
+            return bytes((bits + 7) / 8);
+        }
+
+    private:
+        std::string_view m_data;
+        std::size_t m_pos = 0;
+    };
+
+    struct Packet
+    {
+        int tag;
+        std::string_view body;
+    };
+
+    std::vector<Packet> read_packets(std::string_view data)
+    {
+        std::vector<Packet> packets;
+        Reader reader(data);
+        while (!reader.empty())
+        {
+            auto header = reader.number(1);
+            if (!(header & 0x80))
+            {
+                throw std::runtime_error("OpenPGP: Invalid packet header");
+            }
+
+            int tag = 0;
+            std::size_t length = 0;
+            if (header & 0x40)
+            {
+                // New format
+                tag = static_cast<int>(header & 0x3f);
+                auto first = reader.number(1);
+                if (first < 192)
+                {
+                    length = first;
+                }
+                else if (first < 224)
+                {
+                    length = ((first - 192) << 8) + reader.number(1) + 192;
+                }
+                else if (first == 255)
+                {
+                    length = reader.number(4);
+                }
+                else
+                {
+                    throw std::runtime_error("OpenPGP: Partial body lengths are not supported");
+                }
+            }
+            else
+            {
+                // Old format
+                tag = static_cast<int>((header >> 2) & 0x0f);
+                switch (header & 0x03)
+                {
+                case 0:
+                    length = reader.number(1);
+                    break;
+                case 1:
+                    length = reader.number(2);
+                    break;
+                case 2:
+                    length = reader.number(4);
+                    break;
+                default:
+                    length = data.size() - reader.position();
+                    break;
+                }
+            }
+            packets.push_back({tag, reader.bytes(length)});
+        }
+        return packets;
+    }
+
+    int base64_value(char c)
+    {
+        if (c >= 'A' && c <= 'Z')
+        {
+            return c - 'A';
+        }
+        if (c >= 'a' && c <= 'z')
+        {
+            return c - 'a' + 26;
+        }
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0' + 52;
+        }
+        if (c == '+')
+        {
+            return 62;
+        }
+        if (c == '/')
+        {
+            return 63;
+        }
+        return -1;
+    }
+
+    std::string base64_decode(std::string_view text)
+    {
+        std::string result;
+        result.reserve(text.size() * 3 / 4);
+        std::uint32_t buffer = 0;
+        int bits = 0;
+        for (auto c : text)
+        {
+            if (c == '=')
+            {
+                break;
+            }
+            auto value = base64_value(c);
+            if (value < 0)
+            {
+                // Whitespace
+                continue;
+            }
+            buffer = (buffer << 6) | static_cast<std::uint32_t>(value);
+            bits += 6;
+            if (bits >= 8)
+            {
+                bits -= 8;
+                result += static_cast<char>((buffer >> bits) & 0xff);
+            }
+        }
+        return result;
+    }
+
+    const EVP_MD *hash_algorithm(int algorithm)
+    {
+        // MD5 and SHA-1 are not accepted, like APT does
+        switch (algorithm)
+        {
+        case 8:
+            return EVP_sha256();
+        case 9:
+            return EVP_sha384();
+        case 10:
+            return EVP_sha512();
+        case 11:
+            return EVP_sha224();
+        default:
+            return nullptr;
+        }
+    }
+
+    int hash_algorithm_id(std::string_view name)
+    {
+        if (name == "SHA256")
+        {
+            return 8;
+        }
+        if (name == "SHA384")
+        {
+            return 9;
+        }
+        if (name == "SHA512")
+        {
+            return 10;
+        }
+        if (name == "SHA224")
+        {
+            return 11;
+        }
+        return 0;
+    }
+
+    std::string padded(std::string_view value, std::size_t size)
+    {
+        if (value.size() >= size)
+        {
+            return std::string(value);
+        }
+        return std::string(size - value.size(), '\0') + std::string(value);
+    }
+
+    EVP_PKEY *rsa_key(std::string_view modulus, std::string_view exponent)
+    {
+        auto n = BN_bin2bn(reinterpret_cast<const unsigned char *>(modulus.data()), static_cast<int>(modulus.size()), nullptr);
+        auto e = BN_bin2bn(reinterpret_cast<const unsigned char *>(exponent.data()), static_cast<int>(exponent.size()), nullptr);
+        auto builder = OSSL_PARAM_BLD_new();
+        OSSL_PARAM_BLD_push_BN(builder, OSSL_PKEY_PARAM_RSA_N, n);
+        OSSL_PARAM_BLD_push_BN(builder, OSSL_PKEY_PARAM_RSA_E, e);
+        auto params = OSSL_PARAM_BLD_to_param(builder);
+
+        EVP_PKEY *key = nullptr;
+        auto context = EVP_PKEY_CTX_new_from_name(nullptr, "RSA", nullptr);
+        if (context == nullptr || params == nullptr || EVP_PKEY_fromdata_init(context) <= 0 ||
+            EVP_PKEY_fromdata(context, &key, EVP_PKEY_PUBLIC_KEY, params) <= 0)
+        {
+            key = nullptr;
+        }
+
+        EVP_PKEY_CTX_free(context);
+        OSSL_PARAM_free(params);
+        OSSL_PARAM_BLD_free(builder);
+        BN_free(n);
+        BN_free(e);
+        return key;
+    }
+
+    std::optional<aptrepo::internal::PublicKey> parse_public_key(std::string_view body)
+    {
+        Reader reader(body);
+        if (reader.number(1) != 4)
+        {
+            SPDLOG_DEBUG("OpenPGP: Skipping key of unsupported version");
+            return std::nullopt;
+        }
+        reader.number(4);
+
+        aptrepo::internal::PublicKey result;
+        result.algorithm = static_cast<int>(reader.number(1));
+        EVP_PKEY *key = nullptr;
+        if (result.algorithm == algorithm_rsa || result.algorithm == algorithm_rsa_sign)
+        {
+            auto modulus = reader.mpi();
+            auto exponent = reader.mpi();
+            result.modulus_size = modulus.size();
+            key = rsa_key(modulus, exponent);
+        }
+        else if (result.algorithm == algorithm_eddsa)
+        {
+            auto oid = reader.bytes(reader.number(1));
+            auto point = reader.mpi();
+            // Native point format with a 0x40 prefix
+            if (oid != ed25519_oid || point.size() != 33 || point[0] != 0x40)
+            {
+                SPDLOG_DEBUG("OpenPGP: Skipping EdDSA key of unsupported curve");
+                return std::nullopt;
+            }
+            key = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, reinterpret_cast<const unsigned char *>(point.data() + 1), 32);
+        }
+        else
+        {
+            SPDLOG_DEBUG("OpenPGP: Skipping key of unsupported algorithm {}", result.algorithm);
+            return std::nullopt;
+        }
+        if (key == nullptr)
+        {
+            throw std::runtime_error("OpenPGP: Invalid public key");
+        }
+        result.key = std::shared_ptr<EVP_PKEY>(key, EVP_PKEY_free);
+
+        // Version 4 fingerprint: SHA-1 of the packet with an old format header
+        std::array<unsigned char, EVP_MAX_MD_SIZE> fingerprint;
+        unsigned int length = 0;
+        std::string packet = {'\x99', static_cast<char>(body.size() >> 8), static_cast<char>(body.size() & 0xff)};
+        packet += body;
+        EVP_Digest(packet.data(), packet.size(), fingerprint.data(), &length, EVP_sha1(), nullptr);
+        result.fingerprint = aptrepo::internal::bytes_to_hex(std::string_view(reinterpret_cast<const char *>(fingerprint.data()), length));
+        std::transform(result.fingerprint.begin(), result.fingerprint.end(), result.fingerprint.begin(), [](char c)
+                       { return static_cast<char>(std::toupper(static_cast<unsigned char>(c))); });
+        for (std::size_t i = length - 8; i < length; ++i)
+        {
+            result.key_id = (result.key_id << 8) | fingerprint[i];
+        }
+        return result;
+    }
+
+    /******************************************************************************
+     * Parsed version 4 signature packet.
+     ******************************************************************************/
+    struct Signature
+    {
+        int type = 0;
+        int public_key_algorithm = 0;
+        int hash_algorithm = 0;
+        std::uint64_t issuer = 0;
+        /// The hashed part of the packet, hashed after the signed data.
+        std::string_view hashed;
+        std::string_view left16;
+        std::vector<std::string_view> values;
+    };
+
+    void read_subpackets(std::string_view data, Signature &signature)
+    {
+        Reader reader(data);
+        while (!reader.empty())
+        {
+            std::size_t length = reader.number(1);
+            if (length >= 255)
+            {
+                length = reader.number(4);
+            }
+            else if (length >= 192)
+            {
+                length = ((length - 192) << 8) + reader.number(1) + 192;
+            }
+            auto subpacket = reader.bytes(length);
+            if (subpacket.empty())
+            {
+                continue;
+            }
+            auto type = static_cast<unsigned char>(subpacket[0]) & 0x7f;
+            // Issuer key ID, or issuer fingerprint with a version byte
+            std::string_view issuer;
+            if (type == 16 && subpacket.size() == 9)
+            {
+                issuer = subpacket.substr(1);
+            }
+            else if (type == 33 && subpacket.size() == 22 && subpacket[1] == 4)
+            {
+                issuer = subpacket.substr(14);
+            }
+            if (!issuer.empty())
+            {
+                signature.issuer = 0;
+                for (auto c : issuer)
+                {
+                    signature.issuer = (signature.issuer << 8) | static_cast<unsigned char>(c);
+                }
+            }
+        }
+    }
+
+    std::optional<Signature> parse_signature(std::string_view body)
+    {
+        Reader reader(body);
+        if (reader.number(1) != 4)
+        {
+            return std::nullopt;
+        }
+        Signature signature;
+        signature.type = static_cast<int>(reader.number(1));
+        signature.public_key_algorithm = static_cast<int>(reader.number(1));
+        signature.hash_algorithm = static_cast<int>(reader.number(1));
+        auto hashed = reader.bytes(reader.number(2));
+        signature.hashed = body.substr(0, reader.position());
+        auto unhashed = reader.bytes(reader.number(2));
+        read_subpackets(hashed, signature);
+        if (signature.issuer == 0)
+        {
+            read_subpackets(unhashed, signature);
+        }
+        signature.left16 = reader.bytes(2);
+        while (!reader.empty())
+        {
+            signature.values.push_back(reader.mpi());
+        }
+        return signature;
+    }
+
+    bool verify_digest(const aptrepo::internal::PublicKey &key, const Signature &signature, std::string_view digest)
+    {
+        std::string value;
+        if (key.algorithm == algorithm_eddsa && signature.public_key_algorithm == algorithm_eddsa && signature.values.size() == 2)
+        {
+            value = padded(signature.values[0], 32) + padded(signature.values[1], 32);
+            auto context = EVP_MD_CTX_new();
+            auto ok = EVP_DigestVerifyInit(context, nullptr, nullptr, nullptr, key.key.get()) > 0 &&
+                      EVP_DigestVerify(context, reinterpret_cast<const unsigned char *>(value.data()), value.size(),
+                                       reinterpret_cast<const unsigned char *>(digest.data()), digest.size()) == 1;
+            EVP_MD_CTX_free(context);
+            return ok;
+        }
+        if ((key.algorithm == algorithm_rsa || key.algorithm == algorithm_rsa_sign) &&
+            (signature.public_key_algorithm == algorithm_rsa || signature.public_key_algorithm == algorithm_rsa_sign) && signature.values.size() == 1)
+        {
+            value = padded(signature.values[0], key.modulus_size);
+            auto context = EVP_PKEY_CTX_new(key.key.get(), nullptr);
+            auto ok = context != nullptr && EVP_PKEY_verify_init(context) > 0 &&
+                      EVP_PKEY_CTX_set_rsa_padding(context, RSA_PKCS1_PADDING) > 0 &&
+                      EVP_PKEY_CTX_set_signature_md(context, hash_algorithm(signature.hash_algorithm)) > 0 &&
+                      EVP_PKEY_verify(context, reinterpret_cast<const unsigned char *>(value.data()), value.size(),
+                                      reinterpret_cast<const unsigned char *>(digest.data()), digest.size()) == 1;
+            EVP_PKEY_CTX_free(context);
+            return ok;
+        }
+        return false;
+    }
+}
+
+std::string aptrepo::internal::dearmor(std::string_view text)
+{
+    // Skip the BEGIN line and the armor headers up to the first empty line
+    auto begin = text.find("-----BEGIN ");
+    auto body = text.find("\n\n", begin);
+    auto crlf_body = text.find("\n\r\n", begin);
+    if (begin == std::string_view::npos || (body == std::string_view::npos && crlf_body == std::string_view::npos))
+    {
+        throw std::runtime_error("OpenPGP: Invalid armor");
+    }
+    body = std::min(body, crlf_body);
+    auto end = text.find("\n=", body);
+    end = std::min(end, text.find("-----END ", body));
+    return base64_decode(text.substr(body, end - body));
+}
+
+std::vector<aptrepo::internal::PublicKey> aptrepo::internal::parse_public_keys(std::string_view data)
+{
+    std::string binary;
+    if (data.find("-----BEGIN PGP PUBLIC KEY BLOCK-----") != std::string_view::npos)
+    {
+        // Armored files may contain several blocks
+        for (auto begin = data.find("-----BEGIN PGP PUBLIC KEY BLOCK-----"); begin != std::string_view::npos;
+             begin = data.find("-----BEGIN PGP PUBLIC KEY BLOCK-----", begin + 1))
+        {
+            binary += dearmor(data.substr(begin));
+        }
+        data = binary;
+    }
+
+    std::vector<PublicKey> keys;
+    for (const auto &packet : read_packets(data))
+    {
+        if (packet.tag == tag_public_key || packet.tag == tag_public_subkey)
+        {
+            if (auto key = parse_public_key(packet.body))
+            {
+                keys.push_back(std::move(*key));
+            }
+        }
+    }
+    return keys;
+}
+
+aptrepo::internal::ClearsignVerifier::ClearsignVerifier(const aptrepo::Keyring &keyring)
+    : m_keyring(keyring)
+{
+}
+
+aptrepo::internal::ClearsignVerifier::~ClearsignVerifier()
+{
+    for (auto &hash : m_hashes)
+    {
+        EVP_MD_CTX_free(hash.context);
+    }
+}
+
+void aptrepo::internal::ClearsignVerifier::add_hash(std::string_view name)
+{
+    auto algorithm = hash_algorithm_id(aptrepo::internal::trim(std::string(name)));
+    if (algorithm == 0 || std::any_of(m_hashes.begin(), m_hashes.end(), [&](const Hash &hash)
+                                      { return hash.algorithm == algorithm; }))
+    {
+        return;
+    }
+    auto context = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(context, hash_algorithm(algorithm), nullptr);
+    m_hashes.push_back({algorithm, context});
+}
+
+bool aptrepo::internal::ClearsignVerifier::add_line(std::string_view line)
+{
+    if (line.ends_with('\r'))
+    {
+        line.remove_suffix(1);
+    }
+
+    switch (m_state)
+    {
+    case State::Start:
+        if (line == "-----BEGIN PGP SIGNED MESSAGE-----")
+        {
+            m_state = State::Headers;
+        }
+        return false;
+    case State::Headers:
+        if (line.empty())
+        {
+            if (m_hashes.empty())
+            {
+                add_hash("SHA256");
+                add_hash("SHA512");
+            }
+            m_state = State::Text;
+        }
+        else if (line.starts_with("Hash:"))
+        {
+            line.remove_prefix(5);
+            for (auto comma = line.find(','); !line.empty(); comma = line.find(','))
+            {
+                add_hash(line.substr(0, comma));
+                line.remove_prefix(comma == std::string_view::npos ? line.size() : comma + 1);
+            }
+        }
+        return false;
+    case State::Text:
+        if (line == "-----BEGIN PGP SIGNATURE-----")
+        {
+            m_state = State::SignatureHeaders;
+            return false;
+        }
+        // Dash-escaped lines; trailing whitespace is not signed
+        if (line.starts_with("- "))
+        {
+            line.remove_prefix(2);
+        }
+        while (!line.empty() && (line.back() == ' ' || line.back() == '\t'))
+        {
+            line.remove_suffix(1);
+        }
+        for (auto &hash : m_hashes)
+        {
+            if (!m_first_line)
+            {
+                EVP_DigestUpdate(hash.context, "\r\n", 2);
+            }
+            EVP_DigestUpdate(hash.context, line.data(), line.size());
+        }
+        m_first_line = false;
+        return true;
+    case State::SignatureHeaders:
+        if (line.empty())
+        {
+            m_state = State::Signature;
+        }
+        else if (!line.contains(':'))
+        {
+            m_state = State::Signature;
+            add_line(line);
+        }
+        return false;
+    case State::Signature:
+        if (line.starts_with("-----END PGP SIGNATURE-----"))
+        {
+            m_state = State::End;
+        }
+        else if (!line.starts_with('='))
+        {
+            m_signature += line;
+        }
+        return false;
+    case State::End:
+        break;
+    }
+    return false;
+}
+
+std::string aptrepo::internal::ClearsignVerifier::verify()
+{
+    if (m_state != State::End)
+    {
+        spdlog::error("OpenPGP: Message is not clearsigned");
+        throw std::runtime_error("OpenPGP: Message is not clearsigned");
+    }
+
+    std::string reason = "no signature";
+    auto data = base64_decode(m_signature);
+    for (const auto &packet : read_packets(data))
+    {
+        if (packet.tag != tag_signature)
+        {
+            continue;
+        }
+        auto signature = parse_signature(packet.body);
+        if (!signature || signature->type != signature_canonical_text)
+        {
+            reason = "unsupported signature";
+            continue;
+        }
+        auto key = m_keyring.find(signature->issuer);
+        if (key == nullptr)
+        {
+            reason = std::format("unknown key {:016X}", signature->issuer);
+            continue;
+        }
+        auto hash = std::find_if(m_hashes.begin(), m_hashes.end(), [&](const Hash &hash)
+                                 { return hash.algorithm == signature->hash_algorithm; });
+        if (hash == m_hashes.end())
+        {
+            reason = std::format("unsupported hash algorithm {}", signature->hash_algorithm);
+            continue;
+        }
+
+        // Finish a copy of the text hash with the signature trailer
+        std::string trailer(signature->hashed);
+        auto length = static_cast<std::uint32_t>(signature->hashed.size());
+        trailer += {'\x04', '\xff', static_cast<char>(length >> 24), static_cast<char>(length >> 16), static_cast<char>(length >> 8), static_cast<char>(length)};
+        std::array<unsigned char, EVP_MAX_MD_SIZE> digest;
+        unsigned int digest_length = 0;
+        auto context = EVP_MD_CTX_new();
+        EVP_MD_CTX_copy_ex(context, hash->context);
+        EVP_DigestUpdate(context, trailer.data(), trailer.size());
+        EVP_DigestFinal_ex(context, digest.data(), &digest_length);
+        EVP_MD_CTX_free(context);
+
+        auto digest_view = std::string_view(reinterpret_cast<const char *>(digest.data()), digest_length);
+        if (digest_view.substr(0, 2) != signature->left16 || !verify_digest(*key, *signature, digest_view))
+        {
+            reason = std::format("bad signature of key {}", key->fingerprint);
+            continue;
+        }
+        SPDLOG_DEBUG("OpenPGP: Good signature of key {}", key->fingerprint);
+        return key->fingerprint;
+    }
+
+    spdlog::error("OpenPGP: Verification failed: {}", reason);
+    throw std::runtime_error("OpenPGP: Verification failed: " + reason);
+}
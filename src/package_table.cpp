@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <stdexcept>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/fields.hpp"
+
+#include "aptrepo/package_table.hpp"
+
+namespace
+{
+    constexpr std::size_t word_bits = 64;
+    /// Tables with fewer rows are scanned by the calling thread only.
+    constexpr std::size_t parallel_rows = 1 << 20;
+
+    std::size_t word_count(std::size_t size)
+    {
+        return (size + word_bits - 1) / word_bits;
+    }
+
+    std::uint64_t to_number(const std::string *value)
+    {
+        std::uint64_t result = 0;
+        if (value)
+        {
+            std::from_chars(value->data(), value->data() + value->size(), result);
+        }
+        return result;
+    }
+
+    /******************************************************************************
+     * Evaluate a predicate for each element of a column.
+     *
+     * The inner loop over 64 rows has no branches, so it is vectorized by the
+     * compiler. Large columns are split into word aligned ranges which are
+     * scanned in parallel.
+     ******************************************************************************/
+    template <typename T, typename Predicate>
+    aptrepo::Bitmap scan(const std::vector<T> &column, Predicate predicate)
+    {
+        const auto size = column.size();
+        std::vector<std::uint64_t> words(word_count(size));
+        const T *data = column.data();
+
+        auto kernel = [&](std::size_t first, std::size_t last)
+        {
+            for (auto w = first; w < last; ++w)
+            {
+                auto base = w * word_bits;
+                auto count = std::min(word_bits, size - base);
+                std::uint64_t word = 0;
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    word |= static_cast<std::uint64_t>(predicate(data[base + i])) << i;
+                }
+                words[w] = word;
+            }
+        };
+
+        auto threads = static_cast<std::size_t>(std::max(1u, std::thread::hardware_concurrency()));
+        if (size < parallel_rows || threads == 1)
+        {
+            kernel(0, words.size());
+        }
+        else
+        {
+            std::vector<std::jthread> workers;
+            auto chunk = (words.size() + threads - 1) / threads;
+            for (std::size_t first = chunk; first < words.size(); first += chunk)
+            {
+                workers.emplace_back(kernel, first, std::min(first + chunk, words.size()));
+            }
+            kernel(0, std::min(chunk, words.size()));
+        }
+        return aptrepo::Bitmap(std::move(words), size);
+    }
+}
+
+aptrepo::Bitmap::Bitmap(std::size_t size, bool value)
+    : m_words(word_count(size), value ? ~std::uint64_t(0) : 0), m_size(size)
+{
+    if (value && size % word_bits)
+    {
+        m_words.back() = (std::uint64_t(1) << (size % word_bits)) - 1;
+    }
+}
+
+aptrepo::Bitmap::Bitmap(std::vector<std::uint64_t> words, std::size_t size)
+    : m_words(std::move(words)), m_size(size)
+{
+    if (m_words.size() != word_count(size))
+    {
+        throw std::invalid_argument("Bitmap: word count does not match size");
+    }
+}
+
+std::size_t aptrepo::Bitmap::size() const
+{
+    return m_size;
+}
+
+std::size_t aptrepo::Bitmap::count() const
+{
+    std::size_t result = 0;
+    for (auto word : m_words)
+    {
+        result += static_cast<std::size_t>(std::popcount(word));
+    }
+    return result;
+}
+
+bool aptrepo::Bitmap::test(std::size_t index) const
+{
+    return index < m_size && (m_words[index / word_bits] >> (index % word_bits)) & 1;
+}
+
+void aptrepo::Bitmap::set(std::size_t index)
+{
+    if (index >= m_size)
+    {
+        throw std::out_of_range("Bitmap: index out of range");
+    }
+    m_words[index / word_bits] |= std::uint64_t(1) << (index % word_bits);
+}
+
+std::vector<std::size_t> aptrepo::Bitmap::indexes() const
+{
+    std::vector<std::size_t> result;
+    result.reserve(count());
+    for (std::size_t w = 0; w < m_words.size(); ++w)
+    {
+        for (auto word = m_words[w]; word; word &= word - 1)
+        {
+            result.push_back(w * word_bits + static_cast<std::size_t>(std::countr_zero(word)));
+        }
+    }
+    return result;
+}
+
+const std::vector<std::uint64_t> &aptrepo::Bitmap::get_words() const
+{
+    return m_words;
+}
+
+aptrepo::Bitmap &aptrepo::Bitmap::operator&=(const Bitmap &other)
+{
+    if (other.m_size != m_size)
+    {
+        throw std::invalid_argument("Bitmap: size mismatch");
+    }
+    for (std::size_t w = 0; w < m_words.size(); ++w)
+    {
+        m_words[w] &= other.m_words[w];
+    }
+    return *this;
+}
+
+aptrepo::Bitmap &aptrepo::Bitmap::operator|=(const Bitmap &other)
+{
+    if (other.m_size != m_size)
+    {
+        throw std::invalid_argument("Bitmap: size mismatch");
+    }
+    for (std::size_t w = 0; w < m_words.size(); ++w)
+    {
+        m_words[w] |= other.m_words[w];
+    }
+    return *this;
+}
+
+aptrepo::Bitmap aptrepo::Bitmap::operator~() const
+{
+    auto result = Bitmap(m_size, true);
+    for (std::size_t w = 0; w < m_words.size(); ++w)
+    {
+        result.m_words[w] &= ~m_words[w];
+    }
+    return result;
+}
+
+void aptrepo::PackageTable::Column::append(std::string_view value)
+{
+    auto search = codes.find(value);
+    if (search == codes.end())
+    {
+        search = codes.emplace(std::string(value), static_cast<std::uint32_t>(values.size())).first;
+        values.emplace_back(value);
+    }
+    rows.push_back(search->second);
+}
+
+aptrepo::PackageTable::PackageTable()
+    : PackageTable({"Package", "Source", "Version", "Architecture", "Section", "Priority"})
+{
+}
+
+aptrepo::PackageTable::PackageTable(const std::vector<std::string> &columns)
+{
+    m_columns.push_back({std::string(suite_column), {}, {}, {}});
+    for (const auto &name : columns)
+    {
+        if (name == suite_column)
+        {
+            continue;
+        }
+        // Well-known fields use their canonical spelling
+        auto field = aptrepo::internal::find_field(name);
+        m_columns.push_back({field ? std::string(aptrepo::internal::field_name(*field)) : name, {}, {}, {}});
+    }
+}
+
+void aptrepo::PackageTable::add(const aptrepo::Packages &packages, const std::string &suite)
+{
+    const auto &list = packages.get_packages();
+    for (auto &column : m_columns)
+    {
+        column.rows.reserve(column.rows.size() + list.size());
+    }
+    m_sizes.reserve(m_sizes.size() + list.size());
+    m_installed_sizes.reserve(m_installed_sizes.size() + list.size());
+
+    for (const auto &package : list)
+    {
+        add(package, suite);
+    }
+    spdlog::info("PackageTable: Added {} packages of {}, {} rows", list.size(), suite, size());
+}
+
+void aptrepo::PackageTable::add(const aptrepo::Package &package, const std::string &suite)
+{
+    const auto &fields = package.get_fields();
+    m_columns.front().append(suite);
+    for (std::size_t i = 1; i < m_columns.size(); ++i)
+    {
+        auto value = fields.find(m_columns[i].name);
+        m_columns[i].append(value ? std::string_view(*value) : std::string_view());
+    }
+    m_sizes.push_back(to_number(fields.find("Size")));
+    m_installed_sizes.push_back(to_number(fields.find("Installed-Size")));
+}
+
+std::size_t aptrepo::PackageTable::size() const
+{
+    return m_sizes.size();
+}
+
+std::vector<std::string> aptrepo::PackageTable::get_columns() const
+{
+    std::vector<std::string> names;
+    for (const auto &column : m_columns)
+    {
+        names.push_back(column.name);
+    }
+    return names;
+}
+
+const aptrepo::PackageTable::Column &aptrepo::PackageTable::column(std::string_view name) const
+{
+    for (const auto &column : m_columns)
+    {
+        if (aptrepo::internal::detail::iequals(column.name, name))
+        {
+            return column;
+        }
+    }
+    throw std::invalid_argument("PackageTable: unknown column " + std::string(name));
+}
+
+const std::vector<std::uint64_t> &aptrepo::PackageTable::numeric(Numeric column) const
+{
+    return column == Numeric::Size ? m_sizes : m_installed_sizes;
+}
+
+const std::string &aptrepo::PackageTable::get(std::string_view name, std::size_t row) const
+{
+    const auto &values = column(name);
+    return values.values[values.rows.at(row)];
+}
+
+std::uint64_t aptrepo::PackageTable::get(Numeric column, std::size_t row) const
+{
+    return numeric(column).at(row);
+}
+
+const std::vector<std::string> &aptrepo::PackageTable::get_values(std::string_view name) const
+{
+    return column(name).values;
+}
+
+aptrepo::Bitmap aptrepo::PackageTable::equals(std::string_view name, std::string_view value) const
+{
+    const auto &values = column(name);
+    auto search = values.codes.find(value);
+    if (search == values.codes.end())
+    {
+        // Not in the dictionary, no row can match
+        return Bitmap(size());
+    }
+    auto code = search->second;
+    return scan(values.rows, [code](std::uint32_t row)
+                { return row == code; });
+}
+
+aptrepo::Bitmap aptrepo::PackageTable::any_of(std::string_view name, const std::vector<std::string> &values) const
+{
+    const auto &dictionary = column(name);
+    // Lookup table indexed by the dictionary code
+    std::vector<std::uint8_t> matches(dictionary.values.size(), 0);
+    for (const auto &value : values)
+    {
+        if (auto search = dictionary.codes.find(value); search != dictionary.codes.end())
+        {
+            matches[search->second] = 1;
+        }
+    }
+    const auto *lookup = matches.data();
+    return scan(dictionary.rows, [lookup](std::uint32_t row)
+                { return lookup[row]; });
+}
+
+aptrepo::Bitmap aptrepo::PackageTable::greater(Numeric column, std::uint64_t value) const
+{
+    return scan(numeric(column), [value](std::uint64_t row)
+                { return row > value; });
+}
+
+aptrepo::Bitmap aptrepo::PackageTable::less(Numeric column, std::uint64_t value) const
+{
+    return scan(numeric(column), [value](std::uint64_t row)
+                { return row < value; });
+}
@@ -0,0 +1,262 @@
+#include <charconv>
+#include <optional>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/fields.hpp"
+#include "aptrepo/internal/metrics.hpp"
+
+#include "aptrepo/packages.hpp"
+
+namespace
+{
+    std::size_t to_size(const std::string &value)
+    {
+        std::size_t result = 0;
+        std::from_chars(value.data(), value.data() + value.size(), result);
+        return result;
+    }
+
+    /******************************************************************************
+     * Parse the stanzas of a Deb822 document.
+     *
+     * @param text The document.
+     * @param emit Function called with each parsed aptrepo::Package.
+     ******************************************************************************/
+    template <typename Emit>
+    void parse_stanzas(std::string_view text, Emit &&emit)
+    {
+        aptrepo::Package package;
+        bool has_fields = false;
+        std::string key;
+        std::string value;
+
+        auto flush_field = [&]()
+        {
+            if (!key.empty())
+            {
+                package.add_field(key, std::move(value));
+                has_fields = true;
+            }
+            key.clear();
+            value.clear();
+        };
+
+        auto flush_package = [&]()
+        {
+            flush_field();
+            if (has_fields)
+            {
+                emit(std::move(package));
+                package = aptrepo::Package();
+            }
+            has_fields = false;
+        };
+
+        std::size_t pos = 0;
+        while (pos < text.size())
+        {
+            auto end = text.find('\n', pos);
+            if (end == std::string_view::npos)
+            {
+                end = text.size();
+            }
+            auto line = text.substr(pos, end - pos);
+            pos = end + 1;
+
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.remove_suffix(1);
+            }
+
+            if (line.empty())
+            {
+                // An empty line terminates the stanza
+                flush_package();
+                continue;
+            }
+
+            if (line[0] == '#')
+            {
+                // Skip comments
+                continue;
+            }
+
+            if (line[0] == ' ' || line[0] == '\t')
+            {
+                // Continuation line of a multiline field
+                if (!key.empty())
+                {
+                    value += '\n';
+                    value += line.substr(1);
+                }
+                continue;
+            }
+
+            flush_field();
+
+            auto colon = line.find(':');
+            if (colon == std::string_view::npos)
+            {
+                spdlog::warn("Packages: Ignoring malformed line: {}", line);
+                continue;
+            }
+
+            key = line.substr(0, colon);
+            auto rest = line.substr(colon + 1);
+            auto first = rest.find_first_not_of(" \t");
+            auto last = rest.find_last_not_of(" \t");
+            if (first != std::string_view::npos)
+            {
+                value = rest.substr(first, last - first + 1);
+            }
+        }
+        flush_package();
+    }
+}
+
+aptrepo::Package::Package(std::string_view stanza)
+{
+    bool first = true;
+    parse_stanzas(stanza, [&](Package &&package)
+                  {
+                      if (first)
+                      {
+                          m_fields = std::move(package.m_fields);
+                          first = false;
+                      } });
+}
+
+void aptrepo::Package::add_field(std::string_view key, std::string value)
+{
+    m_fields.set(key, std::move(value));
+}
+
+std::string aptrepo::Package::get_field(std::string_view key) const
+{
+    auto value = m_fields.find(key);
+    if (value)
+    {
+        return *value;
+    }
+    return {};
+}
+
+const aptrepo::internal::FieldTable &aptrepo::Package::get_fields() const
+{
+    return m_fields;
+}
+
+aptrepo::Package::operator std::string() const
+{
+    std::string result;
+    m_fields.for_each([&result](std::string_view key, const std::string &value)
+                      {
+                          result += key;
+                          result += ": ";
+                          for (auto c : value)
+                          {
+                              result += c;
+                              if (c == '\n')
+                              {
+                                  result += ' ';
+                              }
+                          }
+                          result += '\n';
+                      });
+    return result;
+}
+
+const std::string &aptrepo::Package::get_name() const
+{
+    return m_fields.get(aptrepo::internal::Field::Package);
+}
+
+const std::string &aptrepo::Package::get_version() const
+{
+    return m_fields.get(aptrepo::internal::Field::Version);
+}
+
+const std::string &aptrepo::Package::get_architecture() const
+{
+    return m_fields.get(aptrepo::internal::Field::Architecture);
+}
+
+const std::string &aptrepo::Package::get_section() const
+{
+    return m_fields.get(aptrepo::internal::Field::Section);
+}
+
+const std::string &aptrepo::Package::get_priority() const
+{
+    return m_fields.get(aptrepo::internal::Field::Priority);
+}
+
+const std::string &aptrepo::Package::get_filename() const
+{
+    return m_fields.get(aptrepo::internal::Field::Filename);
+}
+
+const std::string &aptrepo::Package::get_description() const
+{
+    return m_fields.get(aptrepo::internal::Field::Description);
+}
+
+std::size_t aptrepo::Package::get_size() const
+{
+    return to_size(m_fields.get(aptrepo::internal::Field::Size));
+}
+
+std::size_t aptrepo::Package::get_installed_size() const
+{
+    return to_size(m_fields.get(aptrepo::internal::Field::InstalledSize));
+}
+
+aptrepo::Packages::Packages(aptrepo::internal::Download download)
+    : m_url(download.get_url()), m_etag(download.get_etag())
+{
+    // Labels are only allocated while a sink is installed
+    std::optional<aptrepo::internal::ScopedTimer> timer;
+    if (aptrepo::internal::metrics_enabled())
+    {
+        timer.emplace("aptrepo_parse_seconds", aptrepo::MetricLabels{{"index", "packages"}});
+    }
+
+    const auto &content = download.get_content();
+    parse_stanzas(content, [this](Package &&package)
+                  { m_packages.push_back(std::move(package)); });
+
+    if (aptrepo::internal::metrics_enabled())
+    {
+        aptrepo::internal::gauge("aptrepo_packages_stanzas", static_cast<double>(m_packages.size()), {{"index", m_url}});
+    }
+
+    spdlog::info("Packages: Parsed {} packages from {}", m_packages.size(), m_url);
+}
+
+std::string aptrepo::Packages::get_url() const
+{
+    return m_url;
+}
+
+std::string aptrepo::Packages::get_etag() const
+{
+    return m_etag;
+}
+
+const std::vector<aptrepo::Package> &aptrepo::Packages::get_packages() const
+{
+    return m_packages;
+}
+
+std::vector<std::string> aptrepo::Packages::get_names() const
+{
+    std::vector<std::string> names;
+    names.reserve(m_packages.size());
+    for (const auto &package : m_packages)
+    {
+        names.push_back(package.get_name());
+    }
+    return names;
+}
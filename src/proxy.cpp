@@ -0,0 +1,475 @@
+#include <array>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+#include <cpr/cpr.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/utils.hpp"
+#include "aptrepo/release.hpp"
+
+#include "aptrepo/proxy.hpp"
+
+namespace
+{
+    void count_request(const char *result)
+    {
+        if (aptrepo::internal::metrics_enabled())
+        {
+            aptrepo::internal::count("aptrepo_proxy_requests_total", 1, {{"result", result}});
+        }
+    }
+
+    constexpr std::string_view http_scheme = "http://";
+    constexpr std::string_view by_hash_sha256 = "/by-hash/SHA256/";
+
+    std::string read_file(const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    std::string hash_file(const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        aptrepo::internal::Sha256 hash;
+        std::array<char, 64 * 1024> buffer;
+        while (file)
+        {
+            file.read(buffer.data(), buffer.size());
+            hash.update(std::string_view(buffer.data(), static_cast<std::size_t>(file.gcount())));
+        }
+        return aptrepo::internal::bytes_to_hex(hash.digest());
+    }
+
+    std::string file_name(const std::string &key)
+    {
+        return key.substr(key.find_last_of('/') + 1);
+    }
+
+    bool is_release_file(const std::string &key)
+    {
+        auto name = file_name(key);
+        return name == "InRelease" || name == "Release" || name == "Release.gpg";
+    }
+
+    std::size_t dists_position(const std::string &key)
+    {
+        if (key.starts_with("dists/"))
+        {
+            return 0;
+        }
+        auto pos = key.find("/dists/");
+        return pos == std::string::npos ? pos : pos + 1;
+    }
+}
+
+aptrepo::CachingProxy::CachingProxy(std::string upstream_url, std::filesystem::path cache_dir, Options options)
+    : m_upstream_url(std::move(upstream_url)), m_cache_dir(std::move(cache_dir)), m_options(std::move(options))
+{
+    while (m_upstream_url.ends_with('/'))
+    {
+        m_upstream_url.pop_back();
+    }
+}
+
+aptrepo::CachingProxy::CachingProxy(std::string upstream_url, std::filesystem::path cache_dir)
+    : CachingProxy(std::move(upstream_url), std::move(cache_dir), Options())
+{
+}
+
+aptrepo::CachingProxy::~CachingProxy()
+{
+    stop();
+}
+
+void aptrepo::CachingProxy::start()
+{
+    if (m_server)
+    {
+        return;
+    }
+
+    std::filesystem::create_directories(m_cache_dir);
+    m_server = std::make_unique<aptrepo::internal::HttpServer>([this](const aptrepo::internal::HttpRequest &request)
+                                                               { return handle(request); },
+                                                               m_options.address, m_options.port);
+
+    spdlog::info("Proxy: Serving {} from {} on {}", m_upstream_url.empty() ? "http://" : m_upstream_url, m_cache_dir.string(), m_server->get_url());
+}
+
+void aptrepo::CachingProxy::stop()
+{
+    if (m_server)
+    {
+        m_server->stop();
+        m_server.reset();
+    }
+}
+
+std::string aptrepo::CachingProxy::get_url() const
+{
+    if (!m_server)
+    {
+        throw std::runtime_error("Proxy: not started");
+    }
+    return m_server->get_url();
+}
+
+aptrepo::CachingProxy::Statistics aptrepo::CachingProxy::get_statistics() const
+{
+    Statistics statistics;
+    statistics.requests = m_requests;
+    statistics.hits = m_hits;
+    statistics.misses = m_misses;
+    statistics.coalesced = m_coalesced;
+    statistics.revalidated = m_revalidated;
+    statistics.rejected = m_rejected;
+    statistics.upstream_bytes = m_upstream_bytes;
+    return statistics;
+}
+
+aptrepo::CachingProxy::Kind aptrepo::CachingProxy::classify(const std::string &key)
+{
+    if (key.find("/by-hash/") != std::string::npos)
+    {
+        return Kind::Immutable;
+    }
+    if (is_release_file(key))
+    {
+        return Kind::Volatile;
+    }
+    if (dists_position(key) != std::string::npos)
+    {
+        return Kind::Index;
+    }
+    if (key.starts_with("pool/") || key.find("/pool/") != std::string::npos ||
+        key.ends_with(".deb") || key.ends_with(".udeb") || key.ends_with(".ddeb") || key.ends_with(".dsc"))
+    {
+        // Debian never changes the content of a published pool file
+        return Kind::Immutable;
+    }
+    return Kind::Volatile;
+}
+
+aptrepo::internal::HttpResponse aptrepo::CachingProxy::handle(const aptrepo::internal::HttpRequest &request)
+{
+    m_requests++;
+
+    aptrepo::internal::HttpResponse response;
+
+    if (request.method != "GET" && request.method != "HEAD")
+    {
+        response.status = 405;
+        return response;
+    }
+
+    std::string base;
+    std::string key;
+    const auto &target = request.target;
+    if (target.starts_with(http_scheme))
+    {
+        if (!m_upstream_url.empty())
+        {
+            // Forward proxy requests are only allowed for the configured upstream
+            if (!target.starts_with(m_upstream_url + "/"))
+            {
+                response.status = 403;
+                return response;
+            }
+            base = m_upstream_url;
+            key = target.substr(m_upstream_url.size() + 1);
+        }
+        else
+        {
+            // Cache key is host and path, e.g. "deb.debian.org/debian/dists/..."
+            base = "http:/";
+            key = target.substr(http_scheme.size());
+        }
+    }
+    else if (!m_upstream_url.empty() && target.starts_with('/'))
+    {
+        base = m_upstream_url;
+        key = target.substr(1);
+    }
+    else
+    {
+        response.status = 400;
+        return response;
+    }
+
+    key = key.substr(0, key.find('?'));
+    // The key is used as path below the cache directory
+    if (!aptrepo::internal::is_safe_path(key))
+    {
+        response.status = 403;
+        return response;
+    }
+
+    SPDLOG_DEBUG("Proxy: {} {}", request.method, key);
+
+    response.status = resolve(base, key);
+    if (response.status != 200)
+    {
+        return response;
+    }
+
+    std::string etag;
+    {
+        std::lock_guard lock(m_mutex);
+        if (auto search = m_entries.find(key); search != m_entries.end())
+        {
+            etag = search->second.etag;
+        }
+    }
+
+    if (!etag.empty())
+    {
+        response.headers["ETag"] = etag;
+        if (request.get_header("If-None-Match") == etag)
+        {
+            response.status = 304;
+            return response;
+        }
+    }
+
+    response.headers["Content-Type"] = "application/octet-stream";
+    response.file = m_cache_dir / key;
+    return response;
+}
+
+int aptrepo::CachingProxy::resolve(const std::string &base, const std::string &key)
+{
+    auto kind = classify(key);
+    auto path = m_cache_dir / key;
+
+    std::string expected;
+    if (kind == Kind::Index)
+    {
+        expected = expected_digest(base, key);
+        if (expected.empty())
+        {
+            // Not listed in the Release, no digest to validate against
+            kind = Kind::Volatile;
+        }
+        else
+        {
+            bool known = false;
+            {
+                std::lock_guard lock(m_mutex);
+                auto search = m_entries.find(key);
+                known = search != m_entries.end() && !search->second.digest.empty();
+            }
+            std::error_code ec;
+            if (!known && std::filesystem::is_regular_file(path, ec))
+            {
+                // File cached by an earlier run, hash it once
+                auto digest = hash_file(path);
+                std::lock_guard lock(m_mutex);
+                m_entries[key].digest = digest;
+            }
+        }
+    }
+
+    std::promise<int> promise;
+    std::shared_future<int> future;
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (auto search = m_inflight.find(key); search != m_inflight.end())
+        {
+            future = search->second;
+        }
+        else
+        {
+            std::error_code ec;
+            bool cached = std::filesystem::is_regular_file(path, ec);
+            auto entry = m_entries.find(key);
+
+            bool fresh = false;
+            switch (kind)
+            {
+            case Kind::Immutable:
+                fresh = cached;
+                break;
+            case Kind::Index:
+                fresh = cached && entry != m_entries.end() && entry->second.digest == expected;
+                break;
+            case Kind::Volatile:
+                fresh = cached && entry != m_entries.end() &&
+                        entry->second.fetched != std::chrono::steady_clock::time_point() &&
+                        std::chrono::steady_clock::now() - entry->second.fetched < m_options.ttl;
+                break;
+            }
+
+            if (fresh)
+            {
+                m_hits++;
+                count_request("hit");
+                return 200;
+            }
+
+            promise = std::promise<int>();
+            m_inflight[key] = promise.get_future().share();
+        }
+    }
+
+    if (future.valid())
+    {
+        m_coalesced++;
+        count_request("coalesced");
+        return future.get();
+    }
+
+    m_misses++;
+    count_request("miss");
+
+    int status = 502;
+    try
+    {
+        status = fetch(base, key, kind, expected);
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::error("Proxy: Fetching {} failed: {}", key, e.what());
+    }
+
+    promise.set_value(status);
+    {
+        std::lock_guard lock(m_mutex);
+        m_inflight.erase(key);
+    }
+    return status;
+}
+
+int aptrepo::CachingProxy::fetch(const std::string &base, const std::string &key, Kind kind, const std::string &expected)
+{
+    auto url = base + "/" + key;
+    auto path = m_cache_dir / key;
+    std::filesystem::create_directories(path.parent_path());
+
+    auto temporary = path;
+    std::string etag;
+    {
+        std::lock_guard lock(m_mutex);
+        temporary += std::format(".tmp{}", m_tmp_counter++);
+        std::error_code ec;
+        if (auto search = m_entries.find(key); kind == Kind::Volatile && search != m_entries.end() && std::filesystem::is_regular_file(path, ec))
+        {
+            etag = search->second.etag;
+        }
+    }
+
+    cpr::Header header;
+    if (!etag.empty())
+    {
+        header["If-None-Match"] = etag;
+    }
+
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        spdlog::error("Proxy: Failed to open {} for writing.", temporary.string());
+        return 502;
+    }
+
+    aptrepo::internal::Sha256 hash;
+    std::size_t bytes = 0;
+    cpr::Response r = cpr::Get(cpr::Url{url}, header,
+                               cpr::WriteCallback{[&](const std::string_view &data, intptr_t)
+                                                  {
+                                                      hash.update(data);
+                                                      bytes += data.size();
+                                                      file.write(data.data(), static_cast<std::streamsize>(data.size()));
+                                                      return static_cast<bool>(file);
+                                                  }});
+    file.close();
+    m_upstream_bytes += bytes;
+    aptrepo::internal::count("aptrepo_proxy_upstream_bytes_total", static_cast<double>(bytes));
+
+    std::error_code ec;
+    if (r.status_code == 304 && !etag.empty())
+    {
+        std::filesystem::remove(temporary, ec);
+        m_revalidated++;
+        std::lock_guard lock(m_mutex);
+        m_entries[key].fetched = std::chrono::steady_clock::now();
+        return 200;
+    }
+
+    if (r.status_code != 200 || !file)
+    {
+        std::filesystem::remove(temporary, ec);
+        spdlog::error("Proxy: Failed to fetch {}. Status code: {}", url, r.status_code);
+        return r.status_code == 404 ? 404 : 502;
+    }
+
+    auto digest = aptrepo::internal::bytes_to_hex(hash.digest());
+
+    auto by_hash = key.find(by_hash_sha256);
+    if ((!expected.empty() && digest != expected) ||
+        (by_hash != std::string::npos && key.substr(by_hash + by_hash_sha256.size()) != digest))
+    {
+        std::filesystem::remove(temporary, ec);
+        spdlog::error("Proxy: Hash mismatch for {}", url);
+        m_rejected++;
+        return 502;
+    }
+
+    // Clients still sending the old file keep their open descriptor
+    std::filesystem::rename(temporary, path);
+
+    std::lock_guard lock(m_mutex);
+    m_entries[key] = Entry{r.header["etag"], digest, std::chrono::steady_clock::now()};
+    if (is_release_file(key))
+    {
+        m_release_digests.erase(key);
+    }
+    return 200;
+}
+
+std::string aptrepo::CachingProxy::expected_digest(const std::string &base, const std::string &key)
+{
+    auto dists = dists_position(key);
+    auto suite_end = key.find('/', dists + 6);
+    if (suite_end == std::string::npos)
+    {
+        return {};
+    }
+
+    auto release_key = key.substr(0, suite_end) + "/InRelease";
+    auto path = key.substr(suite_end + 1);
+
+    if (resolve(base, release_key) != 200)
+    {
+        return {};
+    }
+
+    std::lock_guard lock(m_mutex);
+
+    auto search = m_release_digests.find(release_key);
+    if (search == m_release_digests.end())
+    {
+        auto content = read_file(m_cache_dir / release_key);
+        auto release = aptrepo::Release(aptrepo::internal::Download(base + "/" + release_key, m_entries[release_key].etag, std::move(content)));
+
+        std::map<std::string, std::string> digests;
+        for (const auto &ref : release.get_references())
+        {
+            auto digest = ref.get_hash("SHA256");
+            if (!digest.empty())
+            {
+                digests[ref.get_path()] = digest;
+            }
+        }
+        search = m_release_digests.emplace(release_key, std::move(digests)).first;
+    }
+
+    auto digest = search->second.find(path);
+    return digest != search->second.end() ? digest->second : std::string();
+}
@@ -0,0 +1,706 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/unix_socket.hpp"
+#include "aptrepo/diff.hpp"
+#include "aptrepo/history.hpp"
+
+#include "aptrepo/query_server.hpp"
+
+namespace
+{
+    /// Time a client may block a response before it is dropped.
+    constexpr timeval send_timeout = {1, 0};
+
+    /// Longest accepted request line.
+    constexpr std::size_t max_request = 64 * 1024;
+
+    /// Commands taking the URL of an InRelease file as first argument.
+    constexpr std::string_view suite_commands[] = {"release", "field", "architectures", "components",
+                                                   "references", "digest", "package", "refresh"};
+
+    std::vector<std::string_view> split_words(std::string_view line)
+    {
+        std::vector<std::string_view> words;
+        std::size_t pos = 0;
+        while (pos < line.size())
+        {
+            auto start = line.find_first_not_of(" \t\r", pos);
+            if (start == std::string_view::npos)
+            {
+                break;
+            }
+            auto end = std::min(line.find_first_of(" \t\r", start), line.size());
+            words.push_back(line.substr(start, end - start));
+            pos = end;
+        }
+        return words;
+    }
+
+    void append_lines(std::vector<std::string> &lines, std::string_view text)
+    {
+        while (!text.empty())
+        {
+            auto end = std::min(text.find('\n'), text.size());
+            lines.emplace_back(text.substr(0, end));
+            text.remove_prefix(std::min(end + 1, text.size()));
+        }
+    }
+
+    void require_arguments(const std::vector<std::string_view> &words, std::size_t min, std::size_t max, std::string_view usage)
+    {
+        if (words.size() - 1 < min || words.size() - 1 > max)
+        {
+            throw std::runtime_error(std::format("usage: {}", usage));
+        }
+    }
+}
+
+aptrepo::QueryServer::QueryServer(Options options)
+    : m_options(std::move(options))
+{
+    if (m_options.socket.empty())
+    {
+        m_options.socket = default_socket();
+    }
+    if (!m_options.keyring.empty())
+    {
+        m_keyring = aptrepo::Keyring::load(m_options.keyring);
+    }
+}
+
+aptrepo::QueryServer::QueryServer()
+    : QueryServer(Options())
+{
+}
+
+aptrepo::QueryServer::~QueryServer()
+{
+    stop();
+}
+
+void aptrepo::QueryServer::start()
+{
+    if (m_listen_socket >= 0)
+    {
+        return;
+    }
+    m_listen_socket = aptrepo::internal::listen_unix(m_options.socket);
+    if (::pipe2(m_wakeup, O_CLOEXEC) < 0)
+    {
+        ::close(m_listen_socket);
+        m_listen_socket = -1;
+        spdlog::error("QueryServer: Failed to create pipe: {}", std::strerror(errno));
+        throw std::runtime_error("QueryServer: pipe failed");
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = false;
+    }
+    m_accept_thread = std::thread(&QueryServer::accept_loop, this);
+    m_poll_thread = std::thread(&QueryServer::poll_loop, this);
+    spdlog::info("QueryServer: Listening on {}", m_options.socket.string());
+}
+
+void aptrepo::QueryServer::stop()
+{
+    if (m_listen_socket < 0)
+    {
+        return;
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_stopped.notify_all();
+
+    // Wakes up the polls of the accept thread and of all connections
+    ::close(m_wakeup[1]);
+    m_accept_thread.join();
+    m_poll_thread.join();
+    for (auto &connection : m_connections)
+    {
+        connection.thread.join();
+    }
+    m_connections.clear();
+    ::close(m_wakeup[0]);
+    ::close(m_listen_socket);
+    m_listen_socket = -1;
+
+    std::error_code ec;
+    std::filesystem::remove(m_options.socket, ec);
+    spdlog::info("QueryServer: Stopped");
+}
+
+std::vector<std::string> aptrepo::QueryServer::query(std::string_view request)
+{
+    auto words = split_words(request);
+    if (words.empty())
+    {
+        throw std::runtime_error("empty request");
+    }
+
+    std::vector<std::string> lines;
+    auto command = words[0];
+    if (command == "ping")
+    {
+        require_arguments(words, 0, 0, "ping");
+        return lines;
+    }
+    if (command == "stats")
+    {
+        require_arguments(words, 0, 0, "stats");
+        auto statistics = get_statistics();
+        auto snapshot = m_store.snapshot();
+        lines.push_back(std::format("releases {}", snapshot->releases.size()));
+        lines.push_back(std::format("indexes {}", snapshot->packages.size()));
+        lines.push_back(std::format("queries {}", statistics.queries));
+        lines.push_back(std::format("failed {}", statistics.failed));
+        lines.push_back(std::format("loads {}", statistics.loads));
+        lines.push_back(std::format("polls {}", statistics.polls));
+        lines.push_back(std::format("changed {}", statistics.changed));
+        lines.push_back(std::format("connections {}", statistics.connections));
+        return lines;
+    }
+
+    if (std::find(std::begin(suite_commands), std::end(suite_commands), command) == std::end(suite_commands))
+    {
+        throw std::runtime_error(std::format("unknown command {}", command));
+    }
+    if (words.size() < 2)
+    {
+        throw std::runtime_error(std::format("missing URL for {}", command));
+    }
+    auto url = std::string(words[1]);
+
+    if (command == "release")
+    {
+        require_arguments(words, 1, 1, "release <url>");
+        auto release = find_release(url);
+        append_lines(lines, static_cast<std::string>(*release));
+        if (release->is_verified())
+        {
+            lines.push_back("Signed by: " + release->get_signer());
+        }
+    }
+    else if (command == "field")
+    {
+        require_arguments(words, 2, 2, "field <url> <name>");
+        append_lines(lines, find_release(url)->get_field(words[2]));
+    }
+    else if (command == "architectures")
+    {
+        require_arguments(words, 1, 1, "architectures <url>");
+        lines = find_release(url)->get_architectures();
+    }
+    else if (command == "components")
+    {
+        require_arguments(words, 1, 1, "components <url>");
+        lines = find_release(url)->get_components();
+    }
+    else if (command == "references")
+    {
+        require_arguments(words, 1, 1, "references <url>");
+        for (const auto &reference : find_release(url)->get_references())
+        {
+            lines.push_back(std::format("{} {} {}", reference.get_path(), reference.get_size(),
+                                        reference.get_hash(reference.get_digest_algorithm())));
+        }
+    }
+    else if (command == "digest")
+    {
+        require_arguments(words, 2, 3, "digest <url> <path> [algorithm]");
+        auto release = find_release(url);
+        const auto *reference = release->find_reference(words[2]);
+        if (!reference)
+        {
+            throw std::runtime_error(std::format("{} is not listed in {}", words[2], url));
+        }
+        auto algorithm = words.size() > 3 ? std::string(words[3]) : reference->get_digest_algorithm();
+        auto hash = reference->get_hash(algorithm);
+        if (hash.empty())
+        {
+            throw std::runtime_error(std::format("no {} digest of {}", algorithm, words[2]));
+        }
+        lines.push_back(std::move(hash));
+    }
+    else if (command == "package")
+    {
+        require_arguments(words, 3, 3, "package <url> <index path> <name>");
+        auto lookup = find_names(find_packages(url, std::string(words[2])));
+        auto [first, last] = std::equal_range(lookup->positions.begin(), lookup->positions.end(), std::pair(words[3], std::size_t(0)),
+                                              [](const auto &a, const auto &b)
+                                              { return a.first < b.first; });
+        for (auto it = first; it != last; ++it)
+        {
+            // Several versions of a package are separated like stanzas
+            if (!lines.empty())
+            {
+                lines.emplace_back();
+            }
+            append_lines(lines, static_cast<std::string>(lookup->packages->get_packages()[it->second]));
+        }
+    }
+    else if (command == "refresh")
+    {
+        require_arguments(words, 1, 1, "refresh <url>");
+        find_release(url);
+        lines.push_back(refresh(url) ? "changed" : "unchanged");
+    }
+    return lines;
+}
+
+std::size_t aptrepo::QueryServer::refresh()
+{
+    std::size_t changed = 0;
+    for (const auto &[url, release] : m_store.snapshot()->releases)
+    {
+        try
+        {
+            changed += refresh(url) ? 1 : 0;
+        }
+        catch (const std::exception &e)
+        {
+            spdlog::warn("QueryServer: Polling {} failed: {}", url, e.what());
+        }
+    }
+    return changed;
+}
+
+const std::filesystem::path &aptrepo::QueryServer::get_socket() const
+{
+    return m_options.socket;
+}
+
+aptrepo::QueryServer::Statistics aptrepo::QueryServer::get_statistics() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_statistics;
+}
+
+std::filesystem::path aptrepo::QueryServer::default_socket()
+{
+    if (const auto *runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime)
+    {
+        return std::filesystem::path(runtime) / "aptclient.sock";
+    }
+    // The temporary directory is shared, the socket gets a directory of its own
+    auto directory = std::filesystem::temp_directory_path() / std::format("aptclient-{}", ::geteuid());
+    aptrepo::internal::make_private_directory(directory);
+    return directory / "aptclient.sock";
+}
+
+std::shared_ptr<const aptrepo::Release> aptrepo::QueryServer::find_release(const std::string &url)
+{
+    if (auto release = m_store.snapshot()->find_release(url))
+    {
+        return release;
+    }
+
+    std::lock_guard lock(m_load_mutex);
+    // Concurrent first queries of a URL download it once
+    if (auto release = m_store.snapshot()->find_release(url))
+    {
+        return release;
+    }
+    auto release = parse(aptrepo::internal::download(url));
+    m_store.update([&](StoreSnapshot &snapshot)
+                   { snapshot.releases[url] = release; });
+    {
+        std::lock_guard statistics_lock(m_mutex);
+        m_statistics.loads++;
+    }
+    spdlog::info("QueryServer: Loaded {}", url);
+    return release;
+}
+
+std::shared_ptr<const aptrepo::Packages> aptrepo::QueryServer::find_packages(const std::string &url, const std::string &path)
+{
+    auto release = find_release(url);
+    const auto *reference = release->find_reference(path);
+    if (!reference)
+    {
+        throw std::runtime_error(std::format("{} is not listed in {}", path, url));
+    }
+    if (auto packages = m_store.snapshot()->find_packages(reference->get_url()))
+    {
+        return packages;
+    }
+
+    std::lock_guard lock(m_load_mutex);
+    // The Release may have been refreshed while waiting for the lock
+    auto snapshot = m_store.snapshot();
+    release = snapshot->find_release(url);
+    reference = release->find_reference(path);
+    if (!reference)
+    {
+        throw std::runtime_error(std::format("{} is not listed in {}", path, url));
+    }
+    if (auto packages = snapshot->find_packages(reference->get_url()))
+    {
+        return packages;
+    }
+
+    auto packages = std::make_shared<const aptrepo::Packages>(aptrepo::History::download_index()(*release, *reference).value());
+    m_store.update([&](StoreSnapshot &next)
+                   { next.packages[reference->get_url()] = packages; });
+    {
+        std::lock_guard statistics_lock(m_mutex);
+        m_statistics.loads++;
+    }
+    spdlog::info("QueryServer: Loaded {} with {} packages", reference->get_url(), packages->get_packages().size());
+    return packages;
+}
+
+std::shared_ptr<const aptrepo::QueryServer::NameLookup> aptrepo::QueryServer::find_names(std::shared_ptr<const aptrepo::Packages> packages)
+{
+    std::lock_guard lock(m_lookup_mutex);
+    auto &lookup = m_lookups[packages->get_url()];
+    if (lookup && lookup->packages == packages)
+    {
+        return lookup;
+    }
+
+    // Built once per version of an index, lookups are a binary search then
+    auto next = std::make_shared<NameLookup>();
+    next->packages = std::move(packages);
+    const auto &stanzas = next->packages->get_packages();
+    next->positions.reserve(stanzas.size());
+    for (std::size_t i = 0; i < stanzas.size(); ++i)
+    {
+        next->positions.emplace_back(stanzas[i].get_name(), i);
+    }
+    std::sort(next->positions.begin(), next->positions.end());
+    lookup = next;
+    return lookup;
+}
+
+std::shared_ptr<const aptrepo::Release> aptrepo::QueryServer::parse(aptrepo::internal::Download download) const
+{
+    if (m_keyring)
+    {
+        return std::make_shared<const aptrepo::Release>(std::move(download), *m_keyring);
+    }
+    return std::make_shared<const aptrepo::Release>(std::move(download));
+}
+
+bool aptrepo::QueryServer::refresh(const std::string &url)
+{
+    // Holding the load lock keeps queries from adding indexes of the old
+    // Release while the new one is prepared
+    std::lock_guard lock(m_load_mutex);
+    auto snapshot = m_store.snapshot();
+    auto current = snapshot->find_release(url);
+    if (!current)
+    {
+        return false;
+    }
+
+    auto download = m_client.get_if_changed(url, current->get_etag(), m_options.timeout);
+    {
+        std::lock_guard statistics_lock(m_mutex);
+        m_statistics.polls++;
+    }
+    if (!download)
+    {
+        SPDLOG_DEBUG("QueryServer: {} is unchanged", url);
+        return false;
+    }
+
+    auto release = parse(std::move(*download));
+    auto changes = aptrepo::diff(*current, *release);
+    std::map<std::string, std::shared_ptr<const aptrepo::Packages>> reloaded;
+    for (const auto &reference : changes.changed)
+    {
+        if (snapshot->find_packages(reference.get_url()))
+        {
+            reloaded[reference.get_url()] = std::make_shared<const aptrepo::Packages>(aptrepo::History::download_index()(*release, reference).value());
+        }
+    }
+
+    m_store.update([&](StoreSnapshot &next)
+                   {
+                       next.releases[url] = release;
+                       for (const auto &[index_url, packages] : reloaded)
+                       {
+                           next.packages[index_url] = packages;
+                       }
+                       for (const auto &reference : changes.removed)
+                       {
+                           next.packages.erase(reference.get_url());
+                       } });
+    {
+        // Lookups of replaced indexes would keep the old versions alive
+        std::lock_guard lookup_lock(m_lookup_mutex);
+        for (const auto &[index_url, packages] : reloaded)
+        {
+            m_lookups.erase(index_url);
+        }
+        for (const auto &reference : changes.removed)
+        {
+            m_lookups.erase(reference.get_url());
+        }
+    }
+    {
+        std::lock_guard statistics_lock(m_mutex);
+        m_statistics.changed++;
+    }
+    spdlog::info("QueryServer: {} changed, {} resident indexes loaded again", url, reloaded.size());
+    return true;
+}
+
+std::string aptrepo::QueryServer::handle(std::string_view request)
+{
+    std::string response;
+    bool failed = false;
+    try
+    {
+        auto lines = query(request);
+        response = std::format("OK {}\n", lines.size());
+        for (const auto &line : lines)
+        {
+            response += line;
+            response += '\n';
+        }
+    }
+    catch (const std::exception &e)
+    {
+        SPDLOG_DEBUG("QueryServer: Request {} failed: {}", request, e.what());
+        std::string message = e.what();
+        std::replace(message.begin(), message.end(), '\n', ' ');
+        response = "ERR " + message + "\n";
+        failed = true;
+    }
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_statistics.queries++;
+        if (failed)
+        {
+            m_statistics.failed++;
+        }
+    }
+    if (aptrepo::internal::metrics_enabled())
+    {
+        aptrepo::internal::count("aptrepo_query_requests_total", 1, {{"result", failed ? "error" : "ok"}});
+    }
+    return response;
+}
+
+void aptrepo::QueryServer::accept_loop()
+{
+    while (true)
+    {
+        pollfd fds[2] = {{m_listen_socket, POLLIN, 0}, {m_wakeup[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            spdlog::error("QueryServer: poll failed: {}", std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents != 0)
+        {
+            return;
+        }
+
+        int client = ::accept4(m_listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+        {
+            continue;
+        }
+        if (!aptrepo::internal::is_same_user(client))
+        {
+            spdlog::warn("QueryServer: Rejected a connection of another user");
+            ::close(client);
+            continue;
+        }
+        ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+        // Threads of closed connections are joined before a new one starts
+        m_connections.remove_if([](Connection &connection)
+                                {
+                                    if (!connection.done)
+                                    {
+                                        return false;
+                                    }
+                                    connection.thread.join();
+                                    return true; });
+        auto &connection = m_connections.emplace_back();
+        connection.thread = std::thread(&QueryServer::serve, this, client, std::ref(connection));
+
+        std::lock_guard lock(m_mutex);
+        m_statistics.connections++;
+    }
+}
+
+void aptrepo::QueryServer::serve(int client, Connection &connection)
+{
+    std::string buffer;
+    char chunk[4096];
+    while (true)
+    {
+        pollfd fds[2] = {{client, POLLIN, 0}, {m_wakeup[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0)
+        {
+            break;
+        }
+        auto received = ::recv(client, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            break;
+        }
+        buffer.append(chunk, static_cast<std::size_t>(received));
+
+        // Pipelined requests are answered in order
+        std::size_t start = 0;
+        bool sent = true;
+        for (auto end = buffer.find('\n'); sent && end != std::string::npos; end = buffer.find('\n', start))
+        {
+            sent = aptrepo::internal::send_unix(client, handle(std::string_view(buffer).substr(start, end - start)));
+            start = end + 1;
+        }
+        buffer.erase(0, start);
+        if (!sent)
+        {
+            break;
+        }
+        if (buffer.size() > max_request)
+        {
+            aptrepo::internal::send_unix(client, "ERR request too long\n");
+            break;
+        }
+    }
+    ::close(client);
+    connection.done = true;
+}
+
+void aptrepo::QueryServer::poll_loop()
+{
+    std::unique_lock lock(m_mutex);
+    while (!m_stop)
+    {
+        if (m_stopped.wait_for(lock, m_options.interval, [this]
+                               { return m_stop; }))
+        {
+            break;
+        }
+        lock.unlock();
+        refresh();
+        lock.lock();
+    }
+}
+
+aptrepo::QueryClient::QueryClient(int socket)
+    : m_socket(socket)
+{
+}
+
+aptrepo::QueryClient::~QueryClient()
+{
+    ::close(m_socket);
+}
+
+std::unique_ptr<aptrepo::QueryClient> aptrepo::QueryClient::connect(const std::filesystem::path &socket)
+{
+    int fd = aptrepo::internal::connect_unix(socket);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    // A server of another user could answer with anything
+    if (!aptrepo::internal::is_same_user(fd))
+    {
+        spdlog::warn("QueryClient: {} is served by another user, ignoring it", socket.string());
+        ::close(fd);
+        return nullptr;
+    }
+    return std::unique_ptr<QueryClient>(new QueryClient(fd));
+}
+
+std::vector<std::string> aptrepo::QueryClient::query(std::string_view request)
+{
+    if (request.find('\n') != std::string_view::npos)
+    {
+        throw std::runtime_error("QueryClient: request contains a newline");
+    }
+    std::string line(request);
+    line += '\n';
+    if (!aptrepo::internal::send_unix(m_socket, line))
+    {
+        throw std::runtime_error("QueryClient: connection lost");
+    }
+
+    auto status = read_line();
+    if (status.starts_with("ERR "))
+    {
+        throw std::runtime_error(status.substr(4));
+    }
+    if (!status.starts_with("OK "))
+    {
+        throw std::runtime_error("QueryClient: invalid response " + status);
+    }
+    std::vector<std::string> lines(std::stoul(status.substr(3)));
+    for (auto &response_line : lines)
+    {
+        response_line = read_line();
+    }
+    return lines;
+}
+
+std::string aptrepo::QueryClient::read_line()
+{
+    while (true)
+    {
+        auto end = m_buffer.find('\n', m_offset);
+        if (end != std::string::npos)
+        {
+            auto line = m_buffer.substr(m_offset, end - m_offset);
+            m_offset = end + 1;
+            return line;
+        }
+
+        // Consumed lines are dropped only before reading more, long responses aren't shifted per line
+        m_buffer.erase(0, m_offset);
+        m_offset = 0;
+        char chunk[4096];
+        auto received = ::recv(m_socket, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            throw std::runtime_error("QueryClient: connection lost");
+        }
+        m_buffer.append(chunk, static_cast<std::size_t>(received));
+    }
+}
@@ -2,16 +2,44 @@
 
 #include "spdlog/spdlog.h"
 
+#include "aptrepo/internal/utils.hpp"
+
 #include "aptrepo/reference.hpp"
 
-aptrepo::Reference::Reference(std::string base_url, std::string path, std::size_t size_bytes)
-    : m_base_url(std::move(base_url)), m_path(std::move(path)), m_size_bytes(size_bytes)
+namespace
+{
+    int digest_strength(std::string_view algorithm)
+    {
+        if (algorithm == "SHA512")
+        {
+            return 4;
+        }
+        if (algorithm == "SHA256")
+        {
+            return 3;
+        }
+        if (algorithm == "SHA1")
+        {
+            return 2;
+        }
+        if (algorithm == "MD5Sum")
+        {
+            return 1;
+        }
+        return 0;
+    }
+}
+
+aptrepo::Reference::Reference(std::string_view base_url, std::string_view path, std::size_t size_bytes,
+                              const allocator_type &allocator)
+    : m_arch(allocator), m_comp(allocator), m_base_url(base_url, allocator), m_path(path, allocator),
+      m_size_bytes(size_bytes), m_hashes(allocator), m_digest_algorithm(allocator), m_digest(allocator)
 {
-    spdlog::debug("Creating Reference with base_url: {}, path: {}, size_bytes: {}", m_base_url, m_path, m_size_bytes);
+    SPDLOG_DEBUG("Creating Reference with base_url: {}, path: {}, size_bytes: {}", m_base_url, m_path, m_size_bytes);
 
     if (m_path.starts_with("Contents"))
     {
-        spdlog::debug("Path starts with 'Contents', extracting architecture");
+        SPDLOG_DEBUG("Path starts with 'Contents', extracting architecture");
 
         auto pos = m_path.find('-');
         if (pos != std::string::npos)
@@ -27,21 +55,21 @@ aptrepo::Reference::Reference(std::string base_url, std::string path, std::size_
                 m_arch = m_path.substr(pos + 1);
             }
         }
-        spdlog::debug("Extracted architecture: {}", m_arch);
+        SPDLOG_DEBUG("Extracted architecture: {}", m_arch);
     }
     else
     {
         auto pos = m_path.find('/');
         if (pos != std::string::npos)
         {
-            spdlog::debug("Path contains '/', extracting component and architecture");
+            SPDLOG_DEBUG("Path contains '/', extracting component and architecture");
 
             auto next_pos = m_path.find('/', pos + 1);
             if (next_pos != std::string::npos)
             {
-                auto folder = m_path.substr(pos + 1, next_pos - pos - 1);
+                auto folder = std::string_view(m_path).substr(pos + 1, next_pos - pos - 1);
 
-                spdlog::debug("Extracted folder: {}", folder);
+                SPDLOG_DEBUG("Extracted folder: {}", folder);
 
                 if (folder == "source")
                 {
@@ -49,7 +77,7 @@ aptrepo::Reference::Reference(std::string base_url, std::string path, std::size_
                 }
 
                 pos = folder.find('-', pos + 1);
-                if (pos != std::string::npos)
+                if (pos != std::string_view::npos)
                 {
                     auto first = folder.substr(0, pos);
                     if (first == "binary")
@@ -68,9 +96,41 @@ aptrepo::Reference::Reference(std::string base_url, std::string path, std::size_
     }
 }
 
-void aptrepo::Reference::add_hash(std::string algorithm, std::string hash)
+aptrepo::Reference::Reference(const Reference &other, const allocator_type &allocator)
+    : m_arch(other.m_arch, allocator), m_comp(other.m_comp, allocator), m_base_url(other.m_base_url, allocator),
+      m_path(other.m_path, allocator), m_size_bytes(other.m_size_bytes), m_hashes(other.m_hashes, allocator),
+      m_digest_algorithm(other.m_digest_algorithm, allocator), m_digest(other.m_digest, allocator)
 {
-    m_hashes[algorithm] = hash;
+}
+
+aptrepo::Reference::Reference(Reference &&other, const allocator_type &allocator)
+    : m_arch(std::move(other.m_arch), allocator), m_comp(std::move(other.m_comp), allocator),
+      m_base_url(std::move(other.m_base_url), allocator), m_path(std::move(other.m_path), allocator),
+      m_size_bytes(other.m_size_bytes), m_hashes(std::move(other.m_hashes), allocator),
+      m_digest_algorithm(std::move(other.m_digest_algorithm), allocator), m_digest(std::move(other.m_digest), allocator)
+{
+}
+
+void aptrepo::Reference::add_hash(std::string_view algorithm, std::string_view hash)
+{
+    if (digest_strength(algorithm) > digest_strength(m_digest_algorithm))
+    {
+        // Decoded in place, so the digest is allocated by the allocator of the Reference
+        m_digest.resize(hash.size() / 2);
+        if (!aptrepo::internal::hex_to_bytes(hash, m_digest.data()))
+        {
+            m_digest.clear();
+        }
+        m_digest_algorithm = algorithm;
+    }
+    if (auto it = m_hashes.find(algorithm); it != m_hashes.end())
+    {
+        it->second = hash;
+    }
+    else
+    {
+        m_hashes.emplace(algorithm, hash);
+    }
 }
 
 aptrepo::Reference::operator std::string() const
@@ -82,17 +142,62 @@ aptrepo::Reference::operator std::string() const
         {
             hashes_str += ", ";
         }
-        hashes_str += hash.first + "=" + hash.second;
+        hashes_str += std::format("{}={}", hash.first, hash.second);
     }
     return std::format("Reference<{}/{} {} {}>", m_base_url, m_path, m_size_bytes, hashes_str);
 }
 
 std::string aptrepo::Reference::get_architecture() const
 {
-    return m_arch;
+    return std::string(m_arch);
 }
 
 std::string aptrepo::Reference::get_component() const
 {
-    return m_comp;
+    return std::string(m_comp);
+}
+
+std::string aptrepo::Reference::get_path() const
+{
+    return std::string(m_path);
+}
+
+std::string aptrepo::Reference::get_url() const
+{
+    return std::format("{}/{}", m_base_url, m_path);
+}
+
+std::size_t aptrepo::Reference::get_size() const
+{
+    return m_size_bytes;
+}
+
+std::string aptrepo::Reference::get_hash(const std::string &algorithm) const
+{
+    auto it = m_hashes.find(std::string_view(algorithm));
+    if (it != m_hashes.end())
+    {
+        return std::string(it->second);
+    }
+    return {};
+}
+
+std::string aptrepo::Reference::get_digest_algorithm() const
+{
+    return std::string(m_digest_algorithm);
+}
+
+std::string_view aptrepo::Reference::get_digest() const
+{
+    return m_digest;
+}
+
+const aptrepo::Reference::Hashes &aptrepo::Reference::get_hashes() const
+{
+    return m_hashes;
+}
+
+aptrepo::Reference::allocator_type aptrepo::Reference::get_allocator() const
+{
+    return m_hashes.get_allocator();
 }
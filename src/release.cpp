@@ -1,44 +1,179 @@
 #include <spdlog/spdlog.h>
 #include <sstream>
+#include <algorithm>
 #include <cctype>
-#include <regex>
+#include <charconv>
 #include <format>
 #include <iomanip>
+#include <optional>
 
 #include "aptrepo/reference.hpp"
-#include "aptrepo/internal/utils.hpp"
 #include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/fields.hpp"
+#include "aptrepo/internal/metrics.hpp"
 
 #include "aptrepo/release.hpp"
 
-aptrepo::Release::Release(aptrepo::internal::Download download)
-    : m_flat(false)
+namespace
 {
+    /// Arena bytes per byte of the Release content, enough for the references
+    /// of an Ubuntu InRelease file with MD5Sum, SHA1 and SHA256 lists, so the
+    /// arena is one allocation; untouched pages of it are never mapped in.
+    constexpr std::size_t arena_factor = 5;
+
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> make_arena(const aptrepo::internal::Download &download,
+                                                                    std::pmr::memory_resource *resource)
+    {
+        if (resource)
+        {
+            return nullptr;
+        }
+        return std::make_unique<std::pmr::monotonic_buffer_resource>(
+            std::max<std::size_t>(download.get_content().size() * arena_factor, 1024));
+    }
+
+    std::string_view trim(std::string_view text)
+    {
+        auto first = text.find_first_not_of(" \n\r\t");
+        if (first == std::string_view::npos)
+        {
+            return {};
+        }
+        return text.substr(first, text.find_last_not_of(" \n\r\t") - first + 1);
+    }
+
+    /// Remove the next whitespace separated token from text and return it.
+    std::string_view next_token(std::string_view &text)
+    {
+        auto first = text.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos)
+        {
+            text = {};
+            return {};
+        }
+        auto last = text.find_first_of(" \t\r", first);
+        auto token = text.substr(first, last == std::string_view::npos ? std::string_view::npos : last - first);
+        text = last == std::string_view::npos ? std::string_view{} : text.substr(last);
+        return token;
+    }
+
+    std::vector<std::string> split_words(std::string_view text)
+    {
+        std::vector<std::string> words;
+        for (auto word = next_token(text); !word.empty(); word = next_token(text))
+        {
+            words.emplace_back(word);
+        }
+        return words;
+    }
+}
+
+aptrepo::Release::Release(aptrepo::internal::Download download, std::pmr::memory_resource *resource)
+    : m_flat(false), m_arena(make_arena(download, resource)),
+      m_references(resource ? resource : m_arena.get())
+{
+    parse(download, nullptr);
+}
+
+aptrepo::Release::Release(aptrepo::internal::Download download, const aptrepo::Keyring &keyring,
+                          std::pmr::memory_resource *resource)
+    : m_flat(false), m_arena(make_arena(download, resource)),
+      m_references(resource ? resource : m_arena.get())
+{
+    aptrepo::internal::ClearsignVerifier verifier(keyring);
+    parse(download, &verifier);
+}
+
+aptrepo::Release::Release(const Release &other)
+    : m_flat(other.m_flat), m_signer(other.m_signer), m_url(other.m_url), m_etag(other.m_etag),
+      m_base_url(other.m_base_url), m_date(other.m_date), m_architectures(other.m_architectures),
+      m_components(other.m_components), m_fields(other.m_fields),
+      m_arena(std::make_unique<std::pmr::monotonic_buffer_resource>()),
+      m_references(other.m_references, m_arena.get())
+{
+}
+
+aptrepo::Release &aptrepo::Release::operator=(const Release &other)
+{
+    Release copy(other);
+    swap(copy);
+    return *this;
+}
+
+aptrepo::Release &aptrepo::Release::operator=(Release &&other)
+{
+    Release moved(std::move(other));
+    swap(moved);
+    return *this;
+}
+
+void aptrepo::Release::swap(Release &other)
+{
+    std::swap(m_flat, other.m_flat);
+    std::swap(m_signer, other.m_signer);
+    std::swap(m_url, other.m_url);
+    std::swap(m_etag, other.m_etag);
+    std::swap(m_base_url, other.m_base_url);
+    std::swap(m_date, other.m_date);
+    std::swap(m_architectures, other.m_architectures);
+    std::swap(m_components, other.m_components);
+    std::swap(m_fields, other.m_fields);
+
+    // Maps with different memory resources can't be swapped, so the references
+    // are move constructed, which takes their memory resource along. The old
+    // references of this Release end up with their arena in other.
+    m_arena.swap(other.m_arena);
+    auto references = std::move(m_references);
+    std::destroy_at(&m_references);
+    std::construct_at(&m_references, std::move(other.m_references));
+    std::destroy_at(&other.m_references);
+    std::construct_at(&other.m_references, std::move(references));
+}
+
+void aptrepo::Release::parse(const aptrepo::internal::Download &download, aptrepo::internal::ClearsignVerifier *verifier)
+{
+    // Labels are only allocated while a sink is installed
+    std::optional<aptrepo::internal::ScopedTimer> timer;
+    if (aptrepo::internal::metrics_enabled())
+    {
+        timer.emplace("aptrepo_parse_seconds", aptrepo::MetricLabels{{"index", "release"}});
+    }
+
     m_url = download.get_url();
     m_etag = download.get_etag();
     m_base_url = m_url.substr(0, m_url.find_last_of('/'));
 
-    std::stringstream content(download.get_content());
-    std::string line;
+    std::string_view content = download.get_content();
 
-    std::string key;
+    // Name of the last field, the hash algorithm of the reference lines below it
+    std::string_view key;
 
-    auto reference_regex = std::regex(R"(^\s+(\S+)\s+(\d+)\s+(\S+).*$)");
-
-    while (std::getline(content, line))
+    while (!content.empty())
     {
-        if (line.empty() || line[0] == '#')
+        auto end = content.find('\n');
+        auto line = content.substr(0, end);
+        content = end == std::string_view::npos ? std::string_view{} : content.substr(end + 1);
+
+        if (verifier)
         {
-            // Skip empty lines and comments
-            continue;
+            // Hash the signed text and parse only its fields
+            if (!verifier->add_line(line))
+            {
+                continue;
+            }
         }
-
-        if (line.contains("BEGIN PGP SIGNATURE"))
+        else if (line.contains("BEGIN PGP SIGNATURE"))
         {
             // Stop parsing at the PGP signature block
             break;
         }
 
+        if (line.empty() || line[0] == '#')
+        {
+            // Skip empty lines and comments
+            continue;
+        }
+
         if (line.starts_with("----"))
         {
             // Skip PGP signature lines
@@ -49,90 +184,81 @@ aptrepo::Release::Release(aptrepo::internal::Download download)
         if ((first_char >= 'A' && first_char <= 'Z') || (first_char >= 'a' && first_char <= 'z'))
         {
             auto pos = line.find(':');
-            if (pos != std::string::npos)
+            if (pos != std::string_view::npos)
             {
                 key = line.substr(0, pos);
-                auto value = aptrepo::internal::trim(line.substr(pos + 1));
+                auto value = trim(line.substr(pos + 1));
                 if (!key.empty() && !value.empty())
                 {
-                    add_field(key, value);
+                    m_fields.set(key, std::string(value));
                 }
             }
         }
-        else
+        else if (first_char == ' ' || first_char == '\t')
         {
-            auto match = std::regex_match(line, reference_regex);
-            if (match)
+            // Reference line: hash, size and path, separated by whitespace
+            auto hash = next_token(line);
+            auto size_token = next_token(line);
+            auto path = next_token(line);
+            std::size_t size = 0;
+            auto [ptr, ec] = std::from_chars(size_token.data(), size_token.data() + size_token.size(), size);
+            if (!path.empty() && ec == std::errc() && ptr == size_token.data() + size_token.size())
             {
-                std::smatch match_groups;
-                std::regex_search(line, match_groups, reference_regex);
-                std::string path = match_groups[3].str();
-                std::size_t size = std::stoull(match_groups[2].str());
-                std::string hash = match_groups[1].str();
                 add_reference(path, size, key, hash);
             }
         }
     }
 
+    if (verifier)
     {
-        auto it = m_fields.find("Architectures");
-        if (it != m_fields.end())
+        try
         {
-            std::string archs = it->second;
-            std::stringstream ss(archs);
-            std::string arch;
-            while (std::getline(ss, arch, ' '))
+            m_signer = verifier->verify();
+            if (aptrepo::internal::metrics_enabled())
             {
-                if (!arch.empty())
-                {
-                    m_architectures.push_back(arch);
-                }
+                aptrepo::internal::count("aptrepo_release_verifications_total", 1, {{"result", "valid"}});
             }
         }
-        else
+        catch (const std::exception &)
         {
-            spdlog::warn("Release: Architectures field not found in release file.");
+            if (aptrepo::internal::metrics_enabled())
+            {
+                aptrepo::internal::count("aptrepo_release_verifications_total", 1, {{"result", "invalid"}});
+            }
+            spdlog::error("Release: Signature verification of {} failed", m_url);
+            throw;
         }
     }
 
+    m_architectures = split_words(m_fields.get(aptrepo::internal::Field::Architectures));
+    if (m_architectures.empty())
     {
-        auto it = m_fields.find("Components");
-        if (it != m_fields.end())
-        {
-            std::string comps = it->second;
-            std::stringstream ss(comps);
-            std::string comp;
-            while (std::getline(ss, comp, ' '))
-            {
-                if (!comp.empty())
-                {
-                    m_components.push_back(comp);
-                }
-            }
-        }
-        else
-        {
-            spdlog::warn("Release: Components field not found in release file.");
-        }
+        spdlog::warn("Release: Architectures field not found in release file.");
+    }
+
+    m_components = split_words(m_fields.get(aptrepo::internal::Field::Components));
+    if (m_components.empty())
+    {
+        spdlog::warn("Release: Components field not found in release file.");
     }
 
     {
-        auto it = m_fields.find("Date");
-        if (it != m_fields.end())
+        const auto &date = m_fields.get(aptrepo::internal::Field::Date);
+        if (!date.empty())
         {
             tm tm = {};
-            auto stream = std::istringstream(it->second);
+            auto stream = std::istringstream(date);
             stream >> std::get_time(&tm, "%a, %d %b %Y %H:%M:%S");
             if (stream.fail())
             {
-                spdlog::error("Release: Failed to parse date: {}", it->second);
+                spdlog::error("Release: Failed to parse date: {}", date);
             }
             else
             {
                 auto time = std::mktime(&tm) - timezone;
                 if (time == -1)
                 {
-                    spdlog::error("Release: Failed to parse date: {}", it->second);
+                    spdlog::error("Release: Failed to parse date: {}", date);
                 }
                 else
                 {
@@ -145,6 +271,11 @@ aptrepo::Release::Release(aptrepo::internal::Download download)
             spdlog::warn("Release: Date field not found in release file.");
         }
     }
+
+    if (aptrepo::internal::metrics_enabled())
+    {
+        aptrepo::internal::gauge("aptrepo_release_references", static_cast<double>(m_references.size()), {{"release", m_url}});
+    }
 }
 
 aptrepo::Release::operator std::string() const
@@ -153,14 +284,12 @@ aptrepo::Release::operator std::string() const
     result += "Etag: " + m_etag + "\n";
     result += "Base URL: " + m_base_url + "\n";
 
-    for (const auto &field : m_fields)
-    {
-        result += field.first + ": " + field.second + "\n";
-    }
+    m_fields.for_each([&result](std::string_view key, const std::string &value)
+                      { result += std::string(key) + ": " + value + "\n"; });
 
     for (const auto &ref : m_references)
     {
-        result += ref.second->operator std::string() + "\n";
+        result += ref.second.operator std::string() + "\n";
     }
 
     return result;
@@ -168,29 +297,51 @@ aptrepo::Release::operator std::string() const
 
 void aptrepo::Release::add_field(std::string key, std::string value)
 {
-    m_fields[key] = value;
+    m_fields.set(key, std::move(value));
 }
 
-void aptrepo::Release::add_reference(std::string path, std::size_t size, std::string algorithm, std::string hash)
+void aptrepo::Release::add_reference(std::string_view path, std::size_t size, std::string_view algorithm, std::string_view hash)
 {
-    if (auto search = m_references.find(path); search != m_references.end())
+    auto search = m_references.find(path);
+    if (search == m_references.end())
     {
-        m_references[path]->add_hash(algorithm, hash);
+        // The key and the Reference get the allocator of the map
+        search = m_references.try_emplace(std::pmr::string(path, m_references.get_allocator()), m_base_url, path, size).first;
     }
-    else
+    search->second.add_hash(algorithm, hash);
+}
+
+std::string aptrepo::Release::get_field(std::string_view key) const
+{
+    auto value = m_fields.find(key);
+    if (value)
     {
-        auto ref = std::shared_ptr<aptrepo::Reference>{new aptrepo::Reference(m_base_url, path, size)};
-        ref->add_hash(algorithm, hash);
-        m_references[path] = ref;
+        return *value;
     }
+    return {};
+}
+
+bool aptrepo::Release::is_verified() const
+{
+    return !m_signer.empty();
+}
+
+std::string aptrepo::Release::get_signer() const
+{
+    return m_signer;
+}
+
+const aptrepo::internal::FieldTable &aptrepo::Release::get_fields() const
+{
+    return m_fields;
 }
 
 std::string aptrepo::Release::get_origin() const
 {
-    auto it = m_fields.find("Origin");
-    if (it != m_fields.end())
+    const auto &value = m_fields.get(aptrepo::internal::Field::Origin);
+    if (!value.empty())
     {
-        return it->second;
+        return value;
     }
     else
     {
@@ -201,20 +352,20 @@ std::string aptrepo::Release::get_origin() const
 
 std::string aptrepo::Release::get_label() const
 {
-    auto it = m_fields.find("Label");
-    if (it != m_fields.end())
+    const auto &value = m_fields.get(aptrepo::internal::Field::Label);
+    if (!value.empty())
     {
-        return it->second;
+        return value;
     }
     return {};
 }
 
 std::string aptrepo::Release::get_suite() const
 {
-    auto it = m_fields.find("Suite");
-    if (it != m_fields.end())
+    const auto &value = m_fields.get(aptrepo::internal::Field::Suite);
+    if (!value.empty())
     {
-        return it->second;
+        return value;
     }
     else
     {
@@ -225,10 +376,10 @@ std::string aptrepo::Release::get_suite() const
 
 std::string aptrepo::Release::get_version() const
 {
-    auto it = m_fields.find("Version");
-    if (it != m_fields.end())
+    const auto &value = m_fields.get(aptrepo::internal::Field::Version);
+    if (!value.empty())
     {
-        return it->second;
+        return value;
     }
     else
     {
@@ -239,10 +390,10 @@ std::string aptrepo::Release::get_version() const
 
 std::string aptrepo::Release::get_codename() const
 {
-    auto it = m_fields.find("Codename");
-    if (it != m_fields.end())
+    const auto &value = m_fields.get(aptrepo::internal::Field::Codename);
+    if (!value.empty())
     {
-        return it->second;
+        return value;
     }
     else
     {
@@ -268,10 +419,10 @@ std::vector<std::string> aptrepo::Release::get_components() const
 
 std::string aptrepo::Release::get_description() const
 {
-    auto it = m_fields.find("Description");
-    if (it != m_fields.end())
+    const auto &value = m_fields.get(aptrepo::internal::Field::Description);
+    if (!value.empty())
     {
-        return it->second;
+        return value;
     }
     else
     {
@@ -308,21 +459,32 @@ void aptrepo::Release::set_flat(bool flat)
 std::vector<aptrepo::Reference> aptrepo::Release::get_references() const
 {
     std::vector<aptrepo::Reference> refs;
+    refs.reserve(m_references.size());
     for (const auto &ref : m_references)
     {
-        refs.push_back(*ref.second);
+        refs.push_back(ref.second);
     }
     return refs;
 }
 
+const aptrepo::Reference *aptrepo::Release::find_reference(std::string_view path) const
+{
+    auto it = m_references.find(path);
+    if (it != m_references.end())
+    {
+        return &it->second;
+    }
+    return nullptr;
+}
+
 std::vector<aptrepo::Reference> aptrepo::Release::get_references(std::string arch, std::string comp) const
 {
     std::vector<aptrepo::Reference> refs;
     for (const auto &ref : m_references)
     {
-        if (ref.second->get_architecture() == arch && ref.second->get_component() == comp)
+        if (ref.second.get_architecture() == arch && ref.second.get_component() == comp)
         {
-            refs.push_back(*ref.second);
+            refs.push_back(ref.second);
         }
     }
     return refs;
@@ -333,9 +495,9 @@ std::vector<aptrepo::Reference> aptrepo::Release::get_references_for_comp(std::s
     std::vector<aptrepo::Reference> refs;
     for (const auto &ref : m_references)
     {
-        if (ref.second->get_component() == comp)
+        if (ref.second.get_component() == comp)
         {
-            refs.push_back(*ref.second);
+            refs.push_back(ref.second);
         }
     }
     return refs;
@@ -346,9 +508,9 @@ std::vector<aptrepo::Reference> aptrepo::Release::get_references_for_arch(std::s
     std::vector<aptrepo::Reference> refs;
     for (const auto &ref : m_references)
     {
-        if (ref.second->get_architecture() == arch)
+        if (ref.second.get_architecture() == arch)
         {
-            refs.push_back(*ref.second);
+            refs.push_back(ref.second);
         }
     }
     return refs;
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/scheduler.hpp"
+
+namespace
+{
+    /// Smallest burst of the token bucket, a few chunks of a transfer.
+    constexpr std::size_t min_burst = 64 * 1024;
+
+    void count_throttled(const char *reason, std::chrono::steady_clock::duration duration)
+    {
+        if (aptrepo::internal::metrics_enabled())
+        {
+            aptrepo::internal::count("aptrepo_download_throttled_seconds_total", std::chrono::duration<double>(duration).count(), {{"reason", reason}});
+        }
+    }
+}
+
+aptrepo::internal::Priority aptrepo::internal::download_priority(std::string_view path, std::size_t size)
+{
+    auto name = path.substr(path.find_last_of('/') + 1);
+    if (name.starts_with("Contents-") || size >= large_download_size)
+    {
+        return Priority::Low;
+    }
+    if (name == "InRelease" || name.starts_with("Release") || name.starts_with("Packages") || name.starts_with("Sources"))
+    {
+        return Priority::High;
+    }
+    return Priority::Normal;
+}
+
+aptrepo::internal::Priority aptrepo::internal::download_priority(const aptrepo::Reference &reference)
+{
+    return download_priority(reference.get_path(), reference.get_size());
+}
+
+aptrepo::internal::TokenBucket::TokenBucket(std::size_t rate, std::size_t burst)
+    : m_rate(static_cast<double>(rate)), m_burst(static_cast<double>(burst)), m_tokens(static_cast<double>(burst)),
+      m_updated(std::chrono::steady_clock::now())
+{
+}
+
+std::chrono::steady_clock::duration aptrepo::internal::TokenBucket::acquire(std::size_t bytes)
+{
+    if (m_rate <= 0)
+    {
+        return {};
+    }
+
+    std::chrono::duration<double> wait(0);
+    {
+        std::lock_guard lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+        m_tokens = std::min(m_burst, m_tokens + std::chrono::duration<double>(now - m_updated).count() * m_rate);
+        m_updated = now;
+        m_tokens -= static_cast<double>(bytes);
+        if (m_tokens < 0)
+        {
+            wait = std::chrono::duration<double>(-m_tokens / m_rate);
+        }
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait);
+    if (duration.count() > 0)
+    {
+        std::this_thread::sleep_for(duration);
+    }
+    return duration;
+}
+
+aptrepo::internal::DownloadScheduler::DownloadScheduler(std::size_t rate_limit)
+    : m_bucket(rate_limit, std::max(rate_limit / 4, min_burst)), m_limited(rate_limit > 0)
+{
+    if (m_limited)
+    {
+        spdlog::info("Limiting downloads to {} bytes/s", rate_limit);
+    }
+}
+
+std::size_t aptrepo::internal::DownloadScheduler::get_preemptions() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_preemptions;
+}
+
+void aptrepo::internal::DownloadScheduler::wait_for_turn(Priority priority)
+{
+    auto preempted = [&]()
+    {
+        return std::any_of(m_active.begin(), m_active.begin() + static_cast<std::size_t>(priority), [](std::size_t active)
+                           { return active > 0; });
+    };
+
+    std::unique_lock lock(m_mutex);
+    if (!preempted())
+    {
+        return;
+    }
+
+    ++m_preemptions;
+    SPDLOG_DEBUG("DownloadScheduler: Pausing transfer of priority {}", static_cast<int>(priority));
+    auto start = std::chrono::steady_clock::now();
+    m_changed.wait(lock, [&]()
+                   { return !preempted(); });
+    count_throttled("priority", std::chrono::steady_clock::now() - start);
+}
+
+aptrepo::internal::DownloadScheduler::Slot::Slot(DownloadScheduler &scheduler, Priority priority)
+    : m_scheduler(scheduler), m_priority(priority)
+{
+    std::lock_guard lock(m_scheduler.m_mutex);
+    m_scheduler.m_active[static_cast<std::size_t>(m_priority)]++;
+}
+
+aptrepo::internal::DownloadScheduler::Slot::~Slot()
+{
+    {
+        std::lock_guard lock(m_scheduler.m_mutex);
+        m_scheduler.m_active[static_cast<std::size_t>(m_priority)]--;
+    }
+    m_scheduler.m_changed.notify_all();
+}
+
+void aptrepo::internal::DownloadScheduler::Slot::throttle(std::size_t bytes)
+{
+    m_scheduler.wait_for_turn(m_priority);
+    if (m_scheduler.m_limited)
+    {
+        auto waited = m_scheduler.m_bucket.acquire(bytes);
+        if (waited.count() > 0)
+        {
+            count_throttled("rate", waited);
+        }
+    }
+}
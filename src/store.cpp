@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/packages.hpp"
+#include "aptrepo/release.hpp"
+
+#include "aptrepo/store.hpp"
+
+std::shared_ptr<const aptrepo::Release> aptrepo::StoreSnapshot::find_release(const std::string &url) const
+{
+    auto it = releases.find(url);
+    if (it != releases.end())
+    {
+        return it->second;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const aptrepo::Packages> aptrepo::StoreSnapshot::find_packages(const std::string &url) const
+{
+    auto it = packages.find(url);
+    if (it != packages.end())
+    {
+        return it->second;
+    }
+    return nullptr;
+}
+
+namespace
+{
+    struct ReaderCache
+    {
+        std::uint64_t store;
+        std::uint64_t generation;
+        std::shared_ptr<const aptrepo::StoreSnapshot> snapshot;
+    };
+
+    // Bounds the number of stores cached per thread; caches of destroyed
+    // stores are dropped first when the limit is reached.
+    constexpr std::size_t max_reader_caches = 16;
+
+    std::atomic<std::uint64_t> next_store_id = 1;
+    thread_local std::vector<ReaderCache> reader_caches;
+
+    // Number of read() calls of the thread in progress; their snapshots are
+    // referenced by reader_caches only, so the caches must not change
+    thread_local std::size_t active_reads = 0;
+}
+
+aptrepo::ReleaseStore::ReadScope::ReadScope()
+{
+    ++active_reads;
+}
+
+aptrepo::ReleaseStore::ReadScope::~ReadScope()
+{
+    --active_reads;
+}
+
+bool aptrepo::ReleaseStore::ReadScope::active()
+{
+    return active_reads > 0;
+}
+
+aptrepo::ReleaseStore::ReleaseStore()
+    : m_id(next_store_id++), m_generation(0), m_current(std::make_shared<const StoreSnapshot>())
+{
+}
+
+aptrepo::ReleaseStore::~ReleaseStore()
+{
+    // Caches of other threads are released lazily
+    std::erase_if(reader_caches, [this](const ReaderCache &cache)
+                  { return cache.store == m_id; });
+}
+
+const std::shared_ptr<const aptrepo::StoreSnapshot> &aptrepo::ReleaseStore::cached() const
+{
+    auto cache = std::find_if(reader_caches.begin(), reader_caches.end(), [this](const ReaderCache &entry)
+                              { return entry.store == m_id; });
+    if (cache == reader_caches.end())
+    {
+        if (reader_caches.size() >= max_reader_caches)
+        {
+            reader_caches.erase(reader_caches.begin());
+        }
+        reader_caches.push_back({m_id, UINT64_MAX, nullptr});
+        cache = reader_caches.end() - 1;
+    }
+
+    if (cache->generation != m_generation.load(std::memory_order_acquire))
+    {
+        std::lock_guard lock(m_current_mutex);
+        cache->snapshot = m_current;
+        cache->generation = m_current->generation;
+    }
+    return cache->snapshot;
+}
+
+std::shared_ptr<const aptrepo::StoreSnapshot> aptrepo::ReleaseStore::snapshot() const
+{
+    if (ReadScope::active())
+    {
+        return current();
+    }
+    return cached();
+}
+
+std::shared_ptr<const aptrepo::StoreSnapshot> aptrepo::ReleaseStore::current() const
+{
+    std::lock_guard lock(m_current_mutex);
+    return m_current;
+}
+
+void aptrepo::ReleaseStore::update(const std::function<void(StoreSnapshot &)> &update)
+{
+    std::lock_guard lock(m_writer);
+
+    // The writer lock serializes updates, so m_current can be read without
+    // the reader lock here.
+    auto next = std::make_shared<StoreSnapshot>(*m_current);
+    update(*next);
+    ++next->generation;
+
+    {
+        std::lock_guard current_lock(m_current_mutex);
+        m_current = std::move(next);
+        m_generation.store(m_current->generation, std::memory_order_release);
+    }
+}
+
+void aptrepo::ReleaseStore::publish(aptrepo::Release release)
+{
+    auto url = release.get_url();
+    auto shared = std::make_shared<const aptrepo::Release>(std::move(release));
+    update([&](StoreSnapshot &snapshot)
+           { snapshot.releases[url] = shared; });
+}
+
+void aptrepo::ReleaseStore::publish(aptrepo::Packages packages)
+{
+    auto url = packages.get_url();
+    auto shared = std::make_shared<const aptrepo::Packages>(std::move(packages));
+    update([&](StoreSnapshot &snapshot)
+           { snapshot.packages[url] = shared; });
+}
+
+void aptrepo::ReleaseStore::remove_release(const std::string &url)
+{
+    update([&](StoreSnapshot &snapshot)
+           { snapshot.releases.erase(url); });
+}
+
+bool aptrepo::ReleaseStore::refresh(const std::string &url)
+{
+    auto current = snapshot()->find_release(url);
+    if (current && !aptrepo::internal::needs_update(url, current->get_etag()))
+    {
+        return false;
+    }
+
+    // Download and parse outside of the writer lock, readers and other
+    // writers are not blocked by the transfer.
+    auto release = aptrepo::Release(aptrepo::internal::download(url));
+    spdlog::info("ReleaseStore: Publishing new release for {}", url);
+    publish(std::move(release));
+    return true;
+}
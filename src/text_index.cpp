@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/decompress.hpp"
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/utils.hpp"
+
+#include "aptrepo/text_index.hpp"
+
+namespace
+{
+    // BM25 parameters
+    constexpr double k1 = 1.2;
+    constexpr double b = 0.75;
+
+    struct Entry
+    {
+        std::uint32_t doc;
+        std::uint32_t frequency;
+    };
+
+    std::vector<Entry> decode(const std::string &data)
+    {
+        std::vector<Entry> entries;
+        std::size_t pos = 0;
+        std::uint32_t doc = 0;
+        while (pos < data.size())
+        {
+            doc += static_cast<std::uint32_t>(aptrepo::internal::read_varint(data, pos));
+            auto frequency = static_cast<std::uint32_t>(aptrepo::internal::read_varint(data, pos));
+            entries.push_back({doc, frequency});
+        }
+        return entries;
+    }
+
+    template <typename Fn>
+    void for_each_term(std::string_view text, Fn &&fn)
+    {
+        std::string term;
+        for (auto c : text)
+        {
+            auto u = static_cast<unsigned char>(c);
+            if (std::isalnum(u) || u >= 0x80)
+            {
+                term += static_cast<char>(std::tolower(u));
+            }
+            else if (!term.empty())
+            {
+                fn(term);
+                term.clear();
+            }
+        }
+        if (!term.empty())
+        {
+            fn(term);
+        }
+    }
+}
+
+aptrepo::TextIndex::TextIndex(const std::vector<aptrepo::Packages> &packages, std::size_t threads)
+    : m_threads(threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads)
+{
+    std::vector<std::vector<std::string_view>> texts;
+    for (const auto &index : packages)
+    {
+        for (const auto &package : index.get_packages())
+        {
+            auto doc = get_doc(package.get_name());
+            if (texts.size() <= doc)
+            {
+                texts.resize(doc + 1);
+            }
+            texts[doc].push_back(package.get_description());
+        }
+    }
+
+    m_segments[""] = build_segment(texts, m_threads);
+
+    spdlog::info("TextIndex: Indexed {} packages, {} terms", m_docs.size(), m_segments[""].postings.size());
+}
+
+std::uint32_t aptrepo::TextIndex::get_doc(const std::string &name)
+{
+    auto [it, inserted] = m_doc_ids.try_emplace(name, static_cast<std::uint32_t>(m_docs.size()));
+    if (inserted)
+    {
+        m_docs.push_back(name);
+    }
+    return it->second;
+}
+
+aptrepo::TextIndex::Segment aptrepo::TextIndex::build_segment(const std::vector<std::vector<std::string_view>> &texts, std::size_t threads) const
+{
+    using LocalPostings = std::unordered_map<std::string, std::vector<Entry>>;
+
+    Segment segment;
+    segment.doc_lengths.resize(texts.size());
+
+    // Each worker indexes a contiguous range of documents, so appending the
+    // partial posting lists in worker order keeps the doc ids sorted.
+    auto workers = std::max<std::size_t>(1, std::min(threads, texts.size() / 1024 + 1));
+    auto chunk = (texts.size() + workers - 1) / workers;
+    std::vector<LocalPostings> partial(workers);
+    std::vector<std::thread> pool;
+
+    for (std::size_t w = 0; w < workers; ++w)
+    {
+        pool.emplace_back([&, w]()
+                          {
+                              auto begin = w * chunk;
+                              auto end = std::min(texts.size(), begin + chunk);
+                              std::unordered_map<std::string, std::uint32_t> frequencies;
+                              for (auto doc = begin; doc < end; ++doc)
+                              {
+                                  frequencies.clear();
+                                  std::uint32_t length = 0;
+                                  for (auto text : texts[doc])
+                                  {
+                                      for_each_term(text, [&](const std::string &term)
+                                                    {
+                                                        ++frequencies[term];
+                                                        ++length;
+                                                    });
+                                  }
+                                  segment.doc_lengths[doc] = length;
+                                  for (const auto &[term, frequency] : frequencies)
+                                  {
+                                      partial[w][term].push_back({static_cast<std::uint32_t>(doc), frequency});
+                                  }
+                              }
+                          });
+    }
+    for (auto &thread : pool)
+    {
+        thread.join();
+    }
+
+    std::unordered_map<std::string, std::uint32_t> last_doc;
+    for (auto &local : partial)
+    {
+        for (auto &[term, entries] : local)
+        {
+            auto &posting = segment.postings[term];
+            auto &last = last_doc[term];
+            for (auto entry : entries)
+            {
+                aptrepo::internal::append_varint(posting.data, entry.doc - last);
+                aptrepo::internal::append_varint(posting.data, entry.frequency);
+                last = entry.doc;
+                ++posting.doc_frequency;
+            }
+        }
+        local.clear();
+    }
+
+    std::size_t total = 0;
+    std::size_t documents = 0;
+    for (auto length : segment.doc_lengths)
+    {
+        total += length;
+        documents += length > 0 ? 1 : 0;
+    }
+    segment.average_length = documents > 0 ? static_cast<double>(total) / static_cast<double>(documents) : 0;
+
+    return segment;
+}
+
+void aptrepo::TextIndex::set_translation_loader(TranslationLoader loader)
+{
+    std::unique_lock lock(m_mutex);
+    m_loader = std::move(loader);
+}
+
+bool aptrepo::TextIndex::has_language(const std::string &lang) const
+{
+    std::shared_lock lock(m_mutex);
+    return m_segments.contains(lang);
+}
+
+void aptrepo::TextIndex::load_translations(const std::string &lang)
+{
+    // Searches wait for the segment instead of loading it a second time
+    std::unique_lock lock(m_mutex);
+    if (m_segments.contains(lang))
+    {
+        return;
+    }
+    if (!m_loader)
+    {
+        spdlog::warn("TextIndex: No translation loader for language {}", lang);
+        return;
+    }
+
+    spdlog::info("TextIndex: Loading translations for language {}", lang);
+
+    auto key = "Description-" + lang;
+    auto translations = m_loader(lang);
+    std::vector<std::vector<std::string_view>> texts;
+    for (const auto &index : translations)
+    {
+        for (const auto &stanza : index.get_packages())
+        {
+            auto description = stanza.get_fields().find(key);
+            if (description)
+            {
+                auto doc = get_doc(stanza.get_name());
+                if (texts.size() <= doc)
+                {
+                    texts.resize(doc + 1);
+                }
+                texts[doc].push_back(*description);
+            }
+        }
+    }
+    m_segments[lang] = build_segment(texts, m_threads);
+}
+
+std::vector<aptrepo::TextIndex::Result> aptrepo::TextIndex::search(std::string_view query, Mode mode, std::size_t limit, const std::string &lang)
+{
+    std::shared_lock lock(m_mutex);
+    if (!m_segments.contains(lang))
+    {
+        lock.unlock();
+        load_translations(lang);
+        lock.lock();
+        if (!m_segments.contains(lang))
+        {
+            return {};
+        }
+    }
+
+    const auto &segment = m_segments.at(lang);
+
+    auto terms = tokenize(query);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    if (terms.empty())
+    {
+        return {};
+    }
+
+    std::size_t documents = 0;
+    for (auto length : segment.doc_lengths)
+    {
+        documents += length > 0 ? 1 : 0;
+    }
+
+    struct List
+    {
+        double idf;
+        std::vector<Entry> entries;
+    };
+    std::vector<List> lists;
+    for (const auto &term : terms)
+    {
+        auto it = segment.postings.find(term);
+        if (it == segment.postings.end())
+        {
+            if (mode == Mode::And)
+            {
+                return {};
+            }
+            continue;
+        }
+        auto df = static_cast<double>(it->second.doc_frequency);
+        auto idf = std::log(1.0 + (static_cast<double>(documents) - df + 0.5) / (df + 0.5));
+        lists.push_back({idf, decode(it->second.data)});
+    }
+
+    auto term_score = [&](const List &list, const Entry &entry)
+    {
+        auto tf = static_cast<double>(entry.frequency);
+        auto length = static_cast<double>(segment.doc_lengths[entry.doc]);
+        return list.idf * tf * (k1 + 1) / (tf + k1 * (1 - b + b * length / segment.average_length));
+    };
+
+    std::vector<Result> results;
+    if (mode == Mode::And)
+    {
+        // Intersect, driven by the shortest posting list
+        std::sort(lists.begin(), lists.end(), [](const List &x, const List &y)
+                  { return x.entries.size() < y.entries.size(); });
+        std::vector<std::size_t> cursors(lists.size(), 0);
+        for (const auto &entry : lists[0].entries)
+        {
+            auto score = term_score(lists[0], entry);
+            bool matched = true;
+            for (std::size_t i = 1; i < lists.size() && matched; ++i)
+            {
+                const auto &entries = lists[i].entries;
+                auto &cursor = cursors[i];
+                while (cursor < entries.size() && entries[cursor].doc < entry.doc)
+                {
+                    ++cursor;
+                }
+                matched = cursor < entries.size() && entries[cursor].doc == entry.doc;
+                if (matched)
+                {
+                    score += term_score(lists[i], entries[cursor]);
+                }
+            }
+            if (matched)
+            {
+                results.push_back({m_docs[entry.doc], score});
+            }
+        }
+    }
+    else
+    {
+        std::unordered_map<std::uint32_t, double> scores;
+        for (const auto &list : lists)
+        {
+            for (const auto &entry : list.entries)
+            {
+                scores[entry.doc] += term_score(list, entry);
+            }
+        }
+        results.reserve(scores.size());
+        for (const auto &[doc, score] : scores)
+        {
+            results.push_back({m_docs[doc], score});
+        }
+    }
+
+    auto by_score = [](const Result &x, const Result &y)
+    {
+        return x.score != y.score ? x.score > y.score : x.package < y.package;
+    };
+    if (limit != 0 && results.size() > limit)
+    {
+        std::partial_sort(results.begin(), results.begin() + static_cast<std::ptrdiff_t>(limit), results.end(), by_score);
+        results.resize(limit);
+    }
+    else
+    {
+        std::sort(results.begin(), results.end(), by_score);
+    }
+    return results;
+}
+
+aptrepo::TextIndex::TranslationLoader aptrepo::TextIndex::release_translations(const aptrepo::Release &release)
+{
+    return [release](const std::string &lang)
+    {
+        std::vector<aptrepo::Packages> translations;
+        for (const auto &component : release.get_components())
+        {
+            // Archives usually publish only compressed Translation files
+            auto path = component + "/i18n/Translation-" + lang;
+            const aptrepo::Reference *reference = nullptr;
+            for (const auto *extension : {".xz", ".gz", ".zst", ""})
+            {
+                if (aptrepo::internal::is_supported_compression(path + extension))
+                {
+                    reference = release.find_reference(path + extension);
+                    if (reference)
+                    {
+                        break;
+                    }
+                }
+            }
+            if (!reference)
+            {
+                continue;
+            }
+
+            auto url = reference->get_url();
+            auto download = aptrepo::internal::download(url);
+            auto expected = reference->get_hash("SHA256");
+            if (!expected.empty() && aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(download.get_content())) != expected)
+            {
+                spdlog::error("TextIndex: Verification of {} failed.", url);
+                throw std::runtime_error("SHA256 mismatch of " + url);
+            }
+            auto content = aptrepo::internal::decompress(download.get_content(), reference->get_path());
+            translations.emplace_back(aptrepo::internal::Download(url, download.get_etag(), std::move(content)));
+        }
+        return translations;
+    };
+}
+
+std::vector<std::string> aptrepo::TextIndex::tokenize(std::string_view text)
+{
+    std::vector<std::string> terms;
+    for_each_term(text, [&terms](const std::string &term)
+                  { terms.push_back(term); });
+    return terms;
+}
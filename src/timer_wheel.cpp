@@ -0,0 +1,53 @@
+#include <algorithm>
+
+#include "aptrepo/internal/timer_wheel.hpp"
+
+aptrepo::internal::TimerWheel::TimerWheel(std::chrono::milliseconds tick, std::size_t slots, Clock::time_point start)
+    : m_tick(std::max(tick, std::chrono::milliseconds(1))), m_start(start), m_slots(std::max<std::size_t>(slots, 1))
+{
+}
+
+void aptrepo::internal::TimerWheel::schedule(std::size_t id, Clock::time_point due)
+{
+    std::uint64_t tick = m_current;
+    if (due > m_start)
+    {
+        // Round up, a timer never expires early
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(due - m_start + m_tick - std::chrono::milliseconds(1));
+        tick = std::max<std::uint64_t>(tick, static_cast<std::uint64_t>(elapsed / m_tick));
+    }
+    m_slots[tick % m_slots.size()].push_back({tick, id});
+    ++m_size;
+}
+
+std::vector<std::size_t> aptrepo::internal::TimerWheel::expire(Clock::time_point now)
+{
+    std::vector<std::size_t> expired;
+    if (now < m_start)
+    {
+        return expired;
+    }
+    auto now_tick = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_start) / m_tick);
+
+    // After a long pause each slot is visited at most once
+    auto end = std::min<std::uint64_t>(now_tick + 1, m_current + m_slots.size());
+    for (auto tick = m_current; tick < end; ++tick)
+    {
+        auto &slot = m_slots[tick % m_slots.size()];
+        auto due = std::stable_partition(slot.begin(), slot.end(), [&](const Timer &timer)
+                                         { return timer.tick > now_tick; });
+        for (auto timer = due; timer != slot.end(); ++timer)
+        {
+            expired.push_back(timer->id);
+        }
+        m_size -= static_cast<std::size_t>(slot.end() - due);
+        slot.erase(due, slot.end());
+    }
+    m_current = std::max(m_current, now_tick + 1);
+    return expired;
+}
+
+std::size_t aptrepo::internal::TimerWheel::size() const
+{
+    return m_size;
+}
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/unix_socket.hpp"
+
+namespace
+{
+    /// Time a client may block the sender before it is dropped.
+    constexpr timeval send_timeout = {1, 0};
+
+    sockaddr_un unix_address(const std::filesystem::path &path)
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.native().size() >= sizeof(addr.sun_path))
+        {
+            spdlog::error("UnixSocket: Path too long: {}", path.string());
+            throw std::runtime_error("UnixSocket: path too long");
+        }
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        return addr;
+    }
+}
+
+int aptrepo::internal::listen_unix(const std::filesystem::path &path)
+{
+    auto addr = unix_address(path);
+
+    // A socket file without a listening process is left over from a crash
+    auto existing = connect_unix(path);
+    if (existing >= 0)
+    {
+        ::close(existing);
+        spdlog::error("UnixSocket: {} is in use", path.string());
+        throw std::runtime_error("UnixSocket: address in use");
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        spdlog::error("UnixSocket: Failed to create socket: {}", std::strerror(errno));
+        throw std::runtime_error("UnixSocket: socket failed");
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0)
+    {
+        auto error = std::strerror(errno);
+        ::close(fd);
+        spdlog::error("UnixSocket: Failed to listen on {}: {}", path.string(), error);
+        throw std::runtime_error("UnixSocket: listen failed");
+    }
+    return fd;
+}
+
+int aptrepo::internal::connect_unix(const std::filesystem::path &path)
+{
+    auto addr = unix_address(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool aptrepo::internal::send_unix(int socket, std::string_view data)
+{
+    while (!data.empty())
+    {
+        auto sent = ::send(socket, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return false;
+        }
+        data.remove_prefix(static_cast<std::size_t>(sent));
+    }
+    return true;
+}
+
+bool aptrepo::internal::is_same_user(int socket)
+{
+    ucred credentials = {};
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0)
+    {
+        return false;
+    }
+    return credentials.uid == ::geteuid();
+}
+
+void aptrepo::internal::make_private_directory(const std::filesystem::path &path)
+{
+    if (::mkdir(path.c_str(), 0700) < 0 && errno != EEXIST)
+    {
+        spdlog::error("UnixSocket: Failed to create {}: {}", path.string(), std::strerror(errno));
+        throw std::runtime_error("UnixSocket: mkdir failed");
+    }
+
+    // lstat, so a symbolic link planted by another user is not followed
+    struct stat status = {};
+    if (::lstat(path.c_str(), &status) < 0 || !S_ISDIR(status.st_mode) ||
+        status.st_uid != ::geteuid() || (status.st_mode & 077) != 0)
+    {
+        spdlog::error("UnixSocket: {} is not a private directory of this user", path.string());
+        throw std::runtime_error("UnixSocket: directory not private");
+    }
+}
+
+aptrepo::internal::UnixBroadcaster::UnixBroadcaster(const std::filesystem::path &path)
+    : m_path(path), m_listen_socket(listen_unix(path))
+{
+    if (::pipe2(m_wakeup, O_CLOEXEC) < 0)
+    {
+        ::close(m_listen_socket);
+        spdlog::error("UnixBroadcaster: Failed to create pipe: {}", std::strerror(errno));
+        throw std::runtime_error("UnixBroadcaster: pipe failed");
+    }
+    m_accept_thread = std::thread(&UnixBroadcaster::accept_loop, this);
+    spdlog::info("UnixBroadcaster: Listening on {}", m_path.string());
+}
+
+aptrepo::internal::UnixBroadcaster::~UnixBroadcaster()
+{
+    // Wakes up the poll of the accept thread
+    ::close(m_wakeup[1]);
+    m_accept_thread.join();
+    ::close(m_wakeup[0]);
+    ::close(m_listen_socket);
+    for (auto client : m_clients)
+    {
+        ::close(client);
+    }
+    std::error_code ec;
+    std::filesystem::remove(m_path, ec);
+}
+
+void aptrepo::internal::UnixBroadcaster::send(std::string_view data)
+{
+    std::lock_guard lock(m_mutex);
+    std::erase_if(m_clients, [&](int client)
+                  {
+                      if (send_unix(client, data))
+                      {
+                          return false;
+                      }
+                      SPDLOG_DEBUG("UnixBroadcaster: Dropping client {}", client);
+                      ::close(client);
+                      return true; });
+}
+
+std::size_t aptrepo::internal::UnixBroadcaster::get_clients() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_clients.size();
+}
+
+void aptrepo::internal::UnixBroadcaster::accept_loop()
+{
+    while (true)
+    {
+        pollfd fds[2] = {{m_listen_socket, POLLIN, 0}, {m_wakeup[0], POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            spdlog::error("UnixBroadcaster: poll failed: {}", std::strerror(errno));
+            return;
+        }
+        if (fds[1].revents != 0)
+        {
+            return;
+        }
+
+        int client = ::accept4(m_listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+        {
+            continue;
+        }
+        if (!is_same_user(client))
+        {
+            spdlog::warn("UnixBroadcaster: Rejected a connection of another user");
+            ::close(client);
+            continue;
+        }
+        ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        ::shutdown(client, SHUT_RD);
+        std::lock_guard lock(m_mutex);
+        m_clients.push_back(client);
+    }
+}
@@ -1,6 +1,7 @@
 #include <spdlog/spdlog.h>
 #include <cpr/cpr.h>
 #include <exception>
+#include <stdexcept>
 #include <sstream>
 #include <cctype>
 #include <regex>
@@ -15,3 +16,114 @@ std::string aptrepo::internal::trim(const std::string &source)
     s.erase(s.find_last_not_of(" \n\r\t") + 1);
     return s;
 }
+
+bool aptrepo::internal::hex_to_bytes(std::string_view hex, char *bytes)
+{
+    auto nibble = [](char c) -> int
+    {
+        if (c >= '0' && c <= '9')
+        {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f')
+        {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F')
+        {
+            return c - 'A' + 10;
+        }
+        return -1;
+    };
+
+    if (hex.size() % 2 != 0)
+    {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < hex.size() / 2; ++i)
+    {
+        auto high = nibble(hex[2 * i]);
+        auto low = nibble(hex[2 * i + 1]);
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+        bytes[i] = static_cast<char>((high << 4) | low);
+    }
+    return true;
+}
+
+bool aptrepo::internal::is_safe_path(std::string_view path)
+{
+    if (path.empty() || path.back() == '/')
+    {
+        return false;
+    }
+    std::size_t start = 0;
+    while (start <= path.size())
+    {
+        auto end = path.find('/', start);
+        auto segment = path.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        if (segment.empty() || segment == "." || segment == "..")
+        {
+            return false;
+        }
+        if (end == std::string_view::npos)
+        {
+            break;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+std::string aptrepo::internal::hex_to_bytes(std::string_view hex)
+{
+    std::string bytes(hex.size() / 2, '\0');
+    if (!hex_to_bytes(hex, bytes.data()))
+    {
+        return {};
+    }
+    return bytes;
+}
+
+std::string aptrepo::internal::bytes_to_hex(std::string_view bytes)
+{
+    constexpr std::string_view digits = "0123456789abcdef";
+
+    std::string hex;
+    hex.reserve(bytes.size() * 2);
+    for (auto c : bytes)
+    {
+        auto byte = static_cast<unsigned char>(c);
+        hex += digits[byte >> 4];
+        hex += digits[byte & 0x0f];
+    }
+    return hex;
+}
+
+void aptrepo::internal::append_varint(std::string &buffer, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer += static_cast<char>(value);
+}
+
+std::uint64_t aptrepo::internal::read_varint(std::string_view buffer, std::size_t &pos)
+{
+    std::uint64_t value = 0;
+    for (unsigned shift = 0; pos < buffer.size() && shift < 64; shift += 7)
+    {
+        auto byte = static_cast<unsigned char>(buffer[pos++]);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("Truncated varint");
+}
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/utils.hpp"
+
+#include "aptrepo/watcher.hpp"
+
+namespace
+{
+    /// Slots of the timer wheel, one revolution covers the default interval.
+    constexpr std::size_t wheel_slots = 4096;
+
+    void count_poll(const char *result)
+    {
+        if (aptrepo::internal::metrics_enabled())
+        {
+            aptrepo::internal::count("aptrepo_watch_polls_total", 1, {{"result", result}});
+        }
+    }
+}
+
+aptrepo::Watcher::Watcher(Callback callback, Options options)
+    : m_callback(std::move(callback)), m_options(std::move(options)),
+      m_wheel(m_options.tick, wheel_slots), m_random(std::random_device()())
+{
+    m_options.connections = std::max<std::size_t>(m_options.connections, 1);
+    if (!m_options.keyring.empty())
+    {
+        m_keyring = aptrepo::Keyring::load(m_options.keyring);
+    }
+    load_state();
+}
+
+aptrepo::Watcher::Watcher(Callback callback)
+    : Watcher(std::move(callback), Options())
+{
+}
+
+void aptrepo::Watcher::add(const std::string &url)
+{
+    Entry entry;
+    entry.url = url;
+    {
+        std::lock_guard lock(m_mutex);
+        if (auto saved = m_saved_etags.find(url); saved != m_saved_etags.end())
+        {
+            entry.etag = saved->second;
+        }
+    }
+    if (!entry.etag.empty())
+    {
+        // Without the previous version a change could not be diffed, so it is fetched again
+        entry.release = load_release(url, entry.etag);
+        if (!entry.release)
+        {
+            entry.etag.clear();
+        }
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_entries.push_back(std::move(entry));
+
+    // Spread the first polls, so thousands of URLs don't start in one burst
+    std::uniform_real_distribution<double> spread(0.0, m_options.jitter);
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(m_options.interval * spread(m_random));
+    m_wheel.schedule(m_entries.size() - 1, std::chrono::steady_clock::now() + delay);
+}
+
+std::size_t aptrepo::Watcher::size() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_entries.size();
+}
+
+void aptrepo::Watcher::run()
+{
+    spdlog::info("Watcher: Watching {} URLs with {} connections", size(), m_options.connections);
+
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < m_options.connections; ++i)
+    {
+        workers.emplace_back(&Watcher::work, this);
+    }
+
+    {
+        std::unique_lock lock(m_mutex);
+        while (!m_stop)
+        {
+            auto expired = m_wheel.expire();
+            if (!expired.empty())
+            {
+                m_queue.insert(m_queue.end(), expired.begin(), expired.end());
+                m_work.notify_all();
+            }
+            m_stopped.wait_for(lock, m_options.tick, [this]
+                               { return m_stop; });
+        }
+    }
+
+    m_work.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    spdlog::info("Watcher: Stopped");
+}
+
+void aptrepo::Watcher::stop()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_stopped.notify_all();
+    m_work.notify_all();
+}
+
+aptrepo::Watcher::Statistics aptrepo::Watcher::get_statistics() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_statistics;
+}
+
+void aptrepo::Watcher::work()
+{
+    aptrepo::internal::ConditionalClient client;
+    while (true)
+    {
+        std::size_t id = 0;
+        {
+            std::unique_lock lock(m_mutex);
+            m_work.wait(lock, [this]
+                        { return m_stop || !m_queue.empty(); });
+            if (m_stop)
+            {
+                return;
+            }
+            id = m_queue.front();
+            m_queue.pop_front();
+        }
+        poll(client, id);
+    }
+}
+
+void aptrepo::Watcher::poll(aptrepo::internal::ConditionalClient &client, std::size_t id)
+{
+    std::string url;
+    std::string etag;
+    std::string digest;
+    std::shared_ptr<const aptrepo::Release> previous;
+    {
+        std::lock_guard lock(m_mutex);
+        url = m_entries[id].url;
+        etag = m_entries[id].etag;
+        digest = m_entries[id].digest;
+        previous = m_entries[id].release;
+    }
+
+    std::optional<Event> event;
+    bool failed = false;
+    try
+    {
+        auto download = client.get_if_changed(url, etag, m_options.timeout);
+        // Without an ETag every poll downloads the file, unchanged or not
+        auto previous_digest = std::exchange(digest, download ? aptrepo::internal::sha256(download->get_content()) : "");
+        if (download && !(previous && digest == previous_digest))
+        {
+            auto release = m_keyring ? std::make_shared<const aptrepo::Release>(*download, *m_keyring)
+                                     : std::make_shared<const aptrepo::Release>(*download);
+            event = Event{url, release, {}, previous == nullptr};
+            save_release(*download);
+            if (previous)
+            {
+                event->diff = aptrepo::diff(*previous, *release);
+            }
+            else
+            {
+                // Nothing is known about the previous version, so everything is new
+                event->diff.added = release->get_references();
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::warn("Watcher: Polling {} failed: {}", url, e.what());
+        failed = true;
+    }
+
+    std::size_t failures = 0;
+    {
+        std::lock_guard lock(m_mutex);
+        auto &entry = m_entries[id];
+        m_statistics.polls++;
+        if (failed)
+        {
+            failures = ++entry.failures;
+            m_statistics.failed++;
+        }
+        else
+        {
+            entry.failures = 0;
+            if (event)
+            {
+                entry.etag = event->release->get_etag();
+                entry.digest = digest;
+                entry.release = event->release;
+                m_statistics.changed++;
+            }
+            else
+            {
+                m_statistics.unchanged++;
+            }
+        }
+    }
+    count_poll(failed ? "failed" : (event ? "changed" : "unchanged"));
+
+    if (event)
+    {
+        SPDLOG_DEBUG("Watcher: {} changed, {} added, {} removed, {} changed references", url,
+                     event->diff.added.size(), event->diff.removed.size(), event->diff.changed.size());
+        save_state();
+        try
+        {
+            std::lock_guard lock(m_callback_mutex);
+            m_callback(*event);
+        }
+        catch (const std::exception &e)
+        {
+            spdlog::error("Watcher: Handling the change of {} failed: {}", url, e.what());
+        }
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_wheel.schedule(id, std::chrono::steady_clock::now() + next_delay(failures));
+}
+
+std::chrono::milliseconds aptrepo::Watcher::next_delay(std::size_t failures)
+{
+    // Doubled for each failure in a row, up to max_backoff
+    auto delay = m_options.interval;
+    for (std::size_t i = 0; i < failures && delay < m_options.max_backoff; ++i)
+    {
+        delay *= 2;
+    }
+    if (failures > 0)
+    {
+        delay = std::max(std::min(delay, m_options.max_backoff), m_options.interval);
+    }
+
+    std::uniform_real_distribution<double> jitter(1.0 - m_options.jitter, 1.0 + m_options.jitter);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(delay * jitter(m_random));
+}
+
+void aptrepo::Watcher::load_state()
+{
+    if (m_options.state.empty())
+    {
+        return;
+    }
+    std::ifstream file(m_options.state);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        auto tab = line.find('\t');
+        if (tab != std::string::npos)
+        {
+            m_saved_etags[line.substr(0, tab)] = line.substr(tab + 1);
+        }
+    }
+    SPDLOG_DEBUG("Watcher: Loaded {} ETags from {}", m_saved_etags.size(), m_options.state.string());
+}
+
+std::filesystem::path aptrepo::Watcher::release_path(const std::string &url) const
+{
+    auto directory = m_options.state;
+    directory += ".releases";
+    return directory / aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(url));
+}
+
+std::shared_ptr<const aptrepo::Release> aptrepo::Watcher::load_release(const std::string &url, const std::string &etag) const
+{
+    std::ifstream file(release_path(url), std::ios::binary);
+    if (!file)
+    {
+        return nullptr;
+    }
+    std::ostringstream content;
+    content << file.rdbuf();
+    try
+    {
+        // Verified when it was saved, it is only the base of the next diff
+        return std::make_shared<const aptrepo::Release>(aptrepo::internal::Download(url, etag, content.str()));
+    }
+    catch (const std::exception &e)
+    {
+        spdlog::warn("Watcher: Failed to load the saved Release of {}: {}", url, e.what());
+        return nullptr;
+    }
+}
+
+void aptrepo::Watcher::save_release(const aptrepo::internal::Download &download) const
+{
+    if (m_options.state.empty())
+    {
+        return;
+    }
+
+    // Saved before the ETag, so a saved ETag always has its Release
+    auto path = release_path(download.get_url());
+    auto temporary = path;
+    temporary += ".tmp";
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file << download.get_content();
+        if (!file)
+        {
+            spdlog::error("Watcher: Failed to write {}", temporary.string());
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, ec);
+}
+
+void aptrepo::Watcher::save_state()
+{
+    if (m_options.state.empty())
+    {
+        return;
+    }
+
+    std::lock_guard state_lock(m_state_mutex);
+    std::ostringstream content;
+    {
+        std::lock_guard lock(m_mutex);
+        for (const auto &entry : m_entries)
+        {
+            if (!entry.etag.empty())
+            {
+                content << entry.url << '\t' << entry.etag << '\n';
+            }
+        }
+    }
+
+    // Written to a temporary file and renamed, so a crash never leaves a partial state
+    auto temporary = m_options.state;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::trunc);
+        file << content.str();
+        if (!file)
+        {
+            spdlog::error("Watcher: Failed to write {}", temporary.string());
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, m_options.state);
+}
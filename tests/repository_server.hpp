@@ -0,0 +1,306 @@
+/******************************************************************************
+ * @file repository_server.hpp
+ * @brief Loopback APT repository server for tests and benchmarks.
+ *
+ * A RepositoryServer serves synthetic or recorded repositories on
+ * 127.0.0.1, so download paths can be tested offline and measured
+ * reproducibly. Latency, bandwidth, ETag and Range support and failures
+ * are configurable.
+ ******************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/http_server.hpp"
+#include "aptrepo/internal/utils.hpp"
+
+namespace aptrepo
+{
+    namespace test
+    {
+        /******************************************************************************
+         * RepositoryServer class serving a repository over loopback HTTP.
+         *
+         * All methods are thread safe.
+         ******************************************************************************/
+        class RepositoryServer
+        {
+        public:
+            /******************************************************************************
+             * Behavior of the server.
+             ******************************************************************************/
+            struct Options
+            {
+                /// Delay before each response.
+                std::chrono::milliseconds latency{0};
+                /// Bandwidth of each response in bytes per second, 0 for no limit.
+                std::size_t bandwidth = 0;
+                /// Send ETags and answer matching If-None-Match with 304.
+                bool etags = true;
+                /// Answer Range requests with 206.
+                bool ranges = true;
+            };
+
+            /******************************************************************************
+             * Counters of the served requests.
+             ******************************************************************************/
+            struct Statistics
+            {
+                std::size_t requests = 0;
+                std::size_t not_modified = 0;
+                std::size_t partial = 0;
+                std::size_t injected = 0;
+                std::size_t not_found = 0;
+            };
+
+            /******************************************************************************
+             * Constructor for RepositoryServer class, the server listens immediately.
+             *
+             * @param options Behavior of the server.
+             ******************************************************************************/
+            explicit RepositoryServer(Options options)
+                : m_options(options),
+                  m_server(std::make_unique<aptrepo::internal::HttpServer>([this](const aptrepo::internal::HttpRequest &request)
+                                                                           { return handle(request); }))
+            {
+            }
+
+            /******************************************************************************
+             * Constructor for RepositoryServer class using default options.
+             ******************************************************************************/
+            RepositoryServer()
+                : RepositoryServer(Options())
+            {
+            }
+
+            /******************************************************************************
+             * Get the base URL of the repository.
+             *
+             * @return URL like "http://127.0.0.1:8080".
+             ******************************************************************************/
+            std::string get_url() const
+            {
+                return m_server->get_url();
+            }
+
+            /******************************************************************************
+             * Change the behavior of the server.
+             *
+             * @param options Behavior of the server.
+             ******************************************************************************/
+            void set_options(Options options)
+            {
+                std::lock_guard lock(m_mutex);
+                m_options = options;
+            }
+
+            /******************************************************************************
+             * Serve content at a path. Replacing content changes its ETag.
+             *
+             * @param path    Absolute path, e.g. "/dists/noble/InRelease".
+             * @param content Content of the file.
+             ******************************************************************************/
+            void add_file(const std::string &path, std::string content)
+            {
+                std::lock_guard lock(m_mutex);
+                auto etag = std::format("\"{}\"", aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(content)).substr(0, 16));
+                m_files[path] = {std::move(content), {}, std::move(etag)};
+            }
+
+            /******************************************************************************
+             * Serve a recorded repository, e.g. a mirror created by MirrorSync.
+             *
+             * The files are sent from disk.
+             *
+             * @param root Root directory of the repository.
+             ******************************************************************************/
+            void add_directory(const std::filesystem::path &root)
+            {
+                std::lock_guard lock(m_mutex);
+                for (const auto &entry : std::filesystem::recursive_directory_iterator(root))
+                {
+                    if (!entry.is_regular_file())
+                    {
+                        continue;
+                    }
+                    auto mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(entry.last_write_time().time_since_epoch()).count();
+                    auto path = "/" + std::filesystem::relative(entry.path(), root).generic_string();
+                    m_files[path] = {{}, entry.path(), std::format("\"{:x}-{:x}\"", entry.file_size(), mtime)};
+                }
+            }
+
+            /******************************************************************************
+             * Serve a synthetic distribution with an InRelease and one Packages index.
+             *
+             * @param distro   Name of the distribution.
+             * @param packages Number of stanzas in the Packages index.
+             * @return Content of the Packages index.
+             ******************************************************************************/
+            std::string add_distribution(const std::string &distro, std::size_t packages)
+            {
+                std::string index;
+                for (std::size_t i = 0; i < packages; ++i)
+                {
+                    index += std::format("Package: package-{}\nVersion: 1.{}-1\nArchitecture: amd64\nFilename: pool/main/p/package-{}/package-{}_1.{}-1_amd64.deb\n"
+                                         "Size: {}\nSHA256: {}\nDescription: synthetic package {}\n\n",
+                                         i, i % 10, i, i, i % 10, 1000 + i, aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(std::to_string(i))), i);
+                }
+                auto in_release = std::format("Origin: Test\nLabel: Test\nSuite: {}\nCodename: {}\nArchitectures: amd64\nComponents: main\n"
+                                              "Date: Thu, 25 Apr 2024 15:10:33 UTC\nSHA256:\n {} {} main/binary-amd64/Packages\n",
+                                              distro, distro, aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(index)), index.size());
+                add_file("/dists/" + distro + "/main/binary-amd64/Packages", index);
+                add_file("/dists/" + distro + "/InRelease", in_release);
+                return index;
+            }
+
+            /******************************************************************************
+             * Inject failures into the next requests.
+             *
+             * @param count       Number of requests to fail.
+             * @param status      Status code of the failed responses.
+             * @param abort_after For status 200, close the connection after this many
+             *                    body bytes; std::string::npos to send an error status.
+             ******************************************************************************/
+            void fail_next(std::size_t count, int status = 503, std::size_t abort_after = std::string::npos)
+            {
+                std::lock_guard lock(m_mutex);
+                m_failures = count;
+                m_failure_status = status;
+                m_failure_abort = abort_after;
+            }
+
+            /******************************************************************************
+             * Get the counters of the served requests.
+             *
+             * @return The counters.
+             ******************************************************************************/
+            Statistics get_statistics() const
+            {
+                std::lock_guard lock(m_mutex);
+                return m_statistics;
+            }
+
+        private:
+            struct File
+            {
+                std::string content;
+                std::filesystem::path path;
+                std::string etag;
+            };
+
+            aptrepo::internal::HttpResponse handle(const aptrepo::internal::HttpRequest &request)
+            {
+                aptrepo::internal::HttpResponse response;
+                File file;
+                Options options;
+                bool inject = false;
+                bool found = false;
+                {
+                    std::lock_guard lock(m_mutex);
+                    m_statistics.requests++;
+                    options = m_options;
+                    if (m_failures > 0)
+                    {
+                        m_failures--;
+                        m_statistics.injected++;
+                        inject = true;
+                        response.status = m_failure_status;
+                        response.abort_after = m_failure_abort;
+                    }
+                    auto search = m_files.find(request.target.substr(0, request.target.find('?')));
+                    found = search != m_files.end();
+                    if (found)
+                    {
+                        file = search->second;
+                    }
+                    else if (!inject)
+                    {
+                        m_statistics.not_found++;
+                    }
+                }
+
+                if (options.latency.count() > 0)
+                {
+                    std::this_thread::sleep_for(options.latency);
+                }
+                response.rate = options.bandwidth;
+                if (!found || (inject && response.status != 200))
+                {
+                    response.status = inject ? response.status : 404;
+                    response.body = aptrepo::internal::http_reason(response.status) + "\n";
+                    return response;
+                }
+
+                auto size = file.path.empty() ? file.content.size() : std::filesystem::file_size(file.path);
+                if (options.etags)
+                {
+                    response.headers["ETag"] = file.etag;
+                    if (request.get_header("If-None-Match") == file.etag)
+                    {
+                        std::lock_guard lock(m_mutex);
+                        m_statistics.not_modified++;
+                        response.status = 304;
+                        return response;
+                    }
+                }
+
+                std::size_t begin = 0;
+                std::size_t end = size;
+                auto range = request.get_header("Range");
+                auto if_range = request.get_header("If-Range");
+                if (options.ranges && range.starts_with("bytes=") && (if_range.empty() || if_range == file.etag))
+                {
+                    response.headers["Accept-Ranges"] = "bytes";
+                    auto dash = range.find('-');
+                    begin = std::stoull(range.substr(6, dash - 6));
+                    if (dash + 1 < range.size())
+                    {
+                        end = std::min<std::size_t>(std::stoull(range.substr(dash + 1)) + 1, size);
+                    }
+                    if (begin >= size)
+                    {
+                        response.status = 416;
+                        response.headers["Content-Range"] = std::format("bytes */{}", size);
+                        return response;
+                    }
+                    response.status = 206;
+                    response.headers["Content-Range"] = std::format("bytes {}-{}/{}", begin, end - 1, size);
+                    std::lock_guard lock(m_mutex);
+                    m_statistics.partial++;
+                }
+
+                if (file.path.empty())
+                {
+                    response.body = file.content.substr(begin, end - begin);
+                }
+                else
+                {
+                    response.file = file.path;
+                    response.file_offset = begin;
+                    response.file_length = end - begin;
+                }
+                return response;
+            }
+
+            mutable std::mutex m_mutex;
+            Options m_options;
+            std::map<std::string, File> m_files;
+            std::size_t m_failures = 0;
+            int m_failure_status = 503;
+            std::size_t m_failure_abort = std::string::npos;
+            Statistics m_statistics;
+            // Last member, so the server is stopped before the files are destroyed
+            std::unique_ptr<aptrepo::internal::HttpServer> m_server;
+        };
+    }
+}
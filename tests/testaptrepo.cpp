@@ -3,15 +3,108 @@
 
 #include <catch2/catch.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <set>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <cpr/cpr.h>
 #include <spdlog/spdlog.h>
 
+#include "aptrepo/internal/deb.hpp"
+#include "aptrepo/internal/decompress.hpp"
 #include "aptrepo/internal/downloads.hpp"
+#include "aptrepo/internal/fields.hpp"
+#include "aptrepo/internal/hash.hpp"
+#include "aptrepo/internal/http_server.hpp"
+#include "aptrepo/internal/metrics.hpp"
+#include "aptrepo/internal/scheduler.hpp"
+#include "aptrepo/internal/timer_wheel.hpp"
+#include "aptrepo/internal/unix_socket.hpp"
 #include "aptrepo/internal/utils.hpp"
+#include "aptrepo/compressed_packages.hpp"
+#include "aptrepo/deb.hpp"
 #include "aptrepo/reference.hpp"
 #include "aptrepo/release.hpp"
+#include "aptrepo/packages.hpp"
+#include "aptrepo/name_index.hpp"
+#include "aptrepo/package_table.hpp"
+#include "aptrepo/text_index.hpp"
+#include "aptrepo/watcher.hpp"
+#include "aptrepo/diff.hpp"
+#include "aptrepo/history.hpp"
+#include "aptrepo/mirror.hpp"
+#include "aptrepo/mirror_set.hpp"
+#include "aptrepo/ndjson.hpp"
+#include "aptrepo/store.hpp"
+#include "aptrepo/metrics.hpp"
+#include "aptrepo/keyring.hpp"
+#include "aptrepo/proxy.hpp"
+#include "aptrepo/query_server.hpp"
+
 #include "aptrepo/aptrepo.hpp"
 
+#include "repository_server.hpp"
+
+namespace
+{
+    void write_file(const std::filesystem::path &path, const std::string &content)
+    {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << content;
+    }
+
+    std::string sha256_hex(const std::string &content)
+    {
+        return aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(content));
+    }
+
+    void set_tar_checksum(std::string &header)
+    {
+        header.replace(148, 8, "        ");
+        std::size_t checksum = 0;
+        for (auto c : header)
+        {
+            checksum += static_cast<unsigned char>(c);
+        }
+        header.replace(148, 7, std::format("{:06o}", checksum) + '\0');
+    }
+
+    std::string tar_entry(const std::string &name, const std::string &content, char type = '0')
+    {
+        std::string header(512, '\0');
+        header.replace(0, name.size(), name);
+        header.replace(100, 7, "0000644");
+        header.replace(124, 11, std::format("{:011o}", content.size()));
+        header[156] = type;
+        header.replace(257, 6, std::string("ustar\0", 6));
+        set_tar_checksum(header);
+        return header + content + std::string((512 - content.size() % 512) % 512, '\0');
+    }
+
+    std::string ar_member(const std::string &name, const std::string &content)
+    {
+        auto header = std::format("{:<16}{:<12}{:<6}{:<6}{:<8}{:<10}`\n", name, 0, 0, 0, 100644, content.size());
+        return header + content + (content.size() % 2 ? "\n" : "");
+    }
+}
+
 TEST_CASE("Check if update is needed", "[download][internal]")
 {
     spdlog::set_level(spdlog::level::info);
@@ -46,6 +139,76 @@ TEST_CASE("Download URL content", "[download][internal]")
     CHECK_THAT(content, Catch::Matchers::Contains("Suite: noble"));
 }
 
+TEST_CASE("Loopback repository", "[loopback][download]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto server = aptrepo::test::RepositoryServer();
+    auto packages = server.add_distribution("test", 100);
+    auto url = server.get_url() + "/dists/test/InRelease";
+
+    // Same checks as the archive.ubuntu.com tests, without network access
+    auto download = aptrepo::internal::download(url);
+    CHECK_THAT(download.get_content(), Catch::Matchers::Contains("Origin: Test"));
+    REQUIRE(!download.get_etag().empty());
+    REQUIRE(aptrepo::internal::needs_update(url, download.get_etag()) == false);
+    REQUIRE(aptrepo::internal::needs_update(url, "no-match-etag") == true);
+    REQUIRE(server.get_statistics().not_modified == 1);
+
+    auto release = aptrepo::parse_release(url);
+    CHECK_THAT(release.get_suite(), Catch::Matchers::Equals("test"));
+    auto references = release.get_references("amd64", "main");
+    REQUIRE(references.size() == 1);
+    REQUIRE(aptrepo::parse_packages(references[0].get_url()).get_packages().size() == 100);
+
+    // Changed content gets a new ETag
+    server.add_file("/dists/test/InRelease", "Origin: Changed\n");
+    REQUIRE(aptrepo::internal::needs_update(url, download.get_etag()) == true);
+
+    // Ranges
+    auto packages_url = references[0].get_url();
+    CHECK_THAT(aptrepo::internal::download_range(packages_url, 9, 18), Catch::Matchers::Equals(packages.substr(9, 9)));
+    REQUIRE(server.get_statistics().partial == 1);
+    auto options = aptrepo::test::RepositoryServer::Options();
+    options.ranges = false;
+    server.set_options(options);
+    CHECK_THAT(aptrepo::internal::download_range(packages_url, 9, 18), Catch::Matchers::Equals(packages.substr(9, 9)));
+    REQUIRE(server.get_statistics().partial == 1);
+
+    // Injected errors and dropped connections
+    server.set_options(aptrepo::test::RepositoryServer::Options());
+    server.fail_next(1, 503);
+    REQUIRE_THROWS(aptrepo::internal::download(packages_url));
+    REQUIRE_THROWS(aptrepo::internal::download(server.get_url() + "/missing"));
+    REQUIRE(server.get_statistics().not_found == 1);
+    auto root = std::filesystem::temp_directory_path() / "aptrepo-test-loopback";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    server.fail_next(1, 200, 1000);
+    auto digest = aptrepo::internal::download_resumable(packages_url, root / "Packages");
+    REQUIRE(digest == aptrepo::internal::sha256(packages));
+    REQUIRE(server.get_statistics().partial == 2);
+
+    // Recorded repositories are served from disk
+    write_file(root / "recorded" / "dists" / "test" / "InRelease", "Origin: Recorded\nSuite: test\n");
+    auto recorded = aptrepo::test::RepositoryServer();
+    recorded.add_directory(root / "recorded");
+    CHECK_THAT(aptrepo::parse_release(recorded.get_url() + "/dists/test/InRelease").get_origin(), Catch::Matchers::Equals("Recorded"));
+    std::filesystem::remove_all(root);
+
+    // Latency and bandwidth
+    options = aptrepo::test::RepositoryServer::Options();
+    options.latency = std::chrono::milliseconds(100);
+    options.bandwidth = 256 * 1024;
+    server.set_options(options);
+    server.add_file("/large", std::string(128 * 1024, 'x'));
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(aptrepo::internal::download(server.get_url() + "/large").get_content().size() == 128 * 1024);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    REQUIRE(elapsed > std::chrono::milliseconds(500));
+    REQUIRE(elapsed < std::chrono::milliseconds(3000));
+}
+
 TEST_CASE("Trim string", "[utils][internal]")
 {
     spdlog::set_level(spdlog::level::info);
@@ -55,6 +218,169 @@ TEST_CASE("Trim string", "[utils][internal]")
     CHECK_THAT(result, Catch::Matchers::Equals("Hello, World!"));
 }
 
+TEST_CASE("Safe paths", "[utils][internal]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    CHECK(aptrepo::internal::is_safe_path("pool/main/h/hello/hello_1.0..1_amd64.deb"));
+    CHECK(aptrepo::internal::is_safe_path("main/binary-amd64/Packages.xz"));
+    CHECK_FALSE(aptrepo::internal::is_safe_path(""));
+    CHECK_FALSE(aptrepo::internal::is_safe_path("/etc/passwd"));
+    CHECK_FALSE(aptrepo::internal::is_safe_path("pool/../../etc/passwd"));
+    CHECK_FALSE(aptrepo::internal::is_safe_path("pool/./main"));
+    CHECK_FALSE(aptrepo::internal::is_safe_path("pool//main"));
+    CHECK_FALSE(aptrepo::internal::is_safe_path("pool/main/"));
+}
+
+TEST_CASE("Field table", "[utils][internal]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    static_assert(aptrepo::internal::find_field("Origin") == aptrepo::internal::Field::Origin);
+    static_assert(aptrepo::internal::find_field("Installed-Size") == aptrepo::internal::Field::InstalledSize);
+
+    for (std::size_t i = 0; i < aptrepo::internal::field_count; ++i)
+    {
+        auto field = static_cast<aptrepo::internal::Field>(i);
+        REQUIRE(aptrepo::internal::find_field(aptrepo::internal::field_name(field)) == field);
+    }
+
+    REQUIRE(aptrepo::internal::find_field("md5SUM") == aptrepo::internal::Field::MD5sum);
+    REQUIRE(aptrepo::internal::find_field("X-Unknown-Field") == std::nullopt);
+    REQUIRE(aptrepo::internal::find_field("") == std::nullopt);
+
+    auto table = aptrepo::internal::FieldTable{};
+    table.set("Package", "bash");
+    table.set("X-Cargo-Built-Using", "rust-foo");
+    table.set("x-cargo-built-using", "rust-bar");
+
+    CHECK_THAT(table.get(aptrepo::internal::Field::Package), Catch::Matchers::Equals("bash"));
+    CHECK_THAT(table.get(aptrepo::internal::Field::Version), Catch::Matchers::Equals(""));
+    REQUIRE(table.find("package") != nullptr);
+    REQUIRE(table.find("Version") == nullptr);
+    REQUIRE(table.get_overflow().size() == 1);
+    CHECK_THAT(*table.find("X-Cargo-Built-Using"), Catch::Matchers::Equals("rust-bar"));
+}
+
+TEST_CASE("SHA-256", "[utils][internal]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    CHECK_THAT(sha256_hex(""), Catch::Matchers::Equals("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+    CHECK_THAT(sha256_hex("abc"), Catch::Matchers::Equals("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+
+    auto hash = aptrepo::internal::Sha256();
+    auto million = std::string(1000000, 'a');
+    hash.update(std::string_view(million).substr(0, 3));
+    hash.update(std::string_view(million).substr(3, 500000));
+    hash.update(std::string_view(million).substr(500003));
+    CHECK_THAT(aptrepo::internal::bytes_to_hex(hash.digest()), Catch::Matchers::Equals("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"));
+}
+
+TEST_CASE("Decompress", "[utils][internal]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    // Two gzip members
+    auto gz = std::string("\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03\x0b\x48\x4c\xce\x4e\x4c\x4f\xb5\x52\xc8\xcf\x4b\xe5\x02\x00\x61\x7d\xf3\xa0\x0d\x00\x00\x00"
+                          "\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03\xe3\x0a\x48\x4c\xce\x4e\x4c\x4f\xb5\x52\x28\x29\xcf\xe7\x02\x00\x54\x38\x0b\xc2\x0e\x00\x00\x00",
+                          67);
+
+    CHECK_THAT(aptrepo::internal::decompress(gz, "main/binary-amd64/Packages.gz"), Catch::Matchers::Equals("Package: one\n\nPackage: two\n"));
+    CHECK_THAT(aptrepo::internal::decompress("plain", "main/binary-amd64/Packages"), Catch::Matchers::Equals("plain"));
+    REQUIRE_THROWS(aptrepo::internal::decompress(gz.substr(0, 20), "Packages.gz"));
+    REQUIRE(aptrepo::internal::is_supported_compression("dists/noble/main/binary-amd64/Packages.gz"));
+    REQUIRE(aptrepo::internal::is_supported_compression("dists/noble.1/main/binary-amd64/Packages"));
+
+    // Two xz streams
+    auto xz = std::string("\xfd\x37\x7a\x58\x5a\x00\x00\x04\xe6\xd6\xb4\x46\x02\x00\x21\x01\x16\x00\x00\x00\x74\x2f\xe5\xa3\x01\x00\x0c\x50\x61\x63\x6b\x61\x67\x65\x3a\x20\x6f\x6e\x65\x0a\x00\x00\x00\x00\x2e\xa5\x24\x24\x6e\xb8\xee\x98\x00\x01\x25\x0d\x71\x19\xc4\xb6\x1f\xb6\xf3\x7d\x01\x00\x00\x00\x00\x04\x59\x5a"
+                          "\xfd\x37\x7a\x58\x5a\x00\x00\x04\xe6\xd6\xb4\x46\x02\x00\x21\x01\x16\x00\x00\x00\x74\x2f\xe5\xa3\x01\x00\x0d\x0a\x50\x61\x63\x6b\x61\x67\x65\x3a\x20\x74\x77\x6f\x0a\x00\x00\x00\xa3\x5a\x42\x21\x18\xb1\x94\x84\x00\x01\x26\x0e\x08\x1b\xe0\x04\x1f\xb6\xf3\x7d\x01\x00\x00\x00\x00\x04\x59\x5a",
+                          144);
+    CHECK_THAT(aptrepo::internal::decompress(xz, "main/binary-amd64/Packages.xz"), Catch::Matchers::Equals("Package: one\n\nPackage: two\n"));
+    REQUIRE_THROWS(aptrepo::internal::decompress(xz.substr(0, 60), "Packages.xz"));
+    REQUIRE(aptrepo::internal::is_supported_compression("dists/noble/main/binary-amd64/Packages.xz"));
+    REQUIRE(!aptrepo::internal::is_supported_compression("dists/noble/main/binary-amd64/Packages.bz2"));
+
+    // Three xz blocks of 16 bytes, decoded in parallel and passed on in order
+    auto xz_blocks = std::string("\xfd\x37\x7a\x58\x5a\x00\x00\x04\xe6\xd6\xb4\x46\x02\xc0\x14\x10\x21\x01\x16\x00\x2b\x87\x69\x16\x01\x00\x0f\x50\x61\x63\x6b\x61\x67\x65\x3a\x20\x6f\x6e\x65\x0a\x0a\x50\x61\x00\x61\x75\x41\x69\x7d\x66\xea\x66"
+                                 "\x02\xc0\x14\x10\x21\x01\x16\x00\x2b\x87\x69\x16\x01\x00\x0f\x63\x6b\x61\x67\x65\x3a\x20\x74\x77\x6f\x0a\x0a\x50\x61\x63\x6b\x00\xbc\x28\xe8\xd4\x1e\x92\x20\x49"
+                                 "\x02\xc0\x0f\x0b\x21\x01\x16\x00\xe0\xd3\x48\x68\x01\x00\x0a\x61\x67\x65\x3a\x20\x74\x68\x72\x65\x65\x0a\x00\x00\xa1\x44\x30\x34\x6a\x46\x0c\xc2"
+                                 "\x00\x03\x28\x10\x28\x10\x23\x0b\x65\x5f\x0e\x8f\xb1\xc4\x67\xfb\x02\x00\x00\x00\x00\x04\x59\x5a",
+                                 152);
+    std::vector<std::string> pieces;
+    auto sink = [&pieces](std::string_view piece)
+    { pieces.emplace_back(piece); };
+    aptrepo::internal::decompress(xz_blocks, "Packages.xz", sink, 4);
+    CHECK_THAT(pieces, Catch::Matchers::Equals(std::vector<std::string>{"Package: one\n\nPa", "ckage: two\n\nPack", "age: three\n"}));
+    CHECK_THAT(aptrepo::internal::decompress(xz_blocks, "Packages.xz", 4), Catch::Matchers::Equals("Package: one\n\nPackage: two\n\nPackage: three\n"));
+    CHECK_THAT(aptrepo::internal::decompress(xz_blocks, "Packages.xz", 1), Catch::Matchers::Equals("Package: one\n\nPackage: two\n\nPackage: three\n"));
+    auto corrupt = xz_blocks;
+    corrupt[70] ^= 1;
+    REQUIRE_THROWS(aptrepo::internal::decompress(corrupt, "Packages.xz", 4));
+    REQUIRE_THROWS(aptrepo::internal::decompress(xz_blocks.substr(0, 100), "Packages.xz", 4));
+
+    // Blocks stating implausibly large sizes are not allocated up front, but decoded serially
+    auto zeros = std::string("\xfd\x37\x7a\x58\x5a\x00\x00\x01\x69\x22\xde\x36\x02\x00\x21\x01\x16\x00\x00\x00\x74\x2f\xe5\xa3\xe0\xff\xff\x00\x4c\x5d\x00\x00\x6f\xfd\xff\xff\xa3\xb7\xff\x47\x3e\x48\x15\x72\x39\x61\x51\xb8\x92\x28\xe6\xa3\x86\x07\xf9\xee\xe4\x1e\x82\xd3\x2f\xc5\x3a\x3c\x01\x4b\xb1\x7e"
+                                     "\xc9\x8a\x8a\x4d\x2f\xa3\x0d\xd9\x7f\xa6\xe3\x8c\x23\x11\x53\xe0\x59\x18\xc5\x75\x8a\xe2\x77\xf8\xb6\x94\x7f\x0c\x6a\xc0\xde\x74\x49\x64\x5c\x9e\x3a\xd1\x00\x00\xeb\x8e\x97\xd7\x00\x01\x64\x80\x80\x04\x00\x00\xe4\x37\x86\x0b\x3e\x30\x0d\x8b\x02\x00\x00\x00\x00\x01\x59\x5a",
+                                     136);
+    zeros += zeros;
+    pieces.clear();
+    aptrepo::internal::decompress(zeros, "Packages.xz", sink, 4);
+    REQUIRE(pieces.size() == 1);
+    REQUIRE(pieces[0] == std::string(2 * 65536, '\0'));
+
+    // Two BGZF members and the empty end of file member
+    auto bgzf = std::string("\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00\x29\x00\x0b\x48\x4c\xce\x4e\x4c\x4f\xb5\x52\xc8\xcf\x4b\xe5\xe2\x02\x00\x20\xa4\xc2\x08\x0e\x00\x00\x00"
+                            "\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00\x28\x00\x0b\x48\x4c\xce\x4e\x4c\x4f\xb5\x52\x28\x29\xcf\xe7\x02\x00\x8a\xdd\xf3\xce\x0d\x00\x00\x00"
+                            "\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00\x1b\x00\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+                            111);
+    pieces.clear();
+    aptrepo::internal::decompress(bgzf, "Packages.gz", sink, 4);
+    CHECK_THAT(pieces, Catch::Matchers::Equals(std::vector<std::string>{"Package: one\n\n", "Package: two\n", ""}));
+    CHECK_THAT(aptrepo::internal::decompress(bgzf, "Packages.gz", 4), Catch::Matchers::Equals("Package: one\n\nPackage: two\n"));
+    REQUIRE_THROWS(aptrepo::internal::decompress(bgzf.substr(0, 80), "Packages.gz", 4));
+}
+
+TEST_CASE("Metrics", "[metrics][utils]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto exporter = std::make_shared<aptrepo::PrometheusExporter>(std::vector<double>{0.5, 1});
+    exporter->increment("test_total", 2, {{"kind", "a\"b"}});
+    exporter->observe("test_seconds", 0.25, {});
+    exporter->observe("test_seconds", 0.75, {});
+    exporter->observe("test_seconds", 3, {});
+    REQUIRE(exporter->get("test_total", {{"kind", "a\"b"}}) == 2);
+    CHECK_THAT(exporter->render(), Catch::Matchers::Equals("# TYPE test_seconds histogram\n"
+                                                           "test_seconds_bucket{le=\"0.5\"} 1\n"
+                                                           "test_seconds_bucket{le=\"1\"} 2\n"
+                                                           "test_seconds_bucket{le=\"+Inf\"} 3\n"
+                                                           "test_seconds_sum 4\n"
+                                                           "test_seconds_count 3\n"
+                                                           "# TYPE test_total counter\n"
+                                                           "test_total{kind=\"a\\\"b\"} 2\n"));
+
+    // Without a sink nothing is recorded
+    REQUIRE_FALSE(aptrepo::internal::metrics_enabled());
+
+    auto sink = std::make_shared<aptrepo::PrometheusExporter>();
+    aptrepo::set_metrics_sink(sink);
+
+    auto path = std::filesystem::temp_directory_path() / "aptrepo-test-metrics" / "InRelease";
+    auto content = std::string("Origin: Test\nSuite: test\nSHA256:\n ") + std::string(64, 'a') + " 10 main/binary-amd64/Packages\n";
+    write_file(path, content);
+    auto release = aptrepo::Release(aptrepo::internal::download("file://" + path.string()));
+
+    REQUIRE(sink->get("aptrepo_download_requests_total", {{"scheme", "file"}, {"status", "200"}}) == 1);
+    REQUIRE(sink->get("aptrepo_download_bytes_total", {{"scheme", "file"}}) == content.size());
+    REQUIRE(sink->get("aptrepo_release_references", {{"release", release.get_url()}}) == 1);
+    REQUIRE(sink->render().contains("aptrepo_parse_seconds_count{index=\"release\"} 1\n"));
+
+    aptrepo::set_metrics_sink(nullptr);
+    REQUIRE(aptrepo::get_metrics_sink() == nullptr);
+    std::filesystem::remove_all(path.parent_path());
+}
+
 TEST_CASE("Reference", "[inrelease][data]")
 {
     spdlog::set_level(spdlog::level::info);
@@ -152,6 +478,1780 @@ yTy1ow//fX85IioBgUFZ720K233aS/WKYURW/orgOTDImg7bpz15WkfLltwJyxCj\n\
     REQUIRE(release.get_references_for_arch("arm64").size() == 2);
 }
 
+TEST_CASE("Release memory resource", "[release][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto content = "Origin: Test\n\
+Architectures: amd64\n\
+Components: main\n\
+MD5Sum:\n\
+ 1ae40621b32609d6251d09b2a47ef936 1234 main/binary-amd64/Packages\n\
+\t0123 12a4 main/binary-amd64/Invalid\n\
+SHA256:\n\
+ e945cdeadad8067c9b569e66c058f709d5aa4cd11d8099cc088dc192705e7bc7\t1234  main/binary-amd64/Packages\n";
+    auto download = aptrepo::internal::Download("http://example.com/dists/test/InRelease", "", content);
+
+    std::pmr::monotonic_buffer_resource resource;
+    std::optional<aptrepo::Release> release(std::in_place, download, &resource);
+    REQUIRE(release->get_references().size() == 1);
+
+    // Copies don't use the memory resource of the original
+    aptrepo::Release copy(*release);
+    auto assigned = aptrepo::Release(download);
+    assigned = *release;
+    auto reference = release->get_references()[0];
+    release.reset();
+    resource.release();
+
+    for (const auto &r : {copy, assigned})
+    {
+        REQUIRE(r.get_references().size() == 1);
+        CHECK_THAT(r.get_references()[0].get_hash("SHA256"), Catch::Matchers::Equals("e945cdeadad8067c9b569e66c058f709d5aa4cd11d8099cc088dc192705e7bc7"));
+        CHECK_THAT(r.get_references()[0].get_architecture(), Catch::Matchers::Equals("amd64"));
+    }
+    // Assignments replace the arena instead of growing it
+    std::pmr::monotonic_buffer_resource moved_resource;
+    auto moved = aptrepo::Release(download);
+    for (int i = 0; i < 3; ++i)
+    {
+        moved = aptrepo::Release(download, &moved_resource);
+        moved = copy;
+        moved = aptrepo::Release(download);
+    }
+    moved_resource.release();
+    REQUIRE(moved.get_references().size() == 1);
+    CHECK_THAT(moved.get_references()[0].get_architecture(), Catch::Matchers::Equals("amd64"));
+
+    CHECK_THAT(reference.get_url(), Catch::Matchers::Equals("http://example.com/dists/test/main/binary-amd64/Packages"));
+    REQUIRE(reference.get_size() == 1234);
+    REQUIRE(reference.get_digest().size() == 32);
+    REQUIRE(reference.get_hashes().size() == 2);
+}
+
+TEST_CASE("Packages", "[packages][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto packages_url = "http://archive.ubuntu.com/ubuntu/dists/noble/main/binary-amd64/Packages";
+    auto content =
+        "Package: bash\n\
+Architecture: amd64\n\
+Version: 5.2.21-2ubuntu4\n\
+Essential: yes\n\
+Priority: required\n\
+Section: shells\n\
+Installed-Size: 1864\n\
+Filename: pool/main/b/bash/bash_5.2.21-2ubuntu4_amd64.deb\n\
+Size: 794802\n\
+Description: GNU Bourne Again SHell\n\
+ Bash is an sh-compatible command language interpreter.\n\
+X-Custom: value\n\
+\n\
+Package: bash-completion\n\
+Architecture: all\n\
+Version: 1:2.11-8\n\
+Priority: standard\n\
+Section: shells\n\
+Installed-Size: 1460\n\
+Filename: pool/main/b/bash-completion/bash-completion_2.11-8_all.deb\n\
+Size: 180214\n\
+Description: programmable completion for the bash shell\n";
+
+    auto packages = aptrepo::Packages(aptrepo::internal::Download(packages_url, "etag", content));
+
+    REQUIRE(packages.get_packages().size() == 2);
+
+    const auto &bash = packages.get_packages()[0];
+    CHECK_THAT(bash.get_name(), Catch::Matchers::Equals("bash"));
+    CHECK_THAT(bash.get_version(), Catch::Matchers::Equals("5.2.21-2ubuntu4"));
+    CHECK_THAT(bash.get_architecture(), Catch::Matchers::Equals("amd64"));
+    CHECK_THAT(bash.get_section(), Catch::Matchers::Equals("shells"));
+    CHECK_THAT(bash.get_priority(), Catch::Matchers::Equals("required"));
+    CHECK_THAT(bash.get_filename(), Catch::Matchers::Equals("pool/main/b/bash/bash_5.2.21-2ubuntu4_amd64.deb"));
+    CHECK_THAT(bash.get_description(), Catch::Matchers::Equals("GNU Bourne Again SHell\nBash is an sh-compatible command language interpreter."));
+    CHECK_THAT(bash.get_field("X-Custom"), Catch::Matchers::Equals("value"));
+    REQUIRE(bash.get_size() == 794802);
+    REQUIRE(bash.get_installed_size() == 1864);
+
+    CHECK_THAT(std::string(bash), Catch::Matchers::Contains("Description: GNU Bourne Again SHell\n Bash is"));
+    CHECK_THAT(packages.get_names(), Catch::Matchers::Equals(std::vector<std::string>{"bash", "bash-completion"}));
+}
+
+TEST_CASE("Name index", "[search][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    std::vector<std::string> names;
+    for (auto i = 0; i < 100; ++i)
+    {
+        names.push_back("libfoo" + std::to_string(i));
+    }
+    names.insert(names.end(), {"bash", "bash-completion", "bash", "dash", "zsh", "libbar-dev", "python3", "python3-apt"});
+
+    auto index = aptrepo::NameIndex(names);
+
+    REQUIRE(index.size() == 107);
+    REQUIRE(index.find("bash") == 0);
+    REQUIRE(index.find("python3-apt").has_value());
+    REQUIRE_FALSE(index.find("python").has_value());
+    CHECK_THAT(index.get_name(*index.find("libfoo42")), Catch::Matchers::Equals("libfoo42"));
+
+    CHECK_THAT(index.find_prefix("bash"), Catch::Matchers::Equals(std::vector<std::string>{"bash", "bash-completion"}));
+    CHECK_THAT(index.find_prefix("python3"), Catch::Matchers::Equals(std::vector<std::string>{"python3", "python3-apt"}));
+    REQUIRE(index.find_prefix("libfoo").size() == 100);
+    REQUIRE(index.find_prefix("libfoo", 5).size() == 5);
+    REQUIRE(index.find_prefix("nothing").empty());
+
+    CHECK_THAT(index.find_glob("*sh"), Catch::Matchers::Equals(std::vector<std::string>{"bash", "dash", "zsh"}));
+    CHECK_THAT(index.find_glob("libfoo9?"), Catch::Matchers::UnorderedEquals(std::vector<std::string>{"libfoo90", "libfoo91", "libfoo92", "libfoo93", "libfoo94", "libfoo95", "libfoo96", "libfoo97", "libfoo98", "libfoo99"}));
+    CHECK_THAT(index.find_glob("[bd]ash"), Catch::Matchers::Equals(std::vector<std::string>{"bash", "dash"}));
+    CHECK_THAT(index.find_glob("*-[!c]*"), Catch::Matchers::Equals(std::vector<std::string>{"libbar-dev", "python3-apt"}));
+
+    CHECK_THAT(index.find_fuzzy("bsh", 1), Catch::Matchers::Equals(std::vector<std::string>{"bash", "zsh"}));
+    CHECK_THAT(index.find_fuzzy("pyhton3", 2), Catch::Matchers::Equals(std::vector<std::string>{"python3"}));
+    CHECK_THAT(index.find_fuzzy("libfoo7", 0), Catch::Matchers::Equals(std::vector<std::string>{"libfoo7"}));
+    REQUIRE(index.find_fuzzy("libfoo7", 1).size() == 28);
+
+    std::stringstream stream;
+    index.save(stream);
+    stream << "trailing data";
+    auto loaded = aptrepo::NameIndex::load(stream);
+    REQUIRE(loaded.size() == index.size());
+    CHECK_THAT(loaded.find_prefix("bash"), Catch::Matchers::Equals(std::vector<std::string>{"bash", "bash-completion"}));
+    CHECK_THAT(loaded.find_fuzzy("dahs", 2), Catch::Matchers::Contains(std::vector<std::string>{"dash"}));
+}
+
+TEST_CASE("Text index", "[search][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto content =
+        "Package: bash\n\
+Description: GNU Bourne Again SHell\n\
+ Bash is an sh-compatible command language interpreter.\n\
+\n\
+Package: zsh\n\
+Description: shell with lots of features\n\
+\n\
+Package: python3\n\
+Description: interactive high-level object-oriented language\n\
+\n\
+Package: vim\n\
+Description: Vi IMproved - enhanced vi editor\n";
+
+    auto packages = std::vector<aptrepo::Packages>{aptrepo::Packages(aptrepo::internal::Download("Packages", "", content))};
+    auto index = aptrepo::TextIndex(packages, 2);
+
+    CHECK_THAT(aptrepo::TextIndex::tokenize("Vi IMproved - enhanced"), Catch::Matchers::Equals(std::vector<std::string>{"vi", "improved", "enhanced"}));
+
+    auto shells = index.search("shell", aptrepo::TextIndex::Mode::And);
+    REQUIRE(shells.size() == 2);
+    CHECK_THAT(shells[0].package, Catch::Matchers::Equals("zsh"));
+    CHECK_THAT(shells[1].package, Catch::Matchers::Equals("bash"));
+    REQUIRE(shells[0].score > shells[1].score);
+
+    REQUIRE(index.search("shell features", aptrepo::TextIndex::Mode::And).size() == 1);
+    REQUIRE(index.search("shell editor", aptrepo::TextIndex::Mode::And).empty());
+    REQUIRE(index.search("shell editor", aptrepo::TextIndex::Mode::Or).size() == 3);
+    REQUIRE(index.search("shell editor", aptrepo::TextIndex::Mode::Or, 1).size() == 1);
+    REQUIRE(index.search("unknown", aptrepo::TextIndex::Mode::Or).empty());
+
+    std::vector<std::string> loaded;
+    index.set_translation_loader([&loaded](const std::string &lang)
+                                 {
+                                     loaded.push_back(lang);
+                                     auto translation =
+                                         "Package: vim\n\
+Description-md5: 59e8b8f7757db8b53566d5d119872de8\n\
+Description-de: Vi IMproved - erweiterter Vi-Editor\n\
+\n\
+Package: emacs\n\
+Description-md5: 0fdb3ba2b11a2c7fa5b0a1d0c6e2f3e1\n\
+Description-de: GNU Emacs Editor\n";
+                                     return std::vector<aptrepo::Packages>{aptrepo::Packages(aptrepo::internal::Download("Translation-" + lang, "", translation))};
+                                 });
+
+    REQUIRE_FALSE(index.has_language("de"));
+    REQUIRE(index.search("editor").size() == 1);
+    REQUIRE(loaded.empty());
+
+    // Concurrent searches load the translations once
+    std::vector<std::size_t> editors(4);
+    {
+        std::vector<std::jthread> searches;
+        for (std::size_t i = 0; i < editors.size(); ++i)
+        {
+            searches.emplace_back([&, i]()
+                                  { editors[i] = index.search("editor", aptrepo::TextIndex::Mode::And, 10, "de").size(); });
+        }
+    }
+    REQUIRE(editors == std::vector<std::size_t>(4, 2));
+    REQUIRE(index.has_language("de"));
+    REQUIRE(index.search("erweiterter", aptrepo::TextIndex::Mode::And, 10, "de").size() == 1);
+    REQUIRE(loaded.size() == 1);
+}
+
+TEST_CASE("Release translations", "[search][loopback]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    // "Package: one\n\nPackage: two\n" as two gzip members
+    auto gz = std::string("\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03\x0b\x48\x4c\xce\x4e\x4c\x4f\xb5\x52\xc8\xcf\x4b\xe5\x02\x00\x61\x7d\xf3\xa0\x0d\x00\x00\x00"
+                          "\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03\xe3\x0a\x48\x4c\xce\x4e\x4c\x4f\xb5\x52\x28\x29\xcf\xe7\x02\x00\x54\x38\x0b\xc2\x0e\x00\x00\x00",
+                          67);
+    auto plain = std::string("Package: one\n\nPackage: two\n");
+    auto contrib = std::string("Package: three\nDescription-en: third\n");
+    auto hex = [](const std::string &content)
+    { return aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(content)); };
+
+    // main lists the uncompressed file, but only serves the compressed one
+    auto server = aptrepo::test::RepositoryServer();
+    server.add_file("/dists/noble/main/i18n/Translation-en.gz", gz);
+    server.add_file("/dists/noble/contrib/i18n/Translation-en", contrib);
+    server.add_file("/dists/noble/InRelease",
+                    std::format("Origin: Test\nSuite: noble\nComponents: main contrib\nSHA256:\n {} {} main/i18n/Translation-en\n {} {} main/i18n/Translation-en.gz\n"
+                                " {} {} contrib/i18n/Translation-en\n {} 10 main/i18n/Translation-de.bz2\n",
+                                hex(plain), plain.size(), hex(gz), gz.size(), hex(contrib), contrib.size(), hex("bz2")));
+    auto url = server.get_url() + "/dists/noble/InRelease";
+    auto release = aptrepo::parse_release(url);
+
+    auto loader = aptrepo::TextIndex::release_translations(release);
+    auto translations = loader("en");
+    REQUIRE(translations.size() == 2);
+    REQUIRE(translations[0].get_names() == std::vector<std::string>{"one", "two"});
+    REQUIRE(translations[1].get_names() == std::vector<std::string>{"three"});
+    CHECK(server.get_statistics().requests == 3);
+
+    // Unsupported compressions and unknown languages are skipped
+    REQUIRE(loader("de").empty());
+    REQUIRE(loader("fr").empty());
+
+    // Files which don't match the Release are rejected
+    server.add_file("/dists/noble/main/i18n/Translation-en.gz", gz.substr(0, 34));
+    REQUIRE_THROWS_WITH(loader("en"), Catch::Contains("SHA256 mismatch"));
+}
+
+TEST_CASE("OpenPGP verification", "[openpgp][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    // Test keys and signatures created with GnuPG: an RSA 2048 and an Ed25519 key
+    const std::string rsa_key = R"(-----BEGIN PGP PUBLIC KEY BLOCK-----
+
+mQENBGrWH84BCAChrvPMaueAgX6mjW5GvbJ26DhTCpZZh7GetfwPBAVAdsEkT0bF
+/RK7kj0ZBxxMZCdk0J6tsRhx3cLq5C3hhst6Okp+rq1Y98e7cLlHU1o6SerX474h
+T1ufU/9lvCy9ENn6SdGT24XgXe/XlcPfI9dlV2LMF2IxvjH7WFRbS2dQWC3CQTPO
+v7BWEtRwdXTEkiU4GGax+Vjp94EAb97s2U3mZnqESFfe7Oemlj+nNlK/OeJ8fzrw
+VSORkj6nzV9+QRJSKMmMpIA2HyKCslSU3DDR1OdBgouVk31uRXyWZ7qGyEZ26loJ
+UW7fNUWtfcbMT0wyhKl/ADv1ox8wkLlb3i2tABEBAAG0GlRlc3QgUlNBIDxyc2FA
+ZXhhbXBsZS5vcmc+iQFOBBMBCgA4FiEE1lG1seQO45h5kY7qJl3IXALQlhkFAmrW
+H84CGwMFCwkIBwIGFQoJCAsCBBYCAwECHgECF4AACgkQJl3IXALQlhmqxgf/eH9N
+M+jyCoi5iSHFDXTTWUpVpkTudCdT/jV7fDqcp8wB/fnSNDDdhJEZaKCFc+lV1zDX
+hKn3Qk14uXZ9gkR4vxIdd3+hzqQGVFwwYZZZQqS/oibVSdU/tSqy4fDwQ6q8q11k
+1U9HsGAauRXEFwtf233Zg2yMIHewlEnfBtvy8fQ/NsvxJncwnWp70e0DyFekviwZ
+LoLvW+vqE/ZtwCDFyxhO4GpNgj1MOqwb3wu+DbancWvxzFN6nKyaYaO/wxR/z5I+
+VjhFmeQP0qh1MjWXOsO8zrw1Z3fj6EWlXBo4HB9CekJY6iKkjDfesKIfNXrBj1ry
+69s5sGlmA94p04KYPg==
+=NHUL
+-----END PGP PUBLIC KEY BLOCK-----)";
+    const std::string ed25519_key = R"(-----BEGIN PGP PUBLIC KEY BLOCK-----
+
+mDMEatYfzhYJKwYBBAHaRw8BAQdAXU2lyrugH/SuQ12kg5qlwH8pAhSdpmTAYgXO
+k40uoTm0HVRlc3QgRWQyNTUxOSA8ZWRAZXhhbXBsZS5vcmc+iJAEExYIADgWIQTA
+ebAQ3R1JHq61p4DfbOQfG265wAUCatYfzgIbAwULCQgHAgYVCgkICwIEFgIDAQIe
+AQIXgAAKCRDfbOQfG265wFEUAQDVqv4zZepHNyJ2iFF1WxOZNCXu7L2736QuXM4T
+qqPwSwEA8U1AT+2+UmGmcPdH7FpUEp3yOiAIk8iJyhQBle2eRgI=
+=Q8Dy
+-----END PGP PUBLIC KEY BLOCK-----)";
+    const std::string rsa_fingerprint = "D651B5B1E40EE39879918EEA265DC85C02D09619";
+    const std::string ed25519_fingerprint = "C079B010DD1D491EAEB5A780DF6CE41F1B6EB9C0";
+
+    // Signed by both keys with SHA512; note the trailing whitespace and the dash-escaped line
+    const std::string signed_by_both = R"(-----BEGIN PGP SIGNED MESSAGE-----
+Hash: SHA512
+
+Origin: Test
+Label: Test
+Suite: signed
+Codename: signed
+Architectures: amd64
+Components: main
+Date: Thu, 25 Apr 2024 15:10:33 UTC
+Description: Signed test release   
+SHA256:
+ 0ba4a1d3d7ef0a6c64bd7d3f5c4fa3c9a0dd5e4c35a7b6c8b1b7b0f7ddbe56ab 1234 main/binary-amd64/Packages
+- - dash line
+-----BEGIN PGP SIGNATURE-----
+
+iQFEBAEBCgAuFiEE1lG1seQO45h5kY7qJl3IXALQlhkFAmrWH84QHHJzYUBleGFt
+cGxlLm9yZwAKCRAmXchcAtCWGczoB/9m1QWBVXghFVwpAIhCu9KpZwXQUR2zCGNp
+ukHQC/8XElfMgX1JWBvnd3OMhxwwLz5Eb9yYkEHVIVbclaHxIOx67aLPlvu3Nmiq
+abG7C8z6ks5N38DADmSJkQefJrK8ss/YXzY3Orme//4nMYvYg7vVyfDhlS1n1Kki
+1Drh07y3e324d39i0EGYXi9r3Rw1KexO0WAtEuDaZxXpNgiL/uy5eTfBdK03aGxF
+Sgkc1hm4dbxwyhTOQ6G+ipoRJIaSw1rs51Yhq6UgGXnH6sDOTYCSFGOGm1spoJY3
+1m0weAiTBW3XZNtetgRfxL3MEQT3+WNuY/8ns8P0E0oMwTXRE5+niIUEARYKAC0W
+IQTAebAQ3R1JHq61p4DfbOQfG265wAUCatYfzg8cZWRAZXhhbXBsZS5vcmcACgkQ
+32zkHxtuucALEQD/bxm0Q+BouQ5DMHNOfGiDLqU+yIShAh3aeamCxqOiYPoBAJOs
+2p9CB8AFAKIHoQxcLzUSBAAo7RxSWe6xa4TxG9EC
+=qKsz
+-----END PGP SIGNATURE-----
+)";
+    // Signed by the Ed25519 key with SHA256
+    const std::string signed_by_ed25519 = std::regex_replace(signed_by_both.substr(0, signed_by_both.find("-----BEGIN PGP SIGNATURE-----")), std::regex("Hash: SHA512"), "Hash: SHA256") + R"(-----BEGIN PGP SIGNATURE-----
+
+iIUEARYIAC0WIQTAebAQ3R1JHq61p4DfbOQfG265wAUCatYfzg8cZWRAZXhhbXBs
+ZS5vcmcACgkQ32zkHxtuucDCpwD9FY4WZoWS9EA3VhZcE+PYXaiUiUkFcZp3VwTw
+sFqwTn4A/0qihk88mnvpt16vHzwwLDtqLiBfdZDG1JXp/l62AYsI
+=aGxb
+-----END PGP SIGNATURE-----
+)";
+
+    auto url = "http://example.org/dists/signed/InRelease";
+    auto keyring = aptrepo::Keyring();
+    REQUIRE(keyring.add(rsa_key) == 1);
+    REQUIRE(keyring.add(ed25519_key) == 1);
+    REQUIRE(keyring.get_fingerprints() == std::vector<std::string>{ed25519_fingerprint, rsa_fingerprint});
+
+    auto release = aptrepo::Release(aptrepo::internal::Download(url, "", signed_by_both), keyring);
+    REQUIRE(release.is_verified());
+    CHECK_THAT(release.get_signer(), Catch::Matchers::Equals(rsa_fingerprint));
+    CHECK_THAT(release.get_suite(), Catch::Matchers::Equals("signed"));
+    REQUIRE(release.get_field("Hash").empty());
+    REQUIRE(release.get_references().size() == 1);
+    REQUIRE(!aptrepo::Release(aptrepo::internal::Download(url, "", signed_by_both)).is_verified());
+
+    // The second signature is used if the key of the first is unknown
+    auto ed25519_only = aptrepo::Keyring();
+    ed25519_only.add(ed25519_key);
+    CHECK_THAT(aptrepo::Release(aptrepo::internal::Download(url, "", signed_by_both), ed25519_only).get_signer(), Catch::Matchers::Equals(ed25519_fingerprint));
+    CHECK_THAT(aptrepo::Release(aptrepo::internal::Download(url, "", signed_by_ed25519), keyring).get_signer(), Catch::Matchers::Equals(ed25519_fingerprint));
+
+    auto rsa_only = aptrepo::Keyring();
+    rsa_only.add(rsa_key);
+    REQUIRE_THROWS(aptrepo::Release(aptrepo::internal::Download(url, "", signed_by_ed25519), rsa_only));
+    REQUIRE_THROWS(aptrepo::Release(aptrepo::internal::Download(url, "", signed_by_both), aptrepo::Keyring()));
+
+    // Canonicalization: trailing whitespace and line endings are not signed
+    auto canonical = std::regex_replace(signed_by_both, std::regex("release   \n"), "release\n");
+    REQUIRE(aptrepo::Release(aptrepo::internal::Download(url, "", canonical), keyring).is_verified());
+    auto crlf = std::regex_replace(signed_by_both, std::regex("\n"), "\r\n");
+    REQUIRE(aptrepo::Release(aptrepo::internal::Download(url, "", crlf), keyring).is_verified());
+
+    // Modified text, unsigned content and text outside of the signed part
+    auto modified = std::regex_replace(signed_by_both, std::regex("Suite: signed"), "Suite: evil");
+    REQUIRE_THROWS(aptrepo::Release(aptrepo::internal::Download(url, "", modified), keyring));
+    auto unsigned_text = signed_by_both.substr(signed_by_both.find("Origin:"), signed_by_both.find("-----BEGIN PGP SIGNATURE-----") - signed_by_both.find("Origin:"));
+    REQUIRE_THROWS(aptrepo::Release(aptrepo::internal::Download(url, "", unsigned_text), keyring));
+    auto prefixed = aptrepo::Release(aptrepo::internal::Download(url, "", "Suite: evil\n" + signed_by_both + "Suite: evil\n"), keyring);
+    CHECK_THAT(prefixed.get_suite(), Catch::Matchers::Equals("signed"));
+
+    // Releases downloaded from a mirror set are verified as well
+    std::string served = signed_by_both;
+    auto mirror = aptrepo::internal::HttpServer([&](const aptrepo::internal::HttpRequest &)
+                                                {
+                                                    aptrepo::internal::HttpResponse response;
+                                                    response.body = served;
+                                                    return response; });
+    auto mirrors = aptrepo::MirrorSet({mirror.get_url()});
+    auto mirrored = mirrors.parse_release("signed", keyring);
+    REQUIRE(mirrored.is_verified());
+    CHECK_THAT(mirrored.get_signer(), Catch::Matchers::Equals(rsa_fingerprint));
+    served = modified;
+    REQUIRE_THROWS(mirrors.parse_release("signed", keyring));
+    REQUIRE(!mirrors.parse_release("signed").is_verified());
+    mirror.stop();
+
+    // Binary keyrings and directories are loaded once
+    auto root = std::filesystem::temp_directory_path() / "aptrepo-test-keyring";
+    std::filesystem::remove_all(root);
+    write_file(root / "ed25519.gpg", aptrepo::internal::dearmor(ed25519_key));
+    write_file(root / "rsa.asc", rsa_key);
+    write_file(root / "ignored.txt", "not a key");
+    REQUIRE(aptrepo::Keyring(root / "ed25519.gpg").get_fingerprints() == std::vector<std::string>{ed25519_fingerprint});
+    auto loaded = aptrepo::Keyring::load(root);
+    REQUIRE(loaded->size() == 2);
+    REQUIRE(aptrepo::Keyring::load(root) == loaded);
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Release diff", "[inrelease][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto release_url = "http://archive.ubuntu.com/ubuntu/dists/noble-updates/InRelease";
+    auto old_content =
+        "Origin: Ubuntu\n\
+Suite: noble-updates\n\
+MD5Sum:\n\
+ 1ae40621b32609d6251d09b2a47ef936        829119597 Contents-amd64\n\
+ 262e2d34f95ba40bbff222c1902a97de          7165069 main/binary-amd64/Packages\n\
+ c131a52c95ba1474f94558b33807c46c         51152650 main/binary-arm64/Packages\n\
+SHA256:\n\
+ e945cdeadad8067c9b569e66c058f709d5aa4cd11d8099cc088dc192705e7bc7        829119597 Contents-amd64\n\
+ 8f6f71ae839c8cba390a7643fcbbdacddb0bc7d12c1583a2dd80a1f8443a30e5          7165069 main/binary-amd64/Packages\n\
+ c0c2eef334518bb29513157aed43bf0a064d69f4482f515e1d7268403c066620         51152650 main/binary-arm64/Packages\n";
+    auto new_content =
+        "Origin: Ubuntu\n\
+Suite: noble-updates\n\
+SHA256:\n\
+ e945cdeadad8067c9b569e66c058f709d5aa4cd11d8099cc088dc192705e7bc7        829119597 Contents-amd64\n\
+ 0000000000000000000000000000000000000000000000000000000000000000          7165069 main/binary-amd64/Packages\n\
+ e277c84bdd3351fa7b71bb26d3d05d9df8a56a21df463e8ffa47c3adaa5d6366        826443945 main/binary-i386/Packages\n";
+
+    auto old_release = aptrepo::Release(aptrepo::internal::Download(release_url, "a", old_content));
+    auto new_release = aptrepo::Release(aptrepo::internal::Download(release_url, "b", new_content));
+
+    auto reference = old_release.get_references()[0];
+    CHECK_THAT(reference.get_path(), Catch::Matchers::Equals("Contents-amd64"));
+    CHECK_THAT(reference.get_digest_algorithm(), Catch::Matchers::Equals("SHA256"));
+    REQUIRE(reference.get_digest().size() == 32);
+    CHECK_THAT(aptrepo::internal::bytes_to_hex(reference.get_digest()), Catch::Matchers::Equals("e945cdeadad8067c9b569e66c058f709d5aa4cd11d8099cc088dc192705e7bc7"));
+
+    auto result = aptrepo::diff(old_release, new_release);
+    REQUIRE_FALSE(result.empty());
+    REQUIRE(result.added.size() == 1);
+    CHECK_THAT(result.added[0].get_path(), Catch::Matchers::Equals("main/binary-i386/Packages"));
+    REQUIRE(result.removed.size() == 1);
+    CHECK_THAT(result.removed[0].get_path(), Catch::Matchers::Equals("main/binary-arm64/Packages"));
+    REQUIRE(result.changed.size() == 1);
+    CHECK_THAT(result.changed[0].get_path(), Catch::Matchers::Equals("main/binary-amd64/Packages"));
+
+    REQUIRE(aptrepo::diff(new_release, new_release).empty());
+}
+
+TEST_CASE("Mirror sync", "[mirror][api]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto root = std::filesystem::temp_directory_path() / "aptrepo-test-mirror";
+    std::filesystem::remove_all(root);
+    auto upstream = root / "upstream";
+    auto target = root / "target";
+
+    auto publish = [&](const std::string &hello)
+    {
+        auto hello_doc = std::string("hello documentation");
+        write_file(upstream / "pool/main/h/hello/hello_1.0_amd64.deb", hello);
+        write_file(upstream / "pool/main/h/hello/hello-doc_1.0_all.deb", hello_doc);
+
+        auto packages = std::format("Package: hello\nArchitecture: amd64\nFilename: pool/main/h/hello/hello_1.0_amd64.deb\nSize: {}\nSHA256: {}\n\n"
+                                    "Package: hello-doc\nArchitecture: all\nFilename: pool/main/h/hello/hello-doc_1.0_all.deb\nSize: {}\nSHA256: {}\n",
+                                    hello.size(), sha256_hex(hello), hello_doc.size(), sha256_hex(hello_doc));
+        write_file(upstream / "dists/test/main/binary-amd64/Packages", packages);
+        write_file(upstream / "dists/test/main/binary-arm64/Packages", packages);
+
+        auto in_release = std::format("Origin: Test\nSuite: test\nArchitectures: amd64 arm64\nComponents: main\nAcquire-By-Hash: yes\nSHA256:\n"
+                                      " {} {} main/binary-amd64/Packages\n {} {} main/binary-arm64/Packages\n",
+                                      sha256_hex(packages), packages.size(), sha256_hex(packages), packages.size());
+        write_file(upstream / "dists/test/InRelease", in_release);
+        return packages;
+    };
+
+    auto packages = publish("hello binary");
+
+    auto options = aptrepo::MirrorSync::Options();
+    options.architectures = {"amd64"};
+    options.jobs = 2;
+    auto sync = aptrepo::MirrorSync("file://" + upstream.string(), "test", target, options);
+
+    auto statistics = sync.sync();
+    REQUIRE(statistics.failed == 0);
+    REQUIRE(statistics.downloaded == 3);
+    REQUIRE(statistics.bytes == packages.size() + 12 + 19);
+    REQUIRE(std::filesystem::exists(target / "dists/test/InRelease"));
+    REQUIRE(std::filesystem::exists(target / "pool/main/h/hello/hello_1.0_amd64.deb"));
+    REQUIRE(std::filesystem::exists(target / "pool/main/h/hello/hello-doc_1.0_all.deb"));
+    REQUIRE_FALSE(std::filesystem::exists(target / "dists/test/main/binary-arm64/Packages"));
+
+    // Index and by-hash file share the content object
+    auto by_hash = target / "dists/test/main/binary-amd64/by-hash/SHA256" / sha256_hex(packages);
+    REQUIRE(std::filesystem::exists(by_hash));
+    REQUIRE(std::filesystem::hard_link_count(by_hash) == 3);
+
+    statistics = sync.sync();
+    REQUIRE(statistics.downloaded == 0);
+    REQUIRE(statistics.unchanged == 3);
+
+    // A changed package and index are fetched again
+    packages = publish("hello binary v2");
+    statistics = sync.sync();
+    REQUIRE(statistics.failed == 0);
+    REQUIRE(statistics.downloaded == 2);
+    REQUIRE(statistics.unchanged == 1);
+
+    // Files with a wrong hash fail and the published dists stay untouched
+    auto read = [](const std::filesystem::path &path)
+    { return aptrepo::internal::download("file://" + path.string()).get_content(); };
+    auto in_release = read(target / "dists/test/InRelease");
+    auto old_packages = read(target / "dists/test/main/binary-amd64/Packages");
+    auto new_packages = publish("hello binary v3");
+    write_file(upstream / "pool/main/h/hello/hello_1.0_amd64.deb", "tampered binary");
+    statistics = sync.sync();
+    REQUIRE(statistics.failed == 1);
+    CHECK_THAT(read(target / "dists/test/InRelease"), Catch::Matchers::Equals(in_release));
+    CHECK_THAT(read(target / "dists/test/main/binary-amd64/Packages"), Catch::Matchers::Equals(old_packages));
+    REQUIRE_FALSE(std::filesystem::exists(target / "dists/test/main/binary-amd64/by-hash/SHA256" / sha256_hex(new_packages)));
+
+    // Paths leaving the mirror are rejected before anything is fetched
+    auto escaped = root / "escaped";
+    auto hostile = std::format("Package: up\nFilename: ../escaped/up.deb\nSize: 2\nSHA256: {}\n\n"
+                               "Package: absolute\nFilename: {}/absolute.deb\nSize: 2\nSHA256: {}\n",
+                               sha256_hex("up"), escaped.string(), sha256_hex("up"));
+    write_file(upstream / "escaped/up.deb", "up");
+    write_file(upstream / "dists/test/main/binary-amd64/Packages", hostile);
+    write_file(upstream / "dists/test/InRelease",
+               std::format("Origin: Test\nSuite: test\nArchitectures: amd64\nComponents: main\nSHA256:\n {} {} main/binary-amd64/Packages\n {} 2 ../../../escaped/index\n",
+                           sha256_hex(hostile), hostile.size(), sha256_hex("up")));
+    statistics = sync.sync();
+    REQUIRE(statistics.failed == 3);
+    REQUIRE_FALSE(std::filesystem::exists(escaped));
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Mirror set", "[mirrorset][api]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto in_release = std::string("Origin: Test\nSuite: test\n");
+    auto packages = std::string("Package: hello\n");
+
+    // Local mirror stand-ins with injected latency; the broken mirror serves a wrong index
+    auto stand_in = [&](std::chrono::milliseconds latency, bool broken)
+    {
+        return std::make_unique<aptrepo::internal::HttpServer>([=](const aptrepo::internal::HttpRequest &request)
+                                                               {
+                                                                   std::this_thread::sleep_for(latency);
+                                                                   aptrepo::internal::HttpResponse response;
+                                                                   if (request.target == "/dists/test/InRelease")
+                                                                   {
+                                                                       response.body = in_release;
+                                                                   }
+                                                                   else if (request.target == "/dists/test/main/binary-amd64/Packages")
+                                                                   {
+                                                                       response.body = broken ? "Package: broken\n" : packages;
+                                                                   }
+                                                                   else
+                                                                   {
+                                                                       response.status = 404;
+                                                                   }
+                                                                   return response; });
+    };
+    auto slow = stand_in(std::chrono::milliseconds(400), false);
+    auto fast = stand_in(std::chrono::milliseconds(0), false);
+    auto broken = stand_in(std::chrono::milliseconds(0), true);
+
+    auto options = aptrepo::MirrorSet::Options();
+    options.initial_hedge_delay = std::chrono::milliseconds(50);
+
+    // The slow mirror is preferred, but the hedged request to the fast one wins
+    auto mirrors = aptrepo::MirrorSet({slow->get_url(), fast->get_url()}, options);
+    auto start = std::chrono::steady_clock::now();
+    auto release = mirrors.parse_release("test");
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(300));
+    REQUIRE(release.get_url().starts_with(fast->get_url()));
+    CHECK_THAT(release.get_suite(), Catch::Matchers::Equals("test"));
+
+    // The measured latency ranks the fast mirror first, the cancelled request is no failure
+    auto ranked = mirrors.get_status();
+    REQUIRE(ranked.front().url == fast->get_url());
+    REQUIRE(ranked.back().requests == 1);
+    REQUIRE(ranked.back().failures == 0);
+    REQUIRE(ranked.back().latency >= 0.04);
+
+    // Responses with a wrong hash are not accepted
+    auto hashed = aptrepo::MirrorSet({broken->get_url(), slow->get_url()}, options);
+    auto download = hashed.download("dists/test/main/binary-amd64/Packages", sha256_hex(packages));
+    CHECK_THAT(download.get_content(), Catch::Matchers::Equals(packages));
+    REQUIRE(hashed.get_status().back().failures == 1);
+
+    REQUIRE_THROWS(aptrepo::MirrorSet({broken->get_url()}, options).download("dists/test/main/binary-amd64/Packages", sha256_hex(packages)));
+    REQUIRE_THROWS(hashed.download("dists/test/missing"));
+
+    // Probes measure the round trip time
+    auto probed = aptrepo::MirrorSet({slow->get_url(), fast->get_url()}, options);
+    probed.probe();
+    auto status = probed.get_status();
+    REQUIRE(status.front().url == fast->get_url());
+    REQUIRE(status.back().rtt >= 0.4);
+
+    // Once known, the request latency outranks a fast round trip
+    auto stalling = aptrepo::internal::HttpServer([&](const aptrepo::internal::HttpRequest &request)
+                                                  {
+                                                      aptrepo::internal::HttpResponse response;
+                                                      if (request.method != "HEAD")
+                                                      {
+                                                          std::this_thread::sleep_for(std::chrono::milliseconds(400));
+                                                      }
+                                                      response.body = in_release;
+                                                      return response; });
+    auto measured = aptrepo::MirrorSet({stalling.get_url(), fast->get_url()}, options);
+    measured.probe();
+    REQUIRE(measured.get_status().front().rtt < 0.4);
+    measured.parse_release("test");
+    REQUIRE(measured.get_status().front().url == fast->get_url());
+    stalling.stop();
+}
+
+TEST_CASE("Resumable download", "[resume][api]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto root = std::filesystem::temp_directory_path() / "aptrepo-test-resume";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+
+    std::string content;
+    for (std::size_t i = 0; content.size() < 3 * 1024 * 1024; ++i)
+    {
+        content += std::format("Package: package-{}\n", i);
+    }
+    auto changed = content;
+    changed[0] = 'p';
+
+    // Stand-in server with range support; injected drops close the connection mid-body
+    std::mutex mutex;
+    std::string served = content;
+    std::string etag = "\"1\"";
+    std::atomic<int> drops = 0;
+    std::vector<std::string> ranges;
+    std::set<std::string> targets;
+    auto stand_in = [&]()
+    {
+        return std::make_unique<aptrepo::internal::HttpServer>([&](const aptrepo::internal::HttpRequest &request)
+                                                               {
+                                                                   std::lock_guard lock(mutex);
+                                                                   aptrepo::internal::HttpResponse response;
+                                                                   targets.insert(request.target);
+                                                                   if (request.target != "/Packages" && request.target != "/dists/test/main/binary-amd64/Packages")
+                                                                   {
+                                                                       response.status = 404;
+                                                                       return response;
+                                                                   }
+                                                                   response.headers["ETag"] = etag;
+                                                                   auto range = request.get_header("Range");
+                                                                   ranges.push_back(range);
+                                                                   auto if_range = request.get_header("If-Range");
+                                                                   if (range.empty() || (!if_range.empty() && if_range != etag))
+                                                                   {
+                                                                       response.body = served;
+                                                                   }
+                                                                   else
+                                                                   {
+                                                                       auto dash = range.find('-');
+                                                                       auto begin = std::stoull(range.substr(6, dash - 6));
+                                                                       auto end = dash + 1 < range.size() ? std::stoull(range.substr(dash + 1)) + 1 : served.size();
+                                                                       if (begin >= served.size())
+                                                                       {
+                                                                           response.status = 416;
+                                                                           response.headers["Content-Range"] = std::format("bytes */{}", served.size());
+                                                                           return response;
+                                                                       }
+                                                                       response.status = 206;
+                                                                       response.headers["Content-Range"] = std::format("bytes {}-{}/{}", begin, end - 1, served.size());
+                                                                       response.body = served.substr(begin, end - begin);
+                                                                   }
+                                                                   if (drops > 0)
+                                                                   {
+                                                                       drops--;
+                                                                       response.abort_after = response.body.size() / 2;
+                                                                   }
+                                                                   return response; });
+    };
+    auto server = stand_in();
+    auto url = server->get_url() + "/Packages";
+    auto path = root / "Packages";
+    auto partial = root / "Packages.partial";
+    auto read = [](const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+
+    // A dropped connection is resumed with a range request
+    drops = 1;
+    auto digest = aptrepo::internal::download_resumable(url, path);
+    REQUIRE(aptrepo::internal::bytes_to_hex(digest) == sha256_hex(content));
+    REQUIRE(read(path) == content);
+    REQUIRE(ranges.size() == 2);
+    REQUIRE(ranges.back() == std::format("bytes={}-", content.size() / 2));
+    REQUIRE(!std::filesystem::exists(partial));
+
+    // Without retries, the partial file is kept for the next call
+    std::filesystem::remove(path);
+    ranges.clear();
+    drops = 1;
+    REQUIRE_THROWS(aptrepo::internal::download_resumable(url, path, 0));
+    REQUIRE(std::filesystem::file_size(partial) == content.size() / 2);
+    digest = aptrepo::internal::download_resumable(url, path, 0);
+    REQUIRE(aptrepo::internal::bytes_to_hex(digest) == sha256_hex(content));
+    REQUIRE(ranges.back() == std::format("bytes={}-", content.size() / 2));
+
+    // A changed file is downloaded from the start
+    std::filesystem::remove(path);
+    drops = 1;
+    REQUIRE_THROWS(aptrepo::internal::download_resumable(url, path, 0));
+    {
+        std::lock_guard lock(mutex);
+        served = changed;
+        etag = "\"2\"";
+    }
+    digest = aptrepo::internal::download_resumable(url, path, 0);
+    REQUIRE(aptrepo::internal::bytes_to_hex(digest) == sha256_hex(changed));
+    REQUIRE(read(path) == changed);
+
+    // Segments are spread over both servers and survive a dropped connection
+    auto second = stand_in();
+    std::filesystem::remove(path);
+    ranges.clear();
+    drops = 1;
+    digest = aptrepo::internal::download_segments({url, second->get_url() + "/Packages"}, path, changed.size(), 3);
+    REQUIRE(aptrepo::internal::bytes_to_hex(digest) == sha256_hex(changed));
+    REQUIRE(read(path) == changed);
+    REQUIRE(ranges.size() == 4);
+    REQUIRE(!std::filesystem::exists(root / "Packages.partial.segments"));
+
+    // References are verified against their hash
+    auto reference = aptrepo::Reference(server->get_url(), "Packages", changed.size());
+    reference.add_hash("SHA256", sha256_hex(content));
+    REQUIRE_THROWS(aptrepo::download_reference(reference, root / "verified", 2, {second->get_url()}));
+    REQUIRE(!std::filesystem::exists(root / "verified"));
+
+    reference = aptrepo::Reference(server->get_url(), "Packages", changed.size());
+    reference.add_hash("SHA256", sha256_hex(changed));
+    aptrepo::download_reference(reference, root / "verified", 2, {second->get_url()});
+    REQUIRE(read(root / "verified") == changed);
+
+    // Mirrors are repository roots, Release references are below dists/<suite>
+    auto in_release = std::format("Origin: Test\nSHA256:\n {} {} main/binary-amd64/Packages\n", sha256_hex(changed), changed.size());
+    auto release = aptrepo::Release(aptrepo::internal::Download(server->get_url() + "/dists/test/InRelease", "", in_release));
+    std::filesystem::remove(root / "verified");
+    targets.clear();
+    aptrepo::download_reference(release.get_references()[0], root / "verified", 2, {second->get_url() + "/"});
+    REQUIRE(read(root / "verified") == changed);
+    CHECK(targets == std::set<std::string>{"/dists/test/main/binary-amd64/Packages"});
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Deb control", "[deb][api]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto root = std::filesystem::temp_directory_path() / "aptrepo-test-deb";
+    std::filesystem::remove_all(root);
+
+    auto postinst = "#!/bin/sh\n" + std::string(100 * 1024, '#') + "\n";
+    auto control_tar = tar_entry("./", "", '5') +
+                       tar_entry("./control", "Package: hello\nVersion: 2.10-3\nArchitecture: amd64\nDescription: example package\n greets the world\n") +
+                       tar_entry("./md5sums", "6f5902ac237024bdd0c176cb93063dc4  usr/bin/hello\nd41d8cd98f00b204e9800998ecf8427e  etc/hello.conf\n") +
+                       tar_entry("./conffiles", "/etc/hello.conf\n") +
+                       std::string(1024, '\0');
+    auto data = std::string(2 * 1024 * 1024, 'd');
+    auto deb = std::string("!<arch>\n") + ar_member("debian-binary", "2.0\n") + ar_member("control.tar", control_tar) + ar_member("data.tar.xz", data);
+    auto big_control_tar = tar_entry("./control", "Package: big\nVersion: 1\n") + tar_entry("./postinst", postinst) + std::string(1024, '\0');
+    auto big_deb = std::string("!<arch>\n") + ar_member("debian-binary", "2.0\n") + ar_member("control.tar", big_control_tar) + ar_member("data.tar.xz", data);
+    write_file(root / "hello.deb", deb);
+
+    // Local files are memory mapped
+    auto hello = aptrepo::inspect_deb((root / "hello.deb").string());
+    CHECK_THAT(hello.get_control().get_name(), Catch::Matchers::Equals("hello"));
+    CHECK_THAT(hello.get_control().get_version(), Catch::Matchers::Equals("2.10-3"));
+    CHECK_THAT(hello.get_control().get_description(), Catch::Matchers::Equals("example package\ngreets the world"));
+    REQUIRE(hello.get_control_files() == std::vector<std::string>{"conffiles", "control", "md5sums"});
+    REQUIRE(hello.get_files().size() == 2);
+    CHECK_THAT(hello.get_files()[0].path, Catch::Matchers::Equals("/usr/bin/hello"));
+    CHECK_THAT(hello.get_files()[0].md5sum, Catch::Matchers::Equals("6f5902ac237024bdd0c176cb93063dc4"));
+    REQUIRE(hello.get_conffiles() == std::vector<std::string>{"/etc/hello.conf"});
+
+    // Remote files are read with range requests, without the data member
+    std::mutex mutex;
+    std::size_t served = 0;
+    std::size_t requests = 0;
+    auto server = aptrepo::internal::HttpServer([&](const aptrepo::internal::HttpRequest &request)
+                                                {
+                                                    aptrepo::internal::HttpResponse response;
+                                                    const auto &content = request.target == "/hello.deb" ? deb : big_deb;
+                                                    if (request.target == "/missing.deb")
+                                                    {
+                                                        response.status = 404;
+                                                        return response;
+                                                    }
+                                                    auto range = request.get_header("Range");
+                                                    auto dash = range.find('-');
+                                                    auto begin = std::stoull(range.substr(6, dash - 6));
+                                                    auto end = std::min<std::size_t>(std::stoull(range.substr(dash + 1)) + 1, content.size());
+                                                    response.status = 206;
+                                                    response.headers["Content-Range"] = std::format("bytes {}-{}/{}", begin, end - 1, content.size());
+                                                    response.body = content.substr(begin, end - begin);
+
+                                                    std::lock_guard lock(mutex);
+                                                    served += response.body.size();
+                                                    requests++;
+                                                    return response; });
+
+    auto remote = aptrepo::inspect_deb(server.get_url() + "/hello.deb");
+    CHECK_THAT(remote.get_control().get_name(), Catch::Matchers::Equals("hello"));
+    REQUIRE(requests == 1);
+    REQUIRE(served <= 64 * 1024);
+
+    // A control member larger than the first request needs a second one
+    requests = 0;
+    served = 0;
+    auto big = aptrepo::inspect_deb(server.get_url() + "/big.deb");
+    CHECK_THAT(big.get_control_file("postinst"), Catch::Matchers::Equals(postinst));
+    REQUIRE(requests == 2);
+    REQUIRE(served < big_deb.size() - data.size() + 64 * 1024);
+
+    // Many files are read in parallel, the results line up with the URLs
+    auto debs = aptrepo::inspect_debs({server.get_url() + "/hello.deb", server.get_url() + "/missing.deb", server.get_url() + "/big.deb", (root / "missing.deb").string()}, 4);
+    REQUIRE(debs.size() == 4);
+    REQUIRE(debs[0]);
+    CHECK_THAT(debs[0]->get_control().get_name(), Catch::Matchers::Equals("hello"));
+    CHECK(!debs[1]);
+    REQUIRE(debs[2]);
+    CHECK_THAT(debs[2]->get_control().get_name(), Catch::Matchers::Equals("big"));
+    CHECK(!debs[3]);
+
+    // Invalid archives
+    write_file(root / "invalid.deb", "!<arch>\n" + ar_member("debian-binary", "2.0\n") + ar_member("data.tar.xz", data));
+    REQUIRE_THROWS(aptrepo::inspect_deb((root / "invalid.deb").string()));
+    REQUIRE_THROWS(aptrepo::internal::read_tar(control_tar.substr(0, 1100), [](const auto &) {}));
+
+    // Base-256 sizes which would wrap the offset around, and too long ones
+    std::size_t entries = 0;
+    auto count_entries = [&entries](const auto &)
+    { ++entries; };
+    auto oversized = tar_entry("oversized", "");
+    oversized.replace(124, 12, std::string("\x80\0\0\0", 4) + std::string(8, '\xff'));
+    set_tar_checksum(oversized);
+    REQUIRE_THROWS(aptrepo::internal::read_tar(oversized + std::string(1024, '\0'), count_entries));
+    oversized.replace(124, 12, std::string("\x80\0\0\0\xff\xff\xff\xff\xff\xff\xfe\x01", 12));
+    set_tar_checksum(oversized);
+    REQUIRE_THROWS(aptrepo::internal::read_tar(oversized + std::string(1024, '\0'), count_entries));
+    oversized.replace(124, 12, std::string("\xff", 1) + std::string(11, '\xff'));
+    set_tar_checksum(oversized);
+    REQUIRE_THROWS(aptrepo::internal::read_tar(oversized + std::string(1024, '\0'), count_entries));
+    REQUIRE(entries == 0);
+
+    // Pax record lengths overflowing or shorter than their own prefix
+    REQUIRE_THROWS(aptrepo::internal::read_tar(tar_entry("pax", "99999999999999999999999 path=evil\n", 'x'), count_entries));
+    aptrepo::internal::read_tar(tar_entry("pax", "2 path=evil\n", 'x') + tar_entry("file", "content"), [](const auto &entry)
+                                { CHECK_THAT(entry.name, Catch::Matchers::Equals("file")); });
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Download scheduler", "[scheduler][utils]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    using aptrepo::internal::Priority;
+    REQUIRE(aptrepo::internal::download_priority("dists/noble/InRelease", 0) == Priority::High);
+    REQUIRE(aptrepo::internal::download_priority("main/binary-amd64/Packages.xz", 2000000) == Priority::High);
+    REQUIRE(aptrepo::internal::download_priority("main/i18n/Translation-en.xz", 2000000) == Priority::Normal);
+    REQUIRE(aptrepo::internal::download_priority("pool/main/h/hello/hello_2.10-3_amd64.deb", 50000) == Priority::Normal);
+    REQUIRE(aptrepo::internal::download_priority("main/Contents-amd64.gz", 50000000) == Priority::Low);
+    REQUIRE(aptrepo::internal::download_priority("pool/main/l/linux/linux-firmware.deb", 500000000) == Priority::Low);
+    REQUIRE(aptrepo::internal::download_priority(aptrepo::Reference("http://archive.ubuntu.com/ubuntu/dists/noble", "main/source/Sources.gz", 100)) == Priority::High);
+
+    // The burst passes, further bytes wait for the rate
+    auto bucket = aptrepo::internal::TokenBucket(1024 * 1024, 64 * 1024);
+    REQUIRE(bucket.acquire(64 * 1024).count() == 0);
+    auto start = std::chrono::steady_clock::now();
+    bucket.acquire(256 * 1024);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    REQUIRE(elapsed > std::chrono::milliseconds(200));
+    REQUIRE(elapsed < std::chrono::milliseconds(1000));
+
+    // Lower priorities pause while a higher priority transfer runs
+    auto scheduler = aptrepo::internal::DownloadScheduler();
+    std::atomic<bool> done = false;
+    std::thread low;
+    {
+        aptrepo::internal::DownloadScheduler::Slot high(scheduler, Priority::High);
+        high.throttle(1000);
+        low = std::thread([&]()
+                          {
+                              aptrepo::internal::DownloadScheduler::Slot slot(scheduler, Priority::Low);
+                              slot.throttle(1000);
+                              done = true; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        REQUIRE(!done);
+    }
+    low.join();
+    REQUIRE(done);
+    REQUIRE(scheduler.get_preemptions() == 1);
+
+    // Downloads are limited by the throttle
+    auto root = std::filesystem::temp_directory_path() / "aptrepo-test-scheduler";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+    std::ofstream(root / "source", std::ios::binary) << std::string(512 * 1024, 'x');
+    auto limited = aptrepo::internal::DownloadScheduler(1024 * 1024);
+    start = std::chrono::steady_clock::now();
+    {
+        aptrepo::internal::DownloadScheduler::Slot slot(limited, Priority::Normal);
+        auto digest = aptrepo::internal::download_resumable("file://" + (root / "source").string(), root / "target", 3, [&](std::size_t bytes)
+                                                            { slot.throttle(bytes); });
+        REQUIRE(digest == aptrepo::internal::hex_to_bytes(sha256_hex(std::string(512 * 1024, 'x'))));
+    }
+    REQUIRE(std::chrono::steady_clock::now() - start > std::chrono::milliseconds(200));
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Timer wheel", "[watch][utils]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto start = std::chrono::steady_clock::now();
+    auto ms = [&](int count)
+    { return start + std::chrono::milliseconds(count); };
+    auto wheel = aptrepo::internal::TimerWheel(std::chrono::milliseconds(10), 8, start);
+
+    wheel.schedule(1, ms(25));
+    wheel.schedule(2, ms(5));
+    wheel.schedule(3, ms(200)); // More than one revolution ahead
+    wheel.schedule(4, ms(-50)); // Overdue
+    REQUIRE(wheel.size() == 4);
+
+    REQUIRE(wheel.expire(ms(9)) == std::vector<std::size_t>{4});
+    REQUIRE(wheel.expire(ms(10)) == std::vector<std::size_t>{2});
+    REQUIRE(wheel.expire(ms(29)).empty()); // Rounded up to the next tick
+    REQUIRE(wheel.expire(ms(30)) == std::vector<std::size_t>{1});
+    REQUIRE(wheel.expire(ms(199)).empty());
+    REQUIRE(wheel.size() == 1);
+    REQUIRE(wheel.expire(ms(5000)) == std::vector<std::size_t>{3});
+    REQUIRE(wheel.size() == 0);
+
+    // Timers scheduled after a long pause
+    wheel.schedule(5, ms(5000));
+    wheel.schedule(6, ms(5020));
+    REQUIRE(wheel.expire(ms(5000)).empty());
+    REQUIRE(wheel.expire(ms(5015)) == std::vector<std::size_t>{5});
+    REQUIRE(wheel.expire(ms(5020)) == std::vector<std::size_t>{6});
+}
+
+TEST_CASE("Watcher", "[watch][loopback]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto server = aptrepo::test::RepositoryServer();
+    server.add_distribution("noble", 10);
+    server.add_distribution("jammy", 10);
+    auto noble = server.get_url() + "/dists/noble/InRelease";
+    auto jammy = server.get_url() + "/dists/jammy/InRelease";
+
+    auto root = std::filesystem::temp_directory_path() / "aptrepo-test-watcher";
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root);
+
+    auto options = aptrepo::Watcher::Options();
+    options.interval = std::chrono::milliseconds(50);
+    options.max_backoff = std::chrono::milliseconds(200);
+    options.tick = std::chrono::milliseconds(5);
+    options.connections = 2;
+    options.state = root / "etags";
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<aptrepo::Watcher::Event> events;
+    auto record = [&](const aptrepo::Watcher::Event &event)
+    {
+        std::lock_guard lock(mutex);
+        events.push_back(event);
+        changed.notify_all();
+    };
+    auto wait_for = [&](std::size_t count)
+    {
+        std::unique_lock lock(mutex);
+        return changed.wait_for(lock, std::chrono::seconds(10), [&]()
+                                { return events.size() >= count; });
+    };
+
+    {
+        auto watcher = aptrepo::Watcher(record, options);
+        watcher.add(noble);
+        watcher.add(jammy);
+        REQUIRE(watcher.size() == 2);
+        std::thread polling([&]()
+                            { watcher.run(); });
+
+        // Unknown releases are reported with all references
+        REQUIRE(wait_for(2));
+        for (const auto &event : events)
+        {
+            REQUIRE(event.first);
+            REQUIRE(event.diff.added.size() == 1);
+            REQUIRE(event.release->get_suite() == (event.url == noble ? "noble" : "jammy"));
+        }
+
+        // Changes are reported with the diff to the previous version
+        auto polls = server.get_statistics().requests;
+        server.add_distribution("noble", 20);
+        REQUIRE(wait_for(3));
+        CHECK(events[2].url == noble);
+        CHECK(!events[2].first);
+        CHECK(events[2].diff.added.empty());
+        CHECK(events[2].diff.changed.size() == 1);
+
+        // Unchanged releases are polled with conditional requests
+        while (server.get_statistics().not_modified < 4)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(server.get_statistics().requests > polls);
+
+        // Failures are retried with a backoff
+        server.fail_next(3, 503);
+        while (watcher.get_statistics().failed < 3)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        server.add_distribution("jammy", 5);
+        REQUIRE(wait_for(4));
+        CHECK(events[3].url == jammy);
+
+        watcher.stop();
+        polling.join();
+        auto statistics = watcher.get_statistics();
+        CHECK(statistics.changed == 4);
+        CHECK(statistics.polls == statistics.changed + statistics.unchanged + statistics.failed);
+    }
+
+    // ETags are kept across restarts
+    REQUIRE(std::filesystem::exists(root / "etags"));
+    {
+        auto requests = server.get_statistics().requests;
+        auto not_modified = server.get_statistics().not_modified;
+        auto watcher = aptrepo::Watcher(record, options);
+        watcher.add(noble);
+        watcher.add(jammy);
+        std::thread polling([&]()
+                            { watcher.run(); });
+        while (watcher.get_statistics().polls < 4)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        watcher.stop();
+        polling.join();
+        REQUIRE(events.size() == 4);
+        REQUIRE(server.get_statistics().requests - requests == server.get_statistics().not_modified - not_modified);
+    }
+
+    // Changes after a restart are diffed against the saved Release
+    {
+        auto watcher = aptrepo::Watcher(record, options);
+        watcher.add(noble);
+        std::thread polling([&]()
+                            { watcher.run(); });
+        server.add_distribution("noble", 30);
+        REQUIRE(wait_for(5));
+        watcher.stop();
+        polling.join();
+        CHECK(events[4].url == noble);
+        CHECK(!events[4].first);
+        CHECK(events[4].diff.added.empty());
+        CHECK(events[4].diff.changed.size() == 1);
+    }
+
+    // Without the saved Release, the ETag is not used
+    std::filesystem::remove_all(root / "etags.releases");
+    {
+        auto watcher = aptrepo::Watcher(record, options);
+        watcher.add(jammy);
+        std::thread polling([&]()
+                            { watcher.run(); });
+        REQUIRE(wait_for(6));
+        watcher.stop();
+        polling.join();
+        CHECK(events[5].url == jammy);
+        CHECK(events[5].first);
+    }
+
+    // Servers without ETags are compared by content
+    {
+        std::mutex content_mutex;
+        auto content = std::string("Origin: Test\nSuite: plain\nSHA256:\n 01 1 main/binary-amd64/Packages\n");
+        auto plain = aptrepo::internal::HttpServer([&](const aptrepo::internal::HttpRequest &)
+                                                   {
+                                                       std::lock_guard lock(content_mutex);
+                                                       aptrepo::internal::HttpResponse response;
+                                                       response.body = content;
+                                                       return response; });
+        auto watcher = aptrepo::Watcher(record, options);
+        watcher.add(plain.get_url() + "/dists/plain/InRelease");
+        std::thread polling([&]()
+                            { watcher.run(); });
+        REQUIRE(wait_for(7));
+        while (watcher.get_statistics().polls < 4)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(events.size() == 7);
+        {
+            std::lock_guard lock(content_mutex);
+            content = "Origin: Test\nSuite: plain\nSHA256:\n 02 1 main/binary-amd64/Packages\n";
+        }
+        REQUIRE(wait_for(8));
+        watcher.stop();
+        polling.join();
+        plain.stop();
+        REQUIRE(events.size() == 8);
+        CHECK(events[6].first);
+        CHECK(!events[7].first);
+        CHECK(events[7].diff.changed.size() == 1);
+    }
+
+    // Change events as NDJSON diff records to a Unix socket
+    {
+        auto socket_path = root / "events.sock";
+        aptrepo::internal::UnixBroadcaster broadcaster(socket_path);
+        auto client = aptrepo::internal::connect_unix(socket_path);
+        REQUIRE(client >= 0);
+        while (broadcaster.get_clients() == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        REQUIRE_THROWS(aptrepo::internal::UnixBroadcaster(socket_path));
+
+        // Connections of other users are closed without any records
+        if (::geteuid() == 0)
+        {
+            std::filesystem::permissions(socket_path, std::filesystem::perms::all);
+            auto child = ::fork();
+            if (child == 0)
+            {
+                if (::setuid(65534) != 0)
+                {
+                    ::_exit(2);
+                }
+                int raw = aptrepo::internal::connect_unix(socket_path);
+                if (raw < 0)
+                {
+                    ::_exit(3);
+                }
+                timeval timeout = {5, 0};
+                ::setsockopt(raw, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                char record;
+                ::_exit(::recv(raw, &record, 1, 0) == 0 ? 0 : 1);
+            }
+            int status = 0;
+            REQUIRE(::waitpid(child, &status, 0) == child);
+            REQUIRE(WIFEXITED(status));
+            REQUIRE(WEXITSTATUS(status) == 0);
+        }
+
+        aptrepo::NdjsonWriter writer([&](std::string_view data)
+                                     { broadcaster.send(data); }, 64);
+        writer.write(events[2].diff, *events[2].release);
+        writer.flush();
+
+        std::string received;
+        char buffer[256];
+        while (!received.ends_with('\n'))
+        {
+            auto count = ::read(client, buffer, sizeof(buffer));
+            REQUIRE(count > 0);
+            received.append(buffer, static_cast<std::size_t>(count));
+        }
+        CHECK_THAT(received, Catch::Matchers::StartsWith("{\"type\":\"diff\",\"release\":\"" + noble + "\",\"etag\":"));
+        CHECK_THAT(received, Catch::Matchers::EndsWith("\"added\":[],\"removed\":[],\"changed\":[\"main/binary-amd64/Packages\"]}\n"));
+
+        ::close(client);
+        broadcaster.send("dropped\n");
+        REQUIRE(broadcaster.get_clients() == 0);
+    }
+    REQUIRE(aptrepo::internal::connect_unix(root / "events.sock") < 0);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Package table", "[table][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto main = aptrepo::Packages(aptrepo::internal::Download("http://archive.ubuntu.com/ubuntu/dists/noble/main/binary-amd64/Packages", "",
+                                                               "Package: libc6\nSection: libs\nPriority: required\nInstalled-Size: 13000\nSize: 3200000\n\n"
+                                                               "Package: hello\nSection: devel\nPriority: optional\nInstalled-Size: 100\nSize: 50000\n\n"
+                                                               "Package: libtiny\nSection: libs\nPriority: required\nInstalled-Size: 10\n"));
+    auto updates = aptrepo::Packages(aptrepo::internal::Download("http://archive.ubuntu.com/ubuntu/dists/noble-updates/main/binary-amd64/Packages", "",
+                                                                  "Package: libc6\nSection: libs\nPriority: required\nInstalled-Size: 13100\nSize: 3300000\n"));
+
+    auto table = aptrepo::PackageTable();
+    table.add(main, "noble/main");
+    table.add(updates, "noble-updates/main");
+    REQUIRE(table.size() == 4);
+    CHECK_THAT(table.get("package", 3), Catch::Matchers::Equals("libc6"));
+    CHECK_THAT(table.get("Suite", 3), Catch::Matchers::Equals("noble-updates/main"));
+    REQUIRE(table.get(aptrepo::PackageTable::Numeric::Size, 2) == 0);
+    REQUIRE(table.get_values("Section") == std::vector<std::string>{"libs", "devel"});
+    REQUIRE_THROWS(table.get("Maintainer", 0));
+
+    auto required = table.equals("Section", "libs") & table.equals("Priority", "required");
+    REQUIRE(required.indexes() == std::vector<std::size_t>{0, 2, 3});
+    auto large = required & table.greater(aptrepo::PackageTable::Numeric::InstalledSize, 1000);
+    REQUIRE(large.indexes() == std::vector<std::size_t>{0, 3});
+    REQUIRE((large & table.equals("Suite", "noble/main")).count() == 1);
+    REQUIRE((~large).indexes() == std::vector<std::size_t>{1, 2});
+    REQUIRE(table.any_of("Package", {"hello", "libtiny", "unknown"}).indexes() == std::vector<std::size_t>{1, 2});
+    REQUIRE(table.less(aptrepo::PackageTable::Numeric::Size, 100000).count() == 2);
+    REQUIRE(table.equals("Section", "unknown").count() == 0);
+
+    // Word boundaries and the parallel scan of large tables
+    auto many = aptrepo::PackageTable({"Package"});
+    aptrepo::Package package;
+    package.add_field("Package", "p");
+    std::size_t expected = 0;
+    for (std::size_t i = 0; i < (1 << 20) + 3; ++i)
+    {
+        package.add_field("Installed-Size", std::to_string(i % 100));
+        many.add(package, "suite");
+        expected += i % 100 < 50 ? 1 : 0;
+    }
+    auto small = many.less(aptrepo::PackageTable::Numeric::InstalledSize, 50);
+    REQUIRE(small.size() == (1 << 20) + 3);
+    REQUIRE(small.count() == expected);
+    REQUIRE(small.test(1048500));
+    REQUIRE(!small.test(1 << 20));
+    REQUIRE(!small.test(50));
+    REQUIRE((~small).count() == small.size() - expected);
+}
+
+TEST_CASE("Compressed packages", "[compressed][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    std::string content;
+    for (int i = 0; i < 300; ++i)
+    {
+        content += std::format("Package: package-{}\nVersion: 1.{}\nMaintainer: Ubuntu Developers <ubuntu-devel-discuss@lists.ubuntu.com>\n"
+                               "Depends: libc6 (>= 2.34)\nSHA256: {}\nDescription: package number {}\n This is a long\n .\n description.\n\n",
+                               i, i % 7, sha256_hex(std::to_string(i)), i);
+    }
+    content += "Package: package-7\nVersion: 2.0\n";
+    auto packages = aptrepo::Packages(aptrepo::internal::Download("http://archive.ubuntu.com/ubuntu/dists/noble/main/binary-amd64/Packages", "", content));
+
+    auto options = aptrepo::CompressedPackages::Options();
+    options.block_size = 2048;
+    options.cache_blocks = 2;
+    auto compressed = aptrepo::CompressedPackages(packages, options);
+    REQUIRE(compressed.size() == 301);
+    for (std::size_t i = 0; i < compressed.size(); ++i)
+    {
+        REQUIRE(static_cast<std::string>(compressed.get(i)) == static_cast<std::string>(packages.get_packages()[i]));
+    }
+    CHECK_THAT(compressed.get(42).get_description(), Catch::Matchers::Equals("package number 42\nThis is a long\n.\ndescription."));
+
+    // The first stanza with a name wins
+    REQUIRE(compressed.find("package-7")->get_version() == "1.0");
+    REQUIRE(compressed.find("package-299"));
+    REQUIRE(!compressed.find("package-300"));
+    REQUIRE(!compressed.find("package"));
+
+    auto statistics = compressed.get_statistics();
+    REQUIRE((statistics.compression == "zstd" || statistics.compression == "deflate"));
+    REQUIRE(statistics.blocks > 10);
+    REQUIRE(statistics.dictionary_bytes > 0);
+    REQUIRE(statistics.compressed_bytes * 2 < statistics.uncompressed_bytes);
+    REQUIRE(statistics.cache_misses >= statistics.blocks);
+
+    // Hot blocks are served from the cache
+    compressed.get(0);
+    compressed.get(1);
+    REQUIRE(compressed.get_statistics().cache_hits > statistics.cache_hits);
+
+    // The dictionary helps small blocks
+    options.dictionary_size = 0;
+    auto plain = aptrepo::CompressedPackages(packages, options);
+    REQUIRE(plain.get_statistics().dictionary_bytes == 0);
+    REQUIRE(plain.get_statistics().compressed_bytes > statistics.compressed_bytes);
+    REQUIRE(plain.get(300).get_version() == "2.0");
+}
+
+TEST_CASE("NDJSON export", "[export][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto release_content = "Origin: Ubuntu\nSuite: noble\nDescription: Ubuntu \"Noble\" 24.04\\\n"
+                           "SHA256:\n 0ba4a1d3d7ef0a6c64bd7d3f5c4fa3c9a0dd5e4c35a7b6c8b1b7b0f7ddbe56ab 1234 main/binary-amd64/Packages.xz\n";
+    auto release = aptrepo::Release(aptrepo::internal::Download("http://archive.ubuntu.com/ubuntu/dists/noble/Release", "etag", release_content));
+    auto packages = aptrepo::Packages(aptrepo::internal::Download("http://archive.ubuntu.com/ubuntu/dists/noble/main/binary-amd64/Packages", "",
+                                                                  "Package: foo\nVersion: 1.0\nDescription: foo\n tab\tand bell\x07\n\n"
+                                                                  "Package: bar\nVersion: 2.0\nX-Custom: yes\n"));
+
+    auto path = std::filesystem::temp_directory_path() / "aptrepo-test-export.ndjson";
+    {
+        // A small buffer exercises the flushing of partial records
+        auto writer = aptrepo::NdjsonWriter(path, 16);
+        writer.write(release);
+        for (const auto &reference : release.get_references())
+        {
+            writer.write(reference, release.get_url());
+        }
+        for (const auto &package : packages.get_packages())
+        {
+            writer.write(package, packages.get_url());
+        }
+        REQUIRE(writer.get_records() == 4);
+    }
+
+    std::ifstream input(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line);)
+    {
+        lines.push_back(line);
+    }
+    REQUIRE(lines.size() == 4);
+    // Known fields are written in field table order, others follow
+    CHECK_THAT(lines[0], Catch::Matchers::Equals("{\"type\":\"release\",\"url\":\"http://archive.ubuntu.com/ubuntu/dists/noble/Release\",\"etag\":\"etag\","
+                                                 "\"fields\":{\"Origin\":\"Ubuntu\",\"Suite\":\"noble\",\"Description\":\"Ubuntu \\\"Noble\\\" 24.04\\\\\"}}"));
+    CHECK_THAT(lines[1], Catch::Matchers::Equals("{\"type\":\"reference\",\"release\":\"http://archive.ubuntu.com/ubuntu/dists/noble/Release\","
+                                                 "\"path\":\"main/binary-amd64/Packages.xz\",\"url\":\"http://archive.ubuntu.com/ubuntu/dists/noble/main/binary-amd64/Packages.xz\","
+                                                 "\"size\":1234,\"architecture\":\"amd64\",\"component\":\"main\","
+                                                 "\"hashes\":{\"SHA256\":\"0ba4a1d3d7ef0a6c64bd7d3f5c4fa3c9a0dd5e4c35a7b6c8b1b7b0f7ddbe56ab\"}}"));
+    CHECK_THAT(lines[2], Catch::Matchers::Equals("{\"type\":\"package\",\"index\":\"http://archive.ubuntu.com/ubuntu/dists/noble/main/binary-amd64/Packages\","
+                                                 "\"fields\":{\"Version\":\"1.0\",\"Description\":\"foo\\ntab\\tand bell\\u0007\",\"Package\":\"foo\"}}"));
+    CHECK_THAT(lines[3], Catch::Matchers::EndsWith("\"fields\":{\"Version\":\"2.0\",\"Package\":\"bar\",\"X-Custom\":\"yes\"}}"));
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Release store", "[store][data]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto release_url = "http://archive.ubuntu.com/ubuntu/dists/noble/InRelease";
+    auto make_release = [&](const std::string &version)
+    {
+        return aptrepo::Release(aptrepo::internal::Download(release_url, version, "Origin: Ubuntu\nSuite: noble\nVersion: " + version + "\n"));
+    };
+
+    auto store = aptrepo::ReleaseStore();
+    REQUIRE(store.snapshot()->find_release(release_url) == nullptr);
+
+    store.publish(make_release("1"));
+    auto first = store.snapshot();
+    REQUIRE(first->generation == 1);
+    CHECK_THAT(first->find_release(release_url)->get_version(), Catch::Matchers::Equals("1"));
+
+    store.publish(aptrepo::Packages(aptrepo::internal::Download("Packages", "", "Package: bash\n")));
+    store.publish(make_release("2"));
+    auto second = store.snapshot();
+    REQUIRE(second->generation == 3);
+    CHECK_THAT(second->find_release(release_url)->get_version(), Catch::Matchers::Equals("2"));
+    REQUIRE(second->find_packages("Packages")->get_packages().size() == 1);
+
+    // Old snapshots stay valid and unchanged
+    CHECK_THAT(first->find_release(release_url)->get_version(), Catch::Matchers::Equals("1"));
+    REQUIRE(first->find_packages("Packages") == nullptr);
+
+    store.remove_release(release_url);
+    REQUIRE(store.snapshot()->find_release(release_url) == nullptr);
+    REQUIRE(store.snapshot()->find_packages("Packages") != nullptr);
+
+    // Concurrent readers always see a complete Release
+    std::atomic<bool> stop = false;
+    std::atomic<int> errors = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i)
+    {
+        readers.emplace_back([&]()
+                             {
+                                 while (!stop)
+                                 {
+                                     auto release = store.snapshot()->find_release(release_url);
+                                     if (release && release->get_suite() != "noble")
+                                     {
+                                         ++errors;
+                                     }
+                                 }
+                             });
+    }
+    for (int i = 0; i < 200; ++i)
+    {
+        store.publish(make_release(std::to_string(i)));
+    }
+    stop = true;
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    REQUIRE(errors == 0);
+    CHECK_THAT(store.snapshot()->find_release(release_url)->get_version(), Catch::Matchers::Equals("199"));
+
+    // Nested reads after a publish and of many other stores keep the outer snapshot alive
+    std::vector<std::unique_ptr<aptrepo::ReleaseStore>> others;
+    for (int i = 0; i < 20; ++i)
+    {
+        others.push_back(std::make_unique<aptrepo::ReleaseStore>());
+    }
+    auto version = store.read([&](const aptrepo::StoreSnapshot &outer)
+                              {
+                                  auto before = outer.find_release(release_url);
+                                  store.publish(make_release("nested"));
+                                  auto inner = store.read([&](const aptrepo::StoreSnapshot &snapshot)
+                                                          { return snapshot.find_release(release_url)->get_version(); });
+                                  CHECK_THAT(inner, Catch::Matchers::Equals("nested"));
+                                  CHECK_THAT(store.snapshot()->find_release(release_url)->get_version(), Catch::Matchers::Equals("nested"));
+                                  for (const auto &other : others)
+                                  {
+                                      other->publish(make_release("other"));
+                                      other->read([](const aptrepo::StoreSnapshot &snapshot)
+                                                  { return snapshot.generation; });
+                                  }
+                                  CHECK(outer.find_release(release_url) == before);
+                                  return outer.find_release(release_url)->get_version(); });
+    CHECK_THAT(version, Catch::Matchers::Equals("199"));
+    CHECK_THAT(store.read([&](const aptrepo::StoreSnapshot &snapshot)
+                          { return snapshot.find_release(release_url)->get_version(); }),
+               Catch::Matchers::Equals("nested"));
+}
+
+TEST_CASE("History", "[history][loopback]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto server = aptrepo::test::RepositoryServer();
+    auto index = server.add_distribution("noble", 50);
+    auto url = server.get_url() + "/dists/noble/InRelease";
+
+    // Publishes a new version of the suite with the given index and date
+    auto publish = [&](const std::string &packages, const std::string &date)
+    {
+        server.add_file("/dists/noble/main/binary-amd64/Packages", packages);
+        server.add_file("/dists/noble/InRelease",
+                        std::format("Origin: Test\nSuite: noble\nArchitectures: amd64\nComponents: main\nDate: {}\nSHA256:\n {} {} main/binary-amd64/Packages\n",
+                                    date, aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(packages)), packages.size()));
+        return std::make_shared<const aptrepo::Release>(aptrepo::parse_release(url));
+    };
+
+    aptrepo::History history;
+    auto first = std::make_shared<const aptrepo::Release>(aptrepo::parse_release(url));
+    REQUIRE(history.add(first));
+    REQUIRE_FALSE(history.add(first));
+
+    // A new Release with an unchanged index doesn't load the index again
+    auto second = publish(index, "Fri, 26 Apr 2024 15:10:33 UTC");
+    REQUIRE(history.add(second));
+    REQUIRE(history.get_statistics().loads == 1);
+
+    // A changed stanza is stored once, all others are shared
+    auto changed = index;
+    auto pos = changed.find("Version: 1.3-1");
+    changed.replace(pos, 14, "Version: 1.3-2");
+    auto third = publish(changed, "Sat, 27 Apr 2024 15:10:33 UTC");
+    REQUIRE(history.add(third));
+
+    auto statistics = history.get_statistics();
+    REQUIRE(statistics.snapshots == 3);
+    REQUIRE(statistics.loads == 2);
+    REQUIRE(statistics.indexes == 2);
+    REQUIRE(statistics.index_references == 3);
+    REQUIRE(statistics.stanzas == 51);
+    REQUIRE(statistics.stanza_references == 100);
+
+    // Point in time views
+    auto date = first->get_date();
+    REQUIRE(history.at(url, date - std::chrono::seconds(1)) == nullptr);
+    REQUIRE(history.at(url, date)->release == first);
+    REQUIRE(history.at(url, date + std::chrono::hours(30))->release == second);
+    REQUIRE(history.latest(url)->release == third);
+    REQUIRE(history.get_dates(url).size() == 3);
+    REQUIRE(history.at("http://example.com/InRelease", date) == nullptr);
+
+    auto old_index = history.at(url, date)->find_index("main/binary-amd64/Packages");
+    auto new_index = history.latest(url)->find_index("main/binary-amd64/Packages");
+    REQUIRE(old_index == history.at(url, second->get_date())->find_index("main/binary-amd64/Packages"));
+    REQUIRE(old_index != new_index);
+    REQUIRE(new_index->packages.size() == 50);
+    REQUIRE(old_index->packages[0] == new_index->packages[0]);
+    REQUIRE(old_index->packages[3] != new_index->packages[3]);
+    CHECK_THAT(new_index->packages[3]->get_version(), Catch::Matchers::Equals("1.3-2"));
+    REQUIRE(history.latest(url)->find_index("main/binary-i386/Packages") == nullptr);
+
+    // Indexes which don't match their Release are rejected
+    server.add_file("/dists/noble/main/binary-amd64/Packages", index);
+    server.add_file("/dists/noble/InRelease",
+                    std::format("Origin: Test\nDate: Sun, 28 Apr 2024 15:10:33 UTC\nSHA256:\n {} {} main/binary-amd64/Packages\n",
+                                aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256("other")), index.size()));
+    auto invalid = std::make_shared<const aptrepo::Release>(aptrepo::parse_release(url));
+    REQUIRE_THROWS(history.add(invalid));
+    REQUIRE(history.get_statistics().snapshots == 3);
+}
+
+TEST_CASE("Query server", "[query][loopback]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    auto server = aptrepo::test::RepositoryServer();
+    auto index = server.add_distribution("noble", 10);
+    auto url = server.get_url() + "/dists/noble/InRelease";
+    auto socket = std::filesystem::temp_directory_path() / "aptrepo-test-query.sock";
+
+    auto options = aptrepo::QueryServer::Options();
+    options.socket = socket;
+    options.interval = std::chrono::milliseconds(20);
+    auto daemon = aptrepo::QueryServer(options);
+    REQUIRE(aptrepo::QueryClient::connect(socket) == nullptr);
+    daemon.start();
+    REQUIRE_THROWS(aptrepo::QueryServer(options).start());
+
+    auto client = aptrepo::QueryClient::connect(socket);
+    REQUIRE(client != nullptr);
+    REQUIRE(client->query("ping").empty());
+
+    // Connections of other users are closed without an answer
+    if (::geteuid() == 0)
+    {
+        std::filesystem::permissions(socket, std::filesystem::perms::all);
+        auto child = ::fork();
+        if (child == 0)
+        {
+            if (::setuid(65534) != 0)
+            {
+                ::_exit(2);
+            }
+            int raw = aptrepo::internal::connect_unix(socket);
+            if (raw < 0)
+            {
+                ::_exit(3);
+            }
+            timeval timeout = {5, 0};
+            ::setsockopt(raw, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            char answer;
+            ::_exit(::recv(raw, &answer, 1, 0) == 0 ? 0 : 1);
+        }
+        int status = 0;
+        REQUIRE(::waitpid(child, &status, 0) == child);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+
+    // The first query loads the Release, later ones are answered from memory
+    REQUIRE(client->query("architectures " + url) == std::vector<std::string>{"amd64"});
+    REQUIRE(client->query("field " + url + " Suite") == std::vector<std::string>{"noble"});
+    REQUIRE(client->query("field " + url + " Missing").empty());
+    auto digest = aptrepo::internal::bytes_to_hex(aptrepo::internal::sha256(index));
+    REQUIRE(client->query("digest " + url + " main/binary-amd64/Packages") == std::vector<std::string>{digest});
+    REQUIRE(client->query("references " + url) == std::vector<std::string>{std::format("main/binary-amd64/Packages {} {}", index.size(), digest)});
+    auto requests = server.get_statistics().requests;
+    REQUIRE(client->query("components " + url) == std::vector<std::string>{"main"});
+    REQUIRE(server.get_statistics().requests == requests);
+
+    // Packages are looked up in the resident index
+    auto package = client->query("package " + url + " main/binary-amd64/Packages package-3");
+    REQUIRE(std::find(package.begin(), package.end(), "Version: 1.3-1") != package.end());
+    REQUIRE(client->query("package " + url + " main/binary-amd64/Packages package-15").empty());
+
+    // Errors are answered without closing the connection
+    REQUIRE_THROWS_WITH(client->query("digest " + url + " main/binary-i386/Packages"), Catch::Contains("not listed"));
+    REQUIRE_THROWS_WITH(client->query("unknown " + url), Catch::Contains("unknown command"));
+    REQUIRE_THROWS_WITH(client->query("field " + url), Catch::Contains("usage"));
+    REQUIRE_THROWS(client->query("architectures " + server.get_url() + "/dists/missing/InRelease"));
+    REQUIRE_THROWS(client->query("line\nbreak"));
+    REQUIRE(client->query("ping").empty());
+
+    // Pipelined requests on a raw connection are answered in order
+    int raw = aptrepo::internal::connect_unix(socket);
+    REQUIRE(raw >= 0);
+    REQUIRE(aptrepo::internal::send_unix(raw, "ping\ncomponents " + url + "\nbogus\n"));
+    std::string responses;
+    while (std::count(responses.begin(), responses.end(), '\n') < 4)
+    {
+        char chunk[256];
+        auto received = ::recv(raw, chunk, sizeof(chunk), 0);
+        REQUIRE(received > 0);
+        responses.append(chunk, static_cast<std::size_t>(received));
+    }
+    ::close(raw);
+    CHECK_THAT(responses, Catch::Matchers::Equals("OK 0\nOK 1\nmain\nERR unknown command bogus\n"));
+
+    // Changed Releases are picked up in the background with their resident indexes
+    server.add_distribution("noble", 20);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (client->query("package " + url + " main/binary-amd64/Packages package-15").empty())
+    {
+        REQUIRE(std::chrono::steady_clock::now() < deadline);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(client->query("refresh " + url) == std::vector<std::string>{"unchanged"});
+    REQUIRE(server.get_statistics().not_modified > 0);
+
+    auto statistics = daemon.get_statistics();
+    CHECK(statistics.loads == 2);
+    CHECK(statistics.changed == 1);
+    CHECK(statistics.failed == 5);
+    auto stats = client->query("stats");
+    CHECK(std::find(stats.begin(), stats.end(), "releases 1") != stats.end());
+    CHECK(std::find(stats.begin(), stats.end(), "indexes 1") != stats.end());
+
+    // Without a server, queries are answered in the process
+    auto local = aptrepo::QueryServer();
+    REQUIRE(local.query("field " + url + " Codename") == std::vector<std::string>{"noble"});
+
+    daemon.stop();
+    REQUIRE_FALSE(std::filesystem::exists(socket));
+    REQUIRE_THROWS(client->query("ping"));
+
+    // Without $XDG_RUNTIME_DIR, the default socket is in a private directory
+    std::string runtime = std::getenv("XDG_RUNTIME_DIR") ? std::getenv("XDG_RUNTIME_DIR") : "";
+    ::unsetenv("XDG_RUNTIME_DIR");
+    auto default_socket = aptrepo::QueryServer::default_socket();
+    auto directory = default_socket.parent_path();
+    REQUIRE((std::filesystem::status(directory).permissions() & std::filesystem::perms::all) == std::filesystem::perms::owner_all);
+    std::filesystem::permissions(directory, std::filesystem::perms::others_all, std::filesystem::perm_options::add);
+    REQUIRE_THROWS(aptrepo::QueryServer::default_socket());
+    std::filesystem::permissions(directory, std::filesystem::perms::others_all, std::filesystem::perm_options::remove);
+    REQUIRE(aptrepo::QueryServer::default_socket() == default_socket);
+    if (!runtime.empty())
+    {
+        ::setenv("XDG_RUNTIME_DIR", runtime.c_str(), 1);
+    }
+}
+
+TEST_CASE("Caching proxy", "[proxy][api]")
+{
+    spdlog::set_level(spdlog::level::info);
+
+    // Local upstream stand-in serving files from memory
+    std::mutex mutex;
+    std::map<std::string, std::string> files;
+    std::map<std::string, int> fetches;
+    auto upstream = aptrepo::internal::HttpServer([&](const aptrepo::internal::HttpRequest &request)
+                                                  {
+                                                      aptrepo::internal::HttpResponse response;
+                                                      if (request.target.ends_with(".deb"))
+                                                      {
+                                                          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                                                      }
+                                                      std::lock_guard lock(mutex);
+                                                      fetches[request.target]++;
+                                                      auto file = files.find(request.target);
+                                                      if (file == files.end())
+                                                      {
+                                                          response.status = 404;
+                                                          return response;
+                                                      }
+                                                      auto etag = "\"" + sha256_hex(file->second).substr(0, 16) + "\"";
+                                                      response.headers["ETag"] = etag;
+                                                      if (request.get_header("If-None-Match") == etag)
+                                                      {
+                                                          response.status = 304;
+                                                          return response;
+                                                      }
+                                                      response.body = file->second;
+                                                      return response; });
+
+    auto publish = [&](const std::string &packages, const std::string &listed)
+    {
+        std::lock_guard lock(mutex);
+        files["/dists/test/main/binary-amd64/Packages"] = packages;
+        files["/dists/test/InRelease"] = std::format("Origin: Test\nSuite: test\nSHA256:\n {} {} main/binary-amd64/Packages\n", sha256_hex(listed), listed.size());
+    };
+    files["/pool/main/h/hello/hello_1.0_amd64.deb"] = std::string(256 * 1024, 'x');
+    publish("Package: hello\n", "Package: hello\n");
+
+    auto cache = std::filesystem::temp_directory_path() / "aptrepo-test-proxy";
+    std::filesystem::remove_all(cache);
+
+    auto options = aptrepo::CachingProxy::Options();
+    options.port = 0;
+    options.ttl = std::chrono::seconds(0);
+    auto proxy = aptrepo::CachingProxy(upstream.get_url(), cache, options);
+    proxy.start();
+
+    auto packages_url = proxy.get_url() + "/dists/test/main/binary-amd64/Packages";
+
+    // Index files are validated against the InRelease, which is fetched first
+    auto r = cpr::Get(cpr::Url{packages_url});
+    REQUIRE(r.status_code == 200);
+    CHECK_THAT(r.text, Catch::Matchers::Equals("Package: hello\n"));
+    REQUIRE(fetches["/dists/test/InRelease"] == 1);
+
+    // Unchanged index files are served from the cache, InRelease is revalidated
+    r = cpr::Get(cpr::Url{packages_url});
+    REQUIRE(r.status_code == 200);
+    REQUIRE(fetches["/dists/test/main/binary-amd64/Packages"] == 1);
+    REQUIRE(proxy.get_statistics().revalidated == 1);
+
+    // Concurrent requests for the same file share one upstream fetch
+    std::vector<std::thread> clients;
+    std::atomic<int> complete = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        clients.emplace_back([&]()
+                             {
+                                 auto deb = cpr::Get(cpr::Url{proxy.get_url() + "/pool/main/h/hello/hello_1.0_amd64.deb"});
+                                 if (deb.status_code == 200 && deb.text.size() == 256 * 1024)
+                                 {
+                                     ++complete;
+                                 } });
+    }
+    for (auto &client : clients)
+    {
+        client.join();
+    }
+    REQUIRE(complete == 8);
+    REQUIRE(fetches["/pool/main/h/hello/hello_1.0_amd64.deb"] == 1);
+    REQUIRE(proxy.get_statistics().coalesced + proxy.get_statistics().hits >= 7);
+
+    // A changed InRelease invalidates the cached index
+    publish("Package: hello\nVersion: 2\n", "Package: hello\nVersion: 2\n");
+    r = cpr::Get(cpr::Url{packages_url});
+    CHECK_THAT(r.text, Catch::Matchers::Equals("Package: hello\nVersion: 2\n"));
+
+    // Index files not matching the InRelease are rejected
+    publish("Package: tampered\n", "Package: hello\nVersion: 3\n");
+    r = cpr::Get(cpr::Url{packages_url});
+    REQUIRE(r.status_code == 502);
+    REQUIRE(proxy.get_statistics().rejected == 1);
+
+    REQUIRE(cpr::Get(cpr::Url{proxy.get_url() + "/dists/test/missing"}).status_code == 404);
+
+    // Paths escaping the cache directory are refused
+    aptrepo::internal::HttpRequest request;
+    request.method = "GET";
+    request.target = "/dists/../../etc/passwd";
+    REQUIRE(proxy.handle(request).status == 403);
+
+    // Request bodies are skipped, invalid or oversized lengths close the connection
+    auto exchange = [&](const std::string &raw_request)
+    {
+        int raw = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(upstream.get_port());
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(::connect(raw, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+        ::send(raw, raw_request.data(), raw_request.size(), MSG_NOSIGNAL);
+        std::string responses;
+        char chunk[4096];
+        ssize_t received;
+        while ((received = ::recv(raw, chunk, sizeof(chunk), 0)) > 0)
+        {
+            responses.append(chunk, static_cast<std::size_t>(received));
+        }
+        ::close(raw);
+        return responses;
+    };
+    auto responses = exchange("POST /dists/test/InRelease HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+                              "GET /dists/test/missing HTTP/1.1\r\nConnection: close\r\n\r\n");
+    CHECK_THAT(responses, Catch::Contains("HTTP/1.1 200") && Catch::Contains("HTTP/1.1 404"));
+    responses = exchange("POST / HTTP/1.1\r\nContent-Length: abc\r\n\r\nGET / HTTP/1.1\r\n\r\n");
+    CHECK_THAT(responses, Catch::StartsWith("HTTP/1.1 400") && !Catch::Contains("HTTP/1.1 404"));
+    responses = exchange("POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n");
+    CHECK_THAT(responses, Catch::StartsWith("HTTP/1.1 400"));
+    responses = exchange("POST / HTTP/1.1\r\nContent-Length: 1099511627776\r\n\r\n");
+    CHECK_THAT(responses, Catch::StartsWith("HTTP/1.1 413"));
+    REQUIRE(cpr::Get(cpr::Url{upstream.get_url() + "/dists/test/InRelease"}).status_code == 200);
+
+    proxy.stop();
+    upstream.stop();
+    std::filesystem::remove_all(cache);
+}
+
 TEST_CASE("parse_release", "[inrelease][api]")
 {
     spdlog::set_level(spdlog::level::info);